@@ -0,0 +1,126 @@
+#include "batch.h"
+#include "lexer.h"
+#include "parser.h"
+#include "support.h"
+#include "vm.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/* Rows per second and bytes of bound columns read plus output written per second of the batch evaluator,
+ * against binding the same columns as globals and running the stack-based VM once per row */
+
+#define ROWS 4000000
+/* The stack VM is slow enough that a slice of the columns shows its rate */
+#define INTERPRETED_ROWS 200000
+#define TRIALS 5
+
+struct Workload {
+    const char* name;
+    const char* expression;
+    /* Columns the expression reads, ints first */
+    unsigned int ints;
+    unsigned int floats;
+};
+
+static const char* const intNames[] = { "a", "b", "c" };
+static const char* const floatNames[] = { "x", "y", "z" };
+
+/* Best seconds of one run over rows */
+static double batchSeconds(ccc::BatchEvaluator& batch, std::size_t rows, std::vector<long long>& ints, std::vector<double>& floats)
+{
+    double best = 1e300;
+    for (int trial = 0; trial < TRIALS; ++trial) {
+        auto start = std::chrono::steady_clock::now();
+        bool ok = batch.resultType() == ccc::Type::FLOAT ? batch.run(rows, floats.data()) : batch.run(rows, ints.data());
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        if (!ok)
+            return 0;
+        best = std::min(best, std::chrono::duration<double>(elapsed).count());
+    }
+    return best;
+}
+
+/* Best seconds of running the stack VM once per row with the row bound through globals */
+static double interpretedSeconds(ccc::SyntaxTree& ast, const Workload& workload, const std::vector<std::vector<long long>>& intColumns,
+    const std::vector<std::vector<double>>& floatColumns)
+{
+    ccc::Globals globals;
+    std::vector<std::size_t> slots;
+    for (unsigned int i = 0; i < workload.ints; ++i)
+        slots.push_back(globals.slot(intNames[i]));
+    for (unsigned int i = 0; i < workload.floats; ++i) {
+        std::size_t slot = globals.slot(floatNames[i]);
+        globals.values()[slot].isFloat = true;
+        globals.values()[slot].floatValue = 0;
+        slots.push_back(slot);
+    }
+    ccc::StackBasedVM vm { ast, &globals };
+
+    double best = 1e300;
+    for (int trial = 0; trial < TRIALS; ++trial) {
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t row = 0; row < INTERPRETED_ROWS; ++row) {
+            ccc::VM::Value* values = globals.values();
+            for (unsigned int i = 0; i < workload.ints; ++i)
+                values[slots[i]].intValue = intColumns[i][row];
+            for (unsigned int i = 0; i < workload.floats; ++i)
+                values[slots[workload.ints + i]].floatValue = floatColumns[i][row];
+            if (!vm.run())
+                return 0;
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, std::chrono::duration<double>(elapsed).count());
+    }
+    return best;
+}
+
+int main()
+{
+    std::vector<std::vector<long long>> intColumns(3, std::vector<long long>(ROWS));
+    std::vector<std::vector<double>> floatColumns(3, std::vector<double>(ROWS));
+    for (std::size_t row = 0; row < ROWS; ++row) {
+        for (unsigned int i = 0; i < 3; ++i) {
+            intColumns[i][row] = static_cast<long long>(row % 1000) + i + 1;
+            floatColumns[i][row] = static_cast<double>(row % 997) * 0.5 + i + 1;
+        }
+    }
+    std::vector<long long> intOut(ROWS);
+    std::vector<double> floatOut(ROWS);
+
+    const Workload workloads[] = {
+        { "int add/sub", "a + b - c + 7", 3, 0 },
+        { "int mul/div", "(a * b) / c", 3, 0 },
+        { "float", "x * y + z / 2.5", 0, 3 },
+        { "mixed", "a * x + (b - 3) * y", 2, 2 },
+    };
+
+    std::printf("%-12s %14s %10s %14s %10s\n", "workload", "batch rows/s", "GB/s", "stack rows/s", "speedup");
+    for (const Workload& workload : workloads) {
+        ccc::SyntaxTree ast;
+        if (!ccc::test::parse(workload.expression, ast)) {
+            std::printf("failed to parse %s\n", workload.expression);
+            return 1;
+        }
+        ccc::BatchEvaluator batch { ast };
+        for (unsigned int i = 0; i < workload.ints; ++i)
+            batch.bind(intNames[i], intColumns[i].data());
+        for (unsigned int i = 0; i < workload.floats; ++i)
+            batch.bind(floatNames[i], floatColumns[i].data());
+        double batched = batch.compile() ? batchSeconds(batch, ROWS, intOut, floatOut) : 0;
+        double interpreted = interpretedSeconds(ast, workload, intColumns, floatColumns);
+        if (batched == 0 || interpreted == 0) {
+            std::printf("failed to run %s\n", workload.expression);
+            return 1;
+        }
+
+        double batchRate = ROWS / batched;
+        double stackRate = INTERPRETED_ROWS / interpreted;
+        // every column is 8 bytes a row, read once, and so is the output
+        double bytes = static_cast<double>(ROWS) * 8 * (workload.ints + workload.floats + 1);
+        std::printf("%-12s %14.0f %10.2f %14.0f %9.1fx\n", workload.name, batchRate, bytes / batched / 1e9, stackRate, batchRate / stackRate);
+    }
+    return 0;
+}
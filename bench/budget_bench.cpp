@@ -0,0 +1,62 @@
+#include "lexer.h"
+#include "parser.h"
+#include "support.h"
+#include "vm.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+/* ns per loop iteration of a plain run against resuming without limits and in slices of a few instructions,
+ * which is what metering the taken jumps and calls and going back to a scheduler costs */
+
+#define ITERATIONS 2000000
+#define TRIALS 5
+
+/* Best ns per iteration of one plain run or of resuming in slices of instructions until the run ends */
+static double iterationNs(ccc::StackBasedVM& vm, unsigned long long instructions, bool plain, unsigned long long& slices)
+{
+    double best = 1e300;
+    for (int trial = 0; trial < TRIALS; ++trial) {
+        slices = 0;
+        auto start = std::chrono::steady_clock::now();
+        if (plain) {
+            vm.run();
+            slices = 1;
+        } else {
+            ccc::VM::Status status = ccc::VM::Status::YIELDED;
+            for (; status == ccc::VM::Status::YIELDED; ++slices)
+                status = vm.resume(ccc::VM::Budget { instructions, 0, 0 });
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, std::chrono::duration<double, std::nano>(elapsed).count() / ITERATIONS);
+    }
+    return best;
+}
+
+int main()
+{
+    const std::string source = "int step(int x) { return x + 3; } s = 0; i = 0; while (i < " + std::to_string(ITERATIONS)
+        + ") { s = step(s) - i; i = i + 1; } s";
+    ccc::Lexer lexer;
+    ccc::SyntaxTree ast;
+    if (!ccc::test::parse(lexer, source, ast)) {
+        std::printf("failed to parse the workload\n");
+        return 1;
+    }
+    ccc::StackBasedVM vm { ast };
+
+    std::printf("%-16s %12s %12s %10s\n", "run", "ns/iter", "slices", "overhead");
+    unsigned long long slices;
+    double plain = iterationNs(vm, 0, true, slices);
+    std::printf("%-16s %12.2f %12llu\n", "run", plain, slices);
+    const struct {
+        const char* name;
+        unsigned long long instructions;
+    } budgets[] = { { "unlimited", 0 }, { "slices of 10000", 10000 }, { "slices of 1000", 1000 }, { "slices of 100", 100 } };
+    for (const auto& budget : budgets) {
+        double ns = iterationNs(vm, budget.instructions, false, slices);
+        std::printf("%-16s %12.2f %12llu %+9.1f%%\n", budget.name, ns, slices, 100 * (ns / plain - 1));
+    }
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include "bundle.h"
+#include "pipeline.h"
+#include "support.h"
+#include "vm.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+
+/* Time per source of compiling many tiny files one file at a time against the same sources packed into one mapped bundle */
+
+#define SOURCES 10000
+
+int main()
+{
+    const std::string directory = "bundle_bench_files";
+    const std::string bundlePath = "bundle_bench.bundle";
+    std::filesystem::create_directory(directory);
+    std::vector<std::string> paths;
+    ccc::BundleWriter writer;
+    for (int i = 0; i < SOURCES; ++i) {
+        std::string source = "a = " + std::to_string(i) + "; b = a * 3 + 1; (a + b) * 2;\n";
+        paths.push_back(directory + "/" + std::to_string(i) + ".c");
+        std::ofstream { paths.back() } << source;
+        writer.add(paths.back(), source);
+    }
+    if (!writer.write(bundlePath)) {
+        std::printf("failed to write the bundle\n");
+        return 1;
+    }
+
+    ccc::Pipeline pipeline { ccc::test::stackBased, 4, std::numeric_limits<std::size_t>::max() };
+    long long checksum = 0;
+    auto collect = [&checksum](std::size_t, bool, const ccc::Token& value) { checksum += value.intValue; };
+    double filesUs = 1e300;
+    double bundleUs = 1e300;
+    for (int trial = 0; trial < 3; ++trial) {
+        checksum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (const std::string& path : paths)
+            pipeline.run(path, collect);
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        filesUs = std::min(filesUs, std::chrono::duration<double, std::micro>(elapsed).count());
+        long long filesChecksum = checksum;
+
+        checksum = 0;
+        start = std::chrono::steady_clock::now();
+        ccc::Bundle bundle;
+        if (!bundle.open(bundlePath)) {
+            std::printf("failed to open the bundle\n");
+            return 1;
+        }
+        for (std::size_t i = 0; i < bundle.size(); ++i)
+            pipeline.run(bundle[i].source, bundle[i].length, collect);
+        elapsed = std::chrono::steady_clock::now() - start;
+        bundleUs = std::min(bundleUs, std::chrono::duration<double, std::micro>(elapsed).count());
+        if (checksum != filesChecksum) {
+            std::printf("the bundle evaluated differently\n");
+            return 1;
+        }
+    }
+    std::printf("%d sources\n%-8s %12s %12s\n", SOURCES, "input", "total ms", "us/source");
+    std::printf("%-8s %12.2f %12.2f\n", "files", filesUs / 1000, filesUs / SOURCES);
+    std::printf("%-8s %12.2f %12.2f %9.2fx\n", "bundle", bundleUs / 1000, bundleUs / SOURCES, filesUs / bundleUs);
+    std::filesystem::remove_all(directory);
+    std::filesystem::remove(bundlePath);
+    return 0;
+}
@@ -0,0 +1,68 @@
+#include "lexer.h"
+#include "parser.h"
+#include "support.h"
+#include "vm.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+/* Call overhead of StackBasedVM in ns per call of a recursive fib, plain and with the hot pairs fused */
+
+#define N 25
+
+/* Best of a few runs, returns ns per run */
+static double measure(ccc::StackBasedVM& vm, unsigned long long& dispatches)
+{
+    double best = 1e300;
+    for (int trial = 0; trial < 5; ++trial) {
+        unsigned long long before = vm.executedInstructions();
+        auto start = std::chrono::steady_clock::now();
+        vm.run();
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        dispatches = vm.executedInstructions() - before;
+        best = std::min(best, std::chrono::duration<double, std::nano>(elapsed).count());
+    }
+    return best;
+}
+
+int main()
+{
+    const std::string program = "int fib(int n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); } fib(" + std::to_string(N) + ")";
+    ccc::SyntaxTree ast;
+    if (!ccc::test::parse(program, ast)) {
+        std::printf("failed to parse fib\n");
+        return 1;
+    }
+    // fib(n) makes 2 * fib(n + 1) - 1 calls
+    unsigned long long calls = 1;
+    for (unsigned long long previous = 0, current = 1, i = 0; i < N; ++i) {
+        unsigned long long next = previous + current;
+        previous = current;
+        current = next;
+        calls = 2 * next - 1;
+    }
+
+    ccc::StackBasedVM plain { ast };
+    ccc::StackBasedVM fused { ast };
+    for (int round = 0; round < 2; ++round) {
+        fused.instrument(true);
+        fused.run();
+        fused.instrument(false);
+        fused.fuse(fused.pairCounts());
+    }
+    ccc::Token value { "", ccc::Terminal::ERROR };
+    if (!plain.run() || !plain.result(value)) {
+        std::printf("fib(%d) failed\n", N);
+        return 1;
+    }
+    std::printf("fib(%d) = %lld, %llu calls\n", N, value.intValue, calls);
+    std::printf("%-8s %12s %12s %10s\n", "code", "ns/call", "disp/call", "");
+    unsigned long long plainDispatches;
+    unsigned long long fusedDispatches;
+    double plainNs = measure(plain, plainDispatches);
+    double fusedNs = measure(fused, fusedDispatches);
+    std::printf("%-8s %12.2f %12.2f\n", "plain", plainNs / calls, static_cast<double>(plainDispatches) / calls);
+    std::printf("%-8s %12.2f %12.2f %9.2fx\n", "fused", fusedNs / calls, static_cast<double>(fusedDispatches) / calls, plainNs / fusedNs);
+    return 0;
+}
@@ -0,0 +1,193 @@
+#include "diagnostics.h"
+#include "lexer.h"
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+/* Lexing with spans against no span bookkeeping at all and against tracking lines in the hot loop,
+ * and the cost of the lazy newline index */
+
+static std::string generate(std::size_t size)
+{
+    std::mt19937 rng { 30 };
+    std::uniform_int_distribution<int> coin { 0, 3 };
+    std::uniform_int_distribution<int> literal { 0, 9999 };
+    const char ops[] = { '+', '-', '*', '/' };
+    std::string res = "0";
+    while (res.size() < size) {
+        res += ' ';
+        res += ops[coin(rng)];
+        res += coin(rng) == 0 ? " (" + std::to_string(literal(rng)) + ".25 * a" + std::to_string(literal(rng)) + ")" : " " + std::to_string(literal(rng));
+        if (coin(rng) == 0)
+            res += '\n';
+    }
+    return res;
+}
+
+/* Lexer::next with final input over the same automata, Spans picks whether the offset and length get stored.
+ * Only the fields that differ are written so the two variants differ in the span stores alone */
+template <bool Spans>
+static bool scan(const std::vector<std::unique_ptr<ccc::FiniteAutomaton>>& automata, const std::string& source,
+    std::size_t& pos, ccc::Token& out)
+{
+    const char* input = source.data();
+    std::size_t length = source.size();
+    while (pos < length && (input[pos] == ' ' || input[pos] == '\t' || input[pos] == '\n' || input[pos] == '\r'))
+        ++pos;
+    if (pos == length)
+        return false;
+    for (const auto& dfa : automata) {
+        std::size_t i = pos;
+        while (i < length && dfa->transition(input[i]))
+            ++i;
+        bool accepted = dfa->acceptingStates.find(dfa->currentState) != dfa->acceptingStates.end();
+        ccc::Terminal term = dfa->getTerminal();
+        dfa->currentState = 0;
+        if (accepted && std::isalpha(static_cast<unsigned char>(input[pos])) && i < length && std::isalnum(static_cast<unsigned char>(input[i])))
+            continue;
+        if (accepted) {
+            out.lexeme.assign(input + pos, i - pos);
+            out.term = term;
+            if (Spans) {
+                out.offset = static_cast<unsigned int>(pos);
+                out.length = static_cast<unsigned int>(i - pos);
+            }
+            if (term == ccc::Terminal::INT_LITERAL)
+                std::from_chars(input + pos, input + i, out.intValue);
+            else if (term == ccc::Terminal::FLOAT_LITERAL)
+                std::from_chars(input + pos, input + i, out.floatValue);
+            pos = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename Callback>
+static double measure(unsigned int runs, Callback callback)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < runs; ++i)
+        callback();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::milli>(elapsed).count() / runs;
+}
+
+int main()
+{
+    const unsigned int runs = 5;
+    std::string source = generate(8 << 20);
+    double megabytes = source.size() / double(1 << 20);
+    ccc::Lexer lexer;
+    std::size_t tokens = 0;
+    unsigned long long checksum = 0;
+
+    // what the lexer does today, spans are the scan position it already has
+    double spans = measure(runs, [&]() {
+        std::size_t pos = 0;
+        std::size_t examined;
+        ccc::Token token { "", ccc::Terminal::ERROR };
+        tokens = 0;
+        while (lexer.next(source.data(), source.size(), true, pos, token, examined) == ccc::Lexer::ScanResult::TOKEN) {
+            checksum += token.offset + token.length;
+            ++tokens;
+        }
+    });
+
+    // the same scan with and without the span stores, in the lexer's automaton order
+    std::vector<std::unique_ptr<ccc::FiniteAutomaton>> automata;
+    automata.emplace_back(new ccc::StringLiteralAutomaton {});
+    automata.emplace_back(new ccc::BuiltinTypeAutomaton {});
+    automata.emplace_back(new ccc::StorageSpecifierAutomaton {});
+    automata.emplace_back(new ccc::SemicolonAutomaton {});
+    automata.emplace_back(new ccc::CommaAutomaton {});
+    automata.emplace_back(new ccc::ScopeAutomaton {});
+    automata.emplace_back(new ccc::BracketAutomaton {});
+    automata.emplace_back(new ccc::ControlFlowAutomaton {});
+    automata.emplace_back(new ccc::ArithmeticOpAutomaton {});
+    automata.emplace_back(new ccc::LogicalOpAutomaton {});
+    automata.emplace_back(new ccc::AssignmentOpAutomaton {});
+    automata.emplace_back(new ccc::FloatLiteralAutomaton {});
+    automata.emplace_back(new ccc::IntLiteralAutomaton {});
+    automata.emplace_back(new ccc::IdAutomaton {});
+    std::size_t copied = 0;
+    double withSpans = measure(runs, [&]() {
+        std::size_t pos = 0;
+        ccc::Token token { "", ccc::Terminal::ERROR };
+        copied = 0;
+        while (scan<true>(automata, source, pos, token)) {
+            checksum += token.lexeme.size();
+            ++copied;
+        }
+    });
+    double withoutSpans = measure(runs, [&]() {
+        std::size_t pos = 0;
+        ccc::Token token { "", ccc::Terminal::ERROR };
+        while (scan<false>(automata, source, pos, token))
+            checksum += token.lexeme.size();
+    });
+
+    // the alternative of giving every token a line and column while lexing
+    double eager = measure(runs, [&]() {
+        std::size_t pos = 0;
+        std::size_t examined;
+        std::size_t counted = 0;
+        unsigned int line = 1;
+        unsigned int lineStart = 0;
+        ccc::Token token { "", ccc::Terminal::ERROR };
+        while (lexer.next(source.data(), source.size(), true, pos, token, examined) == ccc::Lexer::ScanResult::TOKEN) {
+            for (; counted < token.offset; ++counted)
+                if (source[counted] == '\n') {
+                    ++line;
+                    lineStart = static_cast<unsigned int>(counted + 1);
+                }
+            checksum += line + token.offset - lineStart;
+        }
+    });
+
+    std::vector<unsigned int> lineStarts;
+    double vectorScan = measure(runs, [&]() {
+        lineStarts.clear();
+        ccc::LineIndex::scanNewlines(source.data(), source.size(), lineStarts);
+    });
+    double scalarScan = measure(runs, [&]() {
+        lineStarts.clear();
+        for (std::size_t i = 0; i < source.size(); ++i)
+            if (source[i] == '\n')
+                lineStarts.push_back(static_cast<unsigned int>(i + 1));
+    });
+
+    ccc::LineIndex lines { source.data(), source.size() };
+    unsigned int line;
+    unsigned int column;
+    lines.locate(0, line, column);
+    const unsigned int lookups = 1000000;
+    std::mt19937 rng { 1 };
+    std::uniform_int_distribution<unsigned int> offset { 0, static_cast<unsigned int>(source.size() - 1) };
+    double lookup = measure(1, [&]() {
+        for (unsigned int i = 0; i < lookups; ++i) {
+            lines.locate(offset(rng), line, column);
+            checksum += line + column;
+        }
+    });
+
+    std::printf("%.1f MiB, %zu tokens, %zu lines\n", megabytes, tokens, lineStarts.size() + 1);
+    if (copied != tokens)
+        std::printf("the scan copy found %zu tokens\n", copied);
+    std::printf("%-28s %10.2f ms %10.1f MiB/s\n", "lex with spans", spans, megabytes / spans * 1000);
+    std::printf("%-28s %10.2f ms %10.1f MiB/s\n", "scan with spans", withSpans, megabytes / withSpans * 1000);
+    std::printf("%-28s %10.2f ms %10.1f MiB/s\n", "scan without spans", withoutSpans, megabytes / withoutSpans * 1000);
+    std::printf("%-28s %10.2f ms %10.1f %%\n", "span bookkeeping", withSpans - withoutSpans,
+        (withSpans - withoutSpans) / withoutSpans * 100);
+    std::printf("%-28s %10.2f ms %10.1f MiB/s\n", "lex tracking lines", eager, megabytes / eager * 1000);
+    std::printf("%-28s %10.2f ms %10.1f MiB/s\n", "newline index sse2", vectorScan, megabytes / vectorScan * 1000);
+    std::printf("%-28s %10.2f ms %10.1f MiB/s\n", "newline index scalar", scalarScan, megabytes / scalarScan * 1000);
+    std::printf("%-28s %10.1f ns\n", "line lookup", lookup * 1e6 / lookups);
+    std::printf("checksum %llu\n", checksum);
+    return 0;
+}
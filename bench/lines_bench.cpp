@@ -0,0 +1,58 @@
+#include "lines.h"
+#include "pipeline.h"
+#include "support.h"
+#include "vm.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <string>
+#include <thread>
+
+/* Lines per second of evaluating one expression per line as separate pipeline runs against LineRunner with growing thread counts */
+
+#define LINES 200000
+
+int main()
+{
+    std::mt19937 rng { 45 };
+    std::uniform_int_distribution<int> literal { 1, 999 };
+    std::string input;
+    for (int i = 0; i < LINES; ++i)
+        input += std::to_string(literal(rng)) + " * (" + std::to_string(literal(rng)) + " + " + std::to_string(literal(rng)) + ".5) - "
+            + std::to_string(literal(rng)) + "\n";
+    std::ofstream sink { "/dev/null" };
+
+    ccc::Pipeline pipeline { ccc::test::stackBased, 4, std::numeric_limits<std::size_t>::max() };
+    double pipelineMs = 1e300;
+    for (int trial = 0; trial < 3; ++trial) {
+        auto start = std::chrono::steady_clock::now();
+        std::size_t begin = 0;
+        while (begin < input.size()) {
+            std::size_t end = input.find('\n', begin);
+            ccc::Token last { "", ccc::Terminal::ERROR };
+            pipeline.run(input.data() + begin, end - begin, [&last](std::size_t, bool, const ccc::Token& value) { last = value; });
+            sink << last.floatValue << '\n';
+            begin = end + 1;
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        pipelineMs = std::min(pipelineMs, std::chrono::duration<double, std::milli>(elapsed).count());
+    }
+    std::printf("%d lines, %u cores\n%-14s %10s %12s %9s\n", LINES, std::thread::hardware_concurrency(), "mode", "ms", "lines/s", "speedup");
+    std::printf("%-14s %10.1f %12.0f\n", "pipeline runs", pipelineMs, LINES * 1e3 / pipelineMs);
+    for (std::size_t threads : { 1, 2, 4, 8 }) {
+        double ms = 1e300;
+        for (int trial = 0; trial < 3; ++trial) {
+            ccc::LineRunner runner { threads };
+            auto start = std::chrono::steady_clock::now();
+            runner.run(input.data(), input.size(), sink);
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            ms = std::min(ms, std::chrono::duration<double, std::milli>(elapsed).count());
+        }
+        std::string mode = "lines x" + std::to_string(threads);
+        std::printf("%-14s %10.1f %12.0f %8.2fx\n", mode.c_str(), ms, LINES * 1e3 / ms, pipelineMs / ms);
+    }
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include "loader.h"
+#include "pipeline.h"
+#include "support.h"
+#include "vm.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+#if defined(__unix__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/* Cold-cache throughput of compiling many files read one blocking read at a time against reading them ahead
+ * with the FileLoader backends. The page cache is dropped per file with fadvise before every pass, which only
+ * gives cold reads where the filesystem honours it */
+
+#define FILES 2000
+#define STATEMENTS 40
+
+static void dropCache(const std::vector<std::string>& paths)
+{
+#if defined(__unix__)
+    for (const std::string& path : paths) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            continue;
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+#endif
+}
+
+int main()
+{
+    const std::string directory = "loader_bench_files";
+    std::filesystem::create_directory(directory);
+    std::vector<std::string> paths;
+    std::size_t bytes = 0;
+    for (int i = 0; i < FILES; ++i) {
+        std::string source;
+        for (int j = 0; j < STATEMENTS; ++j)
+            source += "a" + std::to_string(j % 7) + " = " + std::to_string(i + j) + " * 3 + 1;\n";
+        paths.push_back(directory + "/" + std::to_string(i) + ".c");
+        std::ofstream { paths.back() } << source;
+        bytes += source.size();
+    }
+
+    ccc::Pipeline pipeline { ccc::test::stackBased, 4, std::numeric_limits<std::size_t>::max() };
+    const struct {
+        const char* name;
+        std::size_t inFlight;
+        ccc::FileLoader::Backend backend;
+    } modes[] = {
+        { "blocking", 0, ccc::FileLoader::Backend::AUTO },
+        { "ring", 4, ccc::FileLoader::Backend::RING },
+        { "ring", 16, ccc::FileLoader::Backend::RING },
+        { "ring", 64, ccc::FileLoader::Backend::RING },
+        { "threads", 4, ccc::FileLoader::Backend::THREADS },
+        { "threads", 16, ccc::FileLoader::Backend::THREADS },
+    };
+    std::printf("%d files, %.1f MB\n%-10s %9s %10s %10s %10s\n", FILES, bytes / 1e6, "reads", "in flight", "ms", "MB/s", "files/s");
+    for (const auto& mode : modes) {
+        double best = 1e300;
+        const char* used = mode.name;
+        for (int trial = 0; trial < 3; ++trial) {
+            dropCache(paths);
+            auto start = std::chrono::steady_clock::now();
+            if (mode.inFlight == 0) {
+                for (const std::string& path : paths)
+                    pipeline.run(path, nullptr);
+            } else {
+                ccc::FileLoader loader { paths, mode.inFlight, mode.backend };
+                used = loader.backend() == ccc::FileLoader::Backend::RING ? "ring" : "threads";
+                ccc::FileLoader::File file;
+                while (loader.next(file))
+                    pipeline.run(file.contents.data(), file.contents.size(), nullptr);
+            }
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            best = std::min(best, std::chrono::duration<double, std::milli>(elapsed).count());
+        }
+        std::printf("%-10s %9zu %10.1f %10.1f %10.0f\n", used, mode.inFlight, best, bytes / 1e3 / best, FILES * 1e3 / best);
+    }
+    std::filesystem::remove_all(directory);
+    return 0;
+}
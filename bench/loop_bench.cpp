@@ -0,0 +1,65 @@
+#include "lexer.h"
+#include "parser.h"
+#include "support.h"
+#include "vm.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+/* Time and dispatches per loop iteration of StackBasedVM code before and after fusing the
+ * compare-and-branch and store-and-pop pairs of the loop body */
+
+#define ITERATIONS 1000000
+
+/* Best of a few runs, returns ns per iteration */
+static double measure(ccc::StackBasedVM& vm, unsigned long long& dispatches)
+{
+    double best = 1e300;
+    for (int trial = 0; trial < 5; ++trial) {
+        unsigned long long before = vm.executedInstructions();
+        auto start = std::chrono::steady_clock::now();
+        vm.run();
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        dispatches = vm.executedInstructions() - before;
+        best = std::min(best, std::chrono::duration<double, std::nano>(elapsed).count() / ITERATIONS);
+    }
+    return best;
+}
+
+int main()
+{
+    const struct {
+        const char* name;
+        std::string program;
+    } loops[] = {
+        { "counter", "i = 0; while (i < " + std::to_string(ITERATIONS) + ") { i = i + 1; } i" },
+        { "sum", "s = 0; i = 0; while (i < " + std::to_string(ITERATIONS) + ") { s = s + i * 2; i = i + 1; } s" },
+        { "branchy", "s = 0; i = 0; while (i < " + std::to_string(ITERATIONS) + ") { s = s + i; if (s > 1000000) { s = s - 1000000; } i = i + 1; } s" },
+        { "nested", "n = 0; i = 0; while (i < 1000) { j = 0; while (j < 1000) { n = n + j; j = j + 1; } i = i + 1; } n" },
+    };
+
+    std::printf("%-10s %12s %12s %14s %14s %8s\n", "loop", "plain ns/it", "fused ns/it", "plain disp/it", "fused disp/it", "speedup");
+    for (const auto& loop : loops) {
+        ccc::SyntaxTree ast;
+        if (!ccc::test::parse(loop.program, ast)) {
+            std::printf("failed to parse %s\n", loop.name);
+            return 1;
+        }
+        ccc::StackBasedVM plain { ast };
+        ccc::StackBasedVM fused { ast };
+        for (int round = 0; round < 2; ++round) {
+            fused.instrument(true);
+            fused.run();
+            fused.instrument(false);
+            fused.fuse(fused.pairCounts());
+        }
+        unsigned long long plainDispatches;
+        unsigned long long fusedDispatches;
+        double plainNs = measure(plain, plainDispatches);
+        double fusedNs = measure(fused, fusedDispatches);
+        std::printf("%-10s %12.2f %12.2f %14.2f %14.2f %7.2fx\n", loop.name, plainNs, fusedNs, static_cast<double>(plainDispatches) / ITERATIONS,
+            static_cast<double>(fusedDispatches) / ITERATIONS, plainNs / fusedNs);
+    }
+    return 0;
+}
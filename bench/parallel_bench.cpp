@@ -0,0 +1,68 @@
+#include "lexer.h"
+#include "parallel.h"
+#include "parser.h"
+#include "support.h"
+#include "vm.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+/* Scaling of fork-join evaluation of a balanced float expression over thread counts, against the serial
+ * stack-based VM on the same AST */
+
+#define DEPTH 17
+
+static void balanced(unsigned int depth, unsigned int& leaf, std::string& out)
+{
+    static const char* leaves[] = { "1.5", "0.25", "2.0", "0.75" };
+    if (depth == 0) {
+        out += leaves[leaf++ % 4];
+        return;
+    }
+    out += '(';
+    balanced(depth - 1, leaf, out);
+    out += depth % 2 == 0 ? " + " : " * ";
+    balanced(depth - 1, leaf, out);
+    out += ')';
+}
+
+/* Best of a few runs in ms */
+static double measure(ccc::VM& vm)
+{
+    double best = 1e300;
+    for (int trial = 0; trial < 5; ++trial) {
+        auto start = std::chrono::steady_clock::now();
+        vm.run();
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, std::chrono::duration<double, std::milli>(elapsed).count());
+    }
+    return best;
+}
+
+int main()
+{
+    std::string program;
+    unsigned int leaf = 0;
+    balanced(DEPTH, leaf, program);
+    ccc::SyntaxTree ast;
+    if (!ccc::test::parse(program, ast)) {
+        std::printf("failed to parse the tree\n");
+        return 1;
+    }
+    ccc::StackBasedVM serial { ast };
+    double serialMs = measure(serial);
+    std::printf("%u leaves, %u cores, serial %.2f ms\n", leaf, std::thread::hardware_concurrency(), serialMs);
+    std::printf("%-8s %8s %8s %10s %8s\n", "threads", "grain", "tasks", "ms", "speedup");
+    unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+    for (std::size_t grain : { static_cast<std::size_t>(1024), ccc::ParallelVM::defaultGrain, static_cast<std::size_t>(65536) }) {
+        for (std::size_t threads = 1; threads <= std::max(8u, cores); threads *= 2) {
+            ccc::ForkJoinPool pool { threads };
+            ccc::ParallelVM parallel { ast, pool, nullptr, grain };
+            double ms = measure(parallel);
+            std::printf("%-8zu %8zu %8zu %10.2f %7.2fx\n", threads, grain, parallel.tasks(), ms, serialMs / ms);
+        }
+    }
+    return 0;
+}
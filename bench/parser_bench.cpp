@@ -0,0 +1,71 @@
+#include "lexer.h"
+#include "parser.h"
+#include "support.h"
+#include "utility.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+
+/* Throughput and peak tree bytes of LL1Parser against PrattParser building the same AST, both pulling their
+ * tokens from the same in-memory source, with lexing alone as the baseline */
+
+#define STATEMENTS 20000
+#define TRIALS 5
+
+static const ccc::test::Shape shape { false, true, nullptr, "x", ccc::test::Shape::Divisor::ANY, false };
+
+static double lexMs(ccc::Lexer& lexer, const std::string& source)
+{
+    auto start = std::chrono::steady_clock::now();
+    ccc::PullLexer tokens { lexer, source.data(), source.size() };
+    while (tokens.consume()->term != ccc::Terminal::FILE_END)
+        tokens.pop();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static double parseMs(ccc::Lexer& lexer, const std::string& source, ccc::Parser::Backend backend)
+{
+    auto start = std::chrono::steady_clock::now();
+    ccc::PullLexer tokens { lexer, source.data(), source.size() };
+    std::unique_ptr<ccc::Parser> parser = ccc::Parser::create(backend, tokens);
+    ccc::SyntaxTree ast;
+    if (!parser->parse(ast)) {
+        std::printf("failed to parse the workload: %s\n", parser->error().message.c_str());
+        return 0;
+    }
+    parser->convertToAst(ast);
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main()
+{
+    std::mt19937 rng { 47 };
+    std::string source = "int f(int a, int b) { while (a < b) { a = a + 1; } return a * b; }\n";
+    for (int i = 0; i < STATEMENTS; ++i)
+        source += i % 10 == 0 ? "x" + std::to_string(i % 10) + " = f(" + ccc::test::generate(rng, 3, shape) + ", 4);\n"
+                              : ccc::test::generate(rng, 4, shape) + ";\n";
+    ccc::Lexer lexer;
+
+    double lex = 1e300;
+    for (int trial = 0; trial < TRIALS; ++trial)
+        lex = std::min(lex, lexMs(lexer, source));
+    std::printf("%d statements, %zu bytes\n%-8s %10s %10s %10s %12s\n", STATEMENTS, source.size(), "parser", "ms", "parse ms", "MB/s",
+        "tree bytes");
+    std::printf("%-8s %10.2f\n", "lex", lex);
+    const struct {
+        const char* name;
+        ccc::Parser::Backend backend;
+    } backends[] = { { "ll1", ccc::Parser::Backend::LL1 }, { "pratt", ccc::Parser::Backend::PRATT } };
+    for (const auto& backend : backends) {
+        double ms = 1e300;
+        ccc::MemoryStats::reset();
+        for (int trial = 0; trial < TRIALS; ++trial)
+            ms = std::min(ms, parseMs(lexer, source, backend.backend));
+        std::printf("%-8s %10.2f %10.2f %10.1f %12zu\n", backend.name, ms, ms - lex, source.size() / ms / 1e3,
+            ccc::MemoryStats::peak(ccc::MemoryStats::Subsystem::PARSE_TREE));
+    }
+    return 0;
+}
@@ -0,0 +1,78 @@
+#include "lexer.h"
+#include "parser.h"
+#include "pipeline.h"
+#include "support.h"
+#include "utility.h"
+#include "vm.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+
+/* Time to the first result, total time and peak parse tree bytes of compiling a statement list
+ * as a whole before evaluating it against the statement pipeline */
+
+using Clock = std::chrono::steady_clock;
+
+static const ccc::test::Shape shape { false, true, nullptr, nullptr, ccc::test::Shape::Divisor::FLOAT, false };
+
+static double milliseconds(Clock::time_point start, Clock::time_point end)
+{
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main()
+{
+    const std::string file = "pipeline_bench_input.txt";
+    const unsigned int statements = 2000;
+    {
+        std::mt19937 rng { 35 };
+        std::ofstream out { file };
+        for (unsigned int i = 0; i < statements; ++i)
+            out << ccc::test::generate(rng, 6, shape) << ";\n";
+    }
+
+    // what main did before, the result exists once everything is compiled
+    ccc::MemoryStats::reset();
+    Clock::time_point start = Clock::now();
+    double wholeFirst;
+    {
+        ccc::SharedBuffer buffer;
+        ccc::Lexer lexer;
+        std::thread lexerThread { &ccc::Lexer::run, &lexer, file, std::ref(buffer) };
+        ccc::LL1Parser parser { buffer };
+        ccc::SyntaxTree ast;
+        if (!parser.parse(ast)) {
+            std::printf("failed to parse the workload\n");
+            lexerThread.join();
+            return 1;
+        }
+        lexerThread.join();
+        parser.convertToAst(ast);
+        ccc::StackBasedVM vm { ast };
+        vm.run();
+        wholeFirst = milliseconds(start, Clock::now());
+    }
+    double wholeTotal = milliseconds(start, Clock::now());
+    std::size_t wholePeak = ccc::MemoryStats::peak(ccc::MemoryStats::Subsystem::PARSE_TREE);
+
+    ccc::MemoryStats::reset();
+    ccc::Pipeline pipeline { ccc::test::stackBased };
+    double pipelineFirst = 0;
+    start = Clock::now();
+    pipeline.run(file, [&](std::size_t statement, bool, const ccc::Token&) {
+        if (statement == 0)
+            pipelineFirst = milliseconds(start, Clock::now());
+    });
+    double pipelineTotal = milliseconds(start, Clock::now());
+    std::size_t pipelinePeak = ccc::MemoryStats::peak(ccc::MemoryStats::Subsystem::PARSE_TREE);
+
+    std::printf("%u statements\n", statements);
+    std::printf("%-12s %14s %10s %16s\n", "", "first result", "total", "peak tree bytes");
+    std::printf("%-12s %11.2f ms %7.2f ms %16zu\n", "whole file", wholeFirst, wholeTotal, wholePeak);
+    std::printf("%-12s %11.2f ms %7.2f ms %16zu\n", "pipeline", pipelineFirst, pipelineTotal, pipelinePeak);
+    return 0;
+}
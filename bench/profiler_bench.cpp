@@ -0,0 +1,87 @@
+#include "lexer.h"
+#include "parser.h"
+#include "profiler.h"
+#include "vm.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+
+/* Cost of running StackBasedVM with the profiler attached at several sample intervals */
+
+static std::string generate(std::mt19937& rng, unsigned int operands)
+{
+    const char ops[] = { '+', '-', '*', '/' };
+    std::uniform_int_distribution<int> literal { 1, 99 };
+    std::string res = "(" + std::to_string(literal(rng));
+    for (unsigned int i = 1; i < operands; ++i) {
+        char op = ops[std::uniform_int_distribution<int> { 0, 3 }(rng)];
+        res += op;
+        res += op == '/' ? std::to_string(literal(rng)) + ".5" : std::to_string(literal(rng));
+        if (i % 8 == 0)
+            res += ")\n+(" + std::to_string(literal(rng));
+    }
+    return res + ")";
+}
+
+static double measure(ccc::StackBasedVM& vm, unsigned int runs)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < runs; ++i)
+        vm.run();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / runs;
+}
+
+/* Alternates plain and profiled trials so drift hits both, keeps the best of each in ns per run */
+static void compare(ccc::StackBasedVM& vm, ccc::Profiler& profiler, unsigned int runs, double& plain, double& profiled)
+{
+    plain = 1e300;
+    profiled = 1e300;
+    for (int trial = 0; trial < 15; ++trial) {
+        vm.profile(nullptr);
+        plain = std::min(plain, measure(vm, runs));
+        vm.profile(&profiler);
+        profiled = std::min(profiled, measure(vm, runs));
+    }
+    vm.profile(nullptr);
+}
+
+int main()
+{
+    std::mt19937 rng { 33 };
+    const std::string source = generate(rng, 400);
+    const std::string file = "profiler_bench_input.txt";
+    std::ofstream { file } << source;
+    ccc::SharedBuffer buffer;
+    ccc::Lexer lexer;
+    lexer.run(file, buffer);
+    ccc::LL1Parser parser { buffer };
+    ccc::SyntaxTree ast;
+    if (!parser.parse(ast)) {
+        std::printf("failed to parse\n");
+        return 1;
+    }
+    parser.convertToAst(ast);
+
+    const unsigned int runs = 2000;
+    ccc::StackBasedVM vm { ast };
+    std::printf("%zu instructions\n", vm.codeSize());
+    std::printf("%-10s %12s %12s %10s\n", "interval", "plain ns", "profiled ns", "overhead");
+    for (unsigned int interval : { 1u, 16u, 64u, 256u, 1024u, 1u << 30 }) {
+        ccc::Profiler profiler { source, ast, interval };
+        double plain = 0;
+        double profiled = 0;
+        compare(vm, profiler, runs, plain, profiled);
+        std::printf("%-10u %12.0f %12.0f %9.1f%%\n", interval, plain, profiled, 100.0 * (profiled - plain) / plain);
+        if (interval == 64) {
+            std::ostringstream report;
+            profiler.writeReport(report, 5);
+            std::printf("%s", report.str().c_str());
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include "lexer.h"
+#include "parser.h"
+#include "support.h"
+#include "vm.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* Runs per second of one small program lowered once and run through a StackContext per thread, against
+ * lowering a StackBasedVM for every run, for growing thread counts */
+
+#define RUNS 200000
+
+/* Millions of runs per second with the runs split over threads, each thread runs one of them */
+template <typename Body>
+static double measure(unsigned int threads, const Body& body)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < threads; ++i)
+        workers.emplace_back([&] { body(RUNS / threads); });
+    for (std::thread& worker : workers)
+        worker.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return RUNS / seconds / 1e6;
+}
+
+int main()
+{
+    const std::string source = "float lerp(float a, float b, float t) { return a + (b - a) * t; } s = 0; i = 0;\n"
+                               "while (i < 8) { s = s + lerp(i, 10, 0.25); i = i + 1; } s";
+    ccc::Lexer lexer;
+    ccc::SyntaxTree ast;
+    if (!ccc::test::parse(lexer, source, ast)) {
+        std::printf("failed to parse the workload\n");
+        return 1;
+    }
+    std::shared_ptr<const ccc::CompiledProgram> program = ccc::StackBasedVM { ast }.program();
+
+    std::printf("%-8s %16s %16s %8s\n", "threads", "VM per run M/s", "context M/s", "speedup");
+    unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int threads = 1; threads <= std::min(cores, 8u); threads *= 2) {
+        double perRun = 0;
+        double shared = 0;
+        for (int trial = 0; trial < 3; ++trial) {
+            // every thread has its own lexer and AST as a VM per run needs one it may lower
+            perRun = std::max(perRun, measure(threads, [&](int runs) {
+                ccc::Lexer ownLexer;
+                ccc::SyntaxTree own;
+                ccc::test::parse(ownLexer, source, own);
+                for (int run = 0; run < runs; ++run) {
+                    ccc::StackBasedVM vm { own };
+                    vm.run();
+                }
+            }));
+            shared = std::max(shared, measure(threads, [&](int runs) {
+                ccc::StackContext context { program };
+                for (int run = 0; run < runs; ++run)
+                    context.run();
+            }));
+        }
+        std::printf("%-8u %16.3f %16.3f %7.2fx\n", threads, perRun, shared, shared / perRun);
+    }
+    return 0;
+}
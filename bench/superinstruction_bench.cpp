@@ -0,0 +1,140 @@
+#include "lexer.h"
+#include "parser.h"
+#include "support.h"
+#include "vm.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+/* Profiles opcode pairs over a workload, fuses them and compares dispatches and time against plain StackBasedVM code */
+
+static std::string literal(std::mt19937& rng, bool divisor)
+{
+    std::uniform_int_distribution<int> value { 1, 99 };
+    if (divisor || std::uniform_int_distribution<int> { 0, 3 }(rng) == 0)
+        return std::to_string(value(rng)) + ".5";
+    return std::to_string(value(rng));
+}
+
+/* Unbracketed sums of products, the E'S and TF chains of the grammar */
+static std::string chain(std::mt19937& rng)
+{
+    const char ops[] = { '+', '-', '*', '/' };
+    std::string res = literal(rng, false);
+    for (int i = std::uniform_int_distribution<int> { 4, 24 }(rng); i > 0; --i) {
+        char op = ops[std::uniform_int_distribution<int> { 0, 3 }(rng)];
+        res += op;
+        res += literal(rng, op == '/');
+    }
+    return res;
+}
+
+static std::string tree(std::mt19937& rng, unsigned int depth)
+{
+    if (depth == 0)
+        return literal(rng, false);
+    const char ops[] = { '+', '-', '*', '/' };
+    char op = ops[std::uniform_int_distribution<int> { 0, 3 }(rng)];
+    return "(" + tree(rng, depth - 1) + op + (op == '/' ? literal(rng, true) : tree(rng, depth - 1)) + ")";
+}
+
+static const char* name(ccc::StackBasedVM::Opcode op)
+{
+    const char* names[] = { "push", "arith", "pop", "load", "store", "load_local", "store_local", "enter", "jump", "branch", "call", "return", "arith_imm", "push_push", "push_arith_imm", "arith_arith", "branch_imm", "store_pop" };
+    return names[static_cast<int>(op)];
+}
+
+/* Returns ns per pass over the workload */
+static double measure(std::vector<std::unique_ptr<ccc::StackBasedVM>>& vms, unsigned int runs)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < runs; ++i)
+        for (auto& vm : vms)
+            vm->run();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / runs;
+}
+
+static unsigned long long dispatches(std::vector<std::unique_ptr<ccc::StackBasedVM>>& vms)
+{
+    unsigned long long res = 0;
+    for (auto& vm : vms) {
+        unsigned long long before = vm->executedInstructions();
+        vm->run();
+        res += vm->executedInstructions() - before;
+    }
+    return res;
+}
+
+static bool benchmark(const char* workload, const std::vector<std::string>& expressions)
+{
+    std::vector<std::unique_ptr<ccc::SyntaxTree>> asts;
+    std::vector<std::unique_ptr<ccc::StackBasedVM>> plain;
+    std::vector<std::unique_ptr<ccc::StackBasedVM>> fused;
+    for (const std::string& expression : expressions) {
+        asts.emplace_back(new ccc::SyntaxTree);
+        if (!ccc::test::parse(expression, *asts.back()))
+            return false;
+        plain.emplace_back(new ccc::StackBasedVM { *asts.back() });
+        fused.emplace_back(new ccc::StackBasedVM { *asts.back() });
+    }
+
+    // the second round sees pairs of superinstructions made by the first
+    ccc::StackBasedVM::PairCounts first;
+    for (int round = 0; round < 2; ++round) {
+        ccc::StackBasedVM::PairCounts profile;
+        for (auto& vm : fused) {
+            vm->instrument(true);
+            vm->run();
+            vm->instrument(false);
+            for (const auto& pair : vm->pairCounts())
+                profile[pair.first] += pair.second;
+        }
+        for (auto& vm : fused)
+            vm->fuse(profile);
+        if (round == 0)
+            first = profile;
+    }
+
+    std::vector<std::pair<unsigned long long, std::pair<ccc::StackBasedVM::Opcode, ccc::StackBasedVM::Opcode>>> top;
+    unsigned long long total = 0;
+    for (const auto& pair : first) {
+        top.push_back({ pair.second, pair.first });
+        total += pair.second;
+    }
+    std::sort(top.begin(), top.end(), [](const auto& lhs, const auto& rhs) { return lhs.first > rhs.first; });
+    std::printf("%s: %zu expressions, opcode pairs of the plain code\n", workload, expressions.size());
+    for (std::size_t i = 0; i < top.size() && i < 4; ++i)
+        std::printf("  %-10s %-10s %5.1f%%\n", name(top[i].second.first), name(top[i].second.second), 100.0 * top[i].first / total);
+
+    unsigned long long plainDispatches = dispatches(plain);
+    unsigned long long fusedDispatches = dispatches(fused);
+    const unsigned int runs = 2000;
+    double plainNs = measure(plain, runs);
+    double fusedNs = measure(fused, runs);
+    std::printf("  %-12s %12s %12s %10s\n", "", "dispatches", "ns/pass", "");
+    std::printf("  %-12s %12llu %12.0f\n", "plain", plainDispatches, plainNs);
+    std::printf("  %-12s %12llu %12.0f %9.2fx\n", "fused", fusedDispatches, fusedNs, plainNs / fusedNs);
+    std::printf("  dispatch reduction %.1f%%\n\n", 100.0 * (plainDispatches - fusedDispatches) / plainDispatches);
+    return true;
+}
+
+int main()
+{
+    std::mt19937 rng { 32 };
+    std::vector<std::string> chains;
+    std::vector<std::string> trees;
+    for (unsigned int i = 0; i < 200; ++i) {
+        chains.push_back(chain(rng));
+        trees.push_back(tree(rng, 2 + i % 5));
+    }
+    if (!benchmark("chains", chains) || !benchmark("trees", trees)) {
+        std::printf("failed to parse the workload\n");
+        return 1;
+    }
+    return 0;
+}
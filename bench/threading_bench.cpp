@@ -0,0 +1,60 @@
+#include "pipeline.h"
+#include "support.h"
+#include "vm.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <string>
+#include <thread>
+
+/* Single-threaded against threaded pipeline runs over growing files, the crossover is where
+ * Pipeline::defaultThreadedFrom should be */
+
+static const ccc::test::Shape shape { false, true, nullptr, nullptr, ccc::test::Shape::Divisor::FLOAT, false };
+
+/* Returns us per run */
+static double measure(ccc::Pipeline& pipeline, const std::string& file, unsigned int runs)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < runs; ++i)
+        pipeline.run(file, nullptr);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::micro>(elapsed).count() / runs;
+}
+
+int main()
+{
+    const std::string file = "threading_bench_input.txt";
+    ccc::Pipeline single { ccc::test::stackBased, 4, std::numeric_limits<std::size_t>::max() };
+    ccc::Pipeline threaded { ccc::test::stackBased, 4, 0 };
+    std::mt19937 rng { 36 };
+    std::string source;
+    std::size_t crossover = 0;
+
+    std::printf("%u hardware threads\n", std::thread::hardware_concurrency());
+    std::printf("%10s %10s %14s %14s %8s\n", "bytes", "statements", "single us", "threaded us", "ratio");
+    for (unsigned int statements = 1; statements <= 4096; statements *= 4) {
+        while (std::count(source.begin(), source.end(), ';') < statements)
+            source += ccc::test::generate(rng, 3, shape) + ";\n";
+        std::ofstream { file } << source;
+        unsigned int runs = std::max(2u, 4000u / statements);
+        // alternating trials and the best of each damp the noise of a shared machine
+        double singleUs = 1e300;
+        double threadedUs = 1e300;
+        for (int trial = 0; trial < 3; ++trial) {
+            singleUs = std::min(singleUs, measure(single, file, runs));
+            threadedUs = std::min(threadedUs, measure(threaded, file, runs));
+        }
+        std::printf("%10zu %10u %14.1f %14.1f %7.2fx\n", source.size(), statements, singleUs, threadedUs, singleUs / threadedUs);
+        if (crossover == 0 && threadedUs < singleUs)
+            crossover = source.size();
+    }
+    if (crossover == 0)
+        std::printf("threads never paid off on this machine\n");
+    else
+        std::printf("crossover at about %zu bytes\n", crossover);
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include "pipeline.h"
+#include "support.h"
+#include "utility.h"
+#include "vm.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+/* Cost of a trace scope with the tracer off and on, and of tracing a threaded pipeline run */
+
+#define SCOPES 10000000
+#define STATEMENTS 50000
+
+static double scopeNs()
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < SCOPES; ++i) {
+        ccc::Tracer::Scope scope { "scope" };
+        asm volatile("" ::: "memory");
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / SCOPES;
+}
+
+int main()
+{
+    const std::string file = "trace_bench_input.txt";
+    {
+        std::ofstream out { file };
+        for (int i = 0; i < STATEMENTS; ++i)
+            out << "x" << i % 10 << " = " << i << " * 3 + (" << i << " - 1) / 2;\n";
+    }
+
+    double off = scopeNs();
+    ccc::Tracer::start();
+    double on = scopeNs();
+    ccc::Tracer::stop();
+    std::printf("%-22s %10s\n%-22s %10.2f\n%-22s %10.2f\n", "scope", "ns", "tracer off", off, "tracer on", on);
+
+    ccc::Pipeline pipeline { ccc::test::stackBased, 4, 0 };
+    double runMs[2] = { 1e300, 1e300 };
+    std::size_t bytes = 0;
+    for (int trial = 0; trial < 5; ++trial) {
+        for (int traced = 0; traced < 2; ++traced) {
+            if (traced)
+                ccc::Tracer::start();
+            auto start = std::chrono::steady_clock::now();
+            pipeline.run(file, nullptr);
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            ccc::Tracer::stop();
+            runMs[traced] = std::min(runMs[traced], std::chrono::duration<double, std::milli>(elapsed).count());
+        }
+        std::ostringstream trace;
+        ccc::Tracer::write(trace);
+        bytes = trace.str().size();
+    }
+    std::printf("\n%d statements %-8s %10s\n%-22s %10.2f\n%-22s %10.2f %+9.1f%%\n%-22s %10zu\n", STATEMENTS, "threaded", "ms", "tracer off",
+        runMs[0], "tracer on", runMs[1], 100 * (runMs[1] / runMs[0] - 1), "trace bytes", bytes);
+    std::remove(file.c_str());
+    return 0;
+}
@@ -0,0 +1,65 @@
+#include "lexer.h"
+#include "parser.h"
+#include "support.h"
+#include "vm.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+/* Time per iteration of StackBasedVM code lowered untyped, where every operation checks the types of its operands,
+ * against typed code of int and float operations, plain and fused */
+
+#define ITERATIONS 1000000
+
+/* Best of a few runs in ns per iteration, fused after profiling twice when asked */
+static double measure(ccc::SyntaxTree& ast, bool typed, bool fused)
+{
+    ccc::StackBasedVM vm { ast, nullptr, typed };
+    for (int round = 0; fused && round < 2; ++round) {
+        vm.instrument(true);
+        vm.run();
+        vm.instrument(false);
+        vm.fuse(vm.pairCounts());
+    }
+    double best = 1e300;
+    for (int trial = 0; trial < 5; ++trial) {
+        auto start = std::chrono::steady_clock::now();
+        vm.run();
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, std::chrono::duration<double, std::nano>(elapsed).count() / ITERATIONS);
+    }
+    return best;
+}
+
+int main()
+{
+    const std::string iterations = std::to_string(ITERATIONS);
+    const struct {
+        const char* name;
+        std::string program;
+    } workloads[] = {
+        { "int", "s = 0; i = 0; while (i < " + iterations + ") { s = s + i * 2 - i / 3; i = i + 1; } s" },
+        { "float", "x = 0.5; i = 0; while (i < " + iterations + ") { x = x * 0.999 + 1.5; i = i + 1; } x" },
+        // the int counter is converted every iteration
+        { "mixed", "x = 0.5; i = 0; while (i < " + iterations + ") { x = x + i * 0.25; i = i + 1; } x" },
+        { "function", "float lerp(float a, float b, float t) { return a + (b - a) * t; }\n"
+                      "x = 0.0; i = 0; while (i < " + iterations + ") { x = lerp(x, 10.0, 0.5); i = i + 1; } x" },
+    };
+
+    ccc::Lexer lexer;
+    std::printf("%-10s %14s %14s %14s %14s %8s\n", "workload", "untyped ns/it", "typed ns/it", "untyped fused", "typed fused", "speedup");
+    for (const auto& workload : workloads) {
+        ccc::SyntaxTree ast;
+        if (!ccc::test::parse(lexer, workload.program, ast)) {
+            std::printf("failed to parse %s\n", workload.name);
+            return 1;
+        }
+        double untyped = measure(ast, false, false);
+        double typed = measure(ast, true, false);
+        double untypedFused = measure(ast, false, true);
+        double typedFused = measure(ast, true, true);
+        std::printf("%-10s %14.2f %14.2f %14.2f %14.2f %7.2fx\n", workload.name, untyped, typed, untypedFused, typedFused, untyped / typed);
+    }
+    return 0;
+}
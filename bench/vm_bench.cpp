@@ -0,0 +1,62 @@
+#include "lexer.h"
+#include "parser.h"
+#include "support.h"
+#include "vm.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+
+/* Runs StackBasedVM and RegisterVM on the same generated expressions */
+
+static const ccc::test::Shape shape { false, true, ".5", nullptr, ccc::test::Shape::Divisor::DIGIT, false };
+
+/* Returns ns per run */
+static double measure(ccc::VM& vm, unsigned int runs)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < runs; ++i)
+        vm.run();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / runs;
+}
+
+int main()
+{
+    std::mt19937 rng { 42 };
+    std::printf("%-6s %14s %14s %12s %12s %8s\n", "depth", "stack instr", "reg instr", "stack ns", "reg ns", "speedup");
+
+    for (unsigned int depth = 1; depth <= 8; ++depth) {
+        ccc::SyntaxTree ast;
+        std::string expression = ccc::test::generate(rng, depth, shape);
+        if (!ccc::test::parse(expression, ast)) {
+            std::printf("failed to parse depth %u\n", depth);
+            return 1;
+        }
+
+        ccc::StackBasedVM stackVm { ast };
+        ccc::RegisterVM registerVm { ast };
+        if (!stackVm.run() || !registerVm.run()) {
+            std::printf("failed to run depth %u\n", depth);
+            return 1;
+        }
+        ccc::Token stackResult { "", ccc::Terminal::ERROR };
+        ccc::Token registerResult { "", ccc::Terminal::ERROR };
+        stackVm.result(stackResult);
+        registerVm.result(registerResult);
+        if (!(stackResult == registerResult)) {
+            std::printf("results differ at depth %u\n", depth);
+            return 1;
+        }
+
+        unsigned long long stackInstructions = stackVm.executedInstructions();
+        unsigned long long registerInstructions = registerVm.executedInstructions();
+        unsigned int runs = 2000000 / (stackInstructions + 1) + 10;
+        double stackNs = measure(stackVm, runs);
+        double registerNs = measure(registerVm, runs);
+
+        std::printf("%-6u %14llu %14llu %12.1f %12.1f %7.1fx\n", depth, stackInstructions,
+            registerInstructions, stackNs, registerNs, stackNs / registerNs);
+    }
+    return 0;
+}
@@ -0,0 +1,400 @@
+#include "batch.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <type_traits>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Rows per vector, sized so a handful of registers stay in L1 */
+#define BATCH_VECTOR_SIZE 1024
+#define OUTPUT_REGISTER UINT_MAX
+
+namespace {
+
+#ifdef __SSE2__
+inline __m128d loadVector(const double* data)
+{
+    return _mm_loadu_pd(data);
+}
+
+inline __m128i loadVector(const long long* data)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+}
+
+inline void storeVector(double* data, __m128d value)
+{
+    _mm_storeu_pd(data, value);
+}
+
+inline void storeVector(long long* data, __m128i value)
+{
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(data), value);
+}
+
+inline __m128d broadcast(double value)
+{
+    return _mm_set1_pd(value);
+}
+
+inline __m128i broadcast(long long value)
+{
+    return _mm_set1_epi64x(value);
+}
+#endif
+
+template <typename T>
+struct VectorOperand {
+    const T* data;
+
+    T at(std::size_t i) const { return data[i]; }
+#ifdef __SSE2__
+    auto load(std::size_t i) const { return loadVector(data + i); }
+#endif
+};
+
+template <typename T>
+struct ScalarOperand {
+    T value;
+
+    T at(std::size_t) const { return value; }
+#ifdef __SSE2__
+    auto load(std::size_t) const { return broadcast(value); }
+#endif
+};
+
+/* Integer rows are computed unsigned, so the scalar rows wrap around like the vector lanes where signed overflow is undefined */
+inline unsigned long long bits(long long value)
+{
+    return static_cast<unsigned long long>(value);
+}
+
+/* SSE2 has packed 64-bit integer add and sub but no packed multiply or divide */
+struct Add {
+    template <typename T>
+    static constexpr bool vectorized() { return true; }
+    static double apply(double lhs, double rhs) { return lhs + rhs; }
+    static long long apply(long long lhs, long long rhs) { return static_cast<long long>(bits(lhs) + bits(rhs)); }
+#ifdef __SSE2__
+    static __m128d apply(__m128d lhs, __m128d rhs) { return _mm_add_pd(lhs, rhs); }
+    static __m128i apply(__m128i lhs, __m128i rhs) { return _mm_add_epi64(lhs, rhs); }
+#endif
+};
+
+struct Sub {
+    template <typename T>
+    static constexpr bool vectorized() { return true; }
+    static double apply(double lhs, double rhs) { return lhs - rhs; }
+    static long long apply(long long lhs, long long rhs) { return static_cast<long long>(bits(lhs) - bits(rhs)); }
+#ifdef __SSE2__
+    static __m128d apply(__m128d lhs, __m128d rhs) { return _mm_sub_pd(lhs, rhs); }
+    static __m128i apply(__m128i lhs, __m128i rhs) { return _mm_sub_epi64(lhs, rhs); }
+#endif
+};
+
+struct Mul {
+    template <typename T>
+    static constexpr bool vectorized() { return std::is_same<T, double>::value; }
+    static double apply(double lhs, double rhs) { return lhs * rhs; }
+    static long long apply(long long lhs, long long rhs) { return static_cast<long long>(bits(lhs) * bits(rhs)); }
+#ifdef __SSE2__
+    static __m128d apply(__m128d lhs, __m128d rhs) { return _mm_mul_pd(lhs, rhs); }
+#endif
+};
+
+struct Div {
+    template <typename T>
+    static constexpr bool vectorized() { return std::is_same<T, double>::value; }
+    template <typename T>
+    static T apply(T lhs, T rhs) { return lhs / rhs; }
+#ifdef __SSE2__
+    static __m128d apply(__m128d lhs, __m128d rhs) { return _mm_div_pd(lhs, rhs); }
+#endif
+};
+
+template <typename Op, typename T, typename Lhs, typename Rhs>
+void kernel(T* dst, Lhs lhs, Rhs rhs, std::size_t count)
+{
+    std::size_t i = 0;
+#ifdef __SSE2__
+    if constexpr (Op::template vectorized<T>())
+        for (; i + 2 <= count; i += 2)
+            storeVector(dst + i, Op::apply(lhs.load(i), rhs.load(i)));
+#endif
+    for (; i < count; ++i)
+        dst[i] = Op::apply(lhs.at(i), rhs.at(i));
+}
+
+/* A null operand pointer selects the immediate value instead */
+template <typename Op, typename T>
+void binaryKernel(T* dst, const T* lhs, T lhsImmediate, const T* rhs, T rhsImmediate, std::size_t count)
+{
+    if (lhs == nullptr)
+        kernel<Op>(dst, ScalarOperand<T> { lhsImmediate }, VectorOperand<T> { rhs }, count);
+    else if (rhs == nullptr)
+        kernel<Op>(dst, VectorOperand<T> { lhs }, ScalarOperand<T> { rhsImmediate }, count);
+    else
+        kernel<Op>(dst, VectorOperand<T> { lhs }, VectorOperand<T> { rhs }, count);
+}
+
+/* Same rule as VM::divisible for every row, a null operand pointer selects the immediate value instead */
+bool divisible(const long long* lhs, long long lhsImmediate, const long long* rhs, long long rhsImmediate, std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        long long divisor = rhs == nullptr ? rhsImmediate : rhs[i];
+        if (divisor == 0 || (divisor == -1 && (lhs == nullptr ? lhsImmediate : lhs[i]) == LLONG_MIN))
+            return false;
+    }
+    return true;
+}
+
+template <typename T>
+bool binaryKernel(ccc::Terminal op, T* dst, const T* lhs, T lhsImmediate, const T* rhs, T rhsImmediate, std::size_t count)
+{
+    switch (op) {
+    case ccc::Terminal::ARITHMETIC_OP_PLUS:
+        binaryKernel<Add>(dst, lhs, lhsImmediate, rhs, rhsImmediate, count);
+        return true;
+    case ccc::Terminal::ARITHMETIC_OP_MINUS:
+        binaryKernel<Sub>(dst, lhs, lhsImmediate, rhs, rhsImmediate, count);
+        return true;
+    case ccc::Terminal::ARITHMETIC_OP_MULT:
+        binaryKernel<Mul>(dst, lhs, lhsImmediate, rhs, rhsImmediate, count);
+        return true;
+    case ccc::Terminal::ARITHMETIC_OP_DIV:
+        if constexpr (std::is_integral<T>::value) {
+            if (!divisible(lhs, lhsImmediate, rhs, rhsImmediate, count))
+                return false;
+        }
+        binaryKernel<Div>(dst, lhs, lhsImmediate, rhs, rhsImmediate, count);
+        return true;
+    default:
+        return false;
+    }
+}
+
+template <typename T>
+bool fold(ccc::Terminal op, T lhs, T rhs, T& out)
+{
+    return binaryKernel(op, &out, static_cast<const T*>(nullptr), lhs, &rhs, T {}, 1);
+}
+
+}
+
+ccc::BatchEvaluator::BatchEvaluator(SyntaxTree& ast)
+    : ast { ast }
+    , result {}
+    , numRegisters { 0 }
+    , compiled { false }
+{
+}
+
+bool ccc::BatchEvaluator::bind(const std::string& id, const long long* column)
+{
+    if (column == nullptr)
+        return false;
+    bindings[id] = Binding { Type::INT, column };
+    compiled = false;
+    return true;
+}
+
+bool ccc::BatchEvaluator::bind(const std::string& id, const double* column)
+{
+    if (column == nullptr)
+        return false;
+    bindings[id] = Binding { Type::FLOAT, column };
+    compiled = false;
+    return true;
+}
+
+bool ccc::BatchEvaluator::compile()
+{
+    program.clear();
+    numRegisters = 0;
+    compiled = false;
+    if (!compileNode(ast.root, 0, result))
+        return false;
+
+    // write the last result straight into the output column
+    if (result.kind == OperandKind::REGISTER && !program.empty() && program.back().dst == result.reg)
+        program.back().dst = OUTPUT_REGISTER;
+    else
+        program.push_back({ Opcode::MOVE, Terminal::ERROR, result.type, OUTPUT_REGISTER, result, result });
+
+    intRegisters.assign(numRegisters * BATCH_VECTOR_SIZE, 0);
+    floatRegisters.assign(numRegisters * BATCH_VECTOR_SIZE, 0.0);
+    compiled = true;
+    return true;
+}
+
+ccc::Type ccc::BatchEvaluator::resultType() const
+{
+    return result.type;
+}
+
+bool ccc::BatchEvaluator::run(std::size_t rows, long long* out)
+{
+    if (!compiled || result.type != Type::INT || out == nullptr)
+        return false;
+    return execute(rows, out);
+}
+
+bool ccc::BatchEvaluator::run(std::size_t rows, double* out)
+{
+    if (!compiled || result.type != Type::FLOAT || out == nullptr)
+        return false;
+    return execute(rows, out);
+}
+
+bool ccc::BatchEvaluator::compileNode(SyntaxTree::SyntaxTreeNode* node, unsigned int depth, Operand& out)
+{
+    if (node == nullptr)
+        return false;
+    numRegisters = std::max(numRegisters, depth + 1);
+    out = Operand {};
+
+    switch (node->val.term) {
+    case Terminal::INT_LITERAL:
+        out.kind = OperandKind::IMMEDIATE;
+        out.type = Type::INT;
+        out.intImmediate = node->val.intValue;
+        return true;
+    case Terminal::FLOAT_LITERAL:
+        out.kind = OperandKind::IMMEDIATE;
+        out.type = Type::FLOAT;
+        out.floatImmediate = node->val.floatValue;
+        return true;
+    case Terminal::ID: {
+        auto binding = bindings.find(node->val.lexeme);
+        if (binding == bindings.end())
+            return false;
+        out.kind = OperandKind::COLUMN;
+        out.type = binding->second.type;
+        out.column = binding->second.column;
+        return true;
+    }
+    case Terminal::ARITHMETIC_OP_PLUS:
+    case Terminal::ARITHMETIC_OP_MINUS:
+    case Terminal::ARITHMETIC_OP_MULT:
+    case Terminal::ARITHMETIC_OP_DIV:
+        break;
+    default:
+        return false;
+    }
+
+    Operand lhs;
+    Operand rhs;
+    if (node->children == nullptr || !compileNode(node->children, depth, lhs) || !compileNode(node->children->next, depth + 1, rhs))
+        return false;
+
+    // same promotion rule as VM::calc
+    Type type = lhs.type == Type::FLOAT || rhs.type == Type::FLOAT ? Type::FLOAT : Type::INT;
+    if (type == Type::FLOAT) {
+        lhs = toFloat(lhs, depth);
+        rhs = toFloat(rhs, depth + 1);
+    }
+
+    if (lhs.kind == OperandKind::IMMEDIATE && rhs.kind == OperandKind::IMMEDIATE) {
+        out.kind = OperandKind::IMMEDIATE;
+        out.type = type;
+        if (type == Type::FLOAT)
+            return fold(node->val.term, lhs.floatImmediate, rhs.floatImmediate, out.floatImmediate);
+        return fold(node->val.term, lhs.intImmediate, rhs.intImmediate, out.intImmediate);
+    }
+
+    program.push_back({ Opcode::ARITHMETIC, node->val.term, type, depth, lhs, rhs });
+    out.kind = OperandKind::REGISTER;
+    out.type = type;
+    out.reg = depth;
+    return true;
+}
+
+ccc::BatchEvaluator::Operand ccc::BatchEvaluator::toFloat(const Operand& operand, unsigned int reg)
+{
+    if (operand.type == Type::FLOAT)
+        return operand;
+    Operand res = operand;
+    res.type = Type::FLOAT;
+    if (operand.kind == OperandKind::IMMEDIATE) {
+        res.floatImmediate = static_cast<double>(operand.intImmediate);
+        return res;
+    }
+    program.push_back({ Opcode::INT_TO_FLOAT, Terminal::ERROR, Type::FLOAT, reg, operand, operand });
+    res.kind = OperandKind::REGISTER;
+    res.reg = reg;
+    return res;
+}
+
+bool ccc::BatchEvaluator::execute(std::size_t rows, void* out)
+{
+    for (std::size_t row = 0; row < rows; row += BATCH_VECTOR_SIZE) {
+        std::size_t count = std::min<std::size_t>(BATCH_VECTOR_SIZE, rows - row);
+        for (const Instruction& instruction : program)
+            if (!executeInstruction(instruction, row, count, out))
+                return false;
+    }
+    return true;
+}
+
+template <typename T>
+const T* ccc::BatchEvaluator::resolve(const Operand& operand, std::size_t row)
+{
+    switch (operand.kind) {
+    case OperandKind::COLUMN:
+        return static_cast<const T*>(operand.column) + row;
+    case OperandKind::REGISTER:
+        if (operand.type == Type::FLOAT)
+            return reinterpret_cast<const T*>(floatRegisters.data() + operand.reg * BATCH_VECTOR_SIZE);
+        return reinterpret_cast<const T*>(intRegisters.data() + operand.reg * BATCH_VECTOR_SIZE);
+    default:
+        return nullptr;
+    }
+}
+
+bool ccc::BatchEvaluator::executeInstruction(const Instruction& instruction, std::size_t row, std::size_t count, void* out)
+{
+    if (instruction.type == Type::FLOAT) {
+        double* dst = instruction.dst == OUTPUT_REGISTER
+            ? static_cast<double*>(out) + row
+            : floatRegisters.data() + instruction.dst * BATCH_VECTOR_SIZE;
+        const double* lhs = resolve<double>(instruction.lhs, row);
+        switch (instruction.op) {
+        case Opcode::ARITHMETIC:
+            return binaryKernel(instruction.arithmeticOp, dst, lhs, instruction.lhs.floatImmediate,
+                resolve<double>(instruction.rhs, row), instruction.rhs.floatImmediate, count);
+        case Opcode::INT_TO_FLOAT: {
+            const long long* src = resolve<long long>(instruction.lhs, row);
+            for (std::size_t i = 0; i < count; ++i)
+                dst[i] = static_cast<double>(src[i]);
+            return true;
+        }
+        case Opcode::MOVE:
+            if (lhs == nullptr)
+                std::fill(dst, dst + count, instruction.lhs.floatImmediate);
+            else
+                std::memcpy(dst, lhs, count * sizeof(double));
+            return true;
+        }
+        return false;
+    }
+
+    long long* dst = instruction.dst == OUTPUT_REGISTER
+        ? static_cast<long long*>(out) + row
+        : intRegisters.data() + instruction.dst * BATCH_VECTOR_SIZE;
+    const long long* lhs = resolve<long long>(instruction.lhs, row);
+    switch (instruction.op) {
+    case Opcode::ARITHMETIC:
+        return binaryKernel(instruction.arithmeticOp, dst, lhs, instruction.lhs.intImmediate,
+            resolve<long long>(instruction.rhs, row), instruction.rhs.intImmediate, count);
+    case Opcode::MOVE:
+        if (lhs == nullptr)
+            std::fill(dst, dst + count, instruction.lhs.intImmediate);
+        else
+            std::memcpy(dst, lhs, count * sizeof(long long));
+        return true;
+    default:
+        return false;
+    }
+}
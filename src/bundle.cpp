@@ -0,0 +1,164 @@
+#include "bundle.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#if defined(__unix__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define BUNDLE_MMAP
+#endif
+
+#define MAGIC "CCCB"
+#define VERSION 1
+/* Magic, version and entry count */
+#define HEADER_SIZE 16
+/* Name offset and length, source offset and length */
+#define ENTRY_SIZE 32
+
+static unsigned long long get(const char* data, std::size_t bytes)
+{
+    unsigned long long res = 0;
+    for (std::size_t i = bytes; i-- > 0;)
+        res = res << 8 | static_cast<unsigned char>(data[i]);
+    return res;
+}
+
+static void put(std::string& out, unsigned long long value, std::size_t bytes)
+{
+    for (std::size_t i = 0; i < bytes; ++i, value >>= 8)
+        out.push_back(static_cast<char>(value & 0xFF));
+}
+
+/* Whether [offset, offset + length) lies in a file of size bytes, without overflowing */
+static bool inside(unsigned long long offset, unsigned long long length, std::size_t size)
+{
+    return offset <= size && length <= size - offset;
+}
+
+ccc::Bundle::Bundle()
+    : data { nullptr }
+    , dataSize { 0 }
+{
+}
+
+ccc::Bundle::~Bundle()
+{
+    close();
+}
+
+bool ccc::Bundle::open(const std::string& path)
+{
+    close();
+#ifdef BUNDLE_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < HEADER_SIZE) {
+        ::close(fd);
+        return false;
+    }
+    void* mapping = mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps the file, so the descriptor is not needed past here
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+        return false;
+    // entries are lexed front to back, one after the other
+    madvise(mapping, static_cast<std::size_t>(info.st_size), MADV_SEQUENTIAL);
+    data = static_cast<const char*>(mapping);
+    dataSize = static_cast<std::size_t>(info.st_size);
+#else
+    std::ifstream file { path, std::ios::binary };
+    if (!file.is_open())
+        return false;
+    owned.assign(std::istreambuf_iterator<char> { file }, std::istreambuf_iterator<char> {});
+    data = owned.data();
+    dataSize = owned.size();
+#endif
+    if (dataSize < HEADER_SIZE || std::memcmp(data, MAGIC, 4) != 0 || get(data + 4, 4) != VERSION) {
+        close();
+        return false;
+    }
+    unsigned long long count = get(data + 8, 8);
+    if (count > (dataSize - HEADER_SIZE) / ENTRY_SIZE) {
+        close();
+        return false;
+    }
+    entries.reserve(count);
+    for (unsigned long long i = 0; i < count; ++i) {
+        const char* entry = data + HEADER_SIZE + i * ENTRY_SIZE;
+        unsigned long long nameOffset = get(entry, 8);
+        unsigned long long nameLength = get(entry + 8, 8);
+        unsigned long long sourceOffset = get(entry + 16, 8);
+        unsigned long long sourceLength = get(entry + 24, 8);
+        if (!inside(nameOffset, nameLength, dataSize) || !inside(sourceOffset, sourceLength, dataSize)) {
+            close();
+            return false;
+        }
+        entries.push_back({ std::string { data + nameOffset, nameLength }, data + sourceOffset, sourceLength });
+    }
+    return true;
+}
+
+std::size_t ccc::Bundle::size() const
+{
+    return entries.size();
+}
+
+const ccc::Bundle::Entry& ccc::Bundle::operator[](std::size_t index) const
+{
+    return entries[index];
+}
+
+void ccc::Bundle::close()
+{
+#ifdef BUNDLE_MMAP
+    if (data != nullptr)
+        munmap(const_cast<char*>(data), dataSize);
+#endif
+    data = nullptr;
+    dataSize = 0;
+    owned.clear();
+    entries.clear();
+}
+
+void ccc::BundleWriter::add(const std::string& name, const std::string& source)
+{
+    entries.emplace_back(name, source);
+}
+
+bool ccc::BundleWriter::addFile(const std::string& path)
+{
+    std::ifstream file { path, std::ios::binary };
+    if (!file.is_open())
+        return false;
+    add(path, std::string { std::istreambuf_iterator<char> { file }, std::istreambuf_iterator<char> {} });
+    return !file.bad();
+}
+
+bool ccc::BundleWriter::write(const std::string& path) const
+{
+    std::string header { MAGIC };
+    put(header, VERSION, 4);
+    put(header, entries.size(), 8);
+    // every name is followed by its source
+    unsigned long long offset = HEADER_SIZE + ENTRY_SIZE * entries.size();
+    for (const auto& entry : entries) {
+        put(header, offset, 8);
+        put(header, entry.first.size(), 8);
+        put(header, offset + entry.first.size(), 8);
+        put(header, entry.second.size(), 8);
+        offset += entry.first.size() + entry.second.size();
+    }
+    std::ofstream file { path, std::ios::binary | std::ios::trunc };
+    if (!file.is_open())
+        return false;
+    file.write(header.data(), header.size());
+    for (const auto& entry : entries) {
+        file.write(entry.first.data(), entry.first.size());
+        file.write(entry.second.data(), entry.second.size());
+    }
+    return static_cast<bool>(file.flush());
+}
@@ -0,0 +1,34 @@
+#include "bundle.h"
+#include <cstring>
+#include <iostream>
+
+/* ccc_bundle OUTPUT INPUT... packs the inputs into a bundle in the given order, ccc_bundle --list BUNDLE prints its entries */
+int main(int argc, char** argv)
+{
+    if (argc == 3 && std::strcmp(argv[1], "--list") == 0) {
+        ccc::Bundle bundle;
+        if (!bundle.open(argv[2])) {
+            std::cerr << argv[2] << ": error: not a bundle\n";
+            return 1;
+        }
+        for (std::size_t i = 0; i < bundle.size(); ++i)
+            std::cout << bundle[i].name << ' ' << bundle[i].length << '\n';
+        return 0;
+    }
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0] << " OUTPUT INPUT...\n       " << argv[0] << " --list BUNDLE\n";
+        return 1;
+    }
+    ccc::BundleWriter writer;
+    for (int i = 2; i < argc; ++i) {
+        if (!writer.addFile(argv[i])) {
+            std::cerr << argv[i] << ": error: cannot open file\n";
+            return 1;
+        }
+    }
+    if (!writer.write(argv[1])) {
+        std::cerr << argv[1] << ": error: cannot write bundle\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,80 @@
+#include "diagnostics.h"
+#include <algorithm>
+#include <utility>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+ccc::Diagnostic::Diagnostic()
+    : offset { 0 }
+    , length { 0 }
+{
+}
+
+ccc::Diagnostic::Diagnostic(std::string message, unsigned int offset, unsigned int length)
+    : message { std::move(message) }
+    , offset { offset }
+    , length { length }
+{
+}
+
+ccc::LineIndex::LineIndex(const char* source, std::size_t size)
+    : source { source }
+    , size { size }
+{
+}
+
+void ccc::LineIndex::scanNewlines(const char* data, std::size_t size, std::vector<unsigned int>& out)
+{
+    std::size_t i = 0;
+#ifdef __SSE2__
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; i + 16 <= size; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline)));
+        while (mask != 0) {
+            out.push_back(static_cast<unsigned int>(i + __builtin_ctz(mask) + 1));
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i < size; ++i)
+        if (data[i] == '\n')
+            out.push_back(static_cast<unsigned int>(i + 1));
+}
+
+void ccc::LineIndex::locate(unsigned int offset, unsigned int& line, unsigned int& column)
+{
+    if (lineStarts.empty()) {
+        lineStarts.push_back(0);
+        scanNewlines(source, size, lineStarts);
+    }
+    auto start = std::upper_bound(lineStarts.begin(), lineStarts.end(), offset) - 1;
+    line = static_cast<unsigned int>(start - lineStarts.begin()) + 1;
+    column = offset - *start + 1;
+}
+
+std::string ccc::LineIndex::format(const std::string& file, const Diagnostic& diagnostic)
+{
+    unsigned int offset = static_cast<unsigned int>(std::min<std::size_t>(diagnostic.offset, size));
+    unsigned int line;
+    unsigned int column;
+    locate(offset, line, column);
+
+    std::string res = file + ":" + std::to_string(line) + ":" + std::to_string(column) + ": error: " + diagnostic.message + "\n";
+    std::size_t lineStart = offset - (column - 1);
+    std::size_t lineEnd = lineStart;
+    while (lineEnd < size && source[lineEnd] != '\n' && source[lineEnd] != '\r')
+        ++lineEnd;
+    res.append(source + lineStart, lineEnd - lineStart);
+    res += "\n";
+    // tabs stay tabs so the marker lines up in the terminal
+    for (std::size_t i = lineStart; i < offset; ++i)
+        res += source[i] == '\t' ? '\t' : ' ';
+    res += "^";
+    std::size_t spanEnd = std::min<std::size_t>(offset + diagnostic.length, lineEnd);
+    if (spanEnd > offset + 1)
+        res.append(spanEnd - offset - 1, '~');
+    res += "\n";
+    return res;
+}
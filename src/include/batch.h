@@ -0,0 +1,78 @@
+#pragma once
+#include "parser.h"
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ccc {
+
+/* Evaluates one expression over columns of identifier bindings, a vector of rows at a time */
+class BatchEvaluator {
+public:
+    BatchEvaluator(SyntaxTree& ast);
+
+    /* Columns are not copied and must outlive every run */
+    bool bind(const std::string& id, const long long* column);
+    bool bind(const std::string& id, const double* column);
+    /* Lowers the AST against the bound columns, must be called after binding */
+    bool compile();
+    /* Type::INT or Type::FLOAT, valid after compile */
+    Type resultType() const;
+    bool run(std::size_t rows, long long* out);
+    bool run(std::size_t rows, double* out);
+
+private:
+    enum class OperandKind {
+        COLUMN,
+        REGISTER,
+        IMMEDIATE
+    };
+
+    struct Operand {
+        OperandKind kind;
+        Type type;
+        const void* column;
+        unsigned int reg;
+        long long intImmediate;
+        double floatImmediate;
+    };
+
+    enum class Opcode {
+        ARITHMETIC,
+        INT_TO_FLOAT,
+        MOVE
+    };
+
+    struct Instruction {
+        Opcode op;
+        Terminal arithmeticOp;
+        Type type;
+        unsigned int dst;
+        Operand lhs;
+        Operand rhs;
+    };
+
+    struct Binding {
+        Type type;
+        const void* column;
+    };
+
+    bool compileNode(SyntaxTree::SyntaxTreeNode* node, unsigned int depth, Operand& out);
+    Operand toFloat(const Operand& operand, unsigned int reg);
+    bool execute(std::size_t rows, void* out);
+    bool executeInstruction(const Instruction& instruction, std::size_t row, std::size_t count, void* out);
+    template <typename T>
+    const T* resolve(const Operand& operand, std::size_t row);
+
+    SyntaxTree& ast;
+    std::unordered_map<std::string, Binding> bindings;
+    std::vector<Instruction> program;
+    Operand result;
+    unsigned int numRegisters;
+    bool compiled;
+    std::vector<long long> intRegisters;
+    std::vector<double> floatRegisters;
+};
+
+}
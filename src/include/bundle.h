@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ccc {
+
+/* Many sources in one file, so a batch of them costs one open and one mapping instead of one of each per source.
+ * All integers are 64-bit little-endian:
+ *   "CCCB", version 1 as 32 bits, entry count
+ *   per entry: name offset, name length, source offset, source length, offsets from the start of the file
+ *   the names and sources */
+class Bundle {
+public:
+    struct Entry {
+        std::string name;
+        const char* source;
+        std::size_t length;
+    };
+
+    Bundle();
+    ~Bundle();
+    Bundle(const Bundle&) = delete;
+    Bundle& operator=(const Bundle&) = delete;
+
+    /* Maps the file at path, false when it cannot be read or is not a well-formed bundle */
+    bool open(const std::string& path);
+    std::size_t size() const;
+    /* Sources stay valid as long as the bundle is open */
+    const Entry& operator[](std::size_t index) const;
+
+private:
+    void close();
+
+    const char* data;
+    std::size_t dataSize;
+    /* The contents read whole where there is no mmap */
+    std::vector<char> owned;
+    std::vector<Entry> entries;
+};
+
+class BundleWriter {
+public:
+    void add(const std::string& name, const std::string& source);
+    /* Adds the file at path under its path, false when it cannot be read */
+    bool addFile(const std::string& path);
+    bool write(const std::string& path) const;
+
+private:
+    std::vector<std::pair<std::string, std::string>> entries;
+};
+
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace ccc {
+
+/* An error at a span of the source, only turned into a line and column when printed */
+struct Diagnostic {
+    Diagnostic();
+    Diagnostic(std::string message, unsigned int offset, unsigned int length);
+
+    std::string message;
+    unsigned int offset;
+    unsigned int length;
+};
+
+/* Maps source offsets to 1-based lines and columns, the source has to outlive it */
+class LineIndex {
+public:
+    LineIndex(const char* source, std::size_t size);
+
+    void locate(unsigned int offset, unsigned int& line, unsigned int& column);
+    /* "file:line:column: error: message" followed by the source line with the span marked */
+    std::string format(const std::string& file, const Diagnostic& diagnostic);
+
+    /* Appends the offset after every '\n' in data */
+    static void scanNewlines(const char* data, std::size_t size, std::vector<unsigned int>& out);
+
+private:
+    const char* source;
+    std::size_t size;
+    /* Built on the first lookup, a clean compile never pays for it */
+    std::vector<unsigned int> lineStarts;
+};
+
+}
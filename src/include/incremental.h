@@ -0,0 +1,89 @@
+#pragma once
+#include "lexer.h"
+#include "parser.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace ccc {
+
+/* Keeps the tokens and AST of one source and patches them after each edit.
+ * Lexing restarts at the first token whose automata looked at the edited characters and stops
+ * as soon as a token starts where an old one did. Parsing redoes the smallest unit whose
+ * surrounding tokens did not change: a single id, literal or operator, then each enclosing
+ * ( E ), then the whole file.
+ * Spans past the edit are not rewritten: the tokens after the last edit hold their offsets less
+ * a pending delta, and between edits the tree holds each span relative to the one before it, so
+ * an edit only moves the spans of the nodes around it. tokens and ast make them absolute again. */
+class IncrementalCompiler {
+public:
+    IncrementalCompiler();
+
+    bool load(const std::string& source);
+    /* Replaces removed characters at offset with inserted, false when the result does not compile */
+    bool edit(std::size_t offset, std::size_t removed, const std::string& inserted);
+
+    const std::string& source() const;
+    const std::vector<Token>& tokens();
+    /* Only meaningful after the last load or edit returned true */
+    SyntaxTree& ast();
+    /* Work done by the last load or edit */
+    std::size_t relexedTokens() const;
+    std::size_t reparsedTokens() const;
+    /* Token offsets and tree spans rewritten */
+    std::size_t shiftedSpans() const;
+
+private:
+    /* How span ends move, the replaced token maps to the new one when a single token changed */
+    struct Shift {
+        unsigned int start;
+        unsigned int oldEnd;
+        long long delta;
+        unsigned int replacedStart;
+        unsigned int replacedEnd;
+        unsigned int newStart;
+        unsigned int newEnd;
+    };
+
+    bool rebuild();
+    bool reparseAll();
+    bool parse(std::size_t first, std::size_t last, SyntaxTree::SyntaxTreeNode*& out);
+    bool enclosingBrackets(std::size_t& open, std::size_t& close) const;
+    /* Offsets of the token at index, whatever side of the gap it is on */
+    unsigned int tokenOffset(std::size_t index) const;
+    unsigned int examinedEnd(std::size_t index) const;
+    void setExaminedEnd(std::size_t index, unsigned int end);
+    /* Tokens from index on hold their offsets less gapDelta, the ones before it hold them as they are.
+     * Returns how many tokens it rewrote */
+    std::size_t moveGap(std::size_t index);
+
+    /* The tree walks take the nodes of one list and the absolute offset their first node is relative to */
+    SyntaxTree::SyntaxTreeNode** find(SyntaxTree::SyntaxTreeNode** link, unsigned int base, unsigned int start, unsigned int end,
+        unsigned int& at);
+    /* parent gets the node holding the token, it is left alone for a token of a top-level node */
+    SyntaxTree::SyntaxTreeNode** findToken(SyntaxTree::SyntaxTreeNode** link, unsigned int base, unsigned int offset,
+        SyntaxTree::SyntaxTreeNode*& parent);
+    /* Moves the spans of the nodes around the edit, base is where the list was relative to before and after it */
+    void shiftSpans(SyntaxTree::SyntaxTreeNode* node, unsigned int oldBase, unsigned int newBase, const Shift& shift);
+    /* Returns how many nodes it converted */
+    static std::size_t toRelative(SyntaxTree::SyntaxTreeNode* node, unsigned int base);
+    static void toAbsolute(SyntaxTree::SyntaxTreeNode* node, unsigned int base);
+
+    Lexer lexer;
+    std::string text;
+    std::vector<Token> tokenStream;
+    /* Running maximum of how far each token's scan looked, so the first damaged token is a binary search away */
+    std::vector<unsigned int> examinedEnds;
+    std::size_t gapIndex;
+    long long gapDelta;
+    SyntaxTree tree;
+    /* The spans of the tree are as the parser made them rather than relative */
+    bool absolute;
+    bool lexed;
+    bool parsed;
+    std::size_t relexed;
+    std::size_t reparsed;
+    std::size_t shifted;
+};
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "vm.h"
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+namespace ccc {
+
+/* Compiles the arithmetic AST to x86-64 machine code, falls back to StackBasedVM on anything else */
+class JitVM : public VM {
+public:
+    /* globals is handed to the interpreter, compiled code has no variables */
+    JitVM(SyntaxTree& ast, Globals* globals = nullptr);
+    ~JitVM();
+    JitVM(const JitVM&) = delete;
+    JitVM& operator=(const JitVM&) = delete;
+
+    bool run() override;
+    /* Native code runs to the end at once, the interpreter yields and resumes as it does on its own */
+    Status resume(const Budget& budget) override;
+    bool result(Token& out) const override;
+    /* False when the interpreter is used instead of native code */
+    bool isCompiled() const;
+
+private:
+    /* A value of the evaluation stack, held in a register or spilled to its frame slot */
+    struct StackValue {
+        bool isFloat;
+        int reg;
+    };
+
+    bool compile(SyntaxTree::SyntaxTreeNode* node);
+    bool gen(SyntaxTree::SyntaxTreeNode* node);
+    unsigned int need(SyntaxTree::SyntaxTreeNode* node);
+    int allocate(bool isFloat);
+    void release(const StackValue& value);
+    void spill(std::size_t index);
+    void load(std::size_t index);
+    void toFloat(std::size_t index);
+    bool map();
+
+    void emit(unsigned char byte);
+    void emit32(unsigned int value);
+    void emit64(unsigned long long value);
+    void emitRex(bool wide, int reg, int rm);
+    void emitIntOp(unsigned char opcode, int reg, int rm);
+    void emitSseOp(unsigned char prefix, unsigned char opcode, int reg, int rm, bool wide);
+    void emitStackSlot(unsigned char prefix, unsigned char opcode, int reg, std::size_t index, bool isFloat);
+    /* jcc rel32 to the failure exit, patched once the exit is emitted */
+    void emitFailJump(unsigned char condition);
+    void emitEpilogue(unsigned int frameSize);
+
+    StackBasedVM interpreter;
+    bool compiled;
+    bool resultIsFloat;
+    Token lastResult;
+
+    std::vector<unsigned char> code;
+    /* Offsets of the rel32 of each jump to the failure exit */
+    std::vector<std::size_t> failJumps;
+    /* Integer divisions of the compiled code, in the order their checks report them */
+    std::vector<const SyntaxTree::SyntaxTreeNode*> divisions;
+    std::vector<StackValue> values;
+    std::unordered_map<SyntaxTree::SyntaxTreeNode*, unsigned int> needs;
+    bool intFree[16];
+    bool floatFree[16];
+    std::size_t frameSlots;
+    void* executable;
+    std::size_t executableSize;
+};
+
+}
@@ -53,6 +53,13 @@ public:
     Terminal getTerminal() const override;
 };
 
+class StorageSpecifierAutomaton : public FiniteAutomaton {
+public:
+    StorageSpecifierAutomaton();
+
+    Terminal getTerminal() const override;
+};
+
 class ControlFlowAutomaton : public FiniteAutomaton {
 public:
     ControlFlowAutomaton();
@@ -88,6 +95,13 @@ public:
     Terminal getTerminal() const override;
 };
 
+class CommaAutomaton : public FiniteAutomaton {
+public:
+    CommaAutomaton();
+
+    Terminal getTerminal() const override;
+};
+
 class IntLiteralAutomaton : public FiniteAutomaton {
 public:
     IntLiteralAutomaton();
@@ -111,9 +125,59 @@ public:
 
 class Lexer {
 public:
+    enum class ScanResult {
+        TOKEN,
+        END,
+        MORE_INPUT,
+        ERROR
+    };
+
     Lexer();
+    ~Lexer();
+    Lexer(const Lexer&) = delete;
+    Lexer& operator=(const Lexer&) = delete;
+
     /* Only ASCII for now */
     bool run(const std::string& filePath, SharedBuffer& buffer);
+    /* Scans the token at or after pos in input, final tells whether more input follows length.
+     * examined is the last character any automaton looked at, token offsets are relative to input.
+     * On ERROR out is the offending character or out of range literal */
+    ScanResult next(const char* input, std::size_t length, bool final, std::size_t& pos, Token& out, std::size_t& examined);
+
+private:
+    /* Fills the value of literal tokens, false when it does not fit */
+    static bool decode(const char* first, const char* last, Token& token);
+
+    std::vector<FiniteAutomaton*> automata;
+};
+
+/* Lexes a whole file on demand on the thread that parses it, there is nothing to synchronize */
+class PullLexer : public TokenSource {
+public:
+    PullLexer(Lexer& lexer, const std::string& filePath);
+    /* Lexes length bytes at source in place, they have to outlive the lexer */
+    PullLexer(Lexer& lexer, const char* source, std::size_t length);
+    ~PullLexer();
+
+    /* Starts over on length bytes at source, so one parser can read many small sources */
+    void reset(const char* source, std::size_t length);
+
+    Token* consume() override;
+    void pop() override;
+    void close() override;
+
+private:
+    Lexer& lexer;
+    /* The contents of a file read whole, empty for a source lexed in place */
+    std::vector<char> owned;
+    const char* input;
+    std::size_t length;
+    std::size_t pos;
+    Token current;
+    /* current is the next unread token */
+    bool scanned;
+    /* After an ERROR or FILE_END token every consume returns it again */
+    bool done;
 };
 
 }
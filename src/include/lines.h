@@ -0,0 +1,55 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace ccc {
+
+/* Evaluates every line of an input as a compilation unit of its own. The lines are split with the SIMD newline scan
+ * and handed out in chunks to workers that each keep their own lexer and parser, the output of a chunk is written
+ * in one piece once the chunks before it are. One run at a time */
+class LineRunner {
+public:
+    static const std::size_t defaultChunkLines;
+
+    /* 0 threads is one per core, the calling thread is one of them */
+    LineRunner(std::size_t threads = 0, std::size_t chunkLines = defaultChunkLines);
+
+    /* Writes one line to out for every line of length bytes at source, in input order: the value of its last statement,
+     * "ok" when that has none, "error: message" when the line did not compile or run and an empty line for a blank one.
+     * False when any line failed or the input is 4 GiB or more */
+    bool run(const char* source, std::size_t length, std::ostream& out);
+    std::size_t failedLines() const;
+
+private:
+    struct Chunk {
+        std::string output;
+        bool ready;
+    };
+
+    void work();
+    /* Writes the finished chunks that are next in order unless another thread is writing them */
+    void flush();
+
+    std::size_t threads;
+    std::size_t chunkLines;
+
+    const char* source;
+    /* Offset of every line and one past the last line */
+    std::vector<unsigned int> starts;
+    std::vector<Chunk> chunks;
+    std::ostream* out;
+    /* Next chunk to evaluate and next to write, a worker stays a few chunks ahead of the writes */
+    std::size_t taken;
+    std::size_t written;
+    std::size_t window;
+    bool writing;
+    std::size_t failed;
+    std::mutex m;
+    std::condition_variable changed;
+};
+
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ccc {
+
+/* Reads a list of files ahead of the lexers with up to a fixed number of reads in flight, and hands each over
+ * whole in list order to be lexed in memory. Uses io_uring on Linux, a pool of threads doing pread elsewhere
+ * or when the kernel refuses a ring. Meant for one consuming thread */
+class FileLoader {
+public:
+    enum class Backend {
+        /* io_uring where it can be set up, threads otherwise */
+        AUTO,
+        RING,
+        THREADS
+    };
+
+    struct File {
+        std::string path;
+        std::vector<char> contents;
+        /* False when the file could not be opened or read */
+        bool ok;
+    };
+
+    static const std::size_t defaultInFlight;
+
+    FileLoader(std::vector<std::string> paths, std::size_t inFlight = defaultInFlight, Backend backend = Backend::AUTO);
+    ~FileLoader();
+    FileLoader(const FileLoader&) = delete;
+    FileLoader& operator=(const FileLoader&) = delete;
+
+    /* Waits for the next file of the list, false once every file was handed out */
+    bool next(File& out);
+    /* RING or THREADS, whichever AUTO ended up with */
+    Backend backend() const;
+
+private:
+    struct Slot {
+        std::vector<char> contents;
+        int fd;
+        /* Bytes read so far */
+        std::size_t done;
+        bool finished;
+        bool ok;
+    };
+
+    /* Ring backend, driven from next on the consuming thread */
+    bool setupRing(std::size_t entries);
+    void closeRing();
+    /* Opens every file the window has room for and queues its first read */
+    void fillRing();
+    void queueRead(std::size_t index);
+    /* Submits the queued reads and waits for at least one completion */
+    bool waitRing();
+
+    /* Thread backend */
+    void readAhead();
+    static void readWhole(const std::string& path, Slot& slot);
+
+    std::vector<std::string> paths;
+    std::vector<Slot> slots;
+    std::size_t inFlight;
+    Backend used;
+    /* Next file to hand out */
+    std::size_t delivered;
+    /* Next file to start reading */
+    std::size_t started;
+
+    int ringFd;
+    /* The submission and completion rings share one mapping */
+    void* rings;
+    std::size_t ringsSize;
+    void* sqes;
+    std::size_t sqesSize;
+    unsigned int* sqTail;
+    unsigned int* sqMask;
+    unsigned int* sqArray;
+    unsigned int* cqHead;
+    unsigned int* cqTail;
+    unsigned int* cqMask;
+    void* cqes;
+    /* Reads waiting for the next submit */
+    unsigned int queued;
+
+    std::vector<std::thread> readers;
+    std::mutex m;
+    std::condition_variable changed;
+    bool stopping;
+};
+
+}
@@ -0,0 +1,149 @@
+#pragma once
+#include "vm.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace ccc {
+
+/* Runs trees of tasks on a fixed set of threads. Each thread keeps a deque of tasks, takes the newest of
+ * its own and steals the oldest of another's once it runs dry. The thread calling run works as one of them */
+class ForkJoinPool {
+public:
+    /* A task runs once all of its children have, the last child to finish runs its parent */
+    class Task {
+    public:
+        Task();
+        virtual ~Task() = default;
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+
+        void add(Task& child);
+        /* False fails the tree */
+        virtual bool execute() = 0;
+
+    private:
+        friend class ForkJoinPool;
+
+        Task* parent;
+        std::vector<Task*> children;
+        /* Children that have not finished in the current run */
+        std::atomic<std::size_t> pending;
+    };
+
+    /* threads counts the calling thread, so 1 runs every task on it */
+    ForkJoinPool(std::size_t threads);
+    ~ForkJoinPool();
+    ForkJoinPool(const ForkJoinPool&) = delete;
+    ForkJoinPool& operator=(const ForkJoinPool&) = delete;
+
+    std::size_t threads() const;
+    /* Runs the tree below root, one tree at a time. False when a task failed, the ones not started then never run */
+    bool run(Task& root);
+
+private:
+    struct Worker {
+        std::mutex m;
+        std::deque<Task*> tasks;
+    };
+
+    void help(std::size_t index);
+    void work(std::size_t index);
+    Task* take(std::size_t index);
+    void push(std::size_t index, Task* task);
+    /* Runs task and every parent it was the last child of */
+    void finish(Task* task);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> helpers;
+    std::mutex running;
+    std::mutex m;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    /* Counts the runs, a helper joins each new one */
+    std::size_t generation;
+    std::size_t busy;
+    bool stopping;
+    Task* root;
+    std::atomic<bool> done;
+    std::atomic<bool> failed;
+};
+
+/* Evaluates an arithmetic AST on a ForkJoinPool. Where both operands of an operator are subtrees of at least
+ * grain nodes, each becomes a task with an operand stack of its own and the operator combines their results,
+ * so the operations and their order are exactly those of serial evaluation. Falls back to StackBasedVM on anything
+ * but literals, variables and arithmetic */
+class ParallelVM : public VM {
+public:
+    static const std::size_t defaultGrain;
+
+    /* pool has to outlive the VM, globals is read by variables and handed to the interpreter */
+    ParallelVM(SyntaxTree& ast, ForkJoinPool& pool, Globals* globals = nullptr, std::size_t grain = defaultGrain);
+    ~ParallelVM() override;
+    ParallelVM(const ParallelVM&) = delete;
+    ParallelVM& operator=(const ParallelVM&) = delete;
+
+    bool run() override;
+    /* The tasks run to the end at once, the interpreter yields and resumes as it does on its own */
+    Status resume(const Budget& budget) override;
+    bool result(Token& out) const override;
+    /* Tasks a run is split into, 0 when the interpreter is used instead */
+    std::size_t tasks() const;
+
+private:
+    enum class Opcode {
+        PUSH,
+        LOAD,
+        /* Pushes the result of a child task */
+        INPUT,
+        ARITH
+    };
+
+    struct Instruction {
+        Opcode op;
+        Terminal arithmeticOp;
+        Value value;
+        std::size_t index;
+    };
+
+    struct Segment : ForkJoinPool::Task {
+        Segment();
+        bool execute() override;
+
+        std::vector<Instruction> code;
+        /* Results of the children in the order the code uses them */
+        std::vector<Value> inputs;
+        std::vector<Value> operands;
+        Segment* destination;
+        std::size_t input;
+        Value* out;
+        const Value* variables;
+    };
+
+    /* Counts the nodes below every node, false on anything the tasks cannot evaluate */
+    bool measure(const SyntaxTree::SyntaxTreeNode* node);
+    bool compile(const SyntaxTree::SyntaxTreeNode* node, Segment& segment, std::size_t& depth);
+    Segment& split(Segment& parent);
+
+    StackBasedVM interpreter;
+    ForkJoinPool& pool;
+    Globals* globals;
+    std::size_t grain;
+    bool compiled;
+    Token lastResult;
+    Value value;
+    std::size_t instructions;
+    std::size_t operandBytes;
+    /* Only a division fails the tasks, they keep no nodes so it is reported at the whole expression */
+    Diagnostic divisionError;
+    std::vector<std::unique_ptr<Segment>> segments;
+    std::unordered_map<const SyntaxTree::SyntaxTreeNode*, std::size_t> sizes;
+};
+
+}
@@ -1,6 +1,8 @@
 #pragma once
+#include "diagnostics.h"
 #include "lexer.h"
 #include <deque>
+#include <memory>
 #include <stack>
 #include <unordered_map>
 #include <vector>
@@ -17,6 +19,10 @@ enum class Type {
     FLOAT_PTR,
     CHAR_PTR,
     STRING_PTR,
+    /* Of a value the type pass found no path to, such as the call of a function that never returns */
+    VOID,
+    /* Of a value the type pass found both an int and a float reach, its operations check at run time */
+    DYNAMIC,
 };
 
 enum class StorageSpecifier {
@@ -26,10 +32,12 @@ enum class StorageSpecifier {
 };
 
 struct Symbol {
-    Symbol(Type type, StorageSpecifier storageSpecifier);
+    Symbol(Type type, StorageSpecifier storageSpecifier, std::size_t slot = 0);
 
     Type type;
     StorageSpecifier storageSpecifier;
+    /* Where a resolved variable lives, in its frame when AUTO and in the static area otherwise */
+    std::size_t slot;
 };
 
 class SymbolTable {
@@ -43,28 +51,50 @@ public:
     void removeScope();
 
 private:
+    static std::size_t bytes(const std::string& symbolName);
+
     std::stack<std::unordered_map<std::string, Symbol>*> symbols;
     std::stack<std::unordered_map<std::string, Symbol>*> helperStack;
 };
 
 class SyntaxTree {
 public:
+    struct SyntaxTreeNode;
+
     SyntaxTree();
     ~SyntaxTree();
 
-    bool insert(const std::string& parentNonTerminal, const std::vector<Token>& tokens);
+    /* The created nodes are appended to inserted when given */
+    bool insert(const std::string& parentNonTerminal, const std::vector<Token>& tokens, std::vector<SyntaxTreeNode*>* inserted = nullptr);
     void printSyntaxTree();
 
     struct SyntaxTreeNode {
         SyntaxTreeNode(Token val);
+        /* Copies would release the bytes of the node twice */
+        SyntaxTreeNode(const SyntaxTreeNode&) = delete;
         virtual ~SyntaxTreeNode();
 
         Token val;
         SyntaxTreeNode* next;
         SyntaxTreeNode* children;
+        /* Source span of the whole subexpression including its brackets, set by convertToAst */
+        unsigned int offset;
+        unsigned int length;
     };
     struct FunctionNode : SyntaxTreeNode {
     };
+    /* Leaf of a hash-consed tree that stands for the earlier copy target of the subtree it replaced,
+     * the tree keeps owning target */
+    struct SharedNode : SyntaxTreeNode {
+        SharedNode(SyntaxTreeNode* target, const SyntaxTreeNode& copy);
+        ~SharedNode() override;
+
+        SyntaxTreeNode* target;
+    };
+
+    /* Turns every expression of only literals, variables and arithmetic into a DAG: a subtree that repeats
+     * one earlier in the same expression becomes a SharedNode of that copy. Returns the nodes it saved */
+    std::size_t hashCons();
 
     SyntaxTreeNode* root;
 
@@ -76,36 +106,145 @@ private:
 /* Each compilation unit should have their own Parser instance */
 class Parser {
 public:
+    enum class Backend {
+        LL1,
+        PRATT
+    };
+
     virtual ~Parser() = default;
 
-    virtual bool parse(SyntaxTree& res) = 0;
+    /* A parser of backend reading buffer, both build the same AST */
+    static std::unique_ptr<Parser> create(Backend backend, TokenSource& buffer);
+
+    /* The top-level statements of the whole input become siblings under res.root */
+    virtual bool parse(SyntaxTree& res);
+    /* Parses the next top-level statement, "A ;", an if or while or a function definition, into an empty tree,
+     * more tells whether another one follows */
+    virtual bool parseStatement(SyntaxTree& res, bool& more) = 0;
+    /* Converts every top-level statement of st on its own */
     virtual void convertToAst(SyntaxTree& st) = 0;
+    /* Why the last parse failed */
+    const Diagnostic& error() const;
 
 protected:
-    Parser(SharedBuffer& buffer);
+    Parser(TokenSource& buffer);
+
+    /* Records the diagnostic for token and returns false */
+    bool fail(const Token& token, const std::string& message);
+    /* Spans node and its children, whose spans have to be final */
+    static void span(SyntaxTree::SyntaxTreeNode* node);
+    /* Takes the ; ending a statement other than a block, the last one may omit it */
+    bool endStatement(bool block, bool& more);
 
     void addToSymbolTable(Token& token, Type type);
     SymbolTable symbolTable;
-    SharedBuffer& buffer;
+    TokenSource& buffer;
     /* Maps non-terminals to a map which maps terminals to productions */
     std::unordered_map<std::string, std::unordered_map<Terminal, std::vector<std::string>>> parsingTable;
     std::stack<std::string> grammarSymbols;
+    /* Tree nodes of the terminals on grammarSymbols, they get the matched input token */
+    std::stack<SyntaxTree::SyntaxTreeNode*> terminalNodes;
     std::unordered_set<std::string> terminals;
+    Diagnostic lastError;
     const static std::unordered_map<Terminal, std::string> terminalsToProductions;
     const static std::unordered_map<std::string, Terminal> productionsToTerminals;
 };
 
 class LL1Parser : public Parser {
 public:
-    LL1Parser(SharedBuffer& buffer);
+    LL1Parser(TokenSource& buffer);
 
-    bool parse(SyntaxTree& res) override;
+    bool parseStatement(SyntaxTree& res, bool& more) override;
     void convertToAst(SyntaxTree& st) override;
 
 private:
-    SyntaxTree::SyntaxTreeNode* convertToAstHelper(SyntaxTree::SyntaxTreeNode* node);
+    /* node is a DEF, DECL, STMT or A of the syntax tree, the convert functions consume the nodes they are given */
+    SyntaxTree::SyntaxTreeNode* convertStatement(SyntaxTree::SyntaxTreeNode* node);
+    /* The statements of L as siblings */
+    SyntaxTree::SyntaxTreeNode* convertList(SyntaxTree::SyntaxTreeNode* list);
+    SyntaxTree::SyntaxTreeNode* convertAssignment(SyntaxTree::SyntaxTreeNode* expression);
+    SyntaxTree::SyntaxTreeNode* convertDefinition(SyntaxTree::SyntaxTreeNode* specifier);
+    SyntaxTree::SyntaxTreeNode* convertDeclaration(SyntaxTree::SyntaxTreeNode* storage, SyntaxTree::SyntaxTreeNode* type,
+        SyntaxTree::SyntaxTreeNode* name, SyntaxTree::SyntaxTreeNode* rest);
+    SyntaxTree::SyntaxTreeNode* convertParameters(SyntaxTree::SyntaxTreeNode* list);
+    SyntaxTree::SyntaxTreeNode* convertArguments(SyntaxTree::SyntaxTreeNode* list);
+    SyntaxTree::SyntaxTreeNode* convertChain(SyntaxTree::SyntaxTreeNode* node);
+    SyntaxTree::SyntaxTreeNode* convertChainRest(SyntaxTree::SyntaxTreeNode* lhs, SyntaxTree::SyntaxTreeNode* rest);
+    SyntaxTree::SyntaxTreeNode* convertFactor(SyntaxTree::SyntaxTreeNode* node);
     void continueGrammarMatching();
     void expandProduction(SyntaxTree& st);
 };
 
+/* Builds the AST convertToAst makes straight from the tokens, by recursive descent over statements and precedence
+ * climbing over operators, with neither a stack of grammar symbols nor a parse tree to flatten. Every operator binds
+ * to the right, as the chains of the grammar do. convertToAst has nothing left to do */
+class PrattParser : public Parser {
+public:
+    PrattParser(TokenSource& buffer);
+
+    bool parseStatement(SyntaxTree& res, bool& more) override;
+    void convertToAst(SyntaxTree& st) override;
+
+private:
+    using Node = SyntaxTree::SyntaxTreeNode;
+
+    /* Each returns nullptr once it recorded a diagnostic, having freed what it built */
+    /* A statement of a block: return, if, while, a declaration or A ; */
+    Node* statement();
+    /* The statements up to } of the { in scope, which holds them afterwards and spans to the }.
+     * On failure the caller still owns scope */
+    bool block(Node* scope);
+    /* SPEC TYPE id followed by a declaration or, when functions are allowed, a definition */
+    Node* definition(bool functions);
+    /* ( P ) { L } of the function name returning type, it owns both from then on */
+    Node* function(Node* name, Node* type);
+    /* if or while ( A logop A ) { L } */
+    Node* control();
+    /* A, assignments nest to the right */
+    Node* assignment();
+    /* Operators binding at least as tight as precedence */
+    Node* expression(int precedence);
+    Node* factor();
+    /* ( V ) after name, which holds the arguments afterwards. On failure the caller still owns name */
+    bool call(Node* name);
+
+    /* The current token as a node of its own */
+    Node* take();
+    /* The same when the current token is term, records "expected" otherwise */
+    Node* take(Terminal term);
+    /* Pops the current token if it is term and records "expected" otherwise */
+    bool expect(Terminal term);
+    /* Records "unexpected" for the current token */
+    bool unexpected();
+    static int precedence(Terminal term);
+};
+
+/* Takes the postfix operations of an expression in the order their productions complete */
+class PostfixSink {
+public:
+    virtual ~PostfixSink() = default;
+
+    /* literal is an INT_LITERAL or FLOAT_LITERAL token, error says why when it returns false */
+    virtual bool operand(const Token& literal, std::string& error) = 0;
+    /* Applies op to the two operands before it */
+    virtual bool apply(const Token& op, std::string& error) = 0;
+};
+
+/* Parses expression statements of literals and arithmetic without a tree: each operator goes to the sink as soon
+ * as the production of its right operand completes. Chains nest to the right as they do in the AST, so what is
+ * held at a time grows with the nesting of the expression rather than with its tokens */
+class StreamingParser : public LL1Parser {
+public:
+    StreamingParser(TokenSource& buffer);
+
+    /* Parses the next expression statement into sink, more tells whether another one follows */
+    bool stream(PostfixSink& sink, bool& more);
+
+private:
+    /* The expression rows of the parsing table without ids, with an action after the rest of every operator */
+    std::unordered_map<std::string, std::unordered_map<Terminal, std::vector<std::string>>> postfixTable;
+    /* Operators whose action is still on grammarSymbols, innermost last */
+    std::vector<Token> operators;
+};
+
 }
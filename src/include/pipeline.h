@@ -0,0 +1,91 @@
+#pragma once
+#include "diagnostics.h"
+#include "lexer.h"
+#include "parser.h"
+#include "vm.h"
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <vector>
+
+namespace ccc {
+
+/* Lexes, parses and evaluates a file on three threads, handing each top-level statement to the evaluation
+ * stage once it is parsed. Evaluating a statement overlaps parsing the next one and its tree is freed afterwards,
+ * so memory is bounded by the largest few statements rather than by the file.
+ * Files smaller than the threading threshold run all three stages on the calling thread instead */
+class Pipeline {
+public:
+    /* globals holds the variables of the run, the VMs of all its statements share it */
+    using VMFactory = std::function<std::unique_ptr<VM>(SyntaxTree& ast, Globals& globals)>;
+    /* Called on the evaluation thread in statement order, ok is false when the statement did not evaluate
+     * and value is an ERROR token for control flow, which has none */
+    using Callback = std::function<void(std::size_t statement, bool ok, const Token& value)>;
+
+    /* Below this many bytes thread creation and handoffs cost more than they overlap */
+    static const std::size_t defaultThreadedFrom;
+
+    /* At most depth parsed statements wait for evaluation, 0 for threadedFrom threads every file.
+     * hashCons shares the repeated subexpressions of every statement before it is evaluated, parser picks the parser backend */
+    Pipeline(VMFactory factory, std::size_t depth = 4, std::size_t threadedFrom = defaultThreadedFrom, bool hashCons = false,
+        Parser::Backend parser = Parser::Backend::LL1);
+
+    /* False when the file did not parse or a statement did not compile or run, the statements before a syntax error are still evaluated */
+    bool run(const std::string& filePath, const Callback& callback);
+    /* Runs length bytes of source already in memory, such as a bundle entry, on the calling thread without copying them */
+    bool run(const char* source, std::size_t length, const Callback& callback);
+    const Diagnostic& error() const;
+    std::size_t evaluatedStatements() const;
+    /* Whether the last run used threads */
+    bool threaded() const;
+
+private:
+    /* Bounded handoff between the parser and the evaluator, nullptr ends the stream */
+    class StatementQueue {
+    public:
+        StatementQueue(std::size_t capacity);
+        ~StatementQueue();
+
+        void push(SyntaxTree* statement);
+        SyntaxTree* pop();
+
+    private:
+        std::queue<SyntaxTree*> statements;
+        std::size_t capacity;
+        std::mutex m;
+        std::condition_variable filled;
+        std::condition_variable drained;
+    };
+
+    void parse(TokenSource& buffer, StatementQueue& queue);
+    /* Parses and converts the next statement of either mode, false with lastError set when it does not parse */
+    bool parseStatement(Parser& parser, SyntaxTree& statement, bool& more);
+    bool runThreaded(const std::string& filePath, Globals& globals, const Callback& callback);
+    bool runSingleThreaded(TokenSource& source, Globals& globals, const Callback& callback);
+    void start();
+    /* Merges the first compile or runtime error into the result of a run */
+    bool finish(bool res);
+    void evaluate(SyntaxTree* statement, Globals& globals, const Callback& callback);
+
+    VMFactory factory;
+    /* Building the automata costs more than lexing a small file, so every run reuses them */
+    Lexer lexer;
+    std::size_t depth;
+    std::size_t threadedFrom;
+    bool hashCons;
+    Parser::Backend backend;
+    bool usedThreads;
+    Diagnostic lastError;
+    /* Error of the first statement that did not compile or run, kept apart from the parser's error since it is set by another thread */
+    Diagnostic compileError;
+    bool parsed;
+    std::size_t evaluated;
+    /* Statements that define functions live until the end of the run, later statements call them */
+    std::vector<std::unique_ptr<SyntaxTree>> definitions;
+};
+
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include "diagnostics.h"
+#include "parser.h"
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+namespace ccc {
+
+/* Execution counts and sampled cycles of VM instructions, attributed to the AST nodes they were lowered from.
+ * Code without jumps runs every instruction up to a failing one, so executions are counted per run and not per dispatch,
+ * code with jumps has its executions estimated from the samples */
+class Profiler {
+public:
+    struct Counter {
+        unsigned long long executions;
+        /* Cycles of the sampled executions scaled by the sample interval */
+        unsigned long long cycles;
+    };
+
+    /* The AST has to be the one the profiled VM runs, source the text it was parsed from.
+     * An odd interval keeps the samples from lining up with the length of the program */
+    Profiler(const std::string& source, const SyntaxTree& ast, unsigned int sampleInterval = 1021);
+
+    /* Called by the VM with the node of each of its instructions, resets the counters.
+     * With sampledExecutions the VM counts the executions itself */
+    Counter* attach(const std::vector<const SyntaxTree::SyntaxTreeNode*>& instructionNodes, bool sampledExecutions = false);
+    /* Called by the VM when a run starts and when it fails at instruction */
+    void enter();
+    void stop(std::size_t instruction);
+    unsigned int sampleInterval() const;
+    /* Cost of reading the clock, the VM subtracts it from every sample */
+    unsigned long long clockOverhead() const;
+
+    /* One "outer;inner cycles" line per AST path, the input format of flamegraph.pl */
+    void writeFolded(std::ostream& out);
+    /* The n nodes with the most cycles of their own */
+    void writeReport(std::ostream& out, std::size_t n);
+
+    static unsigned long long now()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+private:
+    void collectParents(const SyntaxTree::SyntaxTreeNode* node, const SyntaxTree::SyntaxTreeNode* parent);
+    void countExecutions();
+    std::string frame(const SyntaxTree::SyntaxTreeNode* node);
+
+    const std::string& source;
+    LineIndex lines;
+    std::unordered_map<const SyntaxTree::SyntaxTreeNode*, const SyntaxTree::SyntaxTreeNode*> parents;
+    std::vector<const SyntaxTree::SyntaxTreeNode*> nodes;
+    std::vector<Counter> counters;
+    /* stops[i] runs ended before instruction i */
+    std::vector<unsigned long long> stops;
+    unsigned long long runs;
+    bool sampled;
+    unsigned int interval;
+    unsigned long long overhead;
+};
+
+}
@@ -1,7 +1,15 @@
 #pragma once
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstddef>
+#include <memory>
 #include <mutex>
+#include <ostream>
 #include <queue>
+#include <string>
+#include <unordered_set>
+#include <vector>
 
 namespace ccc {
 
@@ -14,8 +22,11 @@ enum class Terminal {
     INT_PTR,
     FLOAT_PTR,
     CHAR_PTR,
+    STORAGE_STATIC,
+    STORAGE_EXTERN,
     CONTROL_FLOW_BRANCH,
     CONTROL_FLOW_WHILE,
+    CONTROL_FLOW_RETURN,
     ARITHMETIC_OP_PLUS,
     ARITHMETIC_OP_MINUS,
     ARITHMETIC_OP_MULT,
@@ -27,38 +38,208 @@ enum class Terminal {
     FLOAT_LITERAL,
     STRING_LITERAL,
     SEMICOLON,
+    COMMA,
     OPEN_SCOPE,
     CLOSED_SCOPE,
     OPENING_BRACKET,
     CLOSING_BRACKET,
     FILE_END,
+    /* AST nodes the parser makes of the name of a function or declared variable */
+    FUNCTION_DEF,
+    FUNCTION_CALL,
+    VARIABLE_DECL,
+    /* Leaf of a hash-consed tree standing for an earlier copy of its subtree */
+    SHARED_SUBTREE,
     NON_TERMINAL,
     ERROR
 };
 
 struct Token {
-    Token(std::string lexeme, Terminal term);
+    Token(std::string lexeme, Terminal term, unsigned int offset = 0, unsigned int length = 0);
+    /* Computed values, they have no source text */
+    explicit Token(long long value);
+    explicit Token(double value);
 
     bool operator==(const Token& other) const;
 
     std::string lexeme;
     Terminal term;
+    /* Position in the source, tokens the lexer did not read have none */
+    unsigned int offset;
+    unsigned int length;
+    /* Value of INT_LITERAL and FLOAT_LITERAL tokens, decoded once by the lexer */
+    union {
+        long long intValue;
+        double floatValue;
+    };
 };
 
-class SharedBuffer {
+/* Bytes held by each subsystem across all threads, with a budget shared by all of them */
+class MemoryStats {
 public:
-    SharedBuffer();
+    enum class Subsystem {
+        LEXER_BUFFER,
+        TOKEN_QUEUE,
+        PARSE_TREE,
+        SYMBOL_TABLE,
+        VM_STACK,
+        COUNT
+    };
+
+    /* Refuses the bytes and marks the budget exceeded when they do not fit */
+    static bool allocate(Subsystem subsystem, std::size_t bytes);
+    /* For memory that cannot be refused, marks the budget exceeded but keeps counting */
+    static void charge(Subsystem subsystem, std::size_t bytes);
+    static void release(Subsystem subsystem, std::size_t bytes);
+    static bool fits(std::size_t bytes);
+
+    static std::size_t current(Subsystem subsystem);
+    static std::size_t peak(Subsystem subsystem);
+    static std::size_t current();
+    static std::size_t peak();
+
+    /* 0 is no budget */
+    static void setBudget(std::size_t bytes);
+    static std::size_t budget();
+    /* Sticky until reset so that a failure is still visible after the memory was freed */
+    static bool exceeded();
+    /* Peaks start over from the current bytes */
+    static void reset();
+
+    /* Adds the node counts of a tree before and after hash-consing and the parse tree bytes that saved */
+    static void countHashCons(std::size_t nodesBefore, std::size_t nodesAfter, std::size_t bytesSaved);
+
+    static void print(std::ostream& out);
+
+private:
+    static void raisePeak(std::atomic<std::size_t>& peak, std::size_t value);
+
+    static std::atomic<std::size_t> currents[static_cast<int>(Subsystem::COUNT)];
+    static std::atomic<std::size_t> peaks[static_cast<int>(Subsystem::COUNT)];
+    static std::atomic<std::size_t> total;
+    static std::atomic<std::size_t> totalPeak;
+    static std::atomic<std::size_t> limit;
+    static std::atomic<bool> overBudget;
+    static std::atomic<std::size_t> hashConsBefore;
+    static std::atomic<std::size_t> hashConsAfter;
+    static std::atomic<std::size_t> hashConsSaved;
+};
+
+/* Timeline of the phases every thread goes through, to see where the pipeline stages wait on each other.
+ * A thread records into a ring of its own that no other thread writes, the ring of a finished thread goes to
+ * the next new one and keeps its lane. Written as Chrome trace event JSON for chrome://tracing or Perfetto.
+ * Off until start, a Scope then costs one relaxed load */
+class Tracer {
+public:
+    /* Records name on the calling thread from construction to destruction, detail has to outlive the tracer */
+    class Scope {
+    public:
+        Scope(const char* name, const char* detail = nullptr)
+            : name { name }
+            , detail { detail }
+            , begin { on.load(std::memory_order_relaxed) ? now() : 0 }
+        {
+        }
+        ~Scope()
+        {
+            if (begin != 0)
+                record(name, detail, begin, now());
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        const char* name;
+        const char* detail;
+        unsigned long long begin;
+    };
+
+    /* Drops the events of an earlier trace, no traced thread may be running */
+    static void start();
+    static void stop();
+    static bool active();
+    /* A copy of text that lives as long as the program, for details such as file names */
+    static const char* intern(const std::string& text);
+    /* {"traceEvents": [...]} with the newest events of every ring, once the traced threads are done */
+    static void write(std::ostream& out);
+
+private:
+    struct Event {
+        const char* name;
+        const char* detail;
+        unsigned long long begin;
+        unsigned long long end;
+    };
+
+    struct Ring {
+        /* Events ever recorded, the newest ones are kept */
+        std::atomic<std::size_t> head;
+        std::vector<Event> events;
+        std::size_t lane;
+    };
+
+    /* Gives the ring of a thread back when the thread ends */
+    struct Owner {
+        ~Owner();
+
+        Ring* ring;
+    };
+
+    static unsigned long long now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    static void record(const char* name, const char* detail, unsigned long long begin, unsigned long long end);
+
+    static std::atomic<bool> on;
+    static unsigned long long origin;
+    static std::mutex m;
+    static std::vector<std::unique_ptr<Ring>> rings;
+    static std::vector<Ring*> freeRings;
+    static std::unordered_set<std::string> names;
+};
+
+/* Where the parser reads its tokens from */
+class TokenSource {
+public:
+    virtual ~TokenSource() = default;
+
+    /* The current token, it stays valid until pop */
+    virtual Token* consume() = 0;
+    virtual void pop() = 0;
+    /* The consumer stopped reading */
+    virtual void close() = 0;
+};
+
+/* Hands tokens from a lexer thread to a parser thread */
+class SharedBuffer : public TokenSource {
+public:
+    /* Without backpressure produce never waits, for buffers filled before the consumer starts.
+     * A capacity other than 0 is the most tokens queued at once */
+    explicit SharedBuffer(bool backpressure = true, std::size_t capacity = 0);
     ~SharedBuffer();
 
+    /* Waits while the queue is full or over its share of the memory budget and the consumer has tokens to read */
     void produce(Token* token);
-    Token* consume();
-    void pop();
+    Token* consume() override;
+    void pop() override;
+    /* Later tokens are dropped instead of waiting for room */
+    void close() override;
 
 private:
+    static std::size_t bytes(const Token* token);
+    bool hasRoom(std::size_t size) const;
+
     std::queue<Token*> buffer;
     unsigned long long count;
+    std::size_t queuedBytes;
+    bool backpressure;
+    std::size_t capacity;
+    bool producerWaiting;
+    bool closed;
     std::mutex m;
     std::condition_variable condition;
+    std::condition_variable room;
 };
 
 }
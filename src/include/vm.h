@@ -1,8 +1,17 @@
 #pragma once
 #include "parser.h"
-#include <stack>
+#ifdef CCC_PROFILER
+#include "profiler.h"
+#endif
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 namespace ccc {
 
@@ -10,24 +19,489 @@ class VM {
 public:
     virtual ~VM() = default;
 
-    virtual void run() = 0;
+    enum class Status {
+        FINISHED,
+        /* Spent its instructions, the next resume goes on where it stopped */
+        YIELDED,
+        FAILED
+    };
+
+    /* Limits of one resume, 0 for none */
+    struct Budget {
+        /* Dispatches before the run yields, counted to the next taken jump or call */
+        unsigned long long instructions;
+        /* Operand values and bytes of operands and frames the run may hold when it calls */
+        std::size_t stackDepth;
+        std::size_t memoryBytes;
+    };
+
+    virtual bool run() = 0;
+    /* Runs until the end, a failure or the end of budget. After a YIELDED one the next call goes on with the run and
+     * run starts over. Going over the stack or memory budget fails the run with a diagnostic, a VM without loops or
+     * calls runs to the end at once */
+    virtual Status resume(const Budget& budget);
+    /* Value of the last successful run as an INT_LITERAL or FLOAT_LITERAL token */
+    virtual bool result(Token& out) const = 0;
+    /* Instructions dispatched since construction */
+    unsigned long long executedInstructions() const;
+    /* Why the program did not compile or the last run went over its budget, the message is empty otherwise */
+    const Diagnostic& error() const;
+
+    struct Value {
+        bool isFloat;
+        union {
+            long long intValue;
+            double floatValue;
+        };
+    };
+
+protected:
+    enum class Comparison {
+        LESS,
+        LESS_EQUAL,
+        GREATER,
+        GREATER_EQUAL,
+        EQUAL,
+        NOT_EQUAL
+    };
+
+    VM();
+
+    static Token makeOperand(long long value);
+    static Token makeOperand(double value);
+    /* Promotes to double if either side is a float, false on integer division by zero or of the lowest value by -1 */
+    static bool calc(Terminal op, const Value& lhs, const Value& rhs, Value& out);
+    /* Whether lhs / rhs has an integer quotient, the native idiv traps on the others */
+    static bool divisible(long long lhs, long long rhs);
+    /* Integer + - * wrap around like the native instructions, computed unsigned since signed overflow is undefined */
+    static long long add(long long lhs, long long rhs);
+    static long long subtract(long long lhs, long long rhs);
+    static long long multiply(long long lhs, long long rhs);
+    /* False for a lexeme that is not a comparison */
+    static bool comparison(const std::string& lexeme, Comparison& out);
+    static bool compare(Comparison op, const Value& lhs, const Value& rhs);
+    template <typename T>
+    static bool compare(Comparison op, T lhs, T rhs);
+
+    unsigned long long executed;
+    Diagnostic lastError;
 };
 
+/* Variables and functions by name, shared by the VMs of the statements of one program so each sees
+ * the assignments and definitions of the ones before */
+class Globals {
+public:
+    Globals() = default;
+    ~Globals();
+    Globals(const Globals&) = delete;
+    Globals& operator=(const Globals&) = delete;
+
+    /* Slot of name, a new variable starts as the int 0 */
+    std::size_t slot(const std::string& name);
+    /* Slot of a variable declared or assigned before, false for any other name */
+    bool find(const std::string& name, std::size_t& out) const;
+    /* Stays valid until the next new variable */
+    VM::Value* values();
+    /* Variables so far */
+    std::size_t size() const;
+    bool lookup(const std::string& name, VM::Value& out) const;
+    /* Every VM calling a function lowers it from its FUNCTION_DEF node, so the tree has to outlive them.
+     * False when another function has that name */
+    bool define(SyntaxTree::SyntaxTreeNode* function);
+    SyntaxTree::SyntaxTreeNode* function(const std::string& name) const;
+
+private:
+    std::unordered_map<std::string, std::size_t> slots;
+    std::vector<VM::Value> variables;
+    std::unordered_map<std::string, SyntaxTree::SyntaxTreeNode*> functions;
+};
+
+class CompiledProgram;
+
+/* Runs the AST lowered to postfix code over an operand stack. Functions are lowered after the top-level code,
+ * a call finds its arguments in place on the operand stack as the first locals of its frame.
+ * Variables are resolved to slots while lowering, so a run never looks up a name.
+ * Lowering infers the type of every value and emits the int or float form of an operation where it is known,
+ * a function once for every list of argument types it is called with. Globals are typed by their values when
+ * lowered, a run finding one of another type lowers again */
 class StackBasedVM : public VM {
 public:
-    StackBasedVM(SyntaxTree& ast);
-    void run() override;
+    /* Everything after RETURN is a superinstruction made by fuse */
+    enum class Opcode {
+        PUSH,
+        /* Arithmetic on operands of either type, for DYNAMIC ones */
+        ARITH,
+        /* Drops the value of an expression statement before the next one */
+        POP,
+        LOAD,
+        /* Leaves the assigned value on the stack */
+        STORE,
+        LOAD_LOCAL,
+        STORE_LOCAL,
+        /* Makes room for the declared locals of a frame, zeroed */
+        ENTER,
+        JUMP,
+        /* Pops two operands and jumps if their comparison is jumpIf */
+        BRANCH,
+        /* Arithmetic and BRANCH of operands known to be ints or floats, which skip the type checks */
+        IADD,
+        ISUB,
+        IMUL,
+        IDIV,
+        FADD,
+        FSUB,
+        FMUL,
+        FDIV,
+        IBRANCH,
+        FBRANCH,
+        /* Converts the int on top to a float */
+        INT_TO_FLOAT,
+        CALL,
+        /* Replaces the arguments of the call with the value on top */
+        RETURN,
+        ARITH_IMM,
+        PUSH_PUSH,
+        PUSH_ARITH_IMM,
+        ARITH_ARITH,
+        BRANCH_IMM,
+        STORE_POP,
+        COUNT
+    };
+    using PairCounts = std::map<std::pair<Opcode, Opcode>, unsigned long long>;
+
+    /* Variables live in globals when given, otherwise in the VM. Untyped code checks the operand types
+     * of every operation */
+    StackBasedVM(SyntaxTree& ast, Globals* globals = nullptr, bool typed = true);
+    ~StackBasedVM() override;
+    bool run() override;
+    /* Running, fusing or lowering again gives up a paused run, as does a global of the VMs sharing globals changing
+     * its type while it is paused */
+    Status resume(const Budget& budget) override;
+    bool result(Token& out) const override;
+
+    /* Counts adjacent opcode pairs while running */
+    void instrument(bool enabled);
+    PairCounts pairCounts() const;
+    /* Fuses the pairs of profile that have a superinstruction, most frequent first,
+     * returns the number of instructions saved */
+    std::size_t fuse(const PairCounts& profile);
+    std::size_t codeSize() const;
+    /* Arithmetic and branches left to check the types of their operands */
+    std::size_t dynamicInstructions() const;
+#ifdef CCC_PROFILER
+    /* Attributes executions and sampled cycles to profiler until called with nullptr,
+     * fusing afterwards needs another call */
+    void profile(Profiler* target);
+#endif
+    /* The code as lowered and fused so far with a copy of the static area as it is now, for StackContexts
+     * to run. Nullptr if the AST did not compile */
+    std::shared_ptr<const CompiledProgram> program();
 
 private:
-    bool eval(SyntaxTree::SyntaxTreeNode* node);
-    bool binaryOp(Token token);
-    bool pushOperand(Token token);
-    template <typename T>
-    T calc(T firstOperand, T secondOperand, Terminal op);
+    friend class CompiledProgram;
+    friend class StackContext;
+
+    struct Instruction {
+        Opcode op;
+        /* Arithmetic of the ARITH forms, ARITH_ARITH applies first then second */
+        Terminal first;
+        Terminal second;
+        /* PUSH values, ARITH_IMM and BRANCH_IMM take rhs as their right operand */
+        Value lhs;
+        Value rhs;
+        /* Node the instruction was lowered from, the operator for fused ones */
+        const SyntaxTree::SyntaxTreeNode* node;
+        /* Variable of the LOAD and STORE forms, argument count of CALL */
+        std::size_t slot;
+        /* Instruction index of JUMP, BRANCH and CALL */
+        std::size_t target;
+        Comparison comparison;
+        bool jumpIf;
+        /* INT or FLOAT when the arithmetic or comparison is typed, DYNAMIC otherwise */
+        Type type;
+    };
+
+    /* What the type pass knows at a point of the code: the type of every slot of the frame and of the globals
+     * stored since the top-level code started, any other global still has the type it was lowered with */
+    struct Types {
+        std::vector<Type> locals;
+        std::unordered_map<std::size_t, Type> globals;
+    };
+
+    /* What a function called with one list of argument types returns and which globals it may store */
+    struct Specialization {
+        Type returns;
+        std::set<std::size_t> stores;
+    };
+
+    /* A call in progress */
+    struct Frame {
+        const Instruction* returnTo;
+        Value* locals;
+    };
+
+    /* Where a run is, so a profiled run can stop between samples and go on */
+    struct State {
+        std::size_t pc;
+        Value* top;
+        Value* locals;
+        Frame* frame;
+        Opcode previous;
+        /* A Metered run stopped at a call over its stack or memory budget */
+        bool overBudget;
+    };
+
+    /* What a run works on besides its operand stack */
+    struct Machine {
+        const Instruction* code;
+        std::size_t mainSize;
+        Value* variables;
+        Frame* frames;
+        std::size_t frameCount;
+        unsigned long long* executed;
+        unsigned long long (*pairs)[static_cast<int>(Opcode::COUNT)];
+        /* Bottom of the operand stack and what a Metered run may hold of it and the frames when it calls */
+        Value* stack;
+        std::size_t depthLimit;
+        std::size_t byteLimit;
+    };
+
+    /* Lowers the program until a pass learns nothing new about the functions and sizes the stack */
+    void compile();
+    /* One pass over the program, assuming what the ones before found out */
+    bool lowerProgram(std::size_t& mainDepth, std::size_t& frameDepth);
+    /* Widens what the specializations are assumed to do by what the last pass found, true if it changed any */
+    bool widen();
+    /* Lowers a statement list in a scope of its own unless it shares the one of the parameters,
+     * the value of every expression statement in it is dropped */
+    bool lowerBlock(SyntaxTree::SyntaxTreeNode* node, std::size_t& depth, bool openScope = true);
+    /* Leaves the value of an expression statement on the stack, control flow leaves nothing */
+    bool lowerStatement(SyntaxTree::SyntaxTreeNode* node, std::size_t& depth, bool& producesValue);
+    /* Leaves the value of node on the stack, type is what it is known to be */
+    bool lowerNode(SyntaxTree::SyntaxTreeNode* node, std::size_t& depth, Type& type);
+    bool lowerBranch(SyntaxTree::SyntaxTreeNode* comparison, bool jumpIf, std::size_t& depth);
+    /* A file scope declaration is a variable of the static area, one in a block a slot of its frame
+     * unless it is static or extern */
+    bool lowerDeclaration(SyntaxTree::SyntaxTreeNode* node, std::size_t& depth);
+    /* Slot of the variable node names and the LOAD or STORE form to reach it with, a top-level assignment
+     * declares a new global */
+    bool resolve(const SyntaxTree::SyntaxTreeNode* node, bool assignment, bool& local, std::size_t& slot);
+    /* Frame slots the declarations in the statement list take, the ones of nested blocks as well */
+    static std::size_t countLocals(const SyntaxTree::SyntaxTreeNode* node, bool nested);
+    /* Adds the first copies the SharedNodes in node and below stand for to sharedSlots and seen, and returns
+     * how many were not in seen yet, each takes a frame slot */
+    std::size_t collectShared(const SyntaxTree::SyntaxTreeNode* node, std::unordered_set<const SyntaxTree::SyntaxTreeNode*>& seen);
+    /* Type an operation on lhs and rhs results in, an int operand of a float one is converted. The code of lhs
+     * starts at start and the one of rhs at middle */
+    Type promote(std::size_t start, std::size_t middle, Type lhs, Type rhs);
+    /* Converts the int the code from start to end leaves to a float */
+    void toFloat(std::size_t start, std::size_t end);
+    Type typeOf(bool local, std::size_t slot);
+    void setType(bool local, std::size_t slot, Type type);
+    /* Type of a global before the top-level code stores it, a run checks it is still the same */
+    Type entryType(std::size_t slot);
+    /* Either of two states a point of the code is reached with */
+    void merge(Types& into, const Types& other);
+    static Type join(Type lhs, Type rhs);
+    /* Records the diagnostic for node and returns false */
+    bool fail(const SyntaxTree::SyntaxTreeNode* node, const std::string& message);
+    /* Lowers the functions the CALLs name after the top-level code and points the CALLs at them,
+     * frameDepth is the most operands any of their frames holds */
+    bool link(std::size_t& frameDepth);
+    bool lowerFunction(SyntaxTree::SyntaxTreeNode* function, const std::string& signature, std::size_t& frameDepth);
+    /* Every scope opened while lowering is closed on the way out, failed or not, or the top-level code lowered
+     * next would resolve its declarations as locals */
+    void enterScope();
+    void leaveScope();
+    void emit(Opcode op, const SyntaxTree::SyntaxTreeNode* node);
+    static bool isJump(Opcode op);
+    /* ARITH and its typed forms */
+    static bool isArithmetic(Opcode op);
+    static bool fusePair(const Instruction& lhs, const Instruction& rhs, Instruction& out);
+    /* Arithmetic of a superinstruction of the given type */
+    static bool apply(Terminal op, Type type, const Value& lhs, const Value& rhs, Value& out);
+    static bool holds(Comparison op, Type type, const Value& lhs, const Value& rhs);
+    /* Lowers again if a global the code was typed by has changed its type since */
+    void revalidate();
+    Machine machine();
+    /* Runs from state until the end of the top-level code, a failing instruction or, when Limited, the
+     * budget of dispatches is spent, state is where it stopped and false means it failed there. Metered
+     * runs check budget and the limits of machine only at taken jumps and calls, which every loop and
+     * recursion goes through */
+    template <bool Instrumented, bool Limited, bool Metered>
+    static bool execute(const Machine& machine, State& state, unsigned long long& budget);
+    /* Resumes state within budget, error explains why it failed */
+    static Status slice(Machine machine, State& state, const Budget& budget, bool instrumented, Diagnostic& error);
+    /* Why a run within its budget failed at instruction, only a division and a call past the last frame can */
+    static Diagnostic failure(const Instruction& instruction);
+#ifdef CCC_PROFILER
+    template <bool Instrumented>
+    bool executeProfiled();
+#endif
+
+    SyntaxTree::SyntaxTreeNode* root;
+    std::vector<Instruction> code;
+    /* The top-level code ends here and the functions follow */
+    std::size_t mainSize;
+    std::vector<Value> stack;
+    /* Preallocated for the deepest recursion a run may reach */
+    std::vector<Frame> frames;
+    Globals ownGlobals;
+    Globals* globals;
+    /* Variables of the enclosing blocks of the code being lowered */
+    SymbolTable scopes;
+    std::size_t openScopes;
+    /* Next free slot of the frame being lowered */
+    std::size_t frameLocals;
+    /* Declared locals of the top-level blocks, the result of a run sits above them */
+    std::size_t mainLocals;
+    bool inFunction;
+    /* Frame slot the value of a shared subtree is kept in once lowered, npos before */
+    std::unordered_map<const SyntaxTree::SyntaxTreeNode*, std::size_t> sharedSlots;
+    /* Start of the code of every specialization, by the name of its function and its argument types */
+    std::unordered_map<std::string, std::size_t> entries;
+    /* CALLs whose specialization has not been lowered yet */
+    std::vector<std::pair<std::size_t, std::string>> unresolved;
+    bool typed;
+    Types types;
+    /* What the specializations are assumed to do, by signature */
+    std::map<std::string, Specialization> specializations;
+    /* What the specializations lowered in this pass were found to do */
+    std::map<std::string, Specialization> found;
+    /* Signature of the specialization being lowered, empty for the top-level code */
+    std::string current;
+    /* Globals whose type the code relies on with the type they had */
+    std::unordered_map<std::size_t, Type> guards;
+    /* Deepest operand stack of the code being lowered, relative to its frame */
+    std::size_t maxDepth;
+    bool lowered;
+    /* Whether the last statement is an expression whose value is the result */
+    bool producesValue;
+    bool hasJumps;
+    bool hasResult;
+    bool instrumented;
+    /* Where a YIELDED run goes on */
+    State paused;
+    bool suspended;
+    /* Whether each shared global held a float when the run paused */
+    std::vector<bool> pausedTypes;
+    unsigned long long pairs[static_cast<int>(Opcode::COUNT)][static_cast<int>(Opcode::COUNT)];
+#ifdef CCC_PROFILER
+    Profiler* profiler;
+    Profiler::Counter* counters;
+    unsigned int untilSample;
+#endif
+};
+
+/* Code StackBasedVM::program lowered with the static area it had then. Nothing changes it afterwards and it does
+ * not refer to the AST, so any number of threads may run it at once, each through a StackContext of its own */
+class CompiledProgram {
+private:
+    friend class StackBasedVM;
+    friend class StackContext;
+    CompiledProgram() = default;
+
+    std::vector<StackBasedVM::Instruction> code;
+    std::size_t mainSize;
+    std::size_t mainLocals;
+    std::size_t stackSize;
+    std::size_t frameCount;
+    bool producesValue;
+    std::vector<VM::Value> variables;
+};
+
+/* Runs a CompiledProgram on an operand stack, frames and static area of its own, allocated once and reused by
+ * every run. A run starts from the static area of the program, so it never sees what another run stored */
+class StackContext : public VM {
+public:
+    StackContext(std::shared_ptr<const CompiledProgram> program);
+    ~StackContext() override;
+    bool run() override;
+    Status resume(const Budget& budget) override;
+    bool result(Token& out) const override;
+
+private:
+    std::shared_ptr<const CompiledProgram> program;
+    std::vector<Value> stack;
+    std::vector<StackBasedVM::Frame> frames;
+    std::vector<Value> variables;
+    bool allocated;
+    bool hasResult;
+    StackBasedVM::State paused;
+    bool suspended;
+};
+
+class RegisterVM : public VM {
+public:
+    RegisterVM(SyntaxTree& ast);
+    ~RegisterVM() override;
+    bool run() override;
+    bool result(Token& out) const override;
+
+private:
+    /* I suffixed forms take a literal as the right operand, R prefixed ones as the left */
+    enum class Opcode {
+        MOVI,
+        ADD,
+        ADDI,
+        SUB,
+        SUBI,
+        RSUBI,
+        MUL,
+        MULI,
+        DIV,
+        DIVI,
+        RDIVI
+    };
+
+    struct Instruction {
+        Opcode op;
+        unsigned int dst;
+        unsigned int lhs;
+        unsigned int rhs;
+        Value immediate;
+    };
+
+    struct Operand {
+        bool isImmediate;
+        unsigned int reg;
+        Value immediate;
+    };
+
+    bool compile(SyntaxTree::SyntaxTreeNode* node, unsigned int reg, Operand& out);
+
+    std::vector<Instruction> program;
+    std::vector<Value> registers;
+    /* Only a division fails a run, the instructions keep no nodes so it is reported at the whole expression */
+    Diagnostic divisionError;
+    bool compiled;
+    bool hasResult;
+};
+
+/* Evaluates input of only literals and arithmetic while it is parsed, with neither a tree nor code: every operation
+ * is applied the moment StreamingParser completes it, so the result is there once the end of input is read.
+ * The tokens are read by the one run */
+class StreamingVM : public VM, private PostfixSink {
+public:
+    StreamingVM(TokenSource& buffer);
+    ~StreamingVM() override;
+    bool run() override;
+    bool result(Token& out) const override;
+    /* Most operands held at once */
+    std::size_t peakDepth() const;
+
+private:
+    bool operand(const Token& literal, std::string& error) override;
+    bool apply(const Token& op, std::string& error) override;
 
-    SyntaxTree& ast;
-    std::unordered_map<Terminal, bool (ccc::StackBasedVM::*)(Token)> dispatchTable;
-    std::stack<Token> operands;
+    StreamingParser parser;
+    std::vector<Value> operands;
+    /* Bytes of operands charged to VM_STACK */
+    std::size_t charged;
+    std::size_t peak;
+    /* Value of the last statement */
+    Value last;
+    bool hasResult;
 };
 
 }
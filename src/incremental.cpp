@@ -0,0 +1,515 @@
+#include "incremental.h"
+#include <algorithm>
+#include <climits>
+
+static bool sameShape(const ccc::Token& lhs, const ccc::Token& rhs)
+{
+    auto shape = [](ccc::Terminal term) {
+        switch (term) {
+        case ccc::Terminal::ID:
+        case ccc::Terminal::INT_LITERAL:
+        case ccc::Terminal::FLOAT_LITERAL:
+            return 0;
+        case ccc::Terminal::ARITHMETIC_OP_PLUS:
+        case ccc::Terminal::ARITHMETIC_OP_MINUS:
+            return 1;
+        case ccc::Terminal::ARITHMETIC_OP_MULT:
+        case ccc::Terminal::ARITHMETIC_OP_DIV:
+            return 2;
+        default:
+            return -1;
+        }
+    };
+    return shape(lhs.term) >= 0 && shape(lhs.term) == shape(rhs.term);
+}
+
+/* Whether node is a value in an expression, the only place an id and a literal parse alike. Parameters hold their
+ * type, an assignment stores to its first child and a definition names its parameters */
+static bool isOperand(const ccc::SyntaxTree::SyntaxTreeNode* parent, const ccc::SyntaxTree::SyntaxTreeNode* node)
+{
+    if (node->children != nullptr)
+        return false;
+    if (parent == nullptr)
+        return true;
+    switch (parent->val.term) {
+    case ccc::Terminal::FUNCTION_DEF:
+        return false;
+    case ccc::Terminal::ASSIGNMENT_OP:
+        return parent->children != node;
+    default:
+        return true;
+    }
+}
+
+/* Net bracket depth of a token range, -1 when it closes a bracket it did not open */
+template <typename Iterator>
+static int bracketsNest(Iterator first, Iterator last)
+{
+    int depth = 0;
+    for (; first != last; ++first) {
+        if (first->term == ccc::Terminal::OPENING_BRACKET)
+            ++depth;
+        else if (first->term == ccc::Terminal::CLOSING_BRACKET && --depth < 0)
+            return -1;
+    }
+    return depth;
+}
+
+ccc::IncrementalCompiler::IncrementalCompiler()
+    : gapIndex { 0 }
+    , gapDelta { 0 }
+    , absolute { true }
+    , lexed { false }
+    , parsed { false }
+    , relexed { 0 }
+    , reparsed { 0 }
+    , shifted { 0 }
+{
+}
+
+bool ccc::IncrementalCompiler::load(const std::string& source)
+{
+    text = source;
+    return rebuild();
+}
+
+const std::string& ccc::IncrementalCompiler::source() const
+{
+    return text;
+}
+
+const std::vector<ccc::Token>& ccc::IncrementalCompiler::tokens()
+{
+    moveGap(tokenStream.size());
+    gapDelta = 0;
+    return tokenStream;
+}
+
+ccc::SyntaxTree& ccc::IncrementalCompiler::ast()
+{
+    if (!absolute) {
+        toAbsolute(tree.root, 0);
+        absolute = true;
+    }
+    return tree;
+}
+
+std::size_t ccc::IncrementalCompiler::relexedTokens() const
+{
+    return relexed;
+}
+
+std::size_t ccc::IncrementalCompiler::reparsedTokens() const
+{
+    return reparsed;
+}
+
+std::size_t ccc::IncrementalCompiler::shiftedSpans() const
+{
+    return shifted;
+}
+
+bool ccc::IncrementalCompiler::rebuild()
+{
+    tokenStream.clear();
+    examinedEnds.clear();
+    gapIndex = 0;
+    gapDelta = 0;
+    lexed = parsed = false;
+    shifted = 0;
+
+    std::size_t pos = 0;
+    std::size_t examined;
+    Token token { "", Terminal::ERROR };
+    Lexer::ScanResult res;
+    while ((res = lexer.next(text.data(), text.size(), true, pos, token, examined)) == Lexer::ScanResult::TOKEN) {
+        tokenStream.push_back(token);
+        examinedEnds.push_back(std::max(static_cast<unsigned int>(examined), examinedEnds.empty() ? 0 : examinedEnds.back()));
+    }
+    relexed = tokenStream.size();
+    if (res == Lexer::ScanResult::ERROR) {
+        tokenStream.clear();
+        examinedEnds.clear();
+        reparsed = 0;
+        return false;
+    }
+    lexed = true;
+    return reparseAll();
+}
+
+bool ccc::IncrementalCompiler::reparseAll()
+{
+    SyntaxTree::SyntaxTreeNode* root = nullptr;
+    parsed = parse(0, tokenStream.size(), root);
+    delete tree.root;
+    tree.root = root;
+    reparsed = tokenStream.size();
+    // edits work on relative spans, so the whole tree is converted once here rather than shifted on each edit
+    shifted += toRelative(tree.root, 0);
+    absolute = false;
+    return parsed;
+}
+
+bool ccc::IncrementalCompiler::parse(std::size_t first, std::size_t last, SyntaxTree::SyntaxTreeNode*& out)
+{
+    // filled before the parser runs on this thread, so it must not wait for room
+    SharedBuffer buffer { false };
+    for (std::size_t i = first; i < last; ++i) {
+        Token* token = new Token { tokenStream[i] };
+        token->offset = tokenOffset(i);
+        buffer.produce(token);
+    }
+    unsigned int end = last == 0 ? 0 : tokenOffset(last - 1) + tokenStream[last - 1].length;
+    buffer.produce(new Token { "eof", Terminal::FILE_END, end, 0 });
+
+    LL1Parser parser { buffer };
+    SyntaxTree st;
+    if (!parser.parse(st))
+        return false;
+    parser.convertToAst(st);
+    out = st.root;
+    st.root = nullptr;
+    return out != nullptr;
+}
+
+bool ccc::IncrementalCompiler::edit(std::size_t offset, std::size_t removed, const std::string& inserted)
+{
+    if (offset > text.size() || removed > text.size() - offset)
+        return false;
+    text.replace(offset, removed, inserted);
+    if (!lexed)
+        return rebuild();
+
+    long long delta = static_cast<long long>(inserted.size()) - static_cast<long long>(removed);
+    unsigned int oldEnd = static_cast<unsigned int>(offset + removed);
+    shifted = 0;
+
+    // tokens whose scan stopped before the edit are untouched
+    std::size_t first = std::lower_bound(examinedEnds.begin(), examinedEnds.begin() + gapIndex, offset) - examinedEnds.begin();
+    if (first == gapIndex) {
+        auto before = [this](unsigned int end, std::size_t offset) { return static_cast<unsigned int>(end + gapDelta) < offset; };
+        first = std::lower_bound(examinedEnds.begin() + gapIndex, examinedEnds.end(), offset, before) - examinedEnds.begin();
+    }
+    std::size_t pos = first == 0 ? 0 : tokenOffset(first - 1) + tokenStream[first - 1].length;
+
+    std::vector<Token> fresh;
+    std::vector<unsigned int> freshExamined;
+    std::size_t resync = first;
+    std::size_t examined;
+    Token token { "", Terminal::ERROR };
+    while (true) {
+        Lexer::ScanResult res = lexer.next(text.data(), text.size(), true, pos, token, examined);
+        if (res == Lexer::ScanResult::ERROR) {
+            tokenStream.clear();
+            examinedEnds.clear();
+            gapIndex = 0;
+            gapDelta = 0;
+            lexed = parsed = false;
+            relexed = fresh.size();
+            reparsed = 0;
+            return false;
+        }
+        if (res == Lexer::ScanResult::END) {
+            resync = tokenStream.size();
+            break;
+        }
+        // the automata are back in sync once a token starts where an old one past the edit did
+        while (resync < tokenStream.size() && (tokenOffset(resync) < oldEnd || tokenOffset(resync) + delta < token.offset))
+            ++resync;
+        if (resync < tokenStream.size() && tokenOffset(resync) + delta == token.offset)
+            break;
+        fresh.push_back(token);
+        freshExamined.push_back(static_cast<unsigned int>(examined));
+    }
+    relexed = fresh.size();
+    reparsed = 0;
+    // the damaged tokens get their real offsets, the ones past them only take the delta of this edit on top
+    shifted += moveGap(resync);
+
+    // tokens that merely looked at the edit often come back unchanged
+    std::size_t same = 0;
+    while (same < fresh.size() && first + same < resync && fresh[same] == tokenStream[first + same]
+        && fresh[same].offset == tokenStream[first + same].offset) {
+        examinedEnds[first + same] = freshExamined[same];
+        ++same;
+    }
+    fresh.erase(fresh.begin(), fresh.begin() + same);
+    freshExamined.erase(freshExamined.begin(), freshExamined.begin() + same);
+    first += same;
+    int nest = bracketsNest(tokenStream.begin() + first, tokenStream.begin() + resync);
+    bool balanced = nest >= 0 && nest == bracketsNest(fresh.begin(), fresh.end());
+
+    Shift shift { static_cast<unsigned int>(offset), oldEnd, delta, UINT_MAX, UINT_MAX, UINT_MAX, UINT_MAX };
+    bool single = resync - first == 1 && fresh.size() == 1;
+    Token replaced = single ? tokenStream[first] : token;
+    if (single) {
+        shift.replacedStart = replaced.offset;
+        shift.replacedEnd = replaced.offset + replaced.length;
+        shift.newStart = fresh[0].offset;
+        shift.newEnd = fresh[0].offset + fresh[0].length;
+    }
+
+    std::size_t damagedEnd = first + fresh.size();
+    if (resync - first == fresh.size()) {
+        std::copy(fresh.begin(), fresh.end(), tokenStream.begin() + first);
+        std::copy(freshExamined.begin(), freshExamined.end(), examinedEnds.begin() + first);
+    } else {
+        tokenStream.erase(tokenStream.begin() + first, tokenStream.begin() + resync);
+        tokenStream.insert(tokenStream.begin() + first, fresh.begin(), fresh.end());
+        examinedEnds.erase(examinedEnds.begin() + first, examinedEnds.begin() + resync);
+        examinedEnds.insert(examinedEnds.begin() + first, freshExamined.begin(), freshExamined.end());
+    }
+    gapIndex = damagedEnd;
+    gapDelta += delta;
+    for (std::size_t i = first - same; i < examinedEnds.size(); ++i) {
+        unsigned int previous = i == 0 ? 0 : examinedEnd(i - 1);
+        if (examinedEnd(i) >= previous && i >= damagedEnd)
+            break;
+        setExaminedEnd(i, std::max(examinedEnd(i), previous));
+    }
+
+    if (!parsed)
+        return reparseAll();
+    if (absolute) {
+        shifted += toRelative(tree.root, 0);
+        absolute = false;
+    }
+    if (fresh.empty() && resync == first) {
+        // only whitespace changed
+        shiftSpans(tree.root, 0, 0, shift);
+        return true;
+    }
+
+    if (single && sameShape(replaced, fresh[0])) {
+        SyntaxTree::SyntaxTreeNode* parent = nullptr;
+        SyntaxTree::SyntaxTreeNode** link = findToken(&tree.root, 0, replaced.offset, parent);
+        // an id only stands in for a literal where either is an operand
+        if (link != nullptr && sameShape((*link)->val, replaced)
+            && ((replaced.term == Terminal::ID) == (fresh[0].term == Terminal::ID) || isOperand(parent, *link))) {
+            shiftSpans(tree.root, 0, 0, shift);
+            unsigned int at = (*link)->val.offset;
+            (*link)->val = fresh[0];
+            (*link)->val.offset = at;
+            reparsed = 1;
+            return true;
+        }
+    }
+
+    // the old and new bracket pairs only line up when the damage nests the same way
+    std::size_t open = first;
+    std::size_t close = damagedEnd;
+    while (balanced && enclosingBrackets(open, close)) {
+        // the brackets of a call, a parameter list or a condition do not hold an expression of their own
+        Terminal before = open == 0 ? Terminal::ERROR : tokenStream[open - 1].term;
+        if (before == Terminal::ID || before == Terminal::CONTROL_FLOW_BRANCH || before == Terminal::CONTROL_FLOW_WHILE) {
+            ++close;
+            continue;
+        }
+        SyntaxTree::SyntaxTreeNode* sub = nullptr;
+        // brackets only hold a single expression, a statement list or an assignment fails the whole parse
+        if (!parse(open + 1, close, sub) || sub->next != nullptr || sub->val.term == Terminal::ASSIGNMENT_OP) {
+            delete sub;
+            ++close;
+            continue;
+        }
+        // the brackets lie outside the damage, so the old tree still has them at these offsets
+        unsigned int start = tokenOffset(open);
+        unsigned int end = static_cast<unsigned int>(tokenOffset(close) - delta + tokenStream[close].length);
+        unsigned int at;
+        SyntaxTree::SyntaxTreeNode** link = find(&tree.root, 0, start, end, at);
+        if (link == nullptr) {
+            delete sub;
+            break;
+        }
+        // the node starts before the edit, so at holds after the shift as well
+        shiftSpans(tree.root, 0, 0, shift);
+        SyntaxTree::SyntaxTreeNode* old = *link;
+        toRelative(sub->children, at);
+        sub->val.offset -= at;
+        sub->offset = old->offset;
+        sub->length = old->length;
+        sub->next = old->next;
+        old->next = nullptr;
+        *link = sub;
+        delete old;
+        reparsed = close - open - 1;
+        return true;
+    }
+    return reparseAll();
+}
+
+bool ccc::IncrementalCompiler::enclosingBrackets(std::size_t& open, std::size_t& close) const
+{
+    std::size_t depth = 0;
+    std::size_t i = open;
+    while (true) {
+        if (i == 0)
+            return false;
+        Terminal term = tokenStream[--i].term;
+        if (term == Terminal::CLOSING_BRACKET)
+            ++depth;
+        else if (term == Terminal::OPENING_BRACKET) {
+            if (depth == 0)
+                break;
+            --depth;
+        }
+    }
+    for (std::size_t j = close; j < tokenStream.size(); ++j) {
+        Terminal term = tokenStream[j].term;
+        if (term == Terminal::OPENING_BRACKET)
+            ++depth;
+        else if (term == Terminal::CLOSING_BRACKET) {
+            if (depth == 0) {
+                open = i;
+                close = j;
+                return true;
+            }
+            --depth;
+        }
+    }
+    return false;
+}
+
+unsigned int ccc::IncrementalCompiler::tokenOffset(std::size_t index) const
+{
+    unsigned int offset = tokenStream[index].offset;
+    return index < gapIndex ? offset : static_cast<unsigned int>(offset + gapDelta);
+}
+
+unsigned int ccc::IncrementalCompiler::examinedEnd(std::size_t index) const
+{
+    unsigned int end = examinedEnds[index];
+    return index < gapIndex ? end : static_cast<unsigned int>(end + gapDelta);
+}
+
+void ccc::IncrementalCompiler::setExaminedEnd(std::size_t index, unsigned int end)
+{
+    examinedEnds[index] = index < gapIndex ? end : static_cast<unsigned int>(end - gapDelta);
+}
+
+std::size_t ccc::IncrementalCompiler::moveGap(std::size_t index)
+{
+    std::size_t moved = 0;
+    if (gapDelta != 0) {
+        // the offsets wrap around like the delta does, so a token only ever takes back what it was given
+        long long step = index > gapIndex ? gapDelta : -gapDelta;
+        for (std::size_t i = std::min(index, gapIndex); i < std::max(index, gapIndex); ++i) {
+            tokenStream[i].offset = static_cast<unsigned int>(tokenStream[i].offset + step);
+            examinedEnds[i] = static_cast<unsigned int>(examinedEnds[i] + step);
+            ++moved;
+        }
+    }
+    gapIndex = index;
+    return moved;
+}
+
+ccc::SyntaxTree::SyntaxTreeNode** ccc::IncrementalCompiler::find(SyntaxTree::SyntaxTreeNode** link, unsigned int base, unsigned int start,
+    unsigned int end, unsigned int& at)
+{
+    // siblings follow each other in the source, so the first one that does not end before the range holds it or nothing does
+    for (; *link != nullptr; link = &(*link)->next) {
+        SyntaxTree::SyntaxTreeNode* node = *link;
+        base += node->offset;
+        if (base + node->length < end)
+            continue;
+        if (start < base)
+            return nullptr;
+        at = base;
+        if (base == start && base + node->length == end)
+            return link;
+        SyntaxTree::SyntaxTreeNode** inner = find(&node->children, base, start, end, at);
+        if (inner != nullptr)
+            return inner;
+        // redundant brackets such as ((E)) all end up around the same node
+        at = base;
+        return link;
+    }
+    return nullptr;
+}
+
+ccc::SyntaxTree::SyntaxTreeNode** ccc::IncrementalCompiler::findToken(SyntaxTree::SyntaxTreeNode** link, unsigned int base,
+    unsigned int offset, SyntaxTree::SyntaxTreeNode*& parent)
+{
+    for (; *link != nullptr; link = &(*link)->next) {
+        SyntaxTree::SyntaxTreeNode* node = *link;
+        base += node->offset;
+        if (base + node->length <= offset)
+            continue;
+        if (offset < base)
+            return nullptr;
+        if (base + node->val.offset == offset)
+            return link;
+        SyntaxTree::SyntaxTreeNode* holder = node;
+        SyntaxTree::SyntaxTreeNode** inner = findToken(&node->children, base, offset, holder);
+        if (inner != nullptr)
+            parent = holder;
+        return inner;
+    }
+    return nullptr;
+}
+
+void ccc::IncrementalCompiler::shiftSpans(SyntaxTree::SyntaxTreeNode* node, unsigned int oldBase, unsigned int newBase, const Shift& shift)
+{
+    auto moveStart = [&shift](unsigned int x) {
+        if (x == shift.replacedStart)
+            return shift.newStart;
+        return x >= shift.oldEnd ? static_cast<unsigned int>(x + shift.delta) : x;
+    };
+    auto moveEnd = [&shift](unsigned int x) {
+        if (x == shift.replacedEnd)
+            return shift.newEnd;
+        return x > shift.oldEnd ? static_cast<unsigned int>(x + shift.delta) : x;
+    };
+    // outside of these the spans either stay or all move by delta
+    unsigned int low = std::min(shift.start, shift.replacedStart);
+    unsigned int high = shift.replacedEnd == UINT_MAX ? shift.oldEnd : std::max(shift.oldEnd, shift.replacedEnd);
+    for (; node != nullptr; node = node->next) {
+        unsigned int start = oldBase + node->offset;
+        unsigned int end = start + node->length;
+        if (end < low) {
+            if (oldBase != newBase) {
+                node->offset = start - newBase;
+                ++shifted;
+            }
+            oldBase = newBase = start;
+            continue;
+        }
+        if (start > high) {
+            // the children and later siblings are relative to this node and move along with it
+            node->offset = static_cast<unsigned int>(start + shift.delta) - newBase;
+            ++shifted;
+            return;
+        }
+        unsigned int newStart = moveStart(start);
+        shiftSpans(node->children, start, newStart, shift);
+        node->val.offset = moveStart(start + node->val.offset) - newStart;
+        node->length = moveEnd(end) - newStart;
+        node->offset = newStart - newBase;
+        ++shifted;
+        oldBase = start;
+        newBase = newStart;
+    }
+}
+
+std::size_t ccc::IncrementalCompiler::toRelative(SyntaxTree::SyntaxTreeNode* node, unsigned int base)
+{
+    std::size_t converted = 0;
+    for (; node != nullptr; node = node->next) {
+        unsigned int start = node->offset;
+        converted += toRelative(node->children, start) + 1;
+        node->val.offset -= start;
+        node->offset = start - base;
+        base = start;
+    }
+    return converted;
+}
+
+void ccc::IncrementalCompiler::toAbsolute(SyntaxTree::SyntaxTreeNode* node, unsigned int base)
+{
+    for (; node != nullptr; node = node->next) {
+        base += node->offset;
+        node->offset = base;
+        node->val.offset += base;
+        toAbsolute(node->children, base);
+    }
+}
@@ -0,0 +1,436 @@
+#include "jit.h"
+#include <algorithm>
+#include <cstring>
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define JIT_SUPPORTED
+#endif
+
+#define RAX 0
+#define RCX 1
+#define RDX 2
+#define RSI 6
+#define RDI 7
+#define R8 8
+#define R9 9
+#define R10 10
+#define R11 11
+#define XMM0 0
+#define SLOT_SIZE 8
+
+namespace {
+
+/* rax and rdx are kept free for idiv, rdi holds where the index of a failed division is reported */
+const int intPool[] = { RCX, RSI, R8, R9, R10, R11 };
+
+}
+
+ccc::JitVM::JitVM(SyntaxTree& ast, Globals* globals)
+    : interpreter { ast, globals }
+    , compiled { false }
+    , resultIsFloat { false }
+    , lastResult { "", Terminal::ERROR }
+    , frameSlots { 0 }
+    , executable { nullptr }
+    , executableSize { 0 }
+{
+    lastError = interpreter.error();
+    compiled = compile(ast.root) && map();
+    code.clear();
+    values.clear();
+    needs.clear();
+    failJumps.clear();
+}
+
+ccc::JitVM::~JitVM()
+{
+#ifdef JIT_SUPPORTED
+    if (executable != nullptr)
+        munmap(executable, executableSize);
+#endif
+}
+
+bool ccc::JitVM::isCompiled() const
+{
+    return compiled;
+}
+
+bool ccc::JitVM::run()
+{
+    lastResult = { "", Terminal::ERROR };
+    if (!compiled) {
+        // control flow runs without leaving a result
+        if (!interpreter.run()) {
+            lastError = interpreter.error();
+            return false;
+        }
+        interpreter.result(lastResult);
+        return true;
+    }
+#ifdef JIT_SUPPORTED
+    unsigned int failed = 0;
+    Token res = resultIsFloat ? makeOperand(reinterpret_cast<double (*)(unsigned int*)>(executable)(&failed))
+                              : makeOperand(reinterpret_cast<long long (*)(unsigned int*)>(executable)(&failed));
+    // an integer division the interpreter would fail on jumped out instead of trapping, failed is one past its index
+    if (failed != 0) {
+        const SyntaxTree::SyntaxTreeNode* division = divisions[failed - 1];
+        lastError = Diagnostic { "division by zero", division->offset, division->length };
+        return false;
+    }
+    lastError = Diagnostic {};
+    lastResult = res;
+    return true;
+#else
+    return false;
+#endif
+}
+
+ccc::VM::Status ccc::JitVM::resume(const Budget& budget)
+{
+    if (compiled)
+        return run() ? Status::FINISHED : Status::FAILED;
+    lastResult = { "", Terminal::ERROR };
+    Status res = interpreter.resume(budget);
+    lastError = interpreter.error();
+    if (res == Status::FINISHED)
+        interpreter.result(lastResult);
+    return res;
+}
+
+bool ccc::JitVM::result(Token& out) const
+{
+    if (lastResult.term == Terminal::ERROR)
+        return false;
+    out = lastResult;
+    return true;
+}
+
+bool ccc::JitVM::compile(SyntaxTree::SyntaxTreeNode* node)
+{
+#ifndef JIT_SUPPORTED
+    return false;
+#endif
+    if (node == nullptr || node->next != nullptr)
+        return false;
+    std::fill(std::begin(intFree), std::end(intFree), false);
+    std::fill(std::begin(floatFree), std::end(floatFree), false);
+    for (int reg : intPool)
+        intFree[reg] = true;
+    for (int reg = XMM0 + 1; reg < 16; ++reg)
+        floatFree[reg] = true;
+
+    // sub rsp, imm32 patched once the number of spill slots is known
+    emit(0x48);
+    emit(0x81);
+    emit(0xEC);
+    std::size_t frameOffset = code.size();
+    emit32(0);
+
+    if (!gen(node) || values.size() != 1)
+        return false;
+    load(0);
+    if (values[0].reg < 0)
+        return false;
+    resultIsFloat = values[0].isFloat;
+    if (resultIsFloat)
+        emitSseOp(0xF2, 0x10, XMM0, values[0].reg, false); // movsd xmm0, reg
+    else
+        emitIntOp(0x89, values[0].reg, RAX); // mov rax, reg
+
+    // keep rsp 16-byte aligned even though nothing is called
+    unsigned int frameSize = static_cast<unsigned int>((frameSlots * SLOT_SIZE + 15) & ~std::size_t { 15 }) + 8;
+    std::memcpy(code.data() + frameOffset, &frameSize, sizeof(frameSize));
+    emitEpilogue(frameSize);
+
+    // failed: mov [rdi], edx
+    std::size_t failed = code.size();
+    emit(0x89);
+    emit(0x17);
+    emitEpilogue(frameSize);
+    for (std::size_t jump : failJumps) {
+        unsigned int rel = static_cast<unsigned int>(failed - (jump + 4));
+        std::memcpy(code.data() + jump, &rel, sizeof(rel));
+    }
+    return true;
+}
+
+unsigned int ccc::JitVM::need(SyntaxTree::SyntaxTreeNode* node)
+{
+    if (node->children == nullptr)
+        return 1;
+    auto cached = needs.find(node);
+    if (cached != needs.end())
+        return cached->second;
+    unsigned int left = need(node->children);
+    unsigned int right = node->children->next == nullptr ? 0 : need(node->children->next);
+    unsigned int res = left == right ? left + 1 : std::max(left, right);
+    needs[node] = res;
+    return res;
+}
+
+bool ccc::JitVM::gen(SyntaxTree::SyntaxTreeNode* node)
+{
+    switch (node->val.term) {
+    case Terminal::INT_LITERAL: {
+        int reg = allocate(false);
+        if (reg < 0)
+            return false;
+        emitRex(true, 0, reg);
+        emit(0xB8 + (reg & 7)); // mov reg, imm64
+        emit64(static_cast<unsigned long long>(node->val.intValue));
+        values.push_back({ false, reg });
+        break;
+    }
+    case Terminal::FLOAT_LITERAL: {
+        int reg = allocate(true);
+        if (reg < 0)
+            return false;
+        unsigned long long bits;
+        std::memcpy(&bits, &node->val.floatValue, sizeof(bits));
+        emit(0x48);
+        emit(0xB8); // mov rax, imm64
+        emit64(bits);
+        emitSseOp(0x66, 0x6E, reg, RAX, true); // movq reg, rax
+        values.push_back({ true, reg });
+        break;
+    }
+    case Terminal::ARITHMETIC_OP_PLUS:
+    case Terminal::ARITHMETIC_OP_MINUS:
+    case Terminal::ARITHMETIC_OP_MULT:
+    case Terminal::ARITHMETIC_OP_DIV: {
+        SyntaxTree::SyntaxTreeNode* left = node->children;
+        SyntaxTree::SyntaxTreeNode* right = left == nullptr ? nullptr : left->next;
+        if (right == nullptr || right->next != nullptr)
+            return false;
+
+        // Sethi-Ullman order: the operand needing more registers goes first
+        bool rightFirst = need(right) > need(left);
+        if (!gen(rightFirst ? right : left) || !gen(rightFirst ? left : right))
+            return false;
+        std::size_t lhs = values.size() - (rightFirst ? 1 : 2);
+        std::size_t rhs = values.size() - (rightFirst ? 2 : 1);
+
+        load(lhs);
+        load(rhs);
+        bool isFloat = values[lhs].isFloat || values[rhs].isFloat;
+        if (isFloat) {
+            toFloat(lhs);
+            toFloat(rhs);
+        }
+        int dst = values[lhs].reg;
+        int src = values[rhs].reg;
+        if (dst < 0 || src < 0)
+            return false;
+
+        if (isFloat) {
+            unsigned char opcode = node->val.term == Terminal::ARITHMETIC_OP_PLUS ? 0x58
+                : node->val.term == Terminal::ARITHMETIC_OP_MINUS           ? 0x5C
+                : node->val.term == Terminal::ARITHMETIC_OP_MULT            ? 0x59
+                                                                            : 0x5E;
+            emitSseOp(0xF2, opcode, dst, src, false);
+        } else if (node->val.term == Terminal::ARITHMETIC_OP_PLUS) {
+            emitIntOp(0x01, src, dst); // add dst, src
+        } else if (node->val.term == Terminal::ARITHMETIC_OP_MINUS) {
+            emitIntOp(0x29, src, dst); // sub dst, src
+        } else if (node->val.term == Terminal::ARITHMETIC_OP_MULT) {
+            emitRex(true, dst, src);
+            emit(0x0F);
+            emit(0xAF); // imul dst, src
+            emit(0xC0 | (dst & 7) << 3 | (src & 7));
+        } else {
+            // a zero divisor and the lowest value by -1 fail the run, idiv would trap on them
+            divisions.push_back(node);
+            emit(0xBA); // mov edx, imm32
+            emit32(static_cast<unsigned int>(divisions.size()));
+            emitIntOp(0x85, src, src); // test src, src
+            emitFailJump(0x84); // jz failed
+            emitRex(true, 0, src);
+            emit(0x83); // cmp src, -1
+            emit(0xC0 | 7 << 3 | (src & 7));
+            emit(0xFF);
+            emit(0x75); // jne divide
+            std::size_t skip = code.size();
+            emit(0);
+            emit(0x48);
+            emit(0xB8); // mov rax, imm64
+            emit64(0x8000000000000000ULL);
+            emitIntOp(0x39, RAX, dst); // cmp dst, rax
+            emitFailJump(0x84); // je failed
+            code[skip] = static_cast<unsigned char>(code.size() - skip - 1);
+            emitIntOp(0x89, dst, RAX); // mov rax, dst
+            emit(0x48);
+            emit(0x99); // cqo
+            emitRex(true, 0, src);
+            emit(0xF7); // idiv src
+            emit(0xC0 | 7 << 3 | (src & 7));
+            emitIntOp(0x89, RAX, dst); // mov dst, rax
+        }
+
+        StackValue res { isFloat, dst };
+        release(values[rhs]);
+        values.pop_back();
+        values.pop_back();
+        values.push_back(res);
+        break;
+    }
+    default:
+        return false;
+    }
+    frameSlots = std::max(frameSlots, values.size());
+    return true;
+}
+
+int ccc::JitVM::allocate(bool isFloat)
+{
+    bool* freeRegs = isFloat ? floatFree : intFree;
+    for (int reg = 0; reg < 16; ++reg)
+        if (freeRegs[reg]) {
+            freeRegs[reg] = false;
+            return reg;
+        }
+    // spill the value that will be consumed last, never the operands on top
+    for (std::size_t i = 0; i + 2 < values.size(); ++i)
+        if (values[i].isFloat == isFloat && values[i].reg >= 0) {
+            int reg = values[i].reg;
+            spill(i);
+            freeRegs[reg] = false;
+            return reg;
+        }
+    return -1;
+}
+
+void ccc::JitVM::release(const StackValue& value)
+{
+    if (value.reg >= 0)
+        (value.isFloat ? floatFree : intFree)[value.reg] = true;
+}
+
+void ccc::JitVM::spill(std::size_t index)
+{
+    StackValue& value = values[index];
+    if (value.isFloat)
+        emitStackSlot(0xF2, 0x11, value.reg, index, true); // movsd [rsp + slot], reg
+    else
+        emitStackSlot(0, 0x89, value.reg, index, false); // mov [rsp + slot], reg
+    release(value);
+    value.reg = -1;
+}
+
+void ccc::JitVM::load(std::size_t index)
+{
+    if (values[index].reg >= 0)
+        return;
+    bool isFloat = values[index].isFloat;
+    int reg = allocate(isFloat);
+    if (reg < 0)
+        return;
+    if (isFloat)
+        emitStackSlot(0xF2, 0x10, reg, index, true); // movsd reg, [rsp + slot]
+    else
+        emitStackSlot(0, 0x8B, reg, index, false); // mov reg, [rsp + slot]
+    values[index].reg = reg;
+}
+
+void ccc::JitVM::toFloat(std::size_t index)
+{
+    if (values[index].isFloat || values[index].reg < 0)
+        return;
+    int reg = allocate(true);
+    if (reg < 0)
+        return;
+    emitSseOp(0xF2, 0x2A, reg, values[index].reg, true); // cvtsi2sd reg, src
+    release(values[index]);
+    values[index] = { true, reg };
+}
+
+bool ccc::JitVM::map()
+{
+#ifdef JIT_SUPPORTED
+    std::size_t pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    executableSize = (code.size() + pageSize - 1) / pageSize * pageSize;
+    void* memory = mmap(nullptr, executableSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+        return false;
+    std::memcpy(memory, code.data(), code.size());
+    if (mprotect(memory, executableSize, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, executableSize);
+        return false;
+    }
+    executable = memory;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void ccc::JitVM::emit(unsigned char byte)
+{
+    code.push_back(byte);
+}
+
+void ccc::JitVM::emit32(unsigned int value)
+{
+    for (int i = 0; i < 4; ++i)
+        emit(static_cast<unsigned char>(value >> (8 * i)));
+}
+
+void ccc::JitVM::emit64(unsigned long long value)
+{
+    for (int i = 0; i < 8; ++i)
+        emit(static_cast<unsigned char>(value >> (8 * i)));
+}
+
+void ccc::JitVM::emitFailJump(unsigned char condition)
+{
+    emit(0x0F);
+    emit(condition);
+    failJumps.push_back(code.size());
+    emit32(0);
+}
+
+void ccc::JitVM::emitEpilogue(unsigned int frameSize)
+{
+    emit(0x48);
+    emit(0x81);
+    emit(0xC4); // add rsp, imm32
+    emit32(frameSize);
+    emit(0xC3);
+}
+
+void ccc::JitVM::emitRex(bool wide, int reg, int rm)
+{
+    unsigned char rex = 0x40 | (wide ? 0x08 : 0) | (reg & 8 ? 0x04 : 0) | (rm & 8 ? 0x01 : 0);
+    if (rex != 0x40)
+        emit(rex);
+}
+
+void ccc::JitVM::emitIntOp(unsigned char opcode, int reg, int rm)
+{
+    emitRex(true, reg, rm);
+    emit(opcode);
+    emit(0xC0 | (reg & 7) << 3 | (rm & 7));
+}
+
+void ccc::JitVM::emitSseOp(unsigned char prefix, unsigned char opcode, int reg, int rm, bool wide)
+{
+    emit(prefix);
+    emitRex(wide, reg, rm);
+    emit(0x0F);
+    emit(opcode);
+    emit(0xC0 | (reg & 7) << 3 | (rm & 7));
+}
+
+void ccc::JitVM::emitStackSlot(unsigned char prefix, unsigned char opcode, int reg, std::size_t index, bool isFloat)
+{
+    if (prefix != 0)
+        emit(prefix);
+    emitRex(!isFloat, reg, 0);
+    if (isFloat)
+        emit(0x0F);
+    emit(opcode);
+    // [rsp + disp32] needs a SIB byte
+    emit(0x80 | (reg & 7) << 3 | 4);
+    emit(0x24);
+    emit32(static_cast<unsigned int>(index * SLOT_SIZE));
+}
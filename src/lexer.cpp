@@ -1,4 +1,7 @@
 #include "lexer.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
 #include <cwchar>
 #include <iostream>
 #include <memory>
@@ -7,15 +10,41 @@
 
 #define INPUT_BUFFER_SIZE 4096
 
-ccc::Token::Token(std::string lexeme, Terminal term)
+ccc::Token::Token(std::string lexeme, Terminal term, unsigned int offset, unsigned int length)
     : lexeme(lexeme)
     , term(term)
+    , offset(offset)
+    , length(length)
+    , intValue(0)
+{
+}
+
+ccc::Token::Token(long long value)
+    : term(Terminal::INT_LITERAL)
+    , offset(0)
+    , length(0)
+    , intValue(value)
+{
+}
+
+ccc::Token::Token(double value)
+    : term(Terminal::FLOAT_LITERAL)
+    , offset(0)
+    , length(0)
+    , floatValue(value)
 {
 }
 
 bool ccc::Token::operator==(const Token& other) const
 {
-    return other.lexeme == lexeme;
+    if (other.lexeme != lexeme)
+        return false;
+    // computed values have no lexeme to compare
+    if (term == Terminal::INT_LITERAL && other.term == Terminal::INT_LITERAL)
+        return other.intValue == intValue;
+    if (term == Terminal::FLOAT_LITERAL && other.term == Terminal::FLOAT_LITERAL)
+        return memcmp(&other.floatValue, &floatValue, sizeof(double)) == 0;
+    return true;
 }
 
 bool ccc::FiniteAutomaton::transition(char input)
@@ -150,6 +179,47 @@ ccc::Terminal ccc::BuiltinTypeAutomaton::getTerminal() const
     }
 }
 
+ccc::StorageSpecifierAutomaton::StorageSpecifierAutomaton()
+{
+    transitionTable.reserve(10);
+    transitionTable.emplace('s', std::unordered_map<unsigned int, unsigned int> {});
+    transitionTable['s'].emplace(0, 1);
+    transitionTable.emplace('t', std::unordered_map<unsigned int, unsigned int> {});
+    transitionTable['t'].emplace(1, 2);
+    transitionTable.emplace('a', std::unordered_map<unsigned int, unsigned int> {});
+    transitionTable['a'].emplace(2, 3);
+    transitionTable['t'].emplace(3, 4);
+    transitionTable.emplace('i', std::unordered_map<unsigned int, unsigned int> {});
+    transitionTable['i'].emplace(4, 5);
+    transitionTable.emplace('c', std::unordered_map<unsigned int, unsigned int> {});
+    transitionTable['c'].emplace(5, 6);
+    transitionTable.emplace('e', std::unordered_map<unsigned int, unsigned int> {});
+    transitionTable['e'].emplace(0, 7);
+    transitionTable.emplace('x', std::unordered_map<unsigned int, unsigned int> {});
+    transitionTable['x'].emplace(7, 8);
+    transitionTable['t'].emplace(8, 9);
+    transitionTable['e'].emplace(9, 10);
+    transitionTable.emplace('r', std::unordered_map<unsigned int, unsigned int> {});
+    transitionTable['r'].emplace(10, 11);
+    transitionTable.emplace('n', std::unordered_map<unsigned int, unsigned int> {});
+    transitionTable['n'].emplace(11, 12);
+
+    acceptingStates.insert(6);
+    acceptingStates.insert(12);
+}
+
+ccc::Terminal ccc::StorageSpecifierAutomaton::getTerminal() const
+{
+    switch (currentState) {
+    case 6:
+        return Terminal::STORAGE_STATIC;
+    case 12:
+        return Terminal::STORAGE_EXTERN;
+    default:
+        return Terminal::ERROR;
+    }
+}
+
 ccc::IntLiteralAutomaton::IntLiteralAutomaton()
 {
     transitionTable.reserve(10);
@@ -200,6 +270,19 @@ ccc::Terminal ccc::SemicolonAutomaton::getTerminal() const
     return Terminal::SEMICOLON;
 }
 
+ccc::CommaAutomaton::CommaAutomaton()
+{
+    transitionTable.emplace(',', std::unordered_map<unsigned int, unsigned int> {});
+    transitionTable[','].emplace(0, 1);
+
+    acceptingStates.insert(1);
+}
+
+ccc::Terminal ccc::CommaAutomaton::getTerminal() const
+{
+    return Terminal::COMMA;
+}
+
 ccc::ScopeAutomaton::ScopeAutomaton()
 {
     transitionTable.emplace('{', std::unordered_map<unsigned int, unsigned int> {});
@@ -248,7 +331,7 @@ ccc::Terminal ccc::BracketAutomaton::getTerminal() const
 
 ccc::ControlFlowAutomaton::ControlFlowAutomaton()
 {
-    transitionTable.reserve(7);
+    transitionTable.reserve(11);
     transitionTable.emplace('i', std::unordered_map<unsigned int, unsigned int> {});
     transitionTable['i'].emplace(0, 1);
     transitionTable.emplace('f', std::unordered_map<unsigned int, unsigned int> {});
@@ -263,18 +346,31 @@ ccc::ControlFlowAutomaton::ControlFlowAutomaton()
     transitionTable['l'].emplace(5, 6);
     transitionTable.emplace('e', std::unordered_map<unsigned int, unsigned int> {});
     transitionTable['e'].emplace(6, 7);
+    transitionTable.emplace('r', std::unordered_map<unsigned int, unsigned int> {});
+    transitionTable['r'].emplace(0, 8);
+    transitionTable['e'].emplace(8, 9);
+    transitionTable.emplace('t', std::unordered_map<unsigned int, unsigned int> {});
+    transitionTable['t'].emplace(9, 10);
+    transitionTable.emplace('u', std::unordered_map<unsigned int, unsigned int> {});
+    transitionTable['u'].emplace(10, 11);
+    transitionTable['r'].emplace(11, 12);
+    transitionTable.emplace('n', std::unordered_map<unsigned int, unsigned int> {});
+    transitionTable['n'].emplace(12, 13);
 
     acceptingStates.insert(2);
     acceptingStates.insert(7);
+    acceptingStates.insert(13);
 }
 
 ccc::Terminal ccc::ControlFlowAutomaton::getTerminal() const
 {
     switch (currentState) {
-    case 1:
-        return Terminal::CONTROL_FLOW_BRANCH;
     case 2:
+        return Terminal::CONTROL_FLOW_BRANCH;
+    case 7:
         return Terminal::CONTROL_FLOW_WHILE;
+    case 13:
+        return Terminal::CONTROL_FLOW_RETURN;
     default:
         return Terminal::ERROR;
     }
@@ -327,34 +423,12 @@ ccc::Terminal ccc::IdAutomaton::getTerminal() const
 }
 
 ccc::Lexer::Lexer()
-{
-}
-
-static void reloadInputBuffer(std::streamsize& current, std::streamsize starting, std::streamsize& numReadChars, char*& inputBuffer, std::ifstream& file)
-{
-    std::streamsize end = current - starting + 1;
-    memcpy(inputBuffer, inputBuffer + starting, end);
-    file.read(inputBuffer + end, INPUT_BUFFER_SIZE - end);
-    numReadChars = end + file.gcount() - 1;
-    current = end;
-}
-
-bool ccc::Lexer::run(const std::string& filePath, SharedBuffer& buffer)
-{
-    // TODO: dedicated error codes instead of bool
-    std::ifstream file;
-    file.open(filePath);
-    if (!file.is_open())
-        return false;
-
-    char* inputBuffer = new char[INPUT_BUFFER_SIZE];
-    file.read(inputBuffer, INPUT_BUFFER_SIZE);
-    std::streamsize numReadChars = file.gcount() - 1;
-
-    std::vector<FiniteAutomaton*> automata {
+    : automata {
         new StringLiteralAutomaton {},
         new BuiltinTypeAutomaton {},
+        new StorageSpecifierAutomaton {},
         new SemicolonAutomaton {},
+        new CommaAutomaton {},
         new ScopeAutomaton {},
         new BracketAutomaton {},
         new ControlFlowAutomaton {},
@@ -364,39 +438,203 @@ bool ccc::Lexer::run(const std::string& filePath, SharedBuffer& buffer)
         new FloatLiteralAutomaton {},
         new IntLiteralAutomaton {},
         new IdAutomaton {}
-    };
+    }
+{
+}
+
+ccc::Lexer::~Lexer()
+{
+    for (FiniteAutomaton* dfa : automata)
+        delete dfa;
+}
 
-    for (std::streamsize i = 0; i < numReadChars; ++i) {
-        // TODO: support windows CR-LF for new line
-        if (inputBuffer[i] == ' ' || inputBuffer[i] == '\t' || inputBuffer[i] == '\n')
+ccc::Lexer::ScanResult ccc::Lexer::next(const char* input, std::size_t length, bool final, std::size_t& pos, Token& out, std::size_t& examined)
+{
+    while (pos < length && (input[pos] == ' ' || input[pos] == '\t' || input[pos] == '\n' || input[pos] == '\r'))
+        ++pos;
+    examined = pos;
+    if (pos == length)
+        return final ? ScanResult::END : ScanResult::MORE_INPUT;
+
+    // the first automaton to stop in an accepting state wins
+    for (FiniteAutomaton* dfa : automata) {
+        std::size_t i = pos;
+        while (i < length && dfa->transition(input[i]))
+            ++i;
+        if (i == length && !final) {
+            dfa->currentState = 0;
+            return ScanResult::MORE_INPUT;
+        }
+        examined = std::max(examined, i);
+        bool accepted = dfa->acceptingStates.find(dfa->currentState) != dfa->acceptingStates.end();
+        Terminal term = dfa->getTerminal();
+        dfa->currentState = 0;
+        // keywords are only whole words, "iffy" is an identifier and not if followed by fy
+        if (accepted && std::isalpha(static_cast<unsigned char>(input[pos])) && i < length && std::isalnum(static_cast<unsigned char>(input[i])))
             continue;
-        for (FiniteAutomaton* dfa : automata) {
-            std::streamsize starting = i;
-            while (dfa->transition(inputBuffer[i])) {
-                if (i == INPUT_BUFFER_SIZE - 1 && !file.eof())
-                    reloadInputBuffer(i, starting, numReadChars, inputBuffer, file);
-                else if (i++ == numReadChars - 1)
-                    break;
+        if (accepted) {
+            out = Token { std::string(input + pos, i - pos), term, static_cast<unsigned int>(pos), static_cast<unsigned int>(i - pos) };
+            if (!decode(input + pos, input + i, out)) {
+                out.term = Terminal::ERROR;
+                return ScanResult::ERROR;
             }
-            if (dfa->acceptingStates.find(dfa->currentState) != dfa->acceptingStates.end()) {
-                buffer.produce(new Token {
-                    std::string(inputBuffer + starting, i - starting) /* Copy elision */,
-                    dfa->getTerminal() });
-                --i;
-                dfa->currentState = 0;
-                break;
-            }
-            dfa->currentState = 0;
-            if (dfa->getTerminal() == Terminal::ID)
-                return false;
-            i = starting;
+            pos = i;
+            return ScanResult::TOKEN;
         }
     }
-    buffer.produce(new Token { "eof", Terminal::FILE_END });
+    out = Token { std::string(1, input[pos]), Terminal::ERROR, static_cast<unsigned int>(pos), 1 };
+    return ScanResult::ERROR;
+}
 
-    delete[] inputBuffer;
-    for (FiniteAutomaton* dfa : automata)
-        delete dfa;
+bool ccc::Lexer::decode(const char* first, const char* last, Token& token)
+{
+    std::from_chars_result res;
+    if (token.term == Terminal::INT_LITERAL)
+        res = std::from_chars(first, last, token.intValue);
+    else if (token.term == Terminal::FLOAT_LITERAL)
+        res = std::from_chars(first, last, token.floatValue);
+    else
+        return true;
+    // out of range literals are errors rather than silently wrapped or rounded to infinity
+    return res.ec == std::errc {} && res.ptr == last;
+}
+
+bool ccc::Lexer::run(const std::string& filePath, SharedBuffer& buffer)
+{
+    // TODO: dedicated error codes instead of bool
+    Tracer::Scope lexing { "lex" };
+    std::ifstream file;
+    file.open(filePath, std::ios::binary);
+    if (!file.is_open()) {
+        // the parser is already waiting on the buffer
+        buffer.produce(new Token { filePath, Terminal::ERROR });
+        return false;
+    }
+
+    std::vector<char> inputBuffer(INPUT_BUFFER_SIZE);
+    MemoryStats::charge(MemoryStats::Subsystem::LEXER_BUFFER, inputBuffer.size());
+    std::size_t numReadChars = 0;
+    std::size_t current = 0;
+    std::size_t base = 0;
+    bool final = false;
+    Token token { "", Terminal::ERROR };
+    std::size_t examined;
+
+    while (true) {
+        ScanResult res = next(inputBuffer.data(), numReadChars, final, current, token, examined);
+        if (res == ScanResult::TOKEN) {
+            token.offset += static_cast<unsigned int>(base);
+            buffer.produce(new Token { std::move(token) });
+        } else if (res == ScanResult::END) {
+            break;
+        } else if (res == ScanResult::ERROR) {
+            token.offset += static_cast<unsigned int>(base);
+            buffer.produce(new Token { std::move(token) });
+            MemoryStats::release(MemoryStats::Subsystem::LEXER_BUFFER, inputBuffer.size());
+            return false;
+        } else {
+            // keep the unfinished token and refill the rest of the window
+            memmove(inputBuffer.data(), inputBuffer.data() + current, numReadChars - current);
+            numReadChars -= current;
+            base += current;
+            current = 0;
+            if (numReadChars == inputBuffer.size()) {
+                // a token longer than the budget allows ends the compile, the parser reports the budget
+                if (!MemoryStats::allocate(MemoryStats::Subsystem::LEXER_BUFFER, inputBuffer.size())) {
+                    buffer.produce(new Token { "", Terminal::ERROR, static_cast<unsigned int>(base), 0 });
+                    MemoryStats::release(MemoryStats::Subsystem::LEXER_BUFFER, inputBuffer.size());
+                    return false;
+                }
+                inputBuffer.resize(inputBuffer.size() * 2);
+            }
+            Tracer::Scope refill { "refill window" };
+            file.read(inputBuffer.data() + numReadChars, inputBuffer.size() - numReadChars);
+            final = static_cast<std::size_t>(file.gcount()) < inputBuffer.size() - numReadChars;
+            numReadChars += file.gcount();
+        }
+    }
+    buffer.produce(new Token { "eof", Terminal::FILE_END, static_cast<unsigned int>(base + numReadChars), 0 });
+    MemoryStats::release(MemoryStats::Subsystem::LEXER_BUFFER, inputBuffer.size());
 
     return true;
 }
+
+ccc::PullLexer::PullLexer(Lexer& lexer, const std::string& filePath)
+    : lexer { lexer }
+    , input { nullptr }
+    , length { 0 }
+    , pos { 0 }
+    , current { "", Terminal::ERROR }
+    , scanned { false }
+    , done { false }
+{
+    std::ifstream file { filePath, std::ios::binary | std::ios::ate };
+    if (!file.is_open()) {
+        current = Token { filePath, Terminal::ERROR };
+        scanned = true;
+        done = true;
+        return;
+    }
+    std::size_t size = static_cast<std::size_t>(file.tellg());
+    // the parser reports the budget for an empty ERROR token
+    if (!MemoryStats::allocate(MemoryStats::Subsystem::LEXER_BUFFER, size)) {
+        scanned = true;
+        done = true;
+        return;
+    }
+    owned.resize(size);
+    file.seekg(0);
+    file.read(owned.data(), size);
+    input = owned.data();
+    length = size;
+}
+
+ccc::PullLexer::PullLexer(Lexer& lexer, const char* source, std::size_t length)
+    : lexer { lexer }
+    , input { source }
+    , length { length }
+    , pos { 0 }
+    , current { "", Terminal::ERROR }
+    , scanned { false }
+    , done { false }
+{
+}
+
+ccc::PullLexer::~PullLexer()
+{
+    MemoryStats::release(MemoryStats::Subsystem::LEXER_BUFFER, owned.size());
+}
+
+void ccc::PullLexer::reset(const char* source, std::size_t length)
+{
+    MemoryStats::release(MemoryStats::Subsystem::LEXER_BUFFER, owned.size());
+    owned = std::vector<char> {};
+    input = source;
+    this->length = length;
+    pos = 0;
+    scanned = false;
+    done = false;
+}
+
+ccc::Token* ccc::PullLexer::consume()
+{
+    if (scanned)
+        return &current;
+    std::size_t examined;
+    Lexer::ScanResult res = lexer.next(input, length, true, pos, current, examined);
+    if (res == Lexer::ScanResult::END)
+        current = Token { "eof", Terminal::FILE_END, static_cast<unsigned int>(length), 0 };
+    done = res != Lexer::ScanResult::TOKEN;
+    scanned = true;
+    return &current;
+}
+
+void ccc::PullLexer::pop()
+{
+    if (!done)
+        scanned = false;
+}
+
+void ccc::PullLexer::close()
+{
+}
@@ -0,0 +1,160 @@
+#include "lines.h"
+#include "diagnostics.h"
+#include "lexer.h"
+#include "parser.h"
+#include "vm.h"
+#include <algorithm>
+#include <charconv>
+#include <limits>
+#include <thread>
+
+/* Enough lines that taking a chunk and writing its output cost little next to evaluating it */
+#define DEFAULT_CHUNK_LINES 1024
+/* Chunks each worker may finish ahead of the one being written */
+#define CHUNKS_AHEAD 4
+
+const std::size_t ccc::LineRunner::defaultChunkLines = DEFAULT_CHUNK_LINES;
+
+/* Numbers go through to_chars, ints exactly and floats in their shortest form that reads back the same */
+static void appendValue(const ccc::Token& value, std::string& output)
+{
+    char digits[32];
+    std::to_chars_result res = value.term == ccc::Terminal::FLOAT_LITERAL ? std::to_chars(digits, digits + sizeof(digits), value.floatValue)
+                                                                         : std::to_chars(digits, digits + sizeof(digits), value.intValue);
+    output.append(digits, res.ptr);
+}
+
+static bool blank(const char* line, std::size_t length)
+{
+    for (std::size_t i = 0; i < length; ++i)
+        if (line[i] != ' ' && line[i] != '\t' && line[i] != '\r' && line[i] != '\n')
+            return false;
+    return true;
+}
+
+/* Appends the output line of one input line, the parser reads from tokens and outlives every line */
+static bool evaluateLine(ccc::PullLexer& tokens, ccc::LL1Parser& parser, const char* line, std::size_t length, std::string& output)
+{
+    if (blank(line, length)) {
+        output += '\n';
+        return true;
+    }
+    tokens.reset(line, length);
+    ccc::SyntaxTree ast;
+    if (!parser.parse(ast)) {
+        output += "error: " + parser.error().message + '\n';
+        return false;
+    }
+    parser.convertToAst(ast);
+    // a line shares nothing with the others, not even its variables
+    ccc::Globals globals;
+    ccc::StackBasedVM vm { ast, &globals };
+    ccc::Token value { "", ccc::Terminal::ERROR };
+    if (!vm.run()) {
+        output += "error: " + (vm.error().message.empty() ? std::string { "evaluation failed" } : vm.error().message) + '\n';
+        return false;
+    }
+    if (vm.result(value))
+        appendValue(value, output);
+    else
+        output += "ok";
+    output += '\n';
+    return true;
+}
+
+ccc::LineRunner::LineRunner(std::size_t threads, std::size_t chunkLines)
+    : threads { threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency()) }
+    , chunkLines { std::max<std::size_t>(chunkLines, 1) }
+    , source { nullptr }
+    , out { nullptr }
+    , taken { 0 }
+    , written { 0 }
+    , window { 0 }
+    , writing { false }
+    , failed { 0 }
+{
+}
+
+bool ccc::LineRunner::run(const char* source, std::size_t length, std::ostream& out)
+{
+    failed = 0;
+    if (length >= std::numeric_limits<unsigned int>::max())
+        return false;
+    // a line ends after its '\n', a last line without one still counts
+    starts.assign(1, 0);
+    LineIndex::scanNewlines(source, length, starts);
+    if (starts.back() != length)
+        starts.push_back(static_cast<unsigned int>(length));
+    std::size_t lines = starts.size() - 1;
+
+    this->source = source;
+    this->out = &out;
+    chunks.assign((lines + chunkLines - 1) / chunkLines, Chunk { {}, false });
+    taken = 0;
+    written = 0;
+    window = CHUNKS_AHEAD * threads;
+    writing = false;
+    std::vector<std::thread> workers;
+    for (std::size_t i = 1; i < std::min(threads, chunks.size()); ++i)
+        workers.emplace_back(&LineRunner::work, this);
+    work();
+    for (std::thread& worker : workers)
+        worker.join();
+    out.flush();
+    return failed == 0 && out.good();
+}
+
+std::size_t ccc::LineRunner::failedLines() const
+{
+    return failed;
+}
+
+void ccc::LineRunner::work()
+{
+    // building the lexer and parser costs more than most lines, so each worker keeps one of both
+    Lexer lexer;
+    PullLexer tokens { lexer, nullptr, 0 };
+    LL1Parser parser { tokens };
+    for (;;) {
+        std::size_t chunk;
+        {
+            std::unique_lock<std::mutex> lock { m };
+            changed.wait(lock, [this] { return taken == chunks.size() || taken < written + window; });
+            if (taken == chunks.size())
+                return;
+            chunk = taken++;
+        }
+        Tracer::Scope traced { "chunk" };
+        std::string output;
+        std::size_t chunkFailed = 0;
+        std::size_t last = std::min((chunk + 1) * chunkLines, starts.size() - 1);
+        for (std::size_t line = chunk * chunkLines; line < last; ++line)
+            if (!evaluateLine(tokens, parser, source + starts[line], starts[line + 1] - starts[line], output))
+                ++chunkFailed;
+        {
+            std::lock_guard<std::mutex> lock { m };
+            chunks[chunk].output = std::move(output);
+            chunks[chunk].ready = true;
+            failed += chunkFailed;
+        }
+        flush();
+    }
+}
+
+void ccc::LineRunner::flush()
+{
+    std::unique_lock<std::mutex> lock { m };
+    if (writing)
+        return;
+    writing = true;
+    // the thread writing picks up every chunk that is ready by the time it checks again
+    while (written < chunks.size() && chunks[written].ready) {
+        std::string output = std::move(chunks[written].output);
+        lock.unlock();
+        out->write(output.data(), static_cast<std::streamsize>(output.size()));
+        lock.lock();
+        ++written;
+        changed.notify_all();
+    }
+    writing = false;
+}
@@ -0,0 +1,342 @@
+#include "loader.h"
+#include "utility.h"
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <utility>
+#if defined(__unix__)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define LOADER_PREAD
+#endif
+#if defined(__linux__)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(IORING_FEAT_FAST_POLL)
+#define LOADER_RING
+#endif
+#endif
+
+/* Enough to keep a disk queue busy without holding many files in memory */
+#define DEFAULT_IN_FLIGHT 16
+
+const std::size_t ccc::FileLoader::defaultInFlight = DEFAULT_IN_FLIGHT;
+
+ccc::FileLoader::FileLoader(std::vector<std::string> paths, std::size_t inFlight, Backend backend)
+    : paths { std::move(paths) }
+    , slots(this->paths.size(), Slot { {}, -1, 0, false, false })
+    , inFlight { std::max<std::size_t>(inFlight, 1) }
+    , used { Backend::THREADS }
+    , delivered { 0 }
+    , started { 0 }
+    , ringFd { -1 }
+    , rings { nullptr }
+    , ringsSize { 0 }
+    , sqes { nullptr }
+    , sqesSize { 0 }
+    , sqTail { nullptr }
+    , sqMask { nullptr }
+    , sqArray { nullptr }
+    , cqHead { nullptr }
+    , cqTail { nullptr }
+    , cqMask { nullptr }
+    , cqes { nullptr }
+    , queued { 0 }
+    , stopping { false }
+{
+    if (backend != Backend::THREADS && setupRing(this->inFlight)) {
+        used = Backend::RING;
+        return;
+    }
+    // each reader has one file in flight
+    std::size_t threads = std::min(this->inFlight, this->paths.size());
+    for (std::size_t i = 0; i < threads; ++i)
+        readers.emplace_back(&FileLoader::readAhead, this);
+}
+
+ccc::FileLoader::~FileLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock { m };
+        stopping = true;
+    }
+    changed.notify_all();
+    for (std::thread& reader : readers)
+        reader.join();
+    // the kernel may still write into the buffers of reads in flight
+    if (used == Backend::RING) {
+        for (std::size_t i = delivered; i < started; ++i)
+            while (!slots[i].finished && waitRing()) {
+            }
+    }
+    closeRing();
+    // files read ahead but never handed out
+    for (std::size_t i = delivered; i < slots.size(); ++i)
+        MemoryStats::release(MemoryStats::Subsystem::LEXER_BUFFER, slots[i].contents.size());
+}
+
+ccc::FileLoader::Backend ccc::FileLoader::backend() const
+{
+    return used;
+}
+
+bool ccc::FileLoader::next(File& out)
+{
+    if (delivered == paths.size())
+        return false;
+    Slot& slot = slots[delivered];
+    if (used == Backend::RING) {
+        fillRing();
+        while (!slot.finished) {
+            if (!waitRing()) {
+                // a ring that stops working leaves the file unread rather than hanging
+                slot.finished = true;
+                slot.ok = false;
+            }
+            fillRing();
+        }
+    } else {
+        std::unique_lock<std::mutex> lock { m };
+        changed.wait(lock, [&slot] { return slot.finished; });
+    }
+    out.path = paths[delivered];
+    out.ok = slot.ok;
+    out.contents = std::move(slot.contents);
+    MemoryStats::release(MemoryStats::Subsystem::LEXER_BUFFER, out.contents.size());
+    {
+        std::lock_guard<std::mutex> lock { m };
+        ++delivered;
+    }
+    // the window moved, so one more file may be read ahead
+    changed.notify_all();
+    if (used == Backend::RING)
+        fillRing();
+    return true;
+}
+
+void ccc::FileLoader::readWhole(const std::string& path, Slot& slot)
+{
+#ifdef LOADER_PREAD
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat info;
+    if (fd < 0)
+        return;
+    if (fstat(fd, &info) != 0) {
+        ::close(fd);
+        return;
+    }
+    slot.contents.resize(static_cast<std::size_t>(info.st_size));
+    while (slot.done < slot.contents.size()) {
+        ssize_t res = pread(fd, slot.contents.data() + slot.done, slot.contents.size() - slot.done, static_cast<off_t>(slot.done));
+        if (res < 0 && errno == EINTR)
+            continue;
+        if (res < 0) {
+            ::close(fd);
+            return;
+        }
+        // the file shrank since fstat
+        if (res == 0)
+            break;
+        slot.done += static_cast<std::size_t>(res);
+    }
+    ::close(fd);
+    slot.contents.resize(slot.done);
+    slot.ok = true;
+#else
+    std::ifstream file { path, std::ios::binary };
+    if (!file.is_open())
+        return;
+    slot.contents.assign(std::istreambuf_iterator<char> { file }, std::istreambuf_iterator<char> {});
+    slot.ok = !file.bad();
+#endif
+}
+
+void ccc::FileLoader::readAhead()
+{
+    for (;;) {
+        std::size_t index;
+        {
+            std::unique_lock<std::mutex> lock { m };
+            changed.wait(lock, [this] { return stopping || started == paths.size() || started < delivered + inFlight; });
+            if (stopping || started == paths.size())
+                return;
+            index = started++;
+        }
+        Slot slot { {}, -1, 0, false, false };
+        readWhole(paths[index], slot);
+        MemoryStats::charge(MemoryStats::Subsystem::LEXER_BUFFER, slot.contents.size());
+        {
+            std::lock_guard<std::mutex> lock { m };
+            slots[index].contents = std::move(slot.contents);
+            slots[index].ok = slot.ok;
+            slots[index].finished = true;
+        }
+        changed.notify_all();
+    }
+}
+
+#ifdef LOADER_RING
+
+bool ccc::FileLoader::setupRing(std::size_t entries)
+{
+    io_uring_params params {};
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = static_cast<unsigned int>(2 * entries);
+    int fd = static_cast<int>(syscall(__NR_io_uring_setup, static_cast<unsigned int>(entries), &params));
+    if (fd < 0)
+        return false;
+    ringFd = fd;
+    // plain reads came with 5.6, fast poll with 5.7, so a kernel that has the latter takes IORING_OP_READ
+    if (!(params.features & IORING_FEAT_FAST_POLL) || !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        closeRing();
+        return false;
+    }
+    ringsSize = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned int), params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+    void* ring = mmap(nullptr, ringsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    if (ring == MAP_FAILED) {
+        closeRing();
+        return false;
+    }
+    rings = ring;
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* entriesMapping = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if (entriesMapping == MAP_FAILED) {
+        closeRing();
+        return false;
+    }
+    sqes = entriesMapping;
+    char* base = static_cast<char*>(ring);
+    sqTail = reinterpret_cast<unsigned int*>(base + params.sq_off.tail);
+    sqMask = reinterpret_cast<unsigned int*>(base + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned int*>(base + params.sq_off.array);
+    cqHead = reinterpret_cast<unsigned int*>(base + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned int*>(base + params.cq_off.tail);
+    cqMask = reinterpret_cast<unsigned int*>(base + params.cq_off.ring_mask);
+    cqes = base + params.cq_off.cqes;
+    // the window never has more reads in flight than the ring has entries
+    inFlight = std::min<std::size_t>(inFlight, params.sq_entries);
+    return true;
+}
+
+void ccc::FileLoader::closeRing()
+{
+    for (Slot& slot : slots) {
+        if (slot.fd >= 0)
+            ::close(slot.fd);
+        slot.fd = -1;
+    }
+    if (sqes != nullptr)
+        munmap(sqes, sqesSize);
+    if (rings != nullptr)
+        munmap(rings, ringsSize);
+    if (ringFd >= 0)
+        ::close(ringFd);
+    sqes = nullptr;
+    rings = nullptr;
+    ringFd = -1;
+}
+
+void ccc::FileLoader::fillRing()
+{
+    for (; started < paths.size() && started < delivered + inFlight; ++started) {
+        Slot& slot = slots[started];
+        // opening stays synchronous, only the data reads are in flight
+        slot.fd = ::open(paths[started].c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat info;
+        if (slot.fd < 0 || fstat(slot.fd, &info) != 0) {
+            slot.finished = true;
+            continue;
+        }
+        slot.contents.resize(static_cast<std::size_t>(info.st_size));
+        MemoryStats::charge(MemoryStats::Subsystem::LEXER_BUFFER, slot.contents.size());
+        if (slot.contents.empty()) {
+            ::close(slot.fd);
+            slot.fd = -1;
+            slot.finished = true;
+            slot.ok = true;
+            continue;
+        }
+        queueRead(started);
+    }
+}
+
+void ccc::FileLoader::queueRead(std::size_t index)
+{
+    Slot& slot = slots[index];
+    unsigned int tail = *sqTail;
+    unsigned int entry = tail & *sqMask;
+    io_uring_sqe& sqe = static_cast<io_uring_sqe*>(sqes)[entry];
+    sqe = io_uring_sqe {};
+    sqe.opcode = IORING_OP_READ;
+    sqe.fd = slot.fd;
+    sqe.addr = reinterpret_cast<unsigned long long>(slot.contents.data() + slot.done);
+    sqe.len = static_cast<unsigned int>(std::min<std::size_t>(slot.contents.size() - slot.done, 1u << 30));
+    sqe.off = slot.done;
+    sqe.user_data = index;
+    sqArray[entry] = entry;
+    // the kernel reads the entry once it sees the new tail
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    ++queued;
+}
+
+bool ccc::FileLoader::waitRing()
+{
+    int res = static_cast<int>(syscall(__NR_io_uring_enter, ringFd, queued, 1, IORING_ENTER_GETEVENTS, nullptr, 0));
+    if (res < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        return false;
+    if (res > 0)
+        queued -= std::min<unsigned int>(queued, static_cast<unsigned int>(res));
+    unsigned int head = *cqHead;
+    for (; head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE); ++head) {
+        const io_uring_cqe& cqe = static_cast<const io_uring_cqe*>(cqes)[head & *cqMask];
+        Slot& slot = slots[cqe.user_data];
+        if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+            queueRead(cqe.user_data);
+            continue;
+        }
+        if (cqe.res > 0)
+            slot.done += static_cast<std::size_t>(cqe.res);
+        // a short read goes on from where it stopped, end of file or an error ends the file
+        if (cqe.res > 0 && slot.done < slot.contents.size()) {
+            queueRead(cqe.user_data);
+            continue;
+        }
+        ::close(slot.fd);
+        slot.fd = -1;
+        slot.ok = cqe.res >= 0;
+        MemoryStats::release(MemoryStats::Subsystem::LEXER_BUFFER, slot.contents.size() - slot.done);
+        slot.contents.resize(slot.done);
+        slot.finished = true;
+    }
+    __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    return true;
+}
+
+#else
+
+bool ccc::FileLoader::setupRing(std::size_t)
+{
+    return false;
+}
+
+void ccc::FileLoader::closeRing()
+{
+}
+
+void ccc::FileLoader::fillRing()
+{
+}
+
+void ccc::FileLoader::queueRead(std::size_t)
+{
+}
+
+bool ccc::FileLoader::waitRing()
+{
+    return false;
+}
+
+#endif
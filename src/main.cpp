@@ -1,27 +1,287 @@
+#include "bundle.h"
+#include "diagnostics.h"
+#include "jit.h"
 #include "lexer.h"
+#include "lines.h"
+#include "loader.h"
+#include "parallel.h"
 #include "parser.h"
+#include "pipeline.h"
 #include "utility.h"
 #include "vm.h"
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
 #include <thread>
+#include <vector>
 
-int main(int argc, char** argv)
+static bool readSource(const char* filePath, std::string& out)
+{
+    std::ifstream file { filePath, std::ios::binary };
+    if (!file.is_open())
+        return false;
+    out.assign(std::istreambuf_iterator<char> { file }, std::istreambuf_iterator<char> {});
+    return true;
+}
+
+/* Only a failed compile reads the source again to find the line */
+static void report(const char* filePath, const ccc::Diagnostic& diagnostic)
+{
+    std::string source;
+    if (!readSource(filePath, source)) {
+        std::cerr << filePath << ": error: cannot open file\n";
+        return;
+    }
+    ccc::LineIndex lines { source.data(), source.size() };
+    std::cerr << lines.format(filePath, diagnostic);
+}
+
+/* Files from argv[first] on that run through the pipeline, up to the first flag that changes how files are run */
+static std::vector<std::string> plainFiles(int first, int argc, char** argv)
+{
+    std::vector<std::string> res;
+    for (int i = first; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--bundle") == 0 || std::strcmp(argv[i], "--lines") == 0 || std::strcmp(argv[i], "--profile") == 0)
+            break;
+        if (std::strcmp(argv[i], "--threads") == 0 || std::strcmp(argv[i], "--memory-budget") == 0 || std::strcmp(argv[i], "--read-ahead") == 0
+            || std::strcmp(argv[i], "--trace") == 0 || std::strcmp(argv[i], "--parser") == 0)
+            ++i;
+        else if (std::strncmp(argv[i], "--", 2) != 0)
+            res.push_back(argv[i]);
+    }
+    return res;
+}
+
+/* Runs every entry on its own straight from the mapping, results and diagnostics come in bundle order */
+static bool runBundle(const char* bundlePath, const ccc::Pipeline::VMFactory& factory, bool hashCons, ccc::Parser::Backend backend)
+{
+    ccc::Bundle bundle;
+    if (!bundle.open(bundlePath)) {
+        std::cerr << bundlePath << ": error: not a bundle\n";
+        return false;
+    }
+    ccc::Pipeline pipeline { factory, 4, ccc::Pipeline::defaultThreadedFrom, hashCons, backend };
+    bool res = true;
+    for (std::size_t i = 0; i < bundle.size(); ++i) {
+        const ccc::Bundle::Entry& entry = bundle[i];
+        ccc::Token last { "", ccc::Terminal::ERROR };
+        bool failed = false;
+        auto record = [&last, &failed](std::size_t, bool ok, const ccc::Token& value) {
+            last = value;
+            failed = failed || !ok;
+        };
+        // a statement that fails at run time fails the entry, not only a syntax error
+        if (!pipeline.run(entry.source, entry.length, record) || failed) {
+            ccc::LineIndex lines { entry.source, entry.length };
+            std::cerr << lines.format(entry.name, pipeline.error());
+            std::cout << entry.name << ": failed\n";
+            res = false;
+        } else if (last.term == ccc::Terminal::FLOAT_LITERAL) {
+            std::cout << entry.name << ": " << last.floatValue << '\n';
+        } else if (last.term == ccc::Terminal::INT_LITERAL) {
+            std::cout << entry.name << ": " << last.intValue << '\n';
+        } else {
+            std::cout << entry.name << ": ok\n";
+        }
+    }
+    return res;
+}
+
+#ifdef CCC_PROFILER
+/* Lexes and parses in parallel into one AST of all statements */
+static bool parseFile(const char* filePath, ccc::Lexer& lexer, ccc::SyntaxTree& ast, ccc::Parser::Backend backend)
 {
     ccc::SharedBuffer buffer;
+    std::thread lexer_thread { &ccc::Lexer::run, &lexer, filePath, std::ref(buffer) };
+
+    std::unique_ptr<ccc::Parser> parser = ccc::Parser::create(backend, buffer);
+    bool parsed = false;
+    std::thread parser_thread { [&parser, &ast, &parsed]() { parsed = parser->parse(ast); } };
+
+    lexer_thread.join();
+    parser_thread.join();
+    if (!parsed) {
+        report(filePath, parser->error());
+        return false;
+    }
+    parser->convertToAst(ast);
+    return true;
+}
+
+/* A single run gives few dispatches, so every one of them is timed */
+static void profile(const char* filePath, ccc::SyntaxTree& ast, const char* foldedPath)
+{
+    std::string source;
+    if (!readSource(filePath, source))
+        return;
+    ccc::StackBasedVM vm { ast };
+    ccc::Profiler profiler { source, ast, 1 };
+    vm.profile(&profiler);
+    vm.run();
+    vm.profile(nullptr);
+    std::ofstream folded { foldedPath };
+    profiler.writeFolded(folded);
+    profiler.writeReport(std::cerr, 10);
+}
+#endif
+
+int main(int argc, char** argv)
+{
     ccc::Lexer lexer;
+    bool jit = false;
+    bool stats = false;
+    bool hashCons = false;
+    ccc::Parser::Backend backend = ccc::Parser::Backend::LL1;
+    std::unique_ptr<ccc::ForkJoinPool> pool;
+    bool bundles = false;
+    bool streaming = false;
+    bool lines = false;
+    std::size_t threads = 0;
+    std::size_t readAhead = 0;
+    std::unique_ptr<ccc::FileLoader> loader;
+    const char* foldedPath = nullptr;
+    const char* tracePath = nullptr;
+    int res = 0;
+    ccc::Pipeline::VMFactory factory = [&jit, &pool](ccc::SyntaxTree& ast, ccc::Globals& globals) {
+        if (pool != nullptr)
+            return std::unique_ptr<ccc::VM> { new ccc::ParallelVM { ast, *pool, &globals } };
+        return jit ? std::unique_ptr<ccc::VM> { new ccc::JitVM { ast, &globals } } : std::unique_ptr<ccc::VM> { new ccc::StackBasedVM { ast, &globals } };
+    };
 
     for (int i = 1; i < argc; ++i) {
-        std::thread lexer_thread { &ccc::Lexer::run, &lexer, argv[i], std::ref(buffer) };
+        if (std::strcmp(argv[i], "--jit") == 0) {
+            jit = true;
+            continue;
+        }
+        if (std::strcmp(argv[i], "--stats") == 0) {
+            stats = true;
+            continue;
+        }
+        if (std::strcmp(argv[i], "--hash-cons") == 0) {
+            hashCons = true;
+            continue;
+        }
+        if (std::strcmp(argv[i], "--parser") == 0 && i + 1 < argc) {
+            backend = std::strcmp(argv[++i], "pratt") == 0 ? ccc::Parser::Backend::PRATT : ccc::Parser::Backend::LL1;
+            continue;
+        }
+        if (std::strcmp(argv[i], "--bundle") == 0) {
+            bundles = true;
+            continue;
+        }
+        if (std::strcmp(argv[i], "--stream") == 0) {
+            streaming = true;
+            continue;
+        }
+        if (std::strcmp(argv[i], "--lines") == 0) {
+            lines = true;
+            continue;
+        }
+        if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = std::strtoull(argv[++i], nullptr, 10);
+            pool.reset(threads > 1 ? new ccc::ForkJoinPool { threads } : nullptr);
+            continue;
+        }
+        if (std::strcmp(argv[i], "--read-ahead") == 0 && i + 1 < argc) {
+            readAhead = std::strtoull(argv[++i], nullptr, 10);
+            continue;
+        }
+        if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            tracePath = argv[++i];
+            ccc::Tracer::start();
+            continue;
+        }
+        if (std::strcmp(argv[i], "--memory-budget") == 0 && i + 1 < argc) {
+            ccc::MemoryStats::setBudget(std::strtoull(argv[++i], nullptr, 10));
+            continue;
+        }
+#ifdef CCC_PROFILER
+        if (std::strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            foldedPath = argv[++i];
+            continue;
+        }
+#endif
+        // a budget exceeded by the previous file does not fail this one
+        ccc::MemoryStats::reset();
+#ifdef CCC_PROFILER
+        if (foldedPath != nullptr) {
+            // the profiler attributes to one AST of the whole file
+            ccc::SyntaxTree ast;
+            if (parseFile(argv[i], lexer, ast, backend)) {
+                if (hashCons)
+                    ast.hashCons();
+                profile(argv[i], ast, foldedPath);
+            } else {
+                res = 1;
+            }
+            if (stats)
+                ccc::MemoryStats::print(std::cerr);
+            continue;
+        }
+#endif
+        if (bundles) {
+            if (!runBundle(argv[i], factory, hashCons, backend))
+                res = 1;
+            if (stats)
+                ccc::MemoryStats::print(std::cerr);
+            continue;
+        }
+        // every line is a program of its own and prints its own result
+        if (lines) {
+            std::string source;
+            ccc::LineRunner runner { threads };
+            if (!readSource(argv[i], source)) {
+                std::cerr << argv[i] << ": error: cannot open file\n";
+                res = 1;
+            } else if (!runner.run(source.data(), source.size(), std::cout)) {
+                res = 1;
+            }
+            if (stats)
+                ccc::MemoryStats::print(std::cerr);
+            continue;
+        }
 
-        ccc::LL1Parser parser { buffer };
-        ccc::SyntaxTree ast;
-        std::thread parser_thread { &ccc::LL1Parser::parse, &parser, std::ref(ast) };
+        // the files after this one are read while it is compiled, and run from memory
+        if (readAhead != 0 && loader == nullptr)
+            loader.reset(new ccc::FileLoader { plainFiles(i, argc, argv), readAhead });
+        ccc::FileLoader::File file;
+        bool loaded = loader != nullptr && loader->next(file) && file.ok && file.path == argv[i];
 
-        lexer_thread.join();
-        parser_thread.join();
-        parser.convertToAst(ast);
+        // pure arithmetic is evaluated while it is parsed, anything else starts over in the pipeline
+        bool streamed = false;
+        if (streaming) {
+            std::unique_ptr<ccc::PullLexer> tokens { loaded ? new ccc::PullLexer { lexer, file.contents.data(), file.contents.size() }
+                                                            : new ccc::PullLexer { lexer, argv[i] } };
+            ccc::StreamingVM vm { *tokens };
+            streamed = vm.run();
+        }
+        if (streamed) {
+            if (stats)
+                ccc::MemoryStats::print(std::cerr);
+            continue;
+        }
 
-        ccc::StackBasedVM vm { ast };
-        vm.run();
+        // each statement is evaluated while the next one is parsed
+        ccc::Pipeline pipeline { factory, 4, ccc::Pipeline::defaultThreadedFrom, hashCons, backend };
+        if (loaded ? !pipeline.run(file.contents.data(), file.contents.size(), nullptr) : !pipeline.run(argv[i], nullptr)) {
+            report(argv[i], pipeline.error());
+            res = 1;
+        }
+        if (stats)
+            ccc::MemoryStats::print(std::cerr);
+    }
+    if (tracePath != nullptr) {
+        ccc::Tracer::stop();
+        std::ofstream trace { tracePath };
+        ccc::Tracer::write(trace);
+        if (!trace) {
+            std::cerr << tracePath << ": error: cannot write the trace\n";
+            res = 1;
+        }
     }
-    return 0;
+    return res;
 }
@@ -0,0 +1,372 @@
+#include "parallel.h"
+#include <algorithm>
+
+/* Below this many nodes a subtree costs less to evaluate than to hand to another thread */
+#define DEFAULT_GRAIN 4096
+
+const std::size_t ccc::ParallelVM::defaultGrain = DEFAULT_GRAIN;
+
+ccc::ForkJoinPool::Task::Task()
+    : parent { nullptr }
+    , pending { 0 }
+{
+}
+
+void ccc::ForkJoinPool::Task::add(Task& child)
+{
+    child.parent = this;
+    children.push_back(&child);
+}
+
+ccc::ForkJoinPool::ForkJoinPool(std::size_t threads)
+    : generation { 0 }
+    , busy { 0 }
+    , stopping { false }
+    , root { nullptr }
+    , done { false }
+    , failed { false }
+{
+    threads = std::max<std::size_t>(threads, 1);
+    for (std::size_t i = 0; i < threads; ++i)
+        workers.emplace_back(new Worker);
+    for (std::size_t i = 1; i < threads; ++i)
+        helpers.emplace_back(&ForkJoinPool::help, this, i);
+}
+
+ccc::ForkJoinPool::~ForkJoinPool()
+{
+    {
+        std::lock_guard<std::mutex> lock { m };
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& helper : helpers)
+        helper.join();
+}
+
+std::size_t ccc::ForkJoinPool::threads() const
+{
+    return workers.size();
+}
+
+bool ccc::ForkJoinPool::run(Task& task)
+{
+    std::lock_guard<std::mutex> lock { running };
+    root = &task;
+    done.store(false, std::memory_order_relaxed);
+    failed.store(false, std::memory_order_relaxed);
+    push(0, &task);
+    {
+        std::lock_guard<std::mutex> helpersLock { m };
+        ++generation;
+        busy = helpers.size();
+    }
+    wake.notify_all();
+    work(0);
+    // a failed run leaves tasks behind, which must not be taken once the helpers are back for the next one
+    std::unique_lock<std::mutex> helpersLock { m };
+    idle.wait(helpersLock, [this] { return busy == 0; });
+    for (auto& worker : workers)
+        worker->tasks.clear();
+    return !failed.load(std::memory_order_relaxed);
+}
+
+void ccc::ForkJoinPool::help(std::size_t index)
+{
+    std::size_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock { m };
+            wake.wait(lock, [this, seen] { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+        work(index);
+        std::lock_guard<std::mutex> lock { m };
+        if (--busy == 0)
+            idle.notify_all();
+    }
+}
+
+void ccc::ForkJoinPool::work(std::size_t index)
+{
+    while (!done.load(std::memory_order_acquire)) {
+        Task* task = take(index);
+        if (task == nullptr) {
+            std::this_thread::yield();
+            continue;
+        }
+        if (task->children.empty()) {
+            finish(task);
+            continue;
+        }
+        // the owner takes the newest task first, so the first child is evaluated next and the others are left to steal
+        task->pending.store(task->children.size(), std::memory_order_relaxed);
+        for (auto child = task->children.rbegin(); child != task->children.rend(); ++child)
+            push(index, *child);
+    }
+}
+
+ccc::ForkJoinPool::Task* ccc::ForkJoinPool::take(std::size_t index)
+{
+    {
+        Worker& own = *workers[index];
+        std::lock_guard<std::mutex> lock { own.m };
+        if (!own.tasks.empty()) {
+            Task* res = own.tasks.back();
+            own.tasks.pop_back();
+            return res;
+        }
+    }
+    // the oldest task of a victim is the largest subtree it has left
+    for (std::size_t i = 1; i < workers.size(); ++i) {
+        Worker& victim = *workers[(index + i) % workers.size()];
+        std::lock_guard<std::mutex> lock { victim.m };
+        if (!victim.tasks.empty()) {
+            Task* res = victim.tasks.front();
+            victim.tasks.pop_front();
+            return res;
+        }
+    }
+    return nullptr;
+}
+
+void ccc::ForkJoinPool::push(std::size_t index, Task* task)
+{
+    Worker& own = *workers[index];
+    std::lock_guard<std::mutex> lock { own.m };
+    own.tasks.push_back(task);
+}
+
+void ccc::ForkJoinPool::finish(Task* task)
+{
+    for (;;) {
+        if (failed.load(std::memory_order_relaxed))
+            return;
+        if (!task->execute()) {
+            failed.store(true, std::memory_order_relaxed);
+            done.store(true, std::memory_order_release);
+            return;
+        }
+        if (task == root) {
+            done.store(true, std::memory_order_release);
+            return;
+        }
+        // the results of the siblings are visible to whichever of them counts the parent down to zero
+        if (task->parent->pending.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+        task = task->parent;
+    }
+}
+
+ccc::ParallelVM::ParallelVM(SyntaxTree& ast, ForkJoinPool& pool, Globals* globals, std::size_t grain)
+    : interpreter { ast, globals }
+    , pool { pool }
+    , globals { globals }
+    , grain { std::max<std::size_t>(grain, 1) }
+    , compiled { false }
+    , lastResult { "", Terminal::ERROR }
+    , value {}
+    , instructions { 0 }
+    , operandBytes { 0 }
+{
+    lastError = interpreter.error();
+    // only a single expression is split, the interpreter reports anything it cannot resolve
+    if (ast.root == nullptr || ast.root->next != nullptr || !lastError.message.empty() || !measure(ast.root))
+        return;
+    segments.emplace_back(new Segment);
+    std::size_t depth = 0;
+    compiled = compile(ast.root, *segments.front(), depth);
+    sizes.clear();
+    if (!compiled) {
+        segments.clear();
+        return;
+    }
+    // the inputs do not move any more, so every task can be pointed at the one its result goes to
+    for (auto& segment : segments) {
+        segment->out = segment->destination != nullptr ? &segment->destination->inputs[segment->input] : &value;
+        instructions += segment->code.size();
+        operandBytes += (segment->operands.size() + segment->inputs.size()) * sizeof(Value);
+    }
+    MemoryStats::charge(MemoryStats::Subsystem::VM_STACK, operandBytes);
+    divisionError = Diagnostic { "division by zero", ast.root->offset, ast.root->length };
+}
+
+ccc::ParallelVM::~ParallelVM()
+{
+    MemoryStats::release(MemoryStats::Subsystem::VM_STACK, operandBytes);
+}
+
+bool ccc::ParallelVM::run()
+{
+    lastResult = { "", Terminal::ERROR };
+    if (!compiled) {
+        // control flow runs without leaving a result
+        if (!interpreter.run()) {
+            lastError = interpreter.error();
+            return false;
+        }
+        interpreter.result(lastResult);
+        return true;
+    }
+    lastError = Diagnostic {};
+    const Value* variables = globals != nullptr ? globals->values() : nullptr;
+    for (auto& segment : segments)
+        segment->variables = variables;
+    // an expression below the grain is not worth waking the pool for
+    bool ok = segments.size() == 1 ? segments.front()->execute() : pool.run(*segments.front());
+    if (!ok) {
+        lastError = divisionError;
+        return false;
+    }
+    executed += instructions;
+    lastResult = value.isFloat ? makeOperand(value.floatValue) : makeOperand(value.intValue);
+    return true;
+}
+
+ccc::VM::Status ccc::ParallelVM::resume(const Budget& budget)
+{
+    if (compiled)
+        return run() ? Status::FINISHED : Status::FAILED;
+    lastResult = { "", Terminal::ERROR };
+    Status res = interpreter.resume(budget);
+    lastError = interpreter.error();
+    if (res == Status::FINISHED)
+        interpreter.result(lastResult);
+    return res;
+}
+
+bool ccc::ParallelVM::result(Token& out) const
+{
+    if (lastResult.term == Terminal::ERROR)
+        return false;
+    out = lastResult;
+    return true;
+}
+
+std::size_t ccc::ParallelVM::tasks() const
+{
+    return segments.size();
+}
+
+bool ccc::ParallelVM::measure(const SyntaxTree::SyntaxTreeNode* node)
+{
+    std::size_t size = 1;
+    for (const SyntaxTree::SyntaxTreeNode* child = node->children; child != nullptr; child = child->next) {
+        if (!measure(child))
+            return false;
+        size += sizes[child];
+    }
+    switch (node->val.term) {
+    case Terminal::INT_LITERAL:
+    case Terminal::FLOAT_LITERAL:
+    case Terminal::ID:
+        if (node->children != nullptr)
+            return false;
+        break;
+    case Terminal::ARITHMETIC_OP_PLUS:
+    case Terminal::ARITHMETIC_OP_MINUS:
+    case Terminal::ARITHMETIC_OP_MULT:
+    case Terminal::ARITHMETIC_OP_DIV:
+        if (node->children == nullptr || node->children->next == nullptr || node->children->next->next != nullptr)
+            return false;
+        break;
+    default:
+        return false;
+    }
+    sizes[node] = size;
+    return true;
+}
+
+bool ccc::ParallelVM::compile(const SyntaxTree::SyntaxTreeNode* node, Segment& segment, std::size_t& depth)
+{
+    Instruction instruction { Opcode::PUSH, node->val.term, {}, 0 };
+    switch (node->val.term) {
+    case Terminal::INT_LITERAL:
+        instruction.value.isFloat = false;
+        instruction.value.intValue = node->val.intValue;
+        ++depth;
+        break;
+    case Terminal::FLOAT_LITERAL:
+        instruction.value.isFloat = true;
+        instruction.value.floatValue = node->val.floatValue;
+        ++depth;
+        break;
+    case Terminal::ID:
+        if (globals == nullptr || !globals->find(node->val.lexeme, instruction.index))
+            return false;
+        instruction.op = Opcode::LOAD;
+        ++depth;
+        break;
+    default: {
+        const SyntaxTree::SyntaxTreeNode* lhs = node->children;
+        const SyntaxTree::SyntaxTreeNode* rhs = lhs->next;
+        if (sizes[lhs] >= grain && sizes[rhs] >= grain) {
+            // both operands are tasks, which leave their results in the inputs of this one in operand order
+            for (const SyntaxTree::SyntaxTreeNode* operand : { lhs, rhs }) {
+                Segment& child = split(segment);
+                std::size_t childDepth = 0;
+                if (!compile(operand, child, childDepth))
+                    return false;
+                segment.code.push_back({ Opcode::INPUT, operand->val.term, {}, child.input });
+                ++depth;
+                segment.operands.resize(std::max(segment.operands.size(), depth));
+            }
+        } else if (!compile(lhs, segment, depth) || !compile(rhs, segment, depth)) {
+            return false;
+        }
+        instruction.op = Opcode::ARITH;
+        --depth;
+        break;
+    }
+    }
+    segment.code.push_back(instruction);
+    segment.operands.resize(std::max(segment.operands.size(), depth));
+    return true;
+}
+
+ccc::ParallelVM::Segment& ccc::ParallelVM::split(Segment& parent)
+{
+    segments.emplace_back(new Segment);
+    Segment& res = *segments.back();
+    parent.add(res);
+    res.destination = &parent;
+    res.input = parent.inputs.size();
+    parent.inputs.emplace_back();
+    return res;
+}
+
+ccc::ParallelVM::Segment::Segment()
+    : destination { nullptr }
+    , input { 0 }
+    , out { nullptr }
+    , variables { nullptr }
+{
+}
+
+bool ccc::ParallelVM::Segment::execute()
+{
+    // top points one past the topmost operand
+    Value* top = operands.data();
+    for (const Instruction& instruction : code) {
+        switch (instruction.op) {
+        case Opcode::PUSH:
+            *top++ = instruction.value;
+            break;
+        case Opcode::LOAD:
+            *top++ = variables[instruction.index];
+            break;
+        case Opcode::INPUT:
+            *top++ = inputs[instruction.index];
+            break;
+        case Opcode::ARITH:
+            --top;
+            if (!calc(instruction.arithmeticOp, top[-1], top[0], top[-1]))
+                return false;
+            break;
+        }
+    }
+    *out = operands.front();
+    return true;
+}
@@ -1,12 +1,19 @@
 #include "parser.h"
 
 #include <algorithm>
+#include <cctype>
 #include <cstddef>
 #include <iostream>
+#include <memory>
+#include <string>
 
-ccc::Symbol::Symbol(Type type, StorageSpecifier storageSpecifier)
+/* Grammar symbol of StreamingParser that hands the innermost pending operator to the sink */
+#define POSTFIX_ACTION "#"
+
+ccc::Symbol::Symbol(Type type, StorageSpecifier storageSpecifier, std::size_t slot)
     : type { type }
     , storageSpecifier { storageSpecifier }
+    , slot { slot }
 {
 }
 
@@ -16,19 +23,31 @@ ccc::SymbolTable::SymbolTable()
 
 ccc::SymbolTable::~SymbolTable()
 {
-    while (!symbols.empty()) {
-        delete symbols.top();
-        symbols.pop();
-    }
+    while (!symbols.empty())
+        removeScope();
+}
+
+/* Entry and hash node of an unordered_map, the name is counted separately */
+std::size_t ccc::SymbolTable::bytes(const std::string& symbolName)
+{
+    return sizeof(std::pair<const std::string, Symbol>) + 2 * sizeof(void*) + symbolName.size();
 }
 
 void ccc::SymbolTable::addScope()
 {
     symbols.push(new std::unordered_map<std::string, Symbol> {});
+    MemoryStats::charge(MemoryStats::Subsystem::SYMBOL_TABLE, sizeof(std::unordered_map<std::string, Symbol>));
 }
 
 void ccc::SymbolTable::removeScope()
 {
+    if (symbols.empty())
+        return;
+    std::size_t scopeBytes = sizeof(std::unordered_map<std::string, Symbol>);
+    for (const auto& symbol : *symbols.top())
+        scopeBytes += bytes(symbol.first);
+    MemoryStats::release(MemoryStats::Subsystem::SYMBOL_TABLE, scopeBytes);
+    delete symbols.top();
     symbols.pop();
 }
 
@@ -37,28 +56,32 @@ bool ccc::SymbolTable::insert(const std::string& symbolName, const Symbol& symbo
     std::unordered_map<std::string, Symbol>* currentTable = symbols.top();
     if (currentTable->find(symbolName) != currentTable->end())
         return false;
+    MemoryStats::charge(MemoryStats::Subsystem::SYMBOL_TABLE, bytes(symbolName));
     currentTable->insert({ symbolName, symbol });
     return true;
 }
 
 bool ccc::SymbolTable::lookup(const std::string& symbolName, Symbol& outSymbol)
 {
+    bool found = false;
     while (!symbols.empty()) {
         std::unordered_map<std::string, Symbol>* currentTable = symbols.top();
         auto searchedSymbol = currentTable->find(symbolName);
 
         if (searchedSymbol != currentTable->end()) {
             outSymbol = searchedSymbol->second;
-            return true;
+            found = true;
+            break;
         }
         helperStack.push(currentTable);
         symbols.pop();
     }
+    // the inner scopes searched on the way out are put back either way
     while (!helperStack.empty()) {
         symbols.push(helperStack.top());
         helperStack.pop();
     }
-    return false;
+    return found;
 }
 
 ccc::SyntaxTree::SyntaxTree()
@@ -73,12 +96,15 @@ ccc::SyntaxTree::~SyntaxTree()
 
 ccc::SyntaxTree::SyntaxTreeNode::SyntaxTreeNode(Token val)
     : val(val)
-    , children(nullptr)
     , next(nullptr)
+    , children(nullptr)
+    , offset(val.offset)
+    , length(val.length)
 {
+    MemoryStats::charge(MemoryStats::Subsystem::PARSE_TREE, sizeof(SyntaxTreeNode));
 }
 
-bool ccc::SyntaxTree::insert(const std::string& parentNonTerminal, const std::vector<Token>& tokens)
+bool ccc::SyntaxTree::insert(const std::string& parentNonTerminal, const std::vector<Token>& tokens, std::vector<SyntaxTreeNode*>* inserted)
 {
     if (parentNonTerminal.empty()) {
         root = new SyntaxTreeNode(tokens[0]);
@@ -91,46 +117,143 @@ bool ccc::SyntaxTree::insert(const std::string& parentNonTerminal, const std::ve
     if (parentIterator == nonTerminalsToNodes.end())
         return false;
     SyntaxTreeNode* parent = parentIterator->second.front();
-    bool sameNonTerminalEncountered = false;
+    parentIterator->second.pop_front();
+    if (parentIterator->second.empty())
+        nonTerminalsToNodes.erase(parentIterator);
     // insert node as a child of the last inserted grammarSymbol node
+    std::vector<SyntaxTreeNode*> nonTerminals;
+    SyntaxTreeNode** tail = &parent->children;
+    while (*tail != nullptr)
+        tail = &(*tail)->next;
     for (const Token& t : tokens) {
-        SyntaxTreeNode* children;
-        if (t.lexeme == parentNonTerminal && !sameNonTerminalEncountered) {
-            parentIterator->second.pop_front();
-            sameNonTerminalEncountered = true;
-        }
-        if (parent->children == nullptr) {
-            children = new SyntaxTreeNode(t);
-            parent->children = children;
-        } else {
-            children = parent->children;
-            while (children->next != nullptr)
-                children = children->next;
-            children->next = new SyntaxTreeNode(t);
-            children = children->next;
-        }
-        // add the newly added node to the map
-        if (t.term == Terminal::NON_TERMINAL) {
-            if (parentIterator->second.empty())
-                nonTerminalsToNodes[t.lexeme].push_back(children);
-            else
-                nonTerminalsToNodes[t.lexeme].push_front(children);
-        }
-    }
-    if (!sameNonTerminalEncountered) {
-        parentIterator->second.pop_front();
-        if (parentIterator->second.empty())
-            nonTerminalsToNodes.erase(parentIterator);
+        SyntaxTreeNode* children = new SyntaxTreeNode(t);
+        *tail = children;
+        tail = &children->next;
+        if (inserted != nullptr)
+            inserted->push_back(children);
+        if (t.term == Terminal::NON_TERMINAL)
+            nonTerminals.push_back(children);
     }
+    // the expansion is leftmost, so the new non-terminals precede every pending one of
+    // the same name, and "( A logop A )" has to expand its first A first
+    for (auto node = nonTerminals.rbegin(); node != nonTerminals.rend(); ++node)
+        nonTerminalsToNodes[(*node)->val.lexeme].push_front(*node);
     return true;
 }
 
 ccc::SyntaxTree::SyntaxTreeNode::~SyntaxTreeNode()
 {
+    MemoryStats::release(MemoryStats::Subsystem::PARSE_TREE, sizeof(SyntaxTreeNode));
     delete next;
     delete children;
 }
 
+ccc::SyntaxTree::SharedNode::SharedNode(SyntaxTreeNode* target, const SyntaxTreeNode& copy)
+    : SyntaxTreeNode(Token { copy.val.lexeme, Terminal::SHARED_SUBTREE, copy.val.offset, copy.val.length })
+    , target(target)
+{
+    offset = copy.offset;
+    length = copy.length;
+    MemoryStats::charge(MemoryStats::Subsystem::PARSE_TREE, sizeof(SharedNode) - sizeof(SyntaxTreeNode));
+}
+
+ccc::SyntaxTree::SharedNode::~SharedNode()
+{
+    MemoryStats::release(MemoryStats::Subsystem::PARSE_TREE, sizeof(SharedNode) - sizeof(SyntaxTreeNode));
+}
+
+/* Nodes of node and its siblings with all their descendants */
+static std::size_t countNodes(const ccc::SyntaxTree::SyntaxTreeNode* node)
+{
+    std::size_t res = 0;
+    for (; node != nullptr; node = node->next)
+        res += 1 + countNodes(node->children);
+    return res;
+}
+
+/* Numbers the structure of every subtree made of only literals, variables and arithmetic, equal subtrees get
+ * the same number. Returns whether node is such a subtree */
+static bool numberSubtrees(const ccc::SyntaxTree::SyntaxTreeNode* node, std::unordered_map<std::string, std::size_t>& numbers,
+    std::unordered_map<const ccc::SyntaxTree::SyntaxTreeNode*, std::size_t>& numberOf)
+{
+    bool pure = true;
+    for (const ccc::SyntaxTree::SyntaxTreeNode* child = node->children; child != nullptr; child = child->next)
+        pure = numberSubtrees(child, numbers, numberOf) && pure;
+    switch (node->val.term) {
+    case ccc::Terminal::ID:
+    case ccc::Terminal::INT_LITERAL:
+    case ccc::Terminal::FLOAT_LITERAL:
+    case ccc::Terminal::ARITHMETIC_OP_PLUS:
+    case ccc::Terminal::ARITHMETIC_OP_MINUS:
+    case ccc::Terminal::ARITHMETIC_OP_MULT:
+    case ccc::Terminal::ARITHMETIC_OP_DIV:
+        break;
+    default:
+        return false;
+    }
+    if (!pure)
+        return false;
+    // the children are numbered already, so the key stays short however deep the subtree is
+    std::string key = std::to_string(static_cast<int>(node->val.term)) + ' ' + node->val.lexeme;
+    for (const ccc::SyntaxTree::SyntaxTreeNode* child = node->children; child != nullptr; child = child->next)
+        key += ' ' + std::to_string(numberOf[child]);
+    numberOf[node] = numbers.emplace(key, numbers.size()).first->second;
+    return true;
+}
+
+/* Replaces the subtrees below *link that repeat an earlier one of firstCopies */
+static void share(ccc::SyntaxTree::SyntaxTreeNode** link, std::unordered_map<std::size_t, ccc::SyntaxTree::SyntaxTreeNode*>& firstCopies,
+    const std::unordered_map<const ccc::SyntaxTree::SyntaxTreeNode*, std::size_t>& numberOf, std::size_t& removed, std::size_t& shared)
+{
+    ccc::SyntaxTree::SyntaxTreeNode* node = *link;
+    // a leaf is no cheaper to load from a shared slot than to evaluate again
+    if (node->children == nullptr)
+        return;
+    auto first = firstCopies.emplace(numberOf.at(node), node);
+    if (!first.second) {
+        ccc::SyntaxTree::SharedNode* reference = new ccc::SyntaxTree::SharedNode(first.first->second, *node);
+        reference->next = node->next;
+        node->next = nullptr;
+        removed += countNodes(node);
+        ++shared;
+        delete node;
+        *link = reference;
+        return;
+    }
+    for (ccc::SyntaxTree::SyntaxTreeNode** child = &node->children; *child != nullptr; child = &(*child)->next)
+        share(child, firstCopies, numberOf, removed, shared);
+}
+
+/* Hash-conses the outermost arithmetic expressions among *link and its siblings on their own */
+static void shareExpressions(ccc::SyntaxTree::SyntaxTreeNode** link, const std::unordered_map<const ccc::SyntaxTree::SyntaxTreeNode*, std::size_t>& numberOf,
+    std::size_t& removed, std::size_t& shared)
+{
+    for (; *link != nullptr; link = &(*link)->next) {
+        if (numberOf.count(*link) == 0) {
+            shareExpressions(&(*link)->children, numberOf, removed, shared);
+            continue;
+        }
+        // an expression is evaluated all at once, so its first copy is always there for the later ones
+        std::unordered_map<std::size_t, ccc::SyntaxTree::SyntaxTreeNode*> firstCopies;
+        share(link, firstCopies, numberOf, removed, shared);
+    }
+}
+
+std::size_t ccc::SyntaxTree::hashCons()
+{
+    std::unordered_map<std::string, std::size_t> numbers;
+    std::unordered_map<const SyntaxTreeNode*, std::size_t> numberOf;
+    for (const SyntaxTreeNode* node = root; node != nullptr; node = node->next)
+        numberSubtrees(node, numbers, numberOf);
+    std::size_t before = countNodes(root);
+    std::size_t removed = 0;
+    std::size_t shared = 0;
+    shareExpressions(&root, numberOf, removed, shared);
+    std::size_t saved = removed * sizeof(SyntaxTreeNode) - shared * sizeof(SharedNode);
+    MemoryStats::countHashCons(before, before - removed + shared, saved);
+    return removed - shared;
+}
+
 void ccc::SyntaxTree::printSyntaxTree()
 {
     std::vector<std::vector<SyntaxTreeNode*>> levels;
@@ -164,32 +287,22 @@ void ccc::SyntaxTree::levelOrderTraversal(SyntaxTreeNode* node, unsigned int lev
 	}
 }
 
-ccc::Parser::Parser(SharedBuffer& buffer)
-    : buffer{buffer}
+const ccc::Diagnostic& ccc::Parser::error() const
 {
-    grammarSymbols.push("$");
-    grammarSymbols.push("E");
+    return lastError;
+}
 
-    terminals.emplace("id");
-    terminals.emplace("int");
-    terminals.emplace("float");
-    terminals.emplace("char");
-    terminals.emplace("if");
-    terminals.emplace("while");
-    terminals.emplace("+");
-    terminals.emplace("-");
-    terminals.emplace("*");
-    terminals.emplace("/");
-    terminals.emplace("logop");
-    terminals.emplace("=");
-    terminals.emplace("int literal");
-    terminals.emplace("float literal");
-    terminals.emplace("string literal");
-    terminals.emplace(";");
-    terminals.emplace("{");
-    terminals.emplace("}");
-    terminals.emplace("(");
-    terminals.emplace(")");
+bool ccc::Parser::fail(const Token& token, const std::string& message)
+{
+    lastError = Diagnostic { message, token.offset, token.length };
+    // the lexer may be waiting for room in the buffer that will not be read anymore
+    buffer.close();
+    return false;
+}
+
+ccc::Parser::Parser(TokenSource& buffer)
+    : buffer{buffer}
+{
 }
 
 const std::unordered_map<ccc::Terminal, std::string> ccc::Parser::terminalsToProductions = {
@@ -197,8 +310,11 @@ const std::unordered_map<ccc::Terminal, std::string> ccc::Parser::terminalsToPro
     { Terminal::BUILTIN_TYPE_INT, "int" },
     { Terminal::BUILTIN_TYPE_FLOAT, "float" },
     { Terminal::BUILTIN_TYPE_CHAR, "char" },
+    { Terminal::STORAGE_STATIC, "static" },
+    { Terminal::STORAGE_EXTERN, "extern" },
     { Terminal::CONTROL_FLOW_BRANCH, "if" },
     { Terminal::CONTROL_FLOW_WHILE, "while" },
+    { Terminal::CONTROL_FLOW_RETURN, "return" },
     { Terminal::ARITHMETIC_OP_PLUS, "+" },
     { Terminal::ARITHMETIC_OP_MINUS, "-" },
     { Terminal::ARITHMETIC_OP_MULT, "*" },
@@ -209,6 +325,7 @@ const std::unordered_map<ccc::Terminal, std::string> ccc::Parser::terminalsToPro
     { Terminal::FLOAT_LITERAL, "float literal" },
     { Terminal::STRING_LITERAL, "string literal" },
     { Terminal::SEMICOLON, ";" },
+    { Terminal::COMMA, "," },
     { Terminal::OPEN_SCOPE, "{" },
     { Terminal::CLOSED_SCOPE, "}" },
     { Terminal::OPENING_BRACKET, "(" },
@@ -221,8 +338,11 @@ const std::unordered_map<std::string, ccc::Terminal> ccc::Parser::productionsToT
     { "int", Terminal::BUILTIN_TYPE_INT },
     { "float", Terminal::BUILTIN_TYPE_FLOAT },
     { "char", Terminal::BUILTIN_TYPE_CHAR },
+    { "static", Terminal::STORAGE_STATIC },
+    { "extern", Terminal::STORAGE_EXTERN },
     { "if", Terminal::CONTROL_FLOW_BRANCH },
     { "while", Terminal::CONTROL_FLOW_WHILE },
+    { "return", Terminal::CONTROL_FLOW_RETURN },
     { "+", Terminal::ARITHMETIC_OP_PLUS },
     { "-", Terminal::ARITHMETIC_OP_MINUS },
     { "*", Terminal::ARITHMETIC_OP_MULT },
@@ -233,6 +353,7 @@ const std::unordered_map<std::string, ccc::Terminal> ccc::Parser::productionsToT
     { "float literal", Terminal::FLOAT_LITERAL },
     { "string literal", Terminal::STRING_LITERAL },
     { ";", Terminal::SEMICOLON },
+    { ",", Terminal::COMMA },
     { "{", Terminal::OPEN_SCOPE },
     { "}", Terminal::CLOSED_SCOPE },
     { "(", Terminal::OPENING_BRACKET },
@@ -240,9 +361,110 @@ const std::unordered_map<std::string, ccc::Terminal> ccc::Parser::productionsToT
     { "eof", Terminal::FILE_END }
 };
 
-ccc::LL1Parser::LL1Parser(SharedBuffer& buffer)
+ccc::LL1Parser::LL1Parser(TokenSource& buffer)
     : Parser{buffer}
 {
+    terminals.emplace("id");
+    terminals.emplace("int");
+    terminals.emplace("float");
+    terminals.emplace("char");
+    terminals.emplace("static");
+    terminals.emplace("extern");
+    terminals.emplace("if");
+    terminals.emplace("while");
+    terminals.emplace("return");
+    terminals.emplace("+");
+    terminals.emplace("-");
+    terminals.emplace("*");
+    terminals.emplace("/");
+    terminals.emplace("logop");
+    terminals.emplace("=");
+    terminals.emplace("int literal");
+    terminals.emplace("float literal");
+    terminals.emplace("string literal");
+    terminals.emplace(";");
+    terminals.emplace(",");
+    terminals.emplace("{");
+    terminals.emplace("}");
+    terminals.emplace("(");
+    terminals.emplace(")");
+
+    // a top-level name is a function or a variable, one in a block only a variable
+    for (const char* nonTerminal : { "DEF", "DECL" }) {
+        std::string rest = nonTerminal == std::string("DEF") ? "D'" : "D''";
+        parsingTable.emplace(nonTerminal, std::unordered_map<Terminal, std::vector<std::string>> {});
+        for (Terminal first : { Terminal::BUILTIN_TYPE_INT, Terminal::BUILTIN_TYPE_FLOAT, Terminal::BUILTIN_TYPE_CHAR, Terminal::STORAGE_STATIC, Terminal::STORAGE_EXTERN })
+            parsingTable[nonTerminal].emplace(first, std::vector<std::string> { "SPEC", "TYPE", "id", rest });
+    }
+
+    parsingTable.emplace("SPEC", std::unordered_map<Terminal, std::vector<std::string>> {});
+    parsingTable["SPEC"].emplace(Terminal::STORAGE_STATIC, std::vector<std::string> { "static" });
+    parsingTable["SPEC"].emplace(Terminal::STORAGE_EXTERN, std::vector<std::string> { "extern" });
+    parsingTable["SPEC"].emplace(Terminal::BUILTIN_TYPE_INT, std::vector<std::string> { "epsilon" });
+    parsingTable["SPEC"].emplace(Terminal::BUILTIN_TYPE_FLOAT, std::vector<std::string> { "epsilon" });
+    parsingTable["SPEC"].emplace(Terminal::BUILTIN_TYPE_CHAR, std::vector<std::string> { "epsilon" });
+
+    parsingTable.emplace("D'", std::unordered_map<Terminal, std::vector<std::string>> {});
+    parsingTable["D'"].emplace(Terminal::OPENING_BRACKET, std::vector<std::string> { "(", "P", ")", "{", "L", "}" });
+    parsingTable["D'"].emplace(Terminal::SEMICOLON, std::vector<std::string> { ";" });
+    parsingTable["D'"].emplace(Terminal::ASSIGNMENT_OP, std::vector<std::string> { "=", "A", ";" });
+
+    parsingTable.emplace("D''", std::unordered_map<Terminal, std::vector<std::string>> {});
+    parsingTable["D''"].emplace(Terminal::SEMICOLON, std::vector<std::string> { ";" });
+    parsingTable["D''"].emplace(Terminal::ASSIGNMENT_OP, std::vector<std::string> { "=", "A", ";" });
+
+    parsingTable.emplace("TYPE", std::unordered_map<Terminal, std::vector<std::string>> {});
+    parsingTable["TYPE"].emplace(Terminal::BUILTIN_TYPE_INT, std::vector<std::string> { "int" });
+    parsingTable["TYPE"].emplace(Terminal::BUILTIN_TYPE_FLOAT, std::vector<std::string> { "float" });
+    parsingTable["TYPE"].emplace(Terminal::BUILTIN_TYPE_CHAR, std::vector<std::string> { "char" });
+
+    parsingTable.emplace("P", std::unordered_map<Terminal, std::vector<std::string>> {});
+    parsingTable["P"].emplace(Terminal::BUILTIN_TYPE_INT, std::vector<std::string> { "TYPE", "id", "P'" });
+    parsingTable["P"].emplace(Terminal::BUILTIN_TYPE_FLOAT, std::vector<std::string> { "TYPE", "id", "P'" });
+    parsingTable["P"].emplace(Terminal::BUILTIN_TYPE_CHAR, std::vector<std::string> { "TYPE", "id", "P'" });
+    parsingTable["P"].emplace(Terminal::CLOSING_BRACKET, std::vector<std::string> { "epsilon" });
+
+    parsingTable.emplace("P'", std::unordered_map<Terminal, std::vector<std::string>> {});
+    parsingTable["P'"].emplace(Terminal::COMMA, std::vector<std::string> { ",", "TYPE", "id", "P'" });
+    parsingTable["P'"].emplace(Terminal::CLOSING_BRACKET, std::vector<std::string> { "epsilon" });
+
+    parsingTable.emplace("STMT", std::unordered_map<Terminal, std::vector<std::string>> {});
+    parsingTable["STMT"].emplace(Terminal::CONTROL_FLOW_RETURN, std::vector<std::string> { "return", "A", ";" });
+    parsingTable["STMT"].emplace(Terminal::CONTROL_FLOW_BRANCH, std::vector<std::string> { "if", "(", "A", "logop", "A", ")", "{", "L", "}" });
+    parsingTable["STMT"].emplace(Terminal::CONTROL_FLOW_WHILE, std::vector<std::string> { "while", "(", "A", "logop", "A", ")", "{", "L", "}" });
+    parsingTable["STMT"].emplace(Terminal::ID, std::vector<std::string> { "A", ";" });
+    parsingTable["STMT"].emplace(Terminal::INT_LITERAL, std::vector<std::string> { "A", ";" });
+    parsingTable["STMT"].emplace(Terminal::FLOAT_LITERAL, std::vector<std::string> { "A", ";" });
+    parsingTable["STMT"].emplace(Terminal::OPENING_BRACKET, std::vector<std::string> { "A", ";" });
+    for (Terminal first : { Terminal::BUILTIN_TYPE_INT, Terminal::BUILTIN_TYPE_FLOAT, Terminal::BUILTIN_TYPE_CHAR, Terminal::STORAGE_STATIC, Terminal::STORAGE_EXTERN })
+        parsingTable["STMT"].emplace(first, std::vector<std::string> { "DECL" });
+
+    parsingTable.emplace("L", std::unordered_map<Terminal, std::vector<std::string>> {});
+    parsingTable["L"].emplace(Terminal::CONTROL_FLOW_BRANCH, std::vector<std::string> { "STMT", "L" });
+    parsingTable["L"].emplace(Terminal::CONTROL_FLOW_WHILE, std::vector<std::string> { "STMT", "L" });
+    parsingTable["L"].emplace(Terminal::CONTROL_FLOW_RETURN, std::vector<std::string> { "STMT", "L" });
+    parsingTable["L"].emplace(Terminal::ID, std::vector<std::string> { "STMT", "L" });
+    parsingTable["L"].emplace(Terminal::INT_LITERAL, std::vector<std::string> { "STMT", "L" });
+    parsingTable["L"].emplace(Terminal::FLOAT_LITERAL, std::vector<std::string> { "STMT", "L" });
+    parsingTable["L"].emplace(Terminal::OPENING_BRACKET, std::vector<std::string> { "STMT", "L" });
+    for (Terminal first : { Terminal::BUILTIN_TYPE_INT, Terminal::BUILTIN_TYPE_FLOAT, Terminal::BUILTIN_TYPE_CHAR, Terminal::STORAGE_STATIC, Terminal::STORAGE_EXTERN })
+        parsingTable["L"].emplace(first, std::vector<std::string> { "STMT", "L" });
+    parsingTable["L"].emplace(Terminal::CLOSED_SCOPE, std::vector<std::string> { "epsilon" });
+
+    parsingTable.emplace("A", std::unordered_map<Terminal, std::vector<std::string>> {});
+    parsingTable["A"].emplace(Terminal::ID, std::vector<std::string> { "E", "A'" });
+    parsingTable["A"].emplace(Terminal::INT_LITERAL, std::vector<std::string> { "E", "A'" });
+    parsingTable["A"].emplace(Terminal::FLOAT_LITERAL, std::vector<std::string> { "E", "A'" });
+    parsingTable["A"].emplace(Terminal::OPENING_BRACKET, std::vector<std::string> { "E", "A'" });
+
+    parsingTable.emplace("A'", std::unordered_map<Terminal, std::vector<std::string>> {});
+    parsingTable["A'"].emplace(Terminal::ASSIGNMENT_OP, std::vector<std::string> { "=", "E", "A'" });
+    parsingTable["A'"].emplace(Terminal::LOGICAL_OP, std::vector<std::string> { "epsilon" });
+    parsingTable["A'"].emplace(Terminal::FILE_END, std::vector<std::string> { "epsilon" });
+    parsingTable["A'"].emplace(Terminal::CLOSING_BRACKET, std::vector<std::string> { "epsilon" });
+    parsingTable["A'"].emplace(Terminal::SEMICOLON, std::vector<std::string> { "epsilon" });
+    parsingTable["A'"].emplace(Terminal::COMMA, std::vector<std::string> { "epsilon" });
+
     parsingTable.emplace("E", std::unordered_map<Terminal, std::vector<std::string>> {});
     parsingTable["E"].emplace(Terminal::ID, std::vector<std::string> { "E'", "S" });
     parsingTable["E"].emplace(Terminal::INT_LITERAL, std::vector<std::string> { "E'", "S" });
@@ -254,6 +476,10 @@ ccc::LL1Parser::LL1Parser(SharedBuffer& buffer)
     parsingTable["S"].emplace(Terminal::ARITHMETIC_OP_MINUS, std::vector<std::string> { "-", "E'", "S" });
     parsingTable["S"].emplace(Terminal::FILE_END, std::vector<std::string> { "epsilon" });
     parsingTable["S"].emplace(Terminal::CLOSING_BRACKET, std::vector<std::string> { "epsilon" });
+    parsingTable["S"].emplace(Terminal::SEMICOLON, std::vector<std::string> { "epsilon" });
+    parsingTable["S"].emplace(Terminal::ASSIGNMENT_OP, std::vector<std::string> { "epsilon" });
+    parsingTable["S"].emplace(Terminal::LOGICAL_OP, std::vector<std::string> { "epsilon" });
+    parsingTable["S"].emplace(Terminal::COMMA, std::vector<std::string> { "epsilon" });
 
     parsingTable.emplace("E'", std::unordered_map<Terminal, std::vector<std::string>> {});
     parsingTable["E'"].emplace(Terminal::ID, std::vector<std::string> { "T", "F" });
@@ -268,12 +494,34 @@ ccc::LL1Parser::LL1Parser(SharedBuffer& buffer)
     parsingTable["F"].emplace(Terminal::ARITHMETIC_OP_MINUS, std::vector<std::string> { "epsilon" });
     parsingTable["F"].emplace(Terminal::FILE_END, std::vector<std::string> { "epsilon" });
     parsingTable["F"].emplace(Terminal::CLOSING_BRACKET, std::vector<std::string> { "epsilon" });
+    parsingTable["F"].emplace(Terminal::SEMICOLON, std::vector<std::string> { "epsilon" });
+    parsingTable["F"].emplace(Terminal::ASSIGNMENT_OP, std::vector<std::string> { "epsilon" });
+    parsingTable["F"].emplace(Terminal::LOGICAL_OP, std::vector<std::string> { "epsilon" });
+    parsingTable["F"].emplace(Terminal::COMMA, std::vector<std::string> { "epsilon" });
 
     parsingTable.emplace("T", std::unordered_map<Terminal, std::vector<std::string>> {});
-    parsingTable["T"].emplace(Terminal::ID, std::vector<std::string> { "id" });
+    parsingTable["T"].emplace(Terminal::ID, std::vector<std::string> { "id", "T'" });
     parsingTable["T"].emplace(Terminal::INT_LITERAL, std::vector<std::string> { "int literal" });
     parsingTable["T"].emplace(Terminal::FLOAT_LITERAL, std::vector<std::string> { "float literal" });
     parsingTable["T"].emplace(Terminal::OPENING_BRACKET, std::vector<std::string> { "(", "E", ")" });
+
+    // an id followed by ( is a call
+    parsingTable.emplace("T'", std::unordered_map<Terminal, std::vector<std::string>> {});
+    parsingTable["T'"].emplace(Terminal::OPENING_BRACKET, std::vector<std::string> { "(", "V", ")" });
+    for (Terminal follow : { Terminal::ARITHMETIC_OP_PLUS, Terminal::ARITHMETIC_OP_MINUS, Terminal::ARITHMETIC_OP_MULT, Terminal::ARITHMETIC_OP_DIV,
+             Terminal::FILE_END, Terminal::CLOSING_BRACKET, Terminal::SEMICOLON, Terminal::COMMA, Terminal::ASSIGNMENT_OP, Terminal::LOGICAL_OP })
+        parsingTable["T'"].emplace(follow, std::vector<std::string> { "epsilon" });
+
+    parsingTable.emplace("V", std::unordered_map<Terminal, std::vector<std::string>> {});
+    parsingTable["V"].emplace(Terminal::ID, std::vector<std::string> { "A", "V'" });
+    parsingTable["V"].emplace(Terminal::INT_LITERAL, std::vector<std::string> { "A", "V'" });
+    parsingTable["V"].emplace(Terminal::FLOAT_LITERAL, std::vector<std::string> { "A", "V'" });
+    parsingTable["V"].emplace(Terminal::OPENING_BRACKET, std::vector<std::string> { "A", "V'" });
+    parsingTable["V"].emplace(Terminal::CLOSING_BRACKET, std::vector<std::string> { "epsilon" });
+
+    parsingTable.emplace("V'", std::unordered_map<Terminal, std::vector<std::string>> {});
+    parsingTable["V'"].emplace(Terminal::COMMA, std::vector<std::string> { ",", "A", "V'" });
+    parsingTable["V'"].emplace(Terminal::CLOSING_BRACKET, std::vector<std::string> { "epsilon" });
 }
 
 void ccc::Parser::addToSymbolTable(ccc::Token& token, ccc::Type type)
@@ -316,87 +564,864 @@ void ccc::LL1Parser::expandProduction(SyntaxTree& st)
             grammarSymbols.push(terminalsToProductions.find(production->term)->second);
     }
 
-    st.insert(currentGrammarSymbol, productionTokens);
+    std::vector<SyntaxTree::SyntaxTreeNode*> inserted;
+    st.insert(currentGrammarSymbol, productionTokens, &inserted);
+    for (auto node = inserted.rbegin(); node != inserted.rend(); ++node)
+        if ((*node)->val.term != Terminal::NON_TERMINAL)
+            terminalNodes.push(*node);
 }
 
 void ccc::LL1Parser::continueGrammarMatching()
 {
+    // terminals further right in a production were inserted before their token was read
+    if (!terminalNodes.empty()) {
+        terminalNodes.top()->val = *buffer.consume();
+        terminalNodes.pop();
+    }
     grammarSymbols.pop();
     buffer.pop();
 }
 
-bool ccc::LL1Parser::parse(SyntaxTree& res)
+static std::string describe(const ccc::Token& token)
+{
+    if (token.term == ccc::Terminal::FILE_END)
+        return "end of input";
+    return "'" + token.lexeme + "'";
+}
+
+/* The lexer only rejects whole tokens when a literal does not fit its type */
+static std::string invalidToken(const ccc::Token& token)
+{
+    if (!token.lexeme.empty() && (std::isdigit(static_cast<unsigned char>(token.lexeme[0])) || token.lexeme[0] == '.'))
+        return "literal '" + token.lexeme + "' is out of range";
+    return "invalid character '" + token.lexeme + "'";
+}
+
+std::unique_ptr<ccc::Parser> ccc::Parser::create(Backend backend, TokenSource& buffer)
+{
+    if (backend == Backend::PRATT)
+        return std::unique_ptr<Parser> { new PrattParser { buffer } };
+    return std::unique_ptr<Parser> { new LL1Parser { buffer } };
+}
+
+bool ccc::Parser::parse(SyntaxTree& res)
 {
-    res.insert("", std::vector<Token> { Token("E", Terminal::NON_TERMINAL) });
+    // statements are siblings under the root until convertToAst turns each into an AST
+    SyntaxTree::SyntaxTreeNode** tail = &res.root;
+    bool more = true;
+    while (more) {
+        SyntaxTree statement;
+        if (!parseStatement(statement, more))
+            return false;
+        *tail = statement.root;
+        statement.root = nullptr;
+        tail = &(*tail)->next;
+    }
+    return true;
+}
+
+bool ccc::LL1Parser::parseStatement(SyntaxTree& res, bool& more)
+{
+    // control flow and definitions end with their } or ;, anything else is an expression that may assign
+    Terminal first = buffer.consume()->term;
+    bool definition = first == Terminal::BUILTIN_TYPE_INT || first == Terminal::BUILTIN_TYPE_FLOAT || first == Terminal::BUILTIN_TYPE_CHAR
+        || first == Terminal::STORAGE_STATIC || first == Terminal::STORAGE_EXTERN;
+    bool block = definition || first == Terminal::CONTROL_FLOW_BRANCH || first == Terminal::CONTROL_FLOW_WHILE;
+    std::string start = definition ? "DEF" : block ? "STMT" : "A";
+    grammarSymbols = {};
+    grammarSymbols.push("$");
+    grammarSymbols.push(start);
+    terminalNodes = {};
+    res.insert("", std::vector<Token> { Token(start, Terminal::NON_TERMINAL) });
     std::string currentGrammarSymbol = grammarSymbols.top();
 
     while (currentGrammarSymbol != std::string("$")) {
-        Terminal inputTerm = buffer.consume()->term;
+        const Token& input = *buffer.consume();
+        Terminal inputTerm = input.term;
+        if (MemoryStats::exceeded())
+            return fail(input, "memory budget of " + std::to_string(MemoryStats::budget()) + " bytes exceeded");
         // terminal
         if (terminalsToProductions.find(inputTerm) == terminalsToProductions.end())
-            // error out
-            return false;
+            return fail(input, invalidToken(input));
         if (currentGrammarSymbol == terminalsToProductions.find(inputTerm)->second) {
             // if the currentGrammarSymbol is the same terminal as the input
             continueGrammarMatching();
         } else if (terminals.find(currentGrammarSymbol) != terminals.end()) {
             // error currentGrammarSymbol is a terminal but not the one in the
             // input which means the grammar did not match
-            std::cout << "Error\n";
-            return false;
+            return fail(input, "expected '" + currentGrammarSymbol + "' before " + describe(input));
             // non terminal
         } else if (parsingTable[currentGrammarSymbol].find(inputTerm) == parsingTable[currentGrammarSymbol].end()) {
             // error currentGrammarSymbol is a non terminal but there is no entry
             // in the parsing table for the input terminal and the current non
             // terminal and thusly the grammar did not match
-            std::cout << "Error\n";
-            return false;
+            return fail(input, "unexpected " + describe(input));
         } else
             expandProduction(res);
         currentGrammarSymbol = grammarSymbols.top();
     }
+    return endStatement(block, more);
+}
+
+bool ccc::Parser::endStatement(bool block, bool& more)
+{
+    // trailing input such as the ) of "2)" is not part of E, the last statement may omit its ;
+    const Token& input = *buffer.consume();
+    if (block) {
+        more = input.term != Terminal::FILE_END;
+        return true;
+    }
+    if (input.term == Terminal::SEMICOLON) {
+        buffer.pop();
+        more = buffer.consume()->term != Terminal::FILE_END;
+        return true;
+    }
+    if (input.term != Terminal::FILE_END)
+        return fail(input, "unexpected " + describe(input) + " after the expression");
+    more = false;
     return true;
 }
 
 void ccc::LL1Parser::convertToAst(SyntaxTree& st)
 {
-    st.root = convertToAstHelper(st.root);
+    SyntaxTree::SyntaxTreeNode* statement = st.root;
+    SyntaxTree::SyntaxTreeNode** tail = &st.root;
+    while (statement != nullptr) {
+        SyntaxTree::SyntaxTreeNode* next = statement->next;
+        statement->next = nullptr;
+        *tail = convertStatement(statement);
+        tail = &(*tail)->next;
+        statement = next;
+    }
 }
 
-ccc::SyntaxTree::SyntaxTreeNode* ccc::LL1Parser::convertToAstHelper(SyntaxTree::SyntaxTreeNode* node)
+ccc::SyntaxTree::SyntaxTreeNode* ccc::LL1Parser::convertStatement(SyntaxTree::SyntaxTreeNode* node)
 {
-    if (node == nullptr)
-        return node;
-    SyntaxTree::SyntaxTreeNode* next = convertToAstHelper(node->next);
-    SyntaxTree::SyntaxTreeNode* children = convertToAstHelper(node->children);
-    bool reorderChildren = false;
+    SyntaxTree::SyntaxTreeNode* first = node->children;
+    node->children = nullptr;
+    std::string nonTerminal = node->val.lexeme;
+    delete node;
+    if (nonTerminal == "A")
+        return convertAssignment(first);
+    if (nonTerminal == "DEF" || nonTerminal == "DECL")
+        return convertDefinition(first);
+    if (first->val.term == Terminal::NON_TERMINAL) {
+        // A ;
+        delete first->next;
+        first->next = nullptr;
+        return convertStatement(first);
+    }
+    if (first->val.term == Terminal::CONTROL_FLOW_RETURN) {
+        // return A ; holds the value
+        SyntaxTree::SyntaxTreeNode* value = first->next;
+        delete value->next;
+        value->next = nullptr;
+        first->next = nullptr;
+        first->children = convertStatement(value);
+        span(first);
+        return first;
+    }
+    // if ( A logop A ) { L } becomes if holding the comparison and { holding the statements of L
+    SyntaxTree::SyntaxTreeNode* opening = first->next;
+    SyntaxTree::SyntaxTreeNode* lhs = opening->next;
+    SyntaxTree::SyntaxTreeNode* comparison = lhs->next;
+    SyntaxTree::SyntaxTreeNode* rhs = comparison->next;
+    SyntaxTree::SyntaxTreeNode* closing = rhs->next;
+    SyntaxTree::SyntaxTreeNode* scope = closing->next;
+    SyntaxTree::SyntaxTreeNode* list = scope->next;
+    SyntaxTree::SyntaxTreeNode* closingScope = list->next;
+    opening->next = lhs->next = rhs->next = closing->next = scope->next = list->next = nullptr;
+    unsigned int end = closingScope->val.offset + closingScope->val.length;
+    delete opening;
+    delete closing;
+    delete closingScope;
 
-    if (next != nullptr) {
-        if (children == nullptr)
-            node->children = next;
-        else {
-            SyntaxTree::SyntaxTreeNode* temp = children;
-            while (temp->next != nullptr)
-                temp = temp->next;
-            temp->next = next->children;
-            next->children = children;
-            node->children = next;
-            reorderChildren = true;
+    comparison->children = convertStatement(lhs);
+    comparison->children->next = convertStatement(rhs);
+    comparison->next = scope;
+    span(comparison);
+    scope->children = convertList(list);
+    span(scope);
+    scope->length = end - scope->offset;
+    first->next = nullptr;
+    first->children = comparison;
+    span(first);
+    return first;
+}
+
+ccc::SyntaxTree::SyntaxTreeNode* ccc::LL1Parser::convertList(SyntaxTree::SyntaxTreeNode* list)
+{
+    // L -> STMT L | epsilon
+    SyntaxTree::SyntaxTreeNode* res = nullptr;
+    SyntaxTree::SyntaxTreeNode** tail = &res;
+    while (list != nullptr) {
+        SyntaxTree::SyntaxTreeNode* statement = list->children;
+        list->children = nullptr;
+        delete list;
+        if (statement == nullptr)
+            break;
+        list = statement->next;
+        statement->next = nullptr;
+        *tail = convertStatement(statement);
+        tail = &(*tail)->next;
+    }
+    return res;
+}
+
+ccc::SyntaxTree::SyntaxTreeNode* ccc::LL1Parser::convertAssignment(SyntaxTree::SyntaxTreeNode* expression)
+{
+    // expression is the E of E A', A' -> = E A' nests the assignments to the right
+    SyntaxTree::SyntaxTreeNode* rest = expression->next;
+    expression->next = nullptr;
+    SyntaxTree::SyntaxTreeNode* res = convertChain(expression);
+    SyntaxTree::SyntaxTreeNode* assignment = rest->children;
+    rest->children = nullptr;
+    delete rest;
+    if (assignment == nullptr)
+        return res;
+    SyntaxTree::SyntaxTreeNode* value = assignment->next;
+    assignment->next = nullptr;
+    assignment->children = res;
+    res->next = convertAssignment(value);
+    span(assignment);
+    return assignment;
+}
+
+void ccc::Parser::span(SyntaxTree::SyntaxTreeNode* node)
+{
+    node->offset = node->val.offset;
+    unsigned int end = node->val.offset + node->val.length;
+    for (SyntaxTree::SyntaxTreeNode* child = node->children; child != nullptr; child = child->next) {
+        end = std::max(end, child->offset + child->length);
+        node->offset = std::min(node->offset, child->offset);
+    }
+    node->length = end - node->offset;
+}
+
+ccc::SyntaxTree::SyntaxTreeNode* ccc::LL1Parser::convertDefinition(SyntaxTree::SyntaxTreeNode* specifier)
+{
+    // SPEC TYPE id D', the storage specifier only matters to variables
+    SyntaxTree::SyntaxTreeNode* type = specifier->next;
+    SyntaxTree::SyntaxTreeNode* name = type->next;
+    SyntaxTree::SyntaxTreeNode* rest = name->next;
+    specifier->next = type->next = name->next = nullptr;
+    SyntaxTree::SyntaxTreeNode* storage = specifier->children;
+    specifier->children = nullptr;
+    delete specifier;
+    SyntaxTree::SyntaxTreeNode* opening = rest->children;
+    rest->children = nullptr;
+    delete rest;
+    SyntaxTree::SyntaxTreeNode* returnType = type->children;
+    type->children = nullptr;
+    delete type;
+    if (opening->val.term != Terminal::OPENING_BRACKET)
+        return convertDeclaration(storage, returnType, name, opening);
+    delete storage;
+
+    // TYPE id ( P ) { L } becomes the name holding the return type, the parameters and { holding the body
+    SyntaxTree::SyntaxTreeNode* parameters = opening->next;
+    SyntaxTree::SyntaxTreeNode* closing = parameters->next;
+    SyntaxTree::SyntaxTreeNode* scope = closing->next;
+    SyntaxTree::SyntaxTreeNode* list = scope->next;
+    SyntaxTree::SyntaxTreeNode* closingScope = list->next;
+    opening->next = parameters->next = closing->next = scope->next = list->next = nullptr;
+    unsigned int end = closingScope->val.offset + closingScope->val.length;
+    delete opening;
+    delete closing;
+    delete closingScope;
+
+    span(returnType);
+    name->val.term = Terminal::FUNCTION_DEF;
+    name->children = returnType;
+    returnType->next = convertParameters(parameters);
+    SyntaxTree::SyntaxTreeNode* last = returnType;
+    while (last->next != nullptr)
+        last = last->next;
+    last->next = scope;
+    scope->children = convertList(list);
+    span(scope);
+    scope->length = end - scope->offset;
+    span(name);
+    return name;
+}
+
+ccc::SyntaxTree::SyntaxTreeNode* ccc::LL1Parser::convertDeclaration(SyntaxTree::SyntaxTreeNode* storage, SyntaxTree::SyntaxTreeNode* type,
+    SyntaxTree::SyntaxTreeNode* name, SyntaxTree::SyntaxTreeNode* rest)
+{
+    // TYPE id ; or TYPE id = A ; becomes the name holding the type, which holds the storage specifier, and the initializer
+    name->val.term = Terminal::VARIABLE_DECL;
+    name->children = type;
+    type->children = storage;
+    if (storage != nullptr)
+        span(storage);
+    span(type);
+    SyntaxTree::SyntaxTreeNode* semicolon = rest;
+    if (rest->val.term == Terminal::ASSIGNMENT_OP) {
+        SyntaxTree::SyntaxTreeNode* value = rest->next;
+        semicolon = value->next;
+        rest->next = value->next = nullptr;
+        type->next = convertStatement(value);
+        delete rest;
+    }
+    span(name);
+    // the span ends with the ;
+    name->length = semicolon->val.offset + semicolon->val.length - name->offset;
+    delete semicolon;
+    return name;
+}
+
+ccc::SyntaxTree::SyntaxTreeNode* ccc::LL1Parser::convertParameters(SyntaxTree::SyntaxTreeNode* list)
+{
+    // P -> TYPE id P' and P' -> , TYPE id P' | epsilon, every id holds its type
+    SyntaxTree::SyntaxTreeNode* res = nullptr;
+    SyntaxTree::SyntaxTreeNode** tail = &res;
+    while (list != nullptr) {
+        SyntaxTree::SyntaxTreeNode* type = list->children;
+        list->children = nullptr;
+        delete list;
+        if (type == nullptr)
+            break;
+        if (type->val.term == Terminal::COMMA) {
+            SyntaxTree::SyntaxTreeNode* comma = type;
+            type = comma->next;
+            comma->next = nullptr;
+            delete comma;
         }
+        SyntaxTree::SyntaxTreeNode* name = type->next;
+        list = name->next;
+        type->next = name->next = nullptr;
+        name->children = type->children;
+        type->children = nullptr;
+        delete type;
+        span(name->children);
+        span(name);
+        *tail = name;
+        tail = &name->next;
     }
-    node->next = nullptr;
+    return res;
+}
 
-    if (children == nullptr && next == nullptr) {
-        delete node->children;
-        node->children = nullptr;
+ccc::SyntaxTree::SyntaxTreeNode* ccc::LL1Parser::convertArguments(SyntaxTree::SyntaxTreeNode* list)
+{
+    // V -> A V' and V' -> , A V' | epsilon
+    SyntaxTree::SyntaxTreeNode* res = nullptr;
+    SyntaxTree::SyntaxTreeNode** tail = &res;
+    while (list != nullptr) {
+        SyntaxTree::SyntaxTreeNode* argument = list->children;
+        list->children = nullptr;
+        delete list;
+        if (argument == nullptr)
+            break;
+        if (argument->val.term == Terminal::COMMA) {
+            SyntaxTree::SyntaxTreeNode* comma = argument;
+            argument = comma->next;
+            comma->next = nullptr;
+            delete comma;
+        }
+        list = argument->next;
+        argument->next = nullptr;
+        *tail = convertStatement(argument);
+        tail = &(*tail)->next;
     }
-    if (node->val.term == Terminal::NON_TERMINAL) {
-        SyntaxTree::SyntaxTreeNode* temp = node->children;
-        node->children = nullptr;
-        delete node;
-        if (reorderChildren)
-            return temp;
-        return children;
+    return res;
+}
+
+ccc::SyntaxTree::SyntaxTreeNode* ccc::LL1Parser::convertChain(SyntaxTree::SyntaxTreeNode* node)
+{
+    // E -> E' S and E' -> T F, the operators of S and F nest to the right
+    SyntaxTree::SyntaxTreeNode* operand = node->children;
+    SyntaxTree::SyntaxTreeNode* rest = operand->next;
+    node->children = nullptr;
+    operand->next = nullptr;
+    delete node;
+    return convertChainRest(operand->val.lexeme == "T" ? convertFactor(operand) : convertChain(operand), rest);
+}
+
+ccc::SyntaxTree::SyntaxTreeNode* ccc::LL1Parser::convertChainRest(SyntaxTree::SyntaxTreeNode* lhs, SyntaxTree::SyntaxTreeNode* rest)
+{
+    // S -> + E' S and F -> * T F, or epsilon
+    SyntaxTree::SyntaxTreeNode* op = rest->children;
+    rest->children = nullptr;
+    delete rest;
+    if (op == nullptr)
+        return lhs;
+    SyntaxTree::SyntaxTreeNode* operand = op->next;
+    SyntaxTree::SyntaxTreeNode* tail = operand->next;
+    op->next = operand->next = nullptr;
+    op->children = lhs;
+    lhs->next = convertChainRest(operand->val.lexeme == "T" ? convertFactor(operand) : convertChain(operand), tail);
+    span(op);
+    return op;
+}
+
+ccc::SyntaxTree::SyntaxTreeNode* ccc::LL1Parser::convertFactor(SyntaxTree::SyntaxTreeNode* node)
+{
+    // T -> id T' | literal | ( E ) and T' -> ( V ) | epsilon
+    SyntaxTree::SyntaxTreeNode* first = node->children;
+    node->children = nullptr;
+    delete node;
+    SyntaxTree::SyntaxTreeNode* next = first->next;
+    first->next = nullptr;
+    if (first->val.term == Terminal::OPENING_BRACKET) {
+        // the span of a bracketed expression includes its brackets
+        SyntaxTree::SyntaxTreeNode* closing = next->next;
+        next->next = nullptr;
+        SyntaxTree::SyntaxTreeNode* inner = convertChain(next);
+        inner->offset = first->val.offset;
+        inner->length = closing->val.offset + closing->val.length - inner->offset;
+        delete first;
+        delete closing;
+        return inner;
+    }
+    span(first);
+    if (next == nullptr)
+        return first;
+    SyntaxTree::SyntaxTreeNode* opening = next->children;
+    next->children = nullptr;
+    delete next;
+    if (opening == nullptr)
+        return first;
+    // a call holds its arguments
+    SyntaxTree::SyntaxTreeNode* arguments = opening->next;
+    SyntaxTree::SyntaxTreeNode* closing = arguments->next;
+    opening->next = arguments->next = nullptr;
+    first->val.term = Terminal::FUNCTION_CALL;
+    first->children = convertArguments(arguments);
+    first->length = closing->val.offset + closing->val.length - first->offset;
+    delete opening;
+    delete closing;
+    return first;
+}
+
+ccc::PrattParser::PrattParser(TokenSource& buffer)
+    : Parser { buffer }
+{
+}
+
+bool ccc::PrattParser::parseStatement(SyntaxTree& res, bool& more)
+{
+    // the same statements start a definition, a block or an expression as for LL1Parser
+    Terminal first = buffer.consume()->term;
+    bool definition = first == Terminal::BUILTIN_TYPE_INT || first == Terminal::BUILTIN_TYPE_FLOAT || first == Terminal::BUILTIN_TYPE_CHAR
+        || first == Terminal::STORAGE_STATIC || first == Terminal::STORAGE_EXTERN;
+    bool block = definition || first == Terminal::CONTROL_FLOW_BRANCH || first == Terminal::CONTROL_FLOW_WHILE;
+    res.root = definition ? this->definition(true) : block ? control() : assignment();
+    if (res.root == nullptr)
+        return false;
+    return endStatement(block, more);
+}
+
+void ccc::PrattParser::convertToAst(SyntaxTree&)
+{
+    // the statements already are ASTs
+}
+
+ccc::SyntaxTree::SyntaxTreeNode* ccc::PrattParser::statement()
+{
+    switch (buffer.consume()->term) {
+    case Terminal::CONTROL_FLOW_RETURN: {
+        // return A ; holds the value
+        std::unique_ptr<Node> keyword { take() };
+        if (!keyword)
+            return nullptr;
+        keyword->children = assignment();
+        if (keyword->children == nullptr || !expect(Terminal::SEMICOLON))
+            return nullptr;
+        span(keyword.get());
+        return keyword.release();
+    }
+    case Terminal::CONTROL_FLOW_BRANCH:
+    case Terminal::CONTROL_FLOW_WHILE:
+        return control();
+    case Terminal::BUILTIN_TYPE_INT:
+    case Terminal::BUILTIN_TYPE_FLOAT:
+    case Terminal::BUILTIN_TYPE_CHAR:
+    case Terminal::STORAGE_STATIC:
+    case Terminal::STORAGE_EXTERN:
+        return definition(false);
+    case Terminal::ID:
+    case Terminal::INT_LITERAL:
+    case Terminal::FLOAT_LITERAL:
+    case Terminal::OPENING_BRACKET: {
+        std::unique_ptr<Node> expression { assignment() };
+        if (!expression || !expect(Terminal::SEMICOLON))
+            return nullptr;
+        return expression.release();
+    }
+    default:
+        unexpected();
+        return nullptr;
+    }
+}
+
+bool ccc::PrattParser::block(Node* scope)
+{
+    Node** tail = &scope->children;
+    while (buffer.consume()->term != Terminal::CLOSED_SCOPE) {
+        *tail = statement();
+        if (*tail == nullptr)
+            return false;
+        tail = &(*tail)->next;
+    }
+    const Token& closing = *buffer.consume();
+    span(scope);
+    scope->length = closing.offset + closing.length - scope->offset;
+    buffer.pop();
+    return true;
+}
+
+ccc::SyntaxTree::SyntaxTreeNode* ccc::PrattParser::definition(bool functions)
+{
+    // SPEC TYPE id, the storage specifier only matters to variables
+    std::unique_ptr<Node> storage;
+    Terminal first = buffer.consume()->term;
+    if (first == Terminal::STORAGE_STATIC || first == Terminal::STORAGE_EXTERN) {
+        storage.reset(take());
+        if (!storage)
+            return nullptr;
+        first = buffer.consume()->term;
+    }
+    if (first != Terminal::BUILTIN_TYPE_INT && first != Terminal::BUILTIN_TYPE_FLOAT && first != Terminal::BUILTIN_TYPE_CHAR) {
+        unexpected();
+        return nullptr;
+    }
+    std::unique_ptr<Node> type { take() };
+    if (!type)
+        return nullptr;
+    std::unique_ptr<Node> name { take(Terminal::ID) };
+    if (!name)
+        return nullptr;
+    Terminal rest = buffer.consume()->term;
+    if (functions && rest == Terminal::OPENING_BRACKET)
+        return function(name.release(), type.release());
+    if (rest != Terminal::SEMICOLON && rest != Terminal::ASSIGNMENT_OP) {
+        unexpected();
+        return nullptr;
+    }
+
+    // TYPE id ; or TYPE id = A ; becomes the name holding the type, which holds the storage specifier, and the initializer
+    name->val.term = Terminal::VARIABLE_DECL;
+    if (storage)
+        span(storage.get());
+    type->children = storage.release();
+    span(type.get());
+    name->children = type.release();
+    if (rest == Terminal::ASSIGNMENT_OP) {
+        buffer.pop();
+        name->children->next = assignment();
+        if (name->children->next == nullptr)
+            return nullptr;
+    }
+    const Token& semicolon = *buffer.consume();
+    if (semicolon.term != Terminal::SEMICOLON) {
+        expect(Terminal::SEMICOLON);
+        return nullptr;
+    }
+    span(name.get());
+    // the span ends with the ;
+    name->length = semicolon.offset + semicolon.length - name->offset;
+    buffer.pop();
+    return name.release();
+}
+
+ccc::SyntaxTree::SyntaxTreeNode* ccc::PrattParser::function(Node* name, Node* type)
+{
+    // the name holds the return type, the parameters, every id holding its type, and { holding the body
+    std::unique_ptr<Node> res { name };
+    res->val.term = Terminal::FUNCTION_DEF;
+    res->children = type;
+    span(type);
+    buffer.pop();
+    Node** tail = &type->next;
+    if (buffer.consume()->term != Terminal::CLOSING_BRACKET) {
+        for (;;) {
+            Terminal first = buffer.consume()->term;
+            if (first != Terminal::BUILTIN_TYPE_INT && first != Terminal::BUILTIN_TYPE_FLOAT && first != Terminal::BUILTIN_TYPE_CHAR) {
+                unexpected();
+                return nullptr;
+            }
+            std::unique_ptr<Node> parameterType { take() };
+            if (!parameterType)
+                return nullptr;
+            *tail = take(Terminal::ID);
+            if (*tail == nullptr)
+                return nullptr;
+            span(parameterType.get());
+            (*tail)->children = parameterType.release();
+            span(*tail);
+            tail = &(*tail)->next;
+            Terminal next = buffer.consume()->term;
+            if (next == Terminal::CLOSING_BRACKET)
+                break;
+            if (next != Terminal::COMMA) {
+                unexpected();
+                return nullptr;
+            }
+            buffer.pop();
+        }
+    }
+    buffer.pop();
+    *tail = take(Terminal::OPEN_SCOPE);
+    if (*tail == nullptr || !block(*tail))
+        return nullptr;
+    span(res.get());
+    return res.release();
+}
+
+ccc::SyntaxTree::SyntaxTreeNode* ccc::PrattParser::control()
+{
+    // if ( A logop A ) { L } becomes if holding the comparison and { holding the statements of L
+    std::unique_ptr<Node> keyword { take() };
+    if (!keyword || !expect(Terminal::OPENING_BRACKET))
+        return nullptr;
+    std::unique_ptr<Node> lhs { assignment() };
+    if (!lhs)
+        return nullptr;
+    std::unique_ptr<Node> comparison { take(Terminal::LOGICAL_OP) };
+    if (!comparison)
+        return nullptr;
+    comparison->children = lhs.release();
+    comparison->children->next = assignment();
+    if (comparison->children->next == nullptr || !expect(Terminal::CLOSING_BRACKET))
+        return nullptr;
+    span(comparison.get());
+    std::unique_ptr<Node> scope { take(Terminal::OPEN_SCOPE) };
+    if (!scope || !block(scope.get()))
+        return nullptr;
+    comparison->next = scope.release();
+    keyword->children = comparison.release();
+    span(keyword.get());
+    return keyword.release();
+}
+
+ccc::SyntaxTree::SyntaxTreeNode* ccc::PrattParser::assignment()
+{
+    // E = A nests the assignments to the right
+    std::unique_ptr<Node> lhs { expression(0) };
+    if (!lhs || buffer.consume()->term != Terminal::ASSIGNMENT_OP)
+        return lhs.release();
+    std::unique_ptr<Node> res { take() };
+    if (!res)
+        return nullptr;
+    lhs->next = assignment();
+    if (lhs->next == nullptr)
+        return nullptr;
+    res->children = lhs.release();
+    span(res.get());
+    return res.release();
+}
+
+ccc::SyntaxTree::SyntaxTreeNode* ccc::PrattParser::expression(int precedence)
+{
+    // the right operand takes every operator binding as tight as its own, so equal operators nest to the right
+    std::unique_ptr<Node> lhs { factor() };
+    if (!lhs)
+        return nullptr;
+    for (int next = this->precedence(buffer.consume()->term); next >= precedence; next = this->precedence(buffer.consume()->term)) {
+        std::unique_ptr<Node> op { take() };
+        if (!op)
+            return nullptr;
+        lhs->next = expression(next);
+        if (lhs->next == nullptr)
+            return nullptr;
+        op->children = lhs.release();
+        span(op.get());
+        lhs = std::move(op);
+    }
+    return lhs.release();
+}
+
+ccc::SyntaxTree::SyntaxTreeNode* ccc::PrattParser::factor()
+{
+    // T -> id T' | literal | ( E ) and T' -> ( V ) | epsilon
+    std::unique_ptr<Node> res;
+    const Token& first = *buffer.consume();
+    if (first.term == Terminal::INT_LITERAL || first.term == Terminal::FLOAT_LITERAL || first.term == Terminal::ID) {
+        res.reset(take());
+        if (!res)
+            return nullptr;
+        span(res.get());
+        if (res->val.term == Terminal::ID && buffer.consume()->term == Terminal::OPENING_BRACKET && !call(res.get()))
+            return nullptr;
+    } else if (first.term == Terminal::OPENING_BRACKET) {
+        // the span of a bracketed expression includes its brackets
+        unsigned int offset = first.offset;
+        buffer.pop();
+        res.reset(expression(0));
+        if (!res)
+            return nullptr;
+        const Token& closing = *buffer.consume();
+        if (closing.term != Terminal::CLOSING_BRACKET) {
+            expect(Terminal::CLOSING_BRACKET);
+            return nullptr;
+        }
+        res->offset = offset;
+        res->length = closing.offset + closing.length - offset;
+        buffer.pop();
+    } else {
+        unexpected();
+        return nullptr;
+    }
+
+    // only what may follow T in the grammar ends the operand
+    switch (buffer.consume()->term) {
+    case Terminal::ARITHMETIC_OP_PLUS:
+    case Terminal::ARITHMETIC_OP_MINUS:
+    case Terminal::ARITHMETIC_OP_MULT:
+    case Terminal::ARITHMETIC_OP_DIV:
+    case Terminal::FILE_END:
+    case Terminal::CLOSING_BRACKET:
+    case Terminal::SEMICOLON:
+    case Terminal::COMMA:
+    case Terminal::ASSIGNMENT_OP:
+    case Terminal::LOGICAL_OP:
+        return res.release();
+    default:
+        unexpected();
+        return nullptr;
+    }
+}
+
+bool ccc::PrattParser::call(Node* name)
+{
+    // a call holds its arguments
+    name->val.term = Terminal::FUNCTION_CALL;
+    buffer.pop();
+    Node** tail = &name->children;
+    if (buffer.consume()->term != Terminal::CLOSING_BRACKET) {
+        for (;;) {
+            *tail = assignment();
+            if (*tail == nullptr)
+                return false;
+            tail = &(*tail)->next;
+            Terminal next = buffer.consume()->term;
+            if (next == Terminal::CLOSING_BRACKET)
+                break;
+            if (next != Terminal::COMMA)
+                return unexpected();
+            buffer.pop();
+        }
+    }
+    const Token& closing = *buffer.consume();
+    name->length = closing.offset + closing.length - name->offset;
+    buffer.pop();
+    return true;
+}
+
+ccc::SyntaxTree::SyntaxTreeNode* ccc::PrattParser::take()
+{
+    const Token& token = *buffer.consume();
+    if (MemoryStats::exceeded()) {
+        fail(token, "memory budget of " + std::to_string(MemoryStats::budget()) + " bytes exceeded");
+        return nullptr;
+    }
+    Node* res = new Node { token };
+    buffer.pop();
+    return res;
+}
+
+ccc::SyntaxTree::SyntaxTreeNode* ccc::PrattParser::take(Terminal term)
+{
+    if (buffer.consume()->term != term) {
+        expect(term);
+        return nullptr;
+    }
+    return take();
+}
+
+bool ccc::PrattParser::expect(Terminal term)
+{
+    const Token& token = *buffer.consume();
+    if (token.term == term) {
+        buffer.pop();
+        return true;
+    }
+    if (terminalsToProductions.find(token.term) == terminalsToProductions.end())
+        return fail(token, invalidToken(token));
+    return fail(token, "expected '" + terminalsToProductions.find(term)->second + "' before " + describe(token));
+}
+
+bool ccc::PrattParser::unexpected()
+{
+    const Token& token = *buffer.consume();
+    if (terminalsToProductions.find(token.term) == terminalsToProductions.end())
+        return fail(token, invalidToken(token));
+    return fail(token, "unexpected " + describe(token));
+}
+
+int ccc::PrattParser::precedence(Terminal term)
+{
+    switch (term) {
+    case Terminal::ARITHMETIC_OP_MULT:
+    case Terminal::ARITHMETIC_OP_DIV:
+        return 2;
+    case Terminal::ARITHMETIC_OP_PLUS:
+    case Terminal::ARITHMETIC_OP_MINUS:
+        return 1;
+    default:
+        return -1;
+    }
+}
+
+ccc::StreamingParser::StreamingParser(TokenSource& buffer)
+    : LL1Parser { buffer }
+{
+    for (const char* nonTerminal : { "E", "S", "E'", "F", "T" }) {
+        postfixTable.emplace(nonTerminal, parsingTable[nonTerminal]);
+        // S -> + E' S # applies the + after the whole right operand, the same nesting convertChainRest builds
+        if (nonTerminal == std::string("S") || nonTerminal == std::string("F"))
+            for (auto& entry : postfixTable[nonTerminal])
+                if (entry.second.front() != "epsilon")
+                    entry.second.push_back(POSTFIX_ACTION);
+    }
+    postfixTable["T"].erase(Terminal::ID);
+}
+
+bool ccc::StreamingParser::stream(PostfixSink& sink, bool& more)
+{
+    grammarSymbols = {};
+    grammarSymbols.push("$");
+    grammarSymbols.push("E");
+    operators.clear();
+    std::string error;
+
+    while (grammarSymbols.top() != "$") {
+        const Token& input = *buffer.consume();
+        if (MemoryStats::exceeded())
+            return fail(input, "memory budget of " + std::to_string(MemoryStats::budget()) + " bytes exceeded");
+        std::string symbol = grammarSymbols.top();
+        grammarSymbols.pop();
+        if (symbol == POSTFIX_ACTION) {
+            if (!sink.apply(operators.back(), error))
+                return fail(operators.back(), error);
+            operators.pop_back();
+            continue;
+        }
+        auto production = terminalsToProductions.find(input.term);
+        if (production == terminalsToProductions.end())
+            return fail(input, invalidToken(input));
+        if (symbol == production->second) {
+            if (input.term == Terminal::INT_LITERAL || input.term == Terminal::FLOAT_LITERAL) {
+                if (!sink.operand(input, error))
+                    return fail(input, error);
+            } else if (input.term != Terminal::OPENING_BRACKET && input.term != Terminal::CLOSING_BRACKET) {
+                operators.push_back(input);
+            }
+            buffer.pop();
+            continue;
+        }
+        if (terminals.find(symbol) != terminals.end())
+            return fail(input, "expected '" + symbol + "' before " + describe(input));
+        auto row = postfixTable.find(symbol);
+        auto entry = row->second.find(input.term);
+        if (entry == row->second.end()) {
+            if (input.term == Terminal::ID)
+                return fail(input, "only literals and arithmetic can be streamed, not " + describe(input));
+            return fail(input, "unexpected " + describe(input));
+        }
+        for (auto next = entry->second.rbegin(); next != entry->second.rend(); ++next)
+            if (*next != "epsilon")
+                grammarSymbols.push(*next);
     }
-    return node;
+    return endStatement(false, more);
 }
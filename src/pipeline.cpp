@@ -0,0 +1,223 @@
+#include "pipeline.h"
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <thread>
+#include <utility>
+
+/* Tokens the lexer may run ahead of the parser */
+#define TOKEN_CAPACITY 4096
+/* Smallest file in bytes worth the threads on a multicore machine, see ccc_threading_bench */
+#define THREADED_FROM (64 << 10)
+
+ccc::Pipeline::StatementQueue::StatementQueue(std::size_t capacity)
+    : capacity { std::max<std::size_t>(capacity, 1) }
+{
+}
+
+ccc::Pipeline::StatementQueue::~StatementQueue()
+{
+    while (!statements.empty()) {
+        delete statements.front();
+        statements.pop();
+    }
+}
+
+void ccc::Pipeline::StatementQueue::push(SyntaxTree* statement)
+{
+    std::unique_lock<std::mutex> lock { m };
+    // the end of the stream never waits, the evaluator may already be gone
+    if (statement != nullptr && statements.size() >= capacity) {
+        Tracer::Scope stall { "wait for evaluator" };
+        drained.wait(lock, [this]() { return statements.size() < capacity; });
+    }
+    statements.push(statement);
+    lock.unlock();
+    filled.notify_one();
+}
+
+ccc::SyntaxTree* ccc::Pipeline::StatementQueue::pop()
+{
+    std::unique_lock<std::mutex> lock { m };
+    if (statements.empty()) {
+        Tracer::Scope stall { "wait for statements" };
+        filled.wait(lock, [this]() { return !statements.empty(); });
+    }
+    SyntaxTree* res = statements.front();
+    statements.pop();
+    lock.unlock();
+    drained.notify_one();
+    return res;
+}
+
+// on a single core the stages cannot overlap and threads only add handoffs
+const std::size_t ccc::Pipeline::defaultThreadedFrom = std::thread::hardware_concurrency() > 1 ? THREADED_FROM : std::numeric_limits<std::size_t>::max();
+
+ccc::Pipeline::Pipeline(VMFactory factory, std::size_t depth, std::size_t threadedFrom, bool hashCons, Parser::Backend parser)
+    : factory { std::move(factory) }
+    , depth { depth }
+    , threadedFrom { threadedFrom }
+    , hashCons { hashCons }
+    , backend { parser }
+    , usedThreads { false }
+    , parsed { false }
+    , evaluated { 0 }
+{
+}
+
+void ccc::Pipeline::parse(TokenSource& buffer, StatementQueue& queue)
+{
+    std::unique_ptr<Parser> parser = Parser::create(backend, buffer);
+    bool more = true;
+    while (more) {
+        std::unique_ptr<SyntaxTree> statement { new SyntaxTree };
+        if (!parseStatement(*parser, *statement, more))
+            break;
+        queue.push(statement.release());
+    }
+    queue.push(nullptr);
+}
+
+bool ccc::Pipeline::parseStatement(Parser& parser, SyntaxTree& statement, bool& more)
+{
+    {
+        Tracer::Scope parsing { "parse" };
+        if (!parser.parseStatement(statement, more)) {
+            lastError = parser.error();
+            parsed = false;
+            return false;
+        }
+    }
+    {
+        Tracer::Scope converting { "convertToAst" };
+        parser.convertToAst(statement);
+    }
+    if (hashCons) {
+        Tracer::Scope sharing { "hashCons" };
+        statement.hashCons();
+    }
+    return true;
+}
+
+void ccc::Pipeline::evaluate(SyntaxTree* statement, Globals& globals, const Callback& callback)
+{
+    Token value { "", Terminal::ERROR };
+    {
+        std::unique_ptr<VM> vm;
+        {
+            Tracer::Scope compiling { "compile" };
+            vm = factory(*statement, globals);
+        }
+        bool ok;
+        {
+            Tracer::Scope running { "run" };
+            ok = vm->run();
+        }
+        if (ok) {
+            vm->result(value);
+        } else if (compileError.message.empty()) {
+            compileError = vm->error();
+            // a VM that gives no reason still fails the run at the statement
+            if (compileError.message.empty()) {
+                const SyntaxTree::SyntaxTreeNode* root = statement->root;
+                compileError = Diagnostic { "statement did not evaluate", root != nullptr ? root->offset : 0, root != nullptr ? root->length : 0 };
+            }
+        }
+        if (callback)
+            callback(evaluated, ok, value);
+    }
+    if (statement->root != nullptr && statement->root->val.term == Terminal::FUNCTION_DEF)
+        definitions.emplace_back(statement);
+    else
+        delete statement;
+    ++evaluated;
+}
+
+bool ccc::Pipeline::run(const std::string& filePath, const Callback& callback)
+{
+    Tracer::Scope traced { "file", Tracer::active() ? Tracer::intern(filePath) : nullptr };
+    start();
+    std::ifstream file { filePath, std::ios::binary | std::ios::ate };
+    // a missing file is reported by the lexer either way
+    std::size_t size = file.is_open() ? static_cast<std::size_t>(file.tellg()) : 0;
+    file.close();
+    usedThreads = size >= threadedFrom;
+    Globals globals;
+    if (usedThreads)
+        return finish(runThreaded(filePath, globals, callback));
+    PullLexer source { lexer, filePath };
+    return finish(runSingleThreaded(source, globals, callback));
+}
+
+bool ccc::Pipeline::run(const char* source, std::size_t length, const Callback& callback)
+{
+    Tracer::Scope traced { "source" };
+    start();
+    usedThreads = false;
+    Globals globals;
+    PullLexer tokens { lexer, source, length };
+    return finish(runSingleThreaded(tokens, globals, callback));
+}
+
+void ccc::Pipeline::start()
+{
+    parsed = true;
+    evaluated = 0;
+    compileError = Diagnostic {};
+}
+
+bool ccc::Pipeline::finish(bool res)
+{
+    definitions.clear();
+    if (compileError.message.empty())
+        return res;
+    // a statement that did not compile or run fails the run like a syntax error, the earlier of the two is reported
+    if (res || compileError.offset < lastError.offset)
+        lastError = compileError;
+    return false;
+}
+
+bool ccc::Pipeline::runSingleThreaded(TokenSource& source, Globals& globals, const Callback& callback)
+{
+    std::unique_ptr<Parser> parser = Parser::create(backend, source);
+    bool more = true;
+    while (more) {
+        std::unique_ptr<SyntaxTree> statement { new SyntaxTree };
+        if (!parseStatement(*parser, *statement, more))
+            break;
+        evaluate(statement.release(), globals, callback);
+    }
+    return parsed;
+}
+
+bool ccc::Pipeline::runThreaded(const std::string& filePath, Globals& globals, const Callback& callback)
+{
+    SharedBuffer buffer { true, TOKEN_CAPACITY };
+    StatementQueue queue { depth };
+    std::thread lexerThread { &Lexer::run, &lexer, filePath, std::ref(buffer) };
+    std::thread parserThread { &Pipeline::parse, this, std::ref(buffer), std::ref(queue) };
+
+    // the calling thread is the evaluation stage
+    while (SyntaxTree* statement = queue.pop())
+        evaluate(statement, globals, callback);
+
+    parserThread.join();
+    // a failed parse closed the buffer, so the lexer does not wait for room that never comes
+    lexerThread.join();
+    return parsed;
+}
+
+const ccc::Diagnostic& ccc::Pipeline::error() const
+{
+    return lastError;
+}
+
+std::size_t ccc::Pipeline::evaluatedStatements() const
+{
+    return evaluated;
+}
+
+bool ccc::Pipeline::threaded() const
+{
+    return usedThreads;
+}
@@ -0,0 +1,139 @@
+#include "profiler.h"
+#include <algorithm>
+#include <cstdio>
+#include <map>
+
+#define FRAME_TEXT_LIMIT 40
+
+ccc::Profiler::Profiler(const std::string& source, const SyntaxTree& ast, unsigned int sampleInterval)
+    : source { source }
+    , lines { source.data(), source.size() }
+    , runs { 0 }
+    , sampled { false }
+    , interval { std::max(sampleInterval, 1u) }
+    , overhead { ~0ULL }
+{
+    collectParents(ast.root, nullptr);
+    // the cheapest of a few back to back reads is what a sample pays for the clock itself
+    for (int i = 0; i < 64; ++i) {
+        unsigned long long start = now();
+        overhead = std::min(overhead, now() - start);
+    }
+}
+
+void ccc::Profiler::collectParents(const SyntaxTree::SyntaxTreeNode* node, const SyntaxTree::SyntaxTreeNode* parent)
+{
+    for (; node != nullptr; node = node->next) {
+        parents[node] = parent;
+        collectParents(node->children, node);
+    }
+}
+
+ccc::Profiler::Counter* ccc::Profiler::attach(const std::vector<const SyntaxTree::SyntaxTreeNode*>& instructionNodes, bool sampledExecutions)
+{
+    nodes = instructionNodes;
+    sampled = sampledExecutions;
+    counters.assign(nodes.size(), Counter { 0, 0 });
+    stops.assign(nodes.size() + 1, 0);
+    runs = 0;
+    return counters.data();
+}
+
+void ccc::Profiler::enter()
+{
+    ++runs;
+}
+
+void ccc::Profiler::stop(std::size_t instruction)
+{
+    ++stops[instruction + 1];
+}
+
+void ccc::Profiler::countExecutions()
+{
+    if (sampled)
+        return;
+    unsigned long long running = runs;
+    for (std::size_t i = 0; i < counters.size(); ++i) {
+        running -= stops[i];
+        counters[i].executions = running;
+    }
+}
+
+unsigned int ccc::Profiler::sampleInterval() const
+{
+    return interval;
+}
+
+unsigned long long ccc::Profiler::clockOverhead() const
+{
+    return overhead;
+}
+
+std::string ccc::Profiler::frame(const SyntaxTree::SyntaxTreeNode* node)
+{
+    unsigned int line;
+    unsigned int column;
+    lines.locate(node->offset, line, column);
+    std::string text;
+    for (std::size_t i = node->offset; i < node->offset + node->length && i < source.size(); ++i) {
+        if (text.size() == FRAME_TEXT_LIMIT) {
+            text += "...";
+            break;
+        }
+        char c = source[i];
+        // ; separates frames and line breaks separate stacks in the folded format
+        if (c == ';')
+            c = ',';
+        else if (c == '\n' || c == '\r' || c == '\t')
+            c = ' ';
+        text += c;
+    }
+    return std::to_string(line) + ":" + std::to_string(column) + " " + text;
+}
+
+void ccc::Profiler::writeFolded(std::ostream& out)
+{
+    std::map<std::string, unsigned long long> stacks;
+    std::vector<const SyntaxTree::SyntaxTreeNode*> path;
+    for (std::size_t i = 0; i < nodes.size(); ++i) {
+        if (counters[i].cycles == 0 || nodes[i] == nullptr)
+            continue;
+        path.clear();
+        for (const SyntaxTree::SyntaxTreeNode* node = nodes[i]; node != nullptr; node = parents[node])
+            path.push_back(node);
+        std::string key;
+        for (auto node = path.rbegin(); node != path.rend(); ++node) {
+            if (!key.empty())
+                key += ';';
+            key += frame(*node);
+        }
+        stacks[key] += counters[i].cycles;
+    }
+    for (const auto& stack : stacks)
+        out << stack.first << ' ' << stack.second << '\n';
+}
+
+void ccc::Profiler::writeReport(std::ostream& out, std::size_t n)
+{
+    countExecutions();
+    // fused instructions can share a node, so sum per node first
+    std::unordered_map<const SyntaxTree::SyntaxTreeNode*, Counter> perNode;
+    unsigned long long total = 0;
+    for (std::size_t i = 0; i < nodes.size(); ++i) {
+        Counter& counter = perNode.emplace(nodes[i], Counter { 0, 0 }).first->second;
+        counter.executions += counters[i].executions;
+        counter.cycles += counters[i].cycles;
+        total += counters[i].cycles;
+    }
+    std::vector<std::pair<const SyntaxTree::SyntaxTreeNode*, Counter>> hot { perNode.begin(), perNode.end() };
+    std::sort(hot.begin(), hot.end(), [](const auto& lhs, const auto& rhs) { return lhs.second.cycles > rhs.second.cycles; });
+
+    out << "   cycles      %   executions  node\n";
+    for (std::size_t i = 0; i < hot.size() && i < n; ++i) {
+        char line[64];
+        std::snprintf(line, sizeof(line), "%9llu %6.2f %12llu  ", hot[i].second.cycles,
+            total == 0 ? 0.0 : 100.0 * hot[i].second.cycles / total, hot[i].second.executions);
+        out << line << (hot[i].first == nullptr ? std::string { "?" } : frame(hot[i].first)) << '\n';
+    }
+}
@@ -1,45 +1,342 @@
 #include "utility.h"
+#include <cstdio>
 
-ccc::SharedBuffer::SharedBuffer()
+/* Queued tokens may hold this fraction of the memory budget, the rest is left to the parser */
+#define QUEUE_BUDGET_SHARE 16
+/* Newest events kept per thread, a power of two */
+#define RING_EVENTS (std::size_t { 1 } << 15)
+
+std::atomic<std::size_t> ccc::MemoryStats::currents[static_cast<int>(Subsystem::COUNT)] {};
+std::atomic<std::size_t> ccc::MemoryStats::peaks[static_cast<int>(Subsystem::COUNT)] {};
+std::atomic<std::size_t> ccc::MemoryStats::total { 0 };
+std::atomic<std::size_t> ccc::MemoryStats::totalPeak { 0 };
+std::atomic<std::size_t> ccc::MemoryStats::limit { 0 };
+std::atomic<bool> ccc::MemoryStats::overBudget { false };
+std::atomic<std::size_t> ccc::MemoryStats::hashConsBefore { 0 };
+std::atomic<std::size_t> ccc::MemoryStats::hashConsAfter { 0 };
+std::atomic<std::size_t> ccc::MemoryStats::hashConsSaved { 0 };
+
+void ccc::MemoryStats::raisePeak(std::atomic<std::size_t>& peak, std::size_t value)
+{
+    std::size_t seen = peak.load(std::memory_order_relaxed);
+    while (seen < value && !peak.compare_exchange_weak(seen, value, std::memory_order_relaxed))
+        ;
+}
+
+bool ccc::MemoryStats::fits(std::size_t bytes)
+{
+    std::size_t budget = limit.load(std::memory_order_relaxed);
+    return budget == 0 || total.load(std::memory_order_relaxed) + bytes <= budget;
+}
+
+bool ccc::MemoryStats::allocate(Subsystem subsystem, std::size_t bytes)
+{
+    if (!fits(bytes)) {
+        overBudget.store(true, std::memory_order_relaxed);
+        return false;
+    }
+    charge(subsystem, bytes);
+    return true;
+}
+
+void ccc::MemoryStats::charge(Subsystem subsystem, std::size_t bytes)
+{
+    int i = static_cast<int>(subsystem);
+    raisePeak(peaks[i], currents[i].fetch_add(bytes, std::memory_order_relaxed) + bytes);
+    std::size_t now = total.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    raisePeak(totalPeak, now);
+    std::size_t budget = limit.load(std::memory_order_relaxed);
+    if (budget != 0 && now > budget)
+        overBudget.store(true, std::memory_order_relaxed);
+}
+
+void ccc::MemoryStats::release(Subsystem subsystem, std::size_t bytes)
+{
+    currents[static_cast<int>(subsystem)].fetch_sub(bytes, std::memory_order_relaxed);
+    total.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+std::size_t ccc::MemoryStats::current(Subsystem subsystem)
+{
+    return currents[static_cast<int>(subsystem)].load(std::memory_order_relaxed);
+}
+
+std::size_t ccc::MemoryStats::peak(Subsystem subsystem)
+{
+    return peaks[static_cast<int>(subsystem)].load(std::memory_order_relaxed);
+}
+
+std::size_t ccc::MemoryStats::current()
+{
+    return total.load(std::memory_order_relaxed);
+}
+
+std::size_t ccc::MemoryStats::peak()
+{
+    return totalPeak.load(std::memory_order_relaxed);
+}
+
+void ccc::MemoryStats::setBudget(std::size_t bytes)
+{
+    limit.store(bytes, std::memory_order_relaxed);
+}
+
+std::size_t ccc::MemoryStats::budget()
+{
+    return limit.load(std::memory_order_relaxed);
+}
+
+bool ccc::MemoryStats::exceeded()
+{
+    return overBudget.load(std::memory_order_relaxed);
+}
+
+void ccc::MemoryStats::reset()
+{
+    for (int i = 0; i < static_cast<int>(Subsystem::COUNT); ++i)
+        peaks[i].store(currents[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    totalPeak.store(total.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    overBudget.store(false, std::memory_order_relaxed);
+    hashConsBefore.store(0, std::memory_order_relaxed);
+    hashConsAfter.store(0, std::memory_order_relaxed);
+    hashConsSaved.store(0, std::memory_order_relaxed);
+}
+
+void ccc::MemoryStats::countHashCons(std::size_t nodesBefore, std::size_t nodesAfter, std::size_t bytesSaved)
+{
+    hashConsBefore.fetch_add(nodesBefore, std::memory_order_relaxed);
+    hashConsAfter.fetch_add(nodesAfter, std::memory_order_relaxed);
+    hashConsSaved.fetch_add(bytesSaved, std::memory_order_relaxed);
+}
+
+void ccc::MemoryStats::print(std::ostream& out)
+{
+    const char* names[] = { "lexer buffer", "token queue", "parse tree", "symbol table", "vm stack" };
+    out << "memory            current        peak\n";
+    for (int i = 0; i < static_cast<int>(Subsystem::COUNT); ++i) {
+        char line[64];
+        std::snprintf(line, sizeof(line), "%-14s %10zu  %10zu\n", names[i], current(static_cast<Subsystem>(i)), peak(static_cast<Subsystem>(i)));
+        out << line;
+    }
+    char line[96];
+    std::snprintf(line, sizeof(line), "%-14s %10zu  %10zu\n", "total", current(), peak());
+    out << line;
+    if (budget() != 0) {
+        std::snprintf(line, sizeof(line), "%-14s %10zu%s\n", "budget", budget(), exceeded() ? "  exceeded" : "");
+        out << line;
+    }
+    std::size_t before = hashConsBefore.load(std::memory_order_relaxed);
+    if (before != 0) {
+        std::size_t after = hashConsAfter.load(std::memory_order_relaxed);
+        std::snprintf(line, sizeof(line), "%-14s %zu -> %zu nodes (%.1f%%), %zu bytes saved\n", "hash-consing", before, after,
+            100.0 * (before - after) / before, hashConsSaved.load(std::memory_order_relaxed));
+        out << line;
+    }
+}
+
+ccc::SharedBuffer::SharedBuffer(bool backpressure, std::size_t capacity)
     : count { 0 }
+    , queuedBytes { 0 }
+    , backpressure { backpressure }
+    , capacity { capacity }
+    , producerWaiting { false }
+    , closed { false }
 {
 }
 
 ccc::SharedBuffer::~SharedBuffer()
 {
     while (!buffer.empty()) {
+        MemoryStats::release(MemoryStats::Subsystem::TOKEN_QUEUE, bytes(buffer.front()));
         delete buffer.front();
         buffer.pop();
     }
 }
 
+std::size_t ccc::SharedBuffer::bytes(const Token* token)
+{
+    return sizeof(Token) + token->lexeme.size();
+}
+
+bool ccc::SharedBuffer::hasRoom(std::size_t size) const
+{
+    if (capacity != 0 && count >= capacity)
+        return false;
+    std::size_t budget = MemoryStats::budget();
+    return budget == 0 || (queuedBytes + size <= budget / QUEUE_BUDGET_SHARE && MemoryStats::fits(size));
+}
+
 void ccc::SharedBuffer::produce(Token* token)
 {
     // if lock guard used consume could resume before the lock is released 
     // i.e. method returns which would cause wait to sleep again 
     // since it first tries to lock the mutex and awaken once the lock is released
     // needlessly wasting cycles
-    m.lock();
+    std::size_t size = bytes(token);
+    std::unique_lock<std::mutex> lock { m };
+    // an empty queue always takes the token, the parser could not make progress otherwise
+    if (backpressure && !closed && count != 0 && !hasRoom(size)) {
+        Tracer::Scope stall { "wait for queue room" };
+        producerWaiting = true;
+        room.wait(lock, [this, size]() { return closed || count == 0 || hasRoom(size); });
+        producerWaiting = false;
+    }
+    if (closed) {
+        delete token;
+        return;
+    }
+    MemoryStats::charge(MemoryStats::Subsystem::TOKEN_QUEUE, size);
+    queuedBytes += size;
     buffer.push(token);
     ++count;
-    m.unlock();
+    lock.unlock();
     condition.notify_one();
 }
 
 ccc::Token* ccc::SharedBuffer::consume()
 {
     std::unique_lock<std::mutex> lock { m };
-    condition.wait(lock, [this]() { return count > 0; });
+    if (count == 0) {
+        // the parser stalls on the lexer
+        Tracer::Scope stall { "wait for tokens" };
+        condition.wait(lock, [this]() { return count > 0; });
+    }
     Token* res = buffer.front();
     return res;
 }
 
 void ccc::SharedBuffer::pop()
 {
-    std::lock_guard<std::mutex> lock { m };
+    std::unique_lock<std::mutex> lock { m };
     if (buffer.empty())
         return;
+    std::size_t size = bytes(buffer.front());
+    MemoryStats::release(MemoryStats::Subsystem::TOKEN_QUEUE, size);
+    queuedBytes -= size;
     delete buffer.front();
     --count;
     buffer.pop();
+    // a full queue wakes the lexer once half of it is read instead of for every token
+    bool wake = producerWaiting && (capacity == 0 || count <= capacity / 2);
+    lock.unlock();
+    if (wake)
+        room.notify_one();
+}
+
+void ccc::SharedBuffer::close()
+{
+    {
+        std::lock_guard<std::mutex> lock { m };
+        closed = true;
+    }
+    room.notify_all();
+}
+
+std::atomic<bool> ccc::Tracer::on { false };
+unsigned long long ccc::Tracer::origin { 0 };
+std::mutex ccc::Tracer::m;
+std::vector<std::unique_ptr<ccc::Tracer::Ring>> ccc::Tracer::rings;
+std::vector<ccc::Tracer::Ring*> ccc::Tracer::freeRings;
+std::unordered_set<std::string> ccc::Tracer::names;
+
+void ccc::Tracer::start()
+{
+    std::lock_guard<std::mutex> lock { m };
+    for (const std::unique_ptr<Ring>& ring : rings)
+        ring->head.store(0, std::memory_order_relaxed);
+    origin = now();
+    on.store(true, std::memory_order_release);
+}
+
+void ccc::Tracer::stop()
+{
+    on.store(false, std::memory_order_relaxed);
+}
+
+bool ccc::Tracer::active()
+{
+    return on.load(std::memory_order_relaxed);
+}
+
+const char* ccc::Tracer::intern(const std::string& text)
+{
+    std::lock_guard<std::mutex> lock { m };
+    return names.insert(text).first->c_str();
+}
+
+ccc::Tracer::Owner::~Owner()
+{
+    if (ring == nullptr)
+        return;
+    std::lock_guard<std::mutex> lock { m };
+    freeRings.push_back(ring);
+}
+
+void ccc::Tracer::record(const char* name, const char* detail, unsigned long long begin, unsigned long long end)
+{
+    static thread_local Owner owner { nullptr };
+    if (owner.ring == nullptr) {
+        // once per thread, the events themselves take no lock
+        std::lock_guard<std::mutex> lock { m };
+        if (freeRings.empty()) {
+            rings.emplace_back(new Ring);
+            rings.back()->head.store(0, std::memory_order_relaxed);
+            rings.back()->events.resize(RING_EVENTS);
+            rings.back()->lane = rings.size();
+            owner.ring = rings.back().get();
+        } else {
+            owner.ring = freeRings.back();
+            freeRings.pop_back();
+        }
+    }
+    Ring& ring = *owner.ring;
+    std::size_t head = ring.head.load(std::memory_order_relaxed);
+    ring.events[head & (RING_EVENTS - 1)] = Event { name, detail, begin, end };
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+static void writeString(std::ostream& out, const char* text)
+{
+    out << '"';
+    for (; *text != '\0'; ++text) {
+        if (*text == '"' || *text == '\\')
+            out << '\\' << *text;
+        else if (static_cast<unsigned char>(*text) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", *text);
+            out << escaped;
+        } else
+            out << *text;
+    }
+    out << '"';
+}
+
+void ccc::Tracer::write(std::ostream& out)
+{
+    std::lock_guard<std::mutex> lock { m };
+    out << "{\"traceEvents\":[";
+    bool first = true;
+    for (const std::unique_ptr<Ring>& ring : rings) {
+        std::size_t head = ring->head.load(std::memory_order_acquire);
+        for (std::size_t i = head > RING_EVENTS ? head - RING_EVENTS : 0; i < head; ++i) {
+            const Event& event = ring->events[i & (RING_EVENTS - 1)];
+            if (event.begin < origin)
+                continue;
+            // complete events in microseconds since start
+            char times[96];
+            std::snprintf(times, sizeof(times), ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%zu", (event.begin - origin) / 1e3,
+                (event.end - event.begin) / 1e3, ring->lane);
+            out << (first ? "\n{\"name\":" : ",\n{\"name\":");
+            writeString(out, event.name);
+            out << times;
+            if (event.detail != nullptr) {
+                out << ",\"args\":{\"detail\":";
+                writeString(out, event.detail);
+                out << '}';
+            }
+            out << '}';
+            first = false;
+        }
+    }
+    out << "\n],\"displayTimeUnit\":\"ns\"}\n";
 }
@@ -1,79 +1,1761 @@
 #include "vm.h"
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
 
-ccc::StackBasedVM::StackBasedVM(SyntaxTree& ast)
-    : ast { ast }
+/* Deepest recursion a run may reach before it fails */
+#define FRAME_LIMIT 4096
+
+ccc::VM::VM()
+    : executed { 0 }
+{
+}
+
+unsigned long long ccc::VM::executedInstructions() const
+{
+    return executed;
+}
+
+ccc::VM::Status ccc::VM::resume(const Budget&)
+{
+    return run() ? Status::FINISHED : Status::FAILED;
+}
+
+const ccc::Diagnostic& ccc::VM::error() const
+{
+    return lastError;
+}
+
+ccc::Token ccc::VM::makeOperand(long long value)
 {
-    dispatchTable[Terminal::INT_LITERAL] = &StackBasedVM::pushOperand;
-    dispatchTable[Terminal::FLOAT_LITERAL] = &StackBasedVM::pushOperand;
-    dispatchTable[Terminal::ARITHMETIC_OP_DIV] = &StackBasedVM::binaryOp;
-    dispatchTable[Terminal::ARITHMETIC_OP_MULT] = &StackBasedVM::binaryOp;
-    dispatchTable[Terminal::ARITHMETIC_OP_PLUS] = &StackBasedVM::binaryOp;
-    dispatchTable[Terminal::ARITHMETIC_OP_MINUS] = &StackBasedVM::binaryOp;
+    return Token { value };
 }
 
-void ccc::StackBasedVM::run()
+ccc::Token ccc::VM::makeOperand(double value)
 {
-    eval(ast.root);
+    return Token { value };
 }
 
-bool ccc::StackBasedVM::eval(SyntaxTree::SyntaxTreeNode* node)
+bool ccc::VM::calc(Terminal op, const Value& lhs, const Value& rhs, Value& out)
 {
-    if (node == nullptr)
+    if (lhs.isFloat || rhs.isFloat) {
+        double first = lhs.isFloat ? lhs.floatValue : static_cast<double>(lhs.intValue);
+        double second = rhs.isFloat ? rhs.floatValue : static_cast<double>(rhs.intValue);
+        out.isFloat = true;
+        switch (op) {
+        case Terminal::ARITHMETIC_OP_PLUS:
+            out.floatValue = first + second;
+            return true;
+        case Terminal::ARITHMETIC_OP_MINUS:
+            out.floatValue = first - second;
+            return true;
+        case Terminal::ARITHMETIC_OP_MULT:
+            out.floatValue = first * second;
+            return true;
+        default:
+            out.floatValue = first / second;
+            return true;
+        }
+    }
+    out.isFloat = false;
+    switch (op) {
+    case Terminal::ARITHMETIC_OP_PLUS:
+        out.intValue = add(lhs.intValue, rhs.intValue);
+        return true;
+    case Terminal::ARITHMETIC_OP_MINUS:
+        out.intValue = subtract(lhs.intValue, rhs.intValue);
+        return true;
+    case Terminal::ARITHMETIC_OP_MULT:
+        out.intValue = multiply(lhs.intValue, rhs.intValue);
+        return true;
+    default:
+        if (!divisible(lhs.intValue, rhs.intValue))
+            return false;
+        out.intValue = lhs.intValue / rhs.intValue;
         return true;
+    }
+}
+
+bool ccc::VM::divisible(long long lhs, long long rhs)
+{
+    return rhs != 0 && (rhs != -1 || lhs != std::numeric_limits<long long>::min());
+}
+
+long long ccc::VM::add(long long lhs, long long rhs)
+{
+    return static_cast<long long>(static_cast<unsigned long long>(lhs) + static_cast<unsigned long long>(rhs));
+}
+
+long long ccc::VM::subtract(long long lhs, long long rhs)
+{
+    return static_cast<long long>(static_cast<unsigned long long>(lhs) - static_cast<unsigned long long>(rhs));
+}
+
+long long ccc::VM::multiply(long long lhs, long long rhs)
+{
+    return static_cast<long long>(static_cast<unsigned long long>(lhs) * static_cast<unsigned long long>(rhs));
+}
+
+bool ccc::VM::comparison(const std::string& lexeme, Comparison& out)
+{
+    static const std::unordered_map<std::string, Comparison> comparisons = {
+        { "<", Comparison::LESS },
+        { "<=", Comparison::LESS_EQUAL },
+        { ">", Comparison::GREATER },
+        { ">=", Comparison::GREATER_EQUAL },
+        { "==", Comparison::EQUAL },
+        { "!=", Comparison::NOT_EQUAL }
+    };
+    auto res = comparisons.find(lexeme);
+    if (res == comparisons.end())
+        return false;
+    out = res->second;
+    return true;
+}
+
+template <typename T>
+bool ccc::VM::compare(Comparison op, T lhs, T rhs)
+{
+    switch (op) {
+    case Comparison::LESS:
+        return lhs < rhs;
+    case Comparison::LESS_EQUAL:
+        return lhs <= rhs;
+    case Comparison::GREATER:
+        return lhs > rhs;
+    case Comparison::GREATER_EQUAL:
+        return lhs >= rhs;
+    case Comparison::EQUAL:
+        return lhs == rhs;
+    default:
+        return lhs != rhs;
+    }
+}
+
+bool ccc::VM::compare(Comparison op, const Value& lhs, const Value& rhs)
+{
+    if (lhs.isFloat || rhs.isFloat)
+        return compare(op, lhs.isFloat ? lhs.floatValue : static_cast<double>(lhs.intValue),
+            rhs.isFloat ? rhs.floatValue : static_cast<double>(rhs.intValue));
+    return compare(op, lhs.intValue, rhs.intValue);
+}
+
+ccc::Globals::~Globals()
+{
+    MemoryStats::release(MemoryStats::Subsystem::VM_STACK, variables.size() * sizeof(VM::Value));
+}
+
+std::size_t ccc::Globals::slot(const std::string& name)
+{
+    auto res = slots.find(name);
+    if (res != slots.end())
+        return res->second;
+    MemoryStats::charge(MemoryStats::Subsystem::VM_STACK, sizeof(VM::Value));
+    VM::Value zero;
+    zero.isFloat = false;
+    zero.intValue = 0;
+    variables.push_back(zero);
+    slots.emplace(name, variables.size() - 1);
+    return variables.size() - 1;
+}
+
+bool ccc::Globals::find(const std::string& name, std::size_t& out) const
+{
+    auto res = slots.find(name);
+    if (res == slots.end())
+        return false;
+    out = res->second;
+    return true;
+}
+
+ccc::VM::Value* ccc::Globals::values()
+{
+    return variables.data();
+}
 
-    bool res = eval(node->children) && eval(node->next);
+std::size_t ccc::Globals::size() const
+{
+    return variables.size();
+}
 
-    auto func = dispatchTable[node->val.term];
-    if (!(this->*func)(node->val))
+bool ccc::Globals::lookup(const std::string& name, VM::Value& out) const
+{
+    auto res = slots.find(name);
+    if (res == slots.end())
         return false;
+    out = variables[res->second];
+    return true;
+}
+
+bool ccc::Globals::define(SyntaxTree::SyntaxTreeNode* function)
+{
+    auto res = functions.emplace(function->val.lexeme, function);
+    return res.second || res.first->second == function;
+}
+
+ccc::SyntaxTree::SyntaxTreeNode* ccc::Globals::function(const std::string& name) const
+{
+    auto res = functions.find(name);
+    return res != functions.end() ? res->second : nullptr;
+}
 
+/* Argument types of a signature, DYNAMIC for one no path reaches as well */
+static char typeLetter(ccc::Type type)
+{
+    return type == ccc::Type::INT ? 'i' : type == ccc::Type::FLOAT ? 'f' : 'd';
+}
+
+static ccc::Type letterType(char letter)
+{
+    return letter == 'i' ? ccc::Type::INT : letter == 'f' ? ccc::Type::FLOAT : ccc::Type::DYNAMIC;
+}
+
+/* The form of the arithmetic terminal op for operands of type */
+static ccc::StackBasedVM::Opcode arithmetic(ccc::Terminal op, ccc::Type type)
+{
+    using Opcode = ccc::StackBasedVM::Opcode;
+    if (type != ccc::Type::INT && type != ccc::Type::FLOAT)
+        return Opcode::ARITH;
+    bool isInt = type == ccc::Type::INT;
+    switch (op) {
+    case ccc::Terminal::ARITHMETIC_OP_PLUS:
+        return isInt ? Opcode::IADD : Opcode::FADD;
+    case ccc::Terminal::ARITHMETIC_OP_MINUS:
+        return isInt ? Opcode::ISUB : Opcode::FSUB;
+    case ccc::Terminal::ARITHMETIC_OP_MULT:
+        return isInt ? Opcode::IMUL : Opcode::FMUL;
+    default:
+        return isInt ? Opcode::IDIV : Opcode::FDIV;
+    }
+}
+
+ccc::StackBasedVM::StackBasedVM(SyntaxTree& ast, Globals* globals, bool typed)
+    : root { ast.root }
+    , mainSize { 0 }
+    , globals { globals != nullptr ? globals : &ownGlobals }
+    , openScopes { 0 }
+    , frameLocals { 0 }
+    , mainLocals { 0 }
+    , inFunction { false }
+    , typed { typed }
+    , maxDepth { 0 }
+    , lowered { false }
+    , producesValue { false }
+    , hasJumps { false }
+    , hasResult { false }
+    , instrumented { false }
+    , paused {}
+    , suspended { false }
+    , pairs {}
+#ifdef CCC_PROFILER
+    , profiler { nullptr }
+    , counters { nullptr }
+    , untilSample { 0 }
+#endif
+{
+    compile();
+}
+
+ccc::StackBasedVM::~StackBasedVM()
+{
+    MemoryStats::release(MemoryStats::Subsystem::VM_STACK, stack.size() * sizeof(Value) + frames.size() * sizeof(Frame));
+}
+
+void ccc::StackBasedVM::compile()
+{
+    suspended = false;
+    MemoryStats::release(MemoryStats::Subsystem::VM_STACK, stack.size() * sizeof(Value) + frames.size() * sizeof(Frame));
+    stack.clear();
+    frames.clear();
+    // a function is first assumed to return nothing, every pass widens that by what its code was found to return
+    specializations.clear();
+    std::size_t mainDepth = 0;
+    std::size_t frameDepth = 0;
+    while (lowerProgram(mainDepth, frameDepth) && typed && widen())
+        continue;
+    // every frame fits the deepest function, so a call never allocates
+    if (!entries.empty()) {
+        frames.resize(FRAME_LIMIT);
+        mainDepth += FRAME_LIMIT * frameDepth;
+    }
+    stack.resize(mainDepth);
+    // a stack over the memory budget fails every run instead of growing
+    if (!MemoryStats::allocate(MemoryStats::Subsystem::VM_STACK, stack.size() * sizeof(Value) + frames.size() * sizeof(Frame))) {
+        lowered = false;
+        stack.clear();
+        frames.clear();
+    }
+#ifdef CCC_PROFILER
+    // the counters were for the code lowered before
+    if (profiler != nullptr)
+        profile(profiler);
+#endif
+}
+
+bool ccc::StackBasedVM::lowerProgram(std::size_t& mainDepth, std::size_t& frameDepth)
+{
+    code.clear();
+    entries.clear();
+    unresolved.clear();
+    found.clear();
+    guards.clear();
+    current.clear();
+    lastError = Diagnostic {};
+    maxDepth = 0;
+    producesValue = false;
+    hasJumps = false;
+    // values of shared subtrees are locals of the frame they are evaluated in
+    mainLocals = countLocals(root, false);
+    std::unordered_set<const SyntaxTree::SyntaxTreeNode*> seen;
+    for (const SyntaxTree::SyntaxTreeNode* statement = root; statement != nullptr; statement = statement->next)
+        if (statement->val.term != Terminal::FUNCTION_DEF)
+            mainLocals += collectShared(statement, seen);
+    types.locals.assign(mainLocals, typed ? Type::INT : Type::DYNAMIC);
+    types.globals.clear();
+    // every expression statement leaves one value above the locals of the top-level blocks, the run results in the last one
+    if (mainLocals != 0) {
+        emit(Opcode::ENTER, root);
+        code.back().slot = mainLocals;
+    }
+    std::size_t depth = mainLocals;
+    frameLocals = 0;
+    lowered = root != nullptr;
+    for (SyntaxTree::SyntaxTreeNode* statement = root; statement != nullptr && lowered; statement = statement->next) {
+        if (producesValue) {
+            emit(Opcode::POP, statement);
+            --depth;
+        }
+        // a definition only names its function, which is lowered once something calls it
+        if (statement->val.term == Terminal::FUNCTION_DEF) {
+            producesValue = false;
+            lowered = globals->define(statement) || fail(statement, "redefinition of function '" + statement->val.lexeme + "'");
+            continue;
+        }
+        lowered = lowerStatement(statement, depth, producesValue) && depth == mainLocals + (producesValue ? 1 : 0);
+    }
+    mainSize = code.size();
+    mainDepth = maxDepth;
+    frameDepth = 0;
+    lowered = lowered && link(frameDepth);
+    return lowered;
+}
+
+bool ccc::StackBasedVM::widen()
+{
+    bool changed = false;
+    for (const auto& specialization : found) {
+        Specialization& assumed = specializations.emplace(specialization.first, Specialization { Type::VOID, {} }).first->second;
+        Type returns = join(assumed.returns, specialization.second.returns);
+        std::size_t stores = assumed.stores.size();
+        assumed.stores.insert(specialization.second.stores.begin(), specialization.second.stores.end());
+        changed = changed || returns != assumed.returns || stores != assumed.stores.size();
+        assumed.returns = returns;
+    }
+    return changed;
+}
+
+bool ccc::StackBasedVM::link(std::size_t& frameDepth)
+{
+    // lowering a function adds the calls in its body, so the list grows while it is worked off
+    for (std::size_t i = 0; i < unresolved.size(); ++i) {
+        const SyntaxTree::SyntaxTreeNode* call = code[unresolved[i].first].node;
+        SyntaxTree::SyntaxTreeNode* function = globals->function(call->val.lexeme);
+        if (function == nullptr)
+            return fail(call, "undefined function '" + call->val.lexeme + "'");
+        // children of a definition are the return type, the parameters and the body
+        std::size_t parameters = 0;
+        for (SyntaxTree::SyntaxTreeNode* child = function->children->next; child->next != nullptr; child = child->next)
+            ++parameters;
+        if (code[unresolved[i].first].slot != parameters)
+            return fail(call, "'" + call->val.lexeme + "' takes " + std::to_string(parameters) + " arguments");
+        std::string signature = unresolved[i].second;
+        auto entry = entries.find(signature);
+        if (entry == entries.end()) {
+            entry = entries.emplace(signature, code.size()).first;
+            if (!lowerFunction(function, signature, frameDepth))
+                return false;
+        }
+        code[unresolved[i].first].target = entry->second;
+    }
+    return true;
+}
+
+bool ccc::StackBasedVM::lowerFunction(SyntaxTree::SyntaxTreeNode* function, const std::string& signature, std::size_t& frameDepth)
+{
+    // the arguments are the first locals of the frame, the declared ones follow
+    enterScope();
+    frameLocals = 0;
+    types.locals.clear();
+    std::size_t letter = signature.find('(') + 1;
+    SyntaxTree::SyntaxTreeNode* child = function->children != nullptr ? function->children->next : nullptr;
+    for (; child != nullptr && child->next != nullptr; child = child->next) {
+        if (!scopes.insert(child->val.lexeme, Symbol { Type::INT, StorageSpecifier::AUTO, frameLocals++ })) {
+            leaveScope();
+            return fail(child, "redeclaration of parameter '" + child->val.lexeme + "'");
+        }
+        types.locals.push_back(letterType(signature[letter++]));
+    }
+    if (child == nullptr) {
+        leaveScope();
+        return false;
+    }
+    std::unordered_set<const SyntaxTree::SyntaxTreeNode*> seen;
+    std::size_t declared = countLocals(child->children, true) + collectShared(child, seen);
+    types.locals.resize(frameLocals + declared, typed ? Type::INT : Type::DYNAMIC);
+    if (declared != 0) {
+        emit(Opcode::ENTER, child);
+        code.back().slot = declared;
+    }
+    std::size_t depth = frameLocals + declared;
+    maxDepth = depth;
+    inFunction = true;
+    current = signature;
+    Specialization& specialization = found.emplace(signature, Specialization { Type::VOID, {} }).first->second;
+    // the body shares the scope of the parameters
+    bool ok = lowerBlock(child->children, depth, false);
+    inFunction = false;
+    current.clear();
+    leaveScope();
+    if (!ok)
+        return false;
+    // falling off the end returns 0, which only a return as the last statement rules out
+    SyntaxTree::SyntaxTreeNode* last = child->children;
+    while (last != nullptr && last->next != nullptr)
+        last = last->next;
+    if (last == nullptr || last->val.term != Terminal::CONTROL_FLOW_RETURN)
+        specialization.returns = join(specialization.returns, Type::INT);
+    emit(Opcode::PUSH, child);
+    code.back().lhs.isFloat = false;
+    code.back().lhs.intValue = 0;
+    emit(Opcode::RETURN, child);
+    frameDepth = std::max(frameDepth, std::max(maxDepth, depth + 1));
+    return true;
+}
+
+std::size_t ccc::StackBasedVM::countLocals(const SyntaxTree::SyntaxTreeNode* node, bool nested)
+{
+    // static and extern variables live in the static area, as does everything declared at file scope
+    std::size_t res = 0;
+    for (; node != nullptr; node = node->next) {
+        if (node->val.term == Terminal::VARIABLE_DECL && nested && node->children->children == nullptr)
+            ++res;
+        else if ((node->val.term == Terminal::CONTROL_FLOW_BRANCH || node->val.term == Terminal::CONTROL_FLOW_WHILE)
+            && node->children != nullptr && node->children->next != nullptr)
+            res += countLocals(node->children->next->children, true);
+    }
+    return res;
+}
+
+std::size_t ccc::StackBasedVM::collectShared(const SyntaxTree::SyntaxTreeNode* node, std::unordered_set<const SyntaxTree::SyntaxTreeNode*>& seen)
+{
+    std::size_t res = 0;
+    if (node->val.term == Terminal::SHARED_SUBTREE) {
+        const SyntaxTree::SyntaxTreeNode* target = static_cast<const SyntaxTree::SharedNode*>(node)->target;
+        sharedSlots[target] = std::string::npos;
+        res += seen.insert(target).second ? 1 : 0;
+    }
+    for (const SyntaxTree::SyntaxTreeNode* child = node->children; child != nullptr; child = child->next)
+        res += collectShared(child, seen);
     return res;
 }
 
-bool ccc::StackBasedVM::pushOperand(Token token)
+bool ccc::StackBasedVM::fail(const SyntaxTree::SyntaxTreeNode* node, const std::string& message)
+{
+    lastError = Diagnostic { message, node->offset, node->length };
+    return false;
+}
+
+void ccc::StackBasedVM::emit(Opcode op, const SyntaxTree::SyntaxTreeNode* node)
+{
+    code.push_back({ op, Terminal::ERROR, Terminal::ERROR, {}, {}, node, 0, 0, Comparison::EQUAL, false, Type::DYNAMIC });
+}
+
+ccc::Type ccc::StackBasedVM::join(Type lhs, Type rhs)
+{
+    if (lhs == Type::VOID)
+        return rhs;
+    if (rhs == Type::VOID)
+        return lhs;
+    return lhs == rhs ? lhs : Type::DYNAMIC;
+}
+
+ccc::Type ccc::StackBasedVM::promote(std::size_t start, std::size_t middle, Type lhs, Type rhs)
 {
-    operands.push(token);
+    if (!typed)
+        return Type::DYNAMIC;
+    // no path reaches an operation on a value no path reaches
+    if (lhs == Type::VOID || rhs == Type::VOID)
+        return Type::VOID;
+    if (lhs == Type::DYNAMIC || rhs == Type::DYNAMIC)
+        return Type::DYNAMIC;
+    if (lhs == rhs)
+        return lhs;
+    // as calc does, an int with a float becomes a float
+    if (lhs == Type::INT)
+        toFloat(start, middle);
+    else
+        toFloat(middle, code.size());
+    return Type::FLOAT;
+}
+
+void ccc::StackBasedVM::toFloat(std::size_t start, std::size_t end)
+{
+    // a literal is pushed as a float right away
+    if (end - start == 1 && code[start].op == Opcode::PUSH) {
+        double converted = static_cast<double>(code[start].lhs.intValue);
+        code[start].lhs.isFloat = true;
+        code[start].lhs.floatValue = converted;
+        return;
+    }
+    // an expression has no jumps into it, only the calls after the conversion move
+    code.insert(code.begin() + end, Instruction { Opcode::INT_TO_FLOAT, Terminal::ERROR, Terminal::ERROR, {}, {}, code[end - 1].node, 0, 0,
+                                        Comparison::EQUAL, false, Type::FLOAT });
+    for (auto& call : unresolved)
+        if (call.first >= end)
+            ++call.first;
+}
+
+ccc::Type ccc::StackBasedVM::typeOf(bool local, std::size_t slot)
+{
+    if (!typed)
+        return Type::DYNAMIC;
+    if (local)
+        return types.locals[slot];
+    // a function may be called after any statement, so it knows nothing of the globals
+    if (inFunction)
+        return Type::DYNAMIC;
+    auto known = types.globals.find(slot);
+    return known != types.globals.end() ? known->second : entryType(slot);
+}
+
+void ccc::StackBasedVM::setType(bool local, std::size_t slot, Type type)
+{
+    if (!typed)
+        return;
+    if (local)
+        types.locals[slot] = type;
+    else if (inFunction)
+        found.at(current).stores.insert(slot);
+    else
+        types.globals[slot] = type;
+}
+
+ccc::Type ccc::StackBasedVM::entryType(std::size_t slot)
+{
+    Type res = globals->values()[slot].isFloat ? Type::FLOAT : Type::INT;
+    guards.emplace(slot, res);
+    return res;
+}
+
+void ccc::StackBasedVM::merge(Types& into, const Types& other)
+{
+    for (std::size_t i = 0; i < into.locals.size() && i < other.locals.size(); ++i)
+        into.locals[i] = join(into.locals[i], other.locals[i]);
+    // a global only one of them stored still has its entry type in the other
+    for (const auto& global : other.globals) {
+        auto known = into.globals.find(global.first);
+        Type mine = known != into.globals.end() ? known->second : entryType(global.first);
+        into.globals[global.first] = join(mine, global.second);
+    }
+    for (auto& global : into.globals)
+        if (other.globals.find(global.first) == other.globals.end())
+            global.second = join(global.second, entryType(global.first));
+}
+
+bool ccc::StackBasedVM::lowerBlock(SyntaxTree::SyntaxTreeNode* node, std::size_t& depth, bool openScope)
+{
+    if (openScope)
+        enterScope();
+    // jump targets need the same depth on every path, so a block leaves the stack as it found it
+    bool ok = true;
+    for (; node != nullptr && ok; node = node->next) {
+        bool value;
+        ok = lowerStatement(node, depth, value);
+        if (ok && value) {
+            emit(Opcode::POP, node);
+            --depth;
+        }
+    }
+    if (openScope)
+        leaveScope();
+    return ok;
+}
+
+void ccc::StackBasedVM::enterScope()
+{
+    scopes.addScope();
+    ++openScopes;
+}
+
+void ccc::StackBasedVM::leaveScope()
+{
+    scopes.removeScope();
+    --openScopes;
+}
+
+bool ccc::StackBasedVM::lowerStatement(SyntaxTree::SyntaxTreeNode* node, std::size_t& depth, bool& producesValue)
+{
+    producesValue = false;
+    SyntaxTree::SyntaxTreeNode* condition = node->children;
+    switch (node->val.term) {
+    case Terminal::CONTROL_FLOW_BRANCH: {
+        if (condition == nullptr || condition->next == nullptr || !lowerBranch(condition, false, depth))
+            return false;
+        // a false condition skips the body, so what follows is reached with the types of either
+        std::size_t branch = code.size() - 1;
+        Types skipped = types;
+        if (!lowerBlock(condition->next->children, depth))
+            return false;
+        code[branch].target = code.size();
+        merge(types, skipped);
+        return true;
+    }
+    case Terminal::CONTROL_FLOW_WHILE: {
+        if (condition == nullptr || condition->next == nullptr)
+            return false;
+        // the condition sits below the body, so an iteration costs one branch back to the top of it
+        emit(Opcode::JUMP, node);
+        hasJumps = true;
+        std::size_t entry = code.size() - 1;
+        std::size_t body = code.size();
+        // the condition is reached from before the loop and from the end of the body, so the body is lowered
+        // again until the types the condition starts with cover both
+        std::size_t locals = frameLocals;
+        std::size_t calls = unresolved.size();
+        Types head = types;
+        for (;;) {
+            if (!lowerBranch(condition, true, depth))
+                return false;
+            Types entered = types;
+            code.resize(body);
+            unresolved.resize(calls);
+            frameLocals = locals;
+            types = entered;
+            if (!lowerBlock(condition->next->children, depth))
+                return false;
+            Types next = head;
+            merge(next, types);
+            if (next.locals == head.locals && next.globals == head.globals)
+                break;
+            head = next;
+            types = head;
+            code.resize(body);
+            unresolved.resize(calls);
+            frameLocals = locals;
+        }
+        code[entry].target = code.size();
+        types = head;
+        if (!lowerBranch(condition, true, depth))
+            return false;
+        code.back().target = body;
+        return true;
+    }
+    case Terminal::VARIABLE_DECL:
+        return lowerDeclaration(node, depth);
+    case Terminal::CONTROL_FLOW_RETURN: {
+        if (!inFunction)
+            return fail(node, "return outside of a function");
+        Type type;
+        if (node->children == nullptr || !lowerNode(node->children, depth, type))
+            return false;
+        Specialization& specialization = found.at(current);
+        specialization.returns = join(specialization.returns, type);
+        emit(Opcode::RETURN, node);
+        --depth;
+        return true;
+    }
+    default: {
+        producesValue = true;
+        Type type;
+        return lowerNode(node, depth, type);
+    }
+    }
+}
+
+bool ccc::StackBasedVM::lowerBranch(SyntaxTree::SyntaxTreeNode* node, bool jumpIf, std::size_t& depth)
+{
+    Comparison op;
+    SyntaxTree::SyntaxTreeNode* lhs = node->children;
+    if (!comparison(node->val.lexeme, op) || lhs == nullptr || lhs->next == nullptr || lhs->next->next != nullptr)
+        return false;
+    std::size_t start = code.size();
+    Type lhsType;
+    Type rhsType;
+    if (!lowerNode(lhs, depth, lhsType))
+        return false;
+    std::size_t middle = code.size();
+    if (!lowerNode(lhs->next, depth, rhsType))
+        return false;
+    Type type = promote(start, middle, lhsType, rhsType);
+    emit(type == Type::INT ? Opcode::IBRANCH : type == Type::FLOAT ? Opcode::FBRANCH : Opcode::BRANCH, node);
+    code.back().comparison = op;
+    code.back().jumpIf = jumpIf;
+    code.back().type = type == Type::INT || type == Type::FLOAT ? type : Type::DYNAMIC;
+    depth -= 2;
+    hasJumps = true;
     return true;
 }
 
-template <typename T>
-T ccc::StackBasedVM::calc(T firstOperand, T secondOperand, Terminal term)
+bool ccc::StackBasedVM::lowerDeclaration(SyntaxTree::SyntaxTreeNode* node, std::size_t& depth)
 {
-    T res;
-    switch (term) {
-    case Terminal::ARITHMETIC_OP_DIV:
-        res = secondOperand / firstOperand;
+    SyntaxTree::SyntaxTreeNode* type = node->children;
+    SyntaxTree::SyntaxTreeNode* value = type->next;
+    const std::string& name = node->val.lexeme;
+    Symbol symbol { type->val.term == Terminal::BUILTIN_TYPE_FLOAT ? Type::FLOAT : type->val.term == Terminal::BUILTIN_TYPE_CHAR ? Type::CHAR : Type::INT,
+        type->children == nullptr                             ? StorageSpecifier::AUTO
+            : type->children->val.term == Terminal::STORAGE_STATIC ? StorageSpecifier::STATIC
+                                                                   : StorageSpecifier::EXTERN };
+    bool local = false;
+    if (openScopes == 0) {
+        // file scope, a redeclaration names the same variable
+        symbol.slot = globals->slot(name);
+    } else if (symbol.storageSpecifier == StorageSpecifier::AUTO) {
+        symbol.slot = frameLocals++;
+        local = true;
+    } else if (symbol.storageSpecifier == StorageSpecifier::EXTERN) {
+        if (value != nullptr)
+            return fail(node, "extern variable '" + name + "' has an initializer");
+        symbol.slot = globals->slot(name);
+    } else {
+        // a static of a block is initialized once, when the first VM lowers it, under a name no identifier can have
+        std::string hidden = name + "@" + std::to_string(node->offset);
+        if (!globals->find(hidden, symbol.slot)) {
+            symbol.slot = globals->slot(hidden);
+            if (value != nullptr && value->val.term != Terminal::INT_LITERAL && value->val.term != Terminal::FLOAT_LITERAL)
+                return fail(value, "initializer of static '" + name + "' is not a constant");
+            if (value != nullptr) {
+                Value& initial = globals->values()[symbol.slot];
+                initial.isFloat = value->val.term == Terminal::FLOAT_LITERAL;
+                if (initial.isFloat)
+                    initial.floatValue = value->val.floatValue;
+                else
+                    initial.intValue = value->val.intValue;
+            }
+        }
+        value = nullptr;
+    }
+    if (openScopes != 0 && !scopes.insert(name, symbol))
+        return fail(node, "redeclaration of '" + name + "'");
+    if (value == nullptr)
+        return true;
+    Type valueType;
+    if (!lowerNode(value, depth, valueType))
+        return false;
+    emit(local ? Opcode::STORE_LOCAL : Opcode::STORE, node);
+    code.back().slot = symbol.slot;
+    setType(local, symbol.slot, valueType);
+    emit(Opcode::POP, node);
+    --depth;
+    return true;
+}
+
+bool ccc::StackBasedVM::resolve(const SyntaxTree::SyntaxTreeNode* node, bool assignment, bool& local, std::size_t& slot)
+{
+    Symbol symbol { Type::INT, StorageSpecifier::AUTO };
+    local = false;
+    if (scopes.lookup(node->val.lexeme, symbol)) {
+        local = symbol.storageSpecifier == StorageSpecifier::AUTO;
+        slot = symbol.slot;
+        return true;
+    }
+    if (globals->find(node->val.lexeme, slot))
+        return true;
+    if (assignment && !inFunction) {
+        slot = globals->slot(node->val.lexeme);
+        return true;
+    }
+    return fail(node, "undeclared identifier '" + node->val.lexeme + "'");
+}
+
+bool ccc::StackBasedVM::lowerNode(SyntaxTree::SyntaxTreeNode* node, std::size_t& depth, Type& type)
+{
+    if (node->val.term == Terminal::ASSIGNMENT_OP) {
+        // the target is a variable and not an operand
+        SyntaxTree::SyntaxTreeNode* target = node->children;
+        if (target == nullptr || target->val.term != Terminal::ID || target->children != nullptr || target->next == nullptr
+            || target->next->next != nullptr || !lowerNode(target->next, depth, type))
+            return false;
+        bool local;
+        std::size_t slot;
+        if (!resolve(target, true, local, slot))
+            return false;
+        emit(local ? Opcode::STORE_LOCAL : Opcode::STORE, node);
+        code.back().slot = slot;
+        setType(local, slot, type);
+        return true;
+    }
+    Instruction instruction { Opcode::PUSH, node->val.term, node->val.term, {}, {}, node, 0, 0, Comparison::EQUAL, false, Type::DYNAMIC };
+    switch (node->val.term) {
+    case Terminal::INT_LITERAL:
+        instruction.lhs.isFloat = false;
+        instruction.lhs.intValue = node->val.intValue;
+        type = Type::INT;
+        ++depth;
+        break;
+    case Terminal::FLOAT_LITERAL:
+        instruction.lhs.isFloat = true;
+        instruction.lhs.floatValue = node->val.floatValue;
+        type = Type::FLOAT;
+        ++depth;
+        break;
+    case Terminal::ID: {
+        bool local;
+        if (!resolve(node, false, local, instruction.slot))
+            return false;
+        instruction.op = local ? Opcode::LOAD_LOCAL : Opcode::LOAD;
+        type = typeOf(local, instruction.slot);
+        ++depth;
+        break;
+    }
+    case Terminal::SHARED_SUBTREE: {
+        // the first copy comes earlier in the same expression, so its value is stored by now
+        auto shared = sharedSlots.find(static_cast<const SyntaxTree::SharedNode*>(node)->target);
+        if (shared == sharedSlots.end() || shared->second == std::string::npos)
+            return false;
+        instruction.op = Opcode::LOAD_LOCAL;
+        instruction.slot = shared->second;
+        type = typeOf(true, instruction.slot);
+        ++depth;
+        break;
+    }
+    case Terminal::FUNCTION_CALL: {
+        // the arguments stay where they are as the locals of the callee, which link lowers for their types
+        std::string signature = node->val.lexeme + "(";
+        for (SyntaxTree::SyntaxTreeNode* argument = node->children; argument != nullptr; argument = argument->next) {
+            Type argumentType;
+            if (!lowerNode(argument, depth, argumentType))
+                return false;
+            signature += typed ? typeLetter(argumentType) : 'd';
+            ++instruction.slot;
+        }
+        signature += ')';
+        instruction.op = Opcode::CALL;
+        unresolved.push_back({ code.size(), signature });
+        depth = depth - instruction.slot + 1;
+        hasJumps = true;
+        // what the callee does is known from the pass before, and nothing is before one lowered it
+        auto assumed = specializations.find(signature);
+        type = !typed ? Type::DYNAMIC : assumed != specializations.end() ? assumed->second.returns : Type::VOID;
+        if (assumed != specializations.end())
+            for (std::size_t slot : assumed->second.stores)
+                setType(false, slot, Type::DYNAMIC);
         break;
+    }
+    case Terminal::ARITHMETIC_OP_PLUS:
+    case Terminal::ARITHMETIC_OP_MINUS:
+    case Terminal::ARITHMETIC_OP_MULT:
+    case Terminal::ARITHMETIC_OP_DIV: {
+        // operands of a node must be on the stack before it is applied
+        SyntaxTree::SyntaxTreeNode* lhs = node->children;
+        if (lhs == nullptr || lhs->next == nullptr || lhs->next->next != nullptr)
+            return false;
+        std::size_t start = code.size();
+        Type lhsType;
+        Type rhsType;
+        if (!lowerNode(lhs, depth, lhsType))
+            return false;
+        std::size_t middle = code.size();
+        if (!lowerNode(lhs->next, depth, rhsType) || depth < 2)
+            return false;
+        type = promote(start, middle, lhsType, rhsType);
+        instruction.op = arithmetic(node->val.term, type);
+        instruction.type = type == Type::INT || type == Type::FLOAT ? type : Type::DYNAMIC;
+        --depth;
+        break;
+    }
+    default:
+        return false;
+    }
+    code.push_back(instruction);
+    maxDepth = std::max(maxDepth, depth);
+    // a subtree other nodes share keeps a copy of its value for them
+    auto shared = sharedSlots.find(node);
+    if (shared != sharedSlots.end()) {
+        shared->second = frameLocals++;
+        emit(Opcode::STORE_LOCAL, node);
+        code.back().slot = shared->second;
+        setType(true, shared->second, type);
+    }
+    return true;
+}
+
+void ccc::StackBasedVM::revalidate()
+{
+    // another VM may have stored a value of the other type into a global the code was typed by
+    for (const auto& guard : guards) {
+        if (lowered && (globals->values()[guard.first].isFloat ? Type::FLOAT : Type::INT) != guard.second) {
+            compile();
+            return;
+        }
+    }
+}
+
+ccc::StackBasedVM::Machine ccc::StackBasedVM::machine()
+{
+    return Machine { code.data(), mainSize, globals->values(), frames.data(), frames.size(), &executed, pairs, stack.data(), 0, 0 };
+}
+
+bool ccc::StackBasedVM::run()
+{
+    hasResult = false;
+    suspended = false;
+    revalidate();
+    if (!lowered)
+        return false;
+    lastError = Diagnostic {};
+#ifdef CCC_PROFILER
+    if (profiler != nullptr) {
+        hasResult = instrumented ? executeProfiled<true>() : executeProfiled<false>();
+        return hasResult;
+    }
+#endif
+    State state { 0, stack.data(), stack.data(), frames.data(), Opcode::COUNT, false };
+    unsigned long long unlimited = 0;
+    hasResult = instrumented ? execute<true, false, false>(machine(), state, unlimited) : execute<false, false, false>(machine(), state, unlimited);
+    if (!hasResult)
+        lastError = failure(code[state.pc]);
+    return hasResult;
+}
+
+ccc::VM::Status ccc::StackBasedVM::resume(const Budget& budget)
+{
+    if (!suspended) {
+        hasResult = false;
+        revalidate();
+        if (!lowered)
+            return Status::FAILED;
+        lastError = Diagnostic {};
+        paused = State { 0, stack.data(), stack.data(), frames.data(), Opcode::COUNT, false };
+    } else {
+        // the code after the pause is typed for the globals as they were then
+        for (std::size_t i = 0; i < pausedTypes.size(); ++i) {
+            if (globals->values()[i].isFloat != pausedTypes[i]) {
+                suspended = false;
+                lastError = Diagnostic { "a global changed its type while the run was paused", 0, 0 };
+                return Status::FAILED;
+            }
+        }
+    }
+    Status res = slice(machine(), paused, budget, instrumented, lastError);
+    suspended = res == Status::YIELDED;
+    // only other VMs sharing the globals can change them before the next resume
+    pausedTypes.clear();
+    if (suspended && typed && globals != &ownGlobals)
+        for (std::size_t i = 0; i < globals->size(); ++i)
+            pausedTypes.push_back(globals->values()[i].isFloat);
+    hasResult = res == Status::FINISHED;
+    return res;
+}
+
+ccc::VM::Status ccc::StackBasedVM::slice(Machine machine, State& state, const Budget& budget, bool instrumented, Diagnostic& error)
+{
+    machine.depthLimit = budget.stackDepth != 0 ? budget.stackDepth : std::numeric_limits<std::size_t>::max();
+    machine.byteLimit = budget.memoryBytes != 0 ? budget.memoryBytes : std::numeric_limits<std::size_t>::max();
+    unsigned long long instructions = budget.instructions != 0 ? budget.instructions : std::numeric_limits<unsigned long long>::max();
+    bool ok = instrumented ? execute<true, false, true>(machine, state, instructions) : execute<false, false, true>(machine, state, instructions);
+    if (!ok && state.overBudget) {
+        const SyntaxTree::SyntaxTreeNode* call = machine.code[state.pc].node;
+        std::string message = static_cast<std::size_t>(state.top - machine.stack) > machine.depthLimit
+            ? "run exceeded its stack budget of " + std::to_string(budget.stackDepth) + " values"
+            : "run exceeded its memory budget of " + std::to_string(budget.memoryBytes) + " bytes";
+        error = Diagnostic { message, call != nullptr ? call->offset : 0, call != nullptr ? call->length : 0 };
+    } else if (!ok) {
+        error = failure(machine.code[state.pc]);
+    }
+    if (!ok)
+        return Status::FAILED;
+    return state.pc == machine.mainSize && state.frame == machine.frames ? Status::FINISHED : Status::YIELDED;
+}
+
+ccc::Diagnostic ccc::StackBasedVM::failure(const Instruction& instruction)
+{
+    const char* message = instruction.op == Opcode::CALL ? "call stack overflow" : "division by zero";
+    if (instruction.node == nullptr)
+        return Diagnostic { message, 0, 0 };
+    return Diagnostic { message, instruction.node->offset, instruction.node->length };
+}
+
+inline bool ccc::StackBasedVM::apply(Terminal op, Type type, const Value& lhs, const Value& rhs, Value& out)
+{
+    // a superinstruction of typed operations trusts the operands to have the type the pass found
+    switch (type) {
+    case Type::INT:
+        out.isFloat = false;
+        switch (op) {
+        case Terminal::ARITHMETIC_OP_PLUS:
+            out.intValue = add(lhs.intValue, rhs.intValue);
+            return true;
+        case Terminal::ARITHMETIC_OP_MINUS:
+            out.intValue = subtract(lhs.intValue, rhs.intValue);
+            return true;
+        case Terminal::ARITHMETIC_OP_MULT:
+            out.intValue = multiply(lhs.intValue, rhs.intValue);
+            return true;
+        default:
+            if (!divisible(lhs.intValue, rhs.intValue))
+                return false;
+            out.intValue = lhs.intValue / rhs.intValue;
+            return true;
+        }
+    case Type::FLOAT:
+        out.isFloat = true;
+        switch (op) {
+        case Terminal::ARITHMETIC_OP_PLUS:
+            out.floatValue = lhs.floatValue + rhs.floatValue;
+            return true;
+        case Terminal::ARITHMETIC_OP_MINUS:
+            out.floatValue = lhs.floatValue - rhs.floatValue;
+            return true;
+        case Terminal::ARITHMETIC_OP_MULT:
+            out.floatValue = lhs.floatValue * rhs.floatValue;
+            return true;
+        default:
+            out.floatValue = lhs.floatValue / rhs.floatValue;
+            return true;
+        }
+    default:
+        return calc(op, lhs, rhs, out);
+    }
+}
+
+inline bool ccc::StackBasedVM::holds(Comparison op, Type type, const Value& lhs, const Value& rhs)
+{
+    switch (type) {
+    case Type::INT:
+        return compare(op, lhs.intValue, rhs.intValue);
+    case Type::FLOAT:
+        return compare(op, lhs.floatValue, rhs.floatValue);
+    default:
+        return compare(op, lhs, rhs);
+    }
+}
+
+template <bool Instrumented, bool Limited, bool Metered>
+bool ccc::StackBasedVM::execute(const Machine& machine, State& state, unsigned long long& budget)
+{
+    // top points one past the topmost operand
+    Value* top = state.top;
+    Value* locals = state.locals;
+    Frame* frame = state.frame;
+    Frame* lastFrame = machine.frames + machine.frameCount;
+    Opcode previous = state.previous;
+    Value* variables = machine.variables;
+    const Instruction* first = machine.code;
+    const Instruction* last = first + machine.mainSize;
+    const Instruction* instruction = first + state.pc;
+    // dispatches are counted a straight stretch at a time, when a jump is taken or the run ends,
+    // and added to the count of the VM once it stops
+    unsigned long long executed = 0;
+    const Instruction* stretch = instruction;
+    bool ok = true;
+    bool yielded = false;
+    bool overBudget = false;
+    // the first function starts where the top-level code ends, so only a call may go on from there
+    while (instruction != last || frame != machine.frames) {
+        if (Limited) {
+            if (budget == 0)
+                break;
+            --budget;
+        }
+        if (Instrumented) {
+            if (previous != Opcode::COUNT)
+                ++machine.pairs[static_cast<int>(previous)][static_cast<int>(instruction->op)];
+            previous = instruction->op;
+        }
+        switch (instruction->op) {
+        case Opcode::PUSH:
+            *top++ = instruction->lhs;
+            break;
+        case Opcode::ARITH:
+            --top;
+            ok = calc(instruction->first, top[-1], top[0], top[-1]);
+            break;
+        case Opcode::POP:
+            --top;
+            break;
+        case Opcode::LOAD:
+            *top++ = variables[instruction->slot];
+            break;
+        case Opcode::STORE:
+            variables[instruction->slot] = top[-1];
+            break;
+        case Opcode::LOAD_LOCAL:
+            *top++ = locals[instruction->slot];
+            break;
+        case Opcode::STORE_LOCAL:
+            locals[instruction->slot] = top[-1];
+            break;
+        case Opcode::ENTER:
+            for (std::size_t i = 0; i < instruction->slot; ++i)
+                top[i] = instruction->lhs;
+            top += instruction->slot;
+            break;
+        case Opcode::JUMP:
+            executed += instruction + 1 - stretch;
+            instruction = stretch = first + instruction->target;
+            if (!Metered || executed < budget)
+                continue;
+            yielded = true;
+            break;
+        case Opcode::BRANCH:
+            top -= 2;
+            if (compare(instruction->comparison, top[0], top[1]) == instruction->jumpIf) {
+                executed += instruction + 1 - stretch;
+                instruction = stretch = first + instruction->target;
+                if (!Metered || executed < budget)
+                    continue;
+                yielded = true;
+                break;
+            }
+            break;
+        case Opcode::IADD:
+            --top;
+            top[-1].intValue = add(top[-1].intValue, top[0].intValue);
+            break;
+        case Opcode::ISUB:
+            --top;
+            top[-1].intValue = subtract(top[-1].intValue, top[0].intValue);
+            break;
+        case Opcode::IMUL:
+            --top;
+            top[-1].intValue = multiply(top[-1].intValue, top[0].intValue);
+            break;
+        case Opcode::IDIV:
+            --top;
+            ok = divisible(top[-1].intValue, top[0].intValue);
+            if (ok)
+                top[-1].intValue /= top[0].intValue;
+            break;
+        case Opcode::FADD:
+            --top;
+            top[-1].floatValue += top[0].floatValue;
+            break;
+        case Opcode::FSUB:
+            --top;
+            top[-1].floatValue -= top[0].floatValue;
+            break;
+        case Opcode::FMUL:
+            --top;
+            top[-1].floatValue *= top[0].floatValue;
+            break;
+        case Opcode::FDIV:
+            --top;
+            top[-1].floatValue /= top[0].floatValue;
+            break;
+        case Opcode::IBRANCH:
+            top -= 2;
+            if (compare(instruction->comparison, top[0].intValue, top[1].intValue) == instruction->jumpIf) {
+                executed += instruction + 1 - stretch;
+                instruction = stretch = first + instruction->target;
+                if (!Metered || executed < budget)
+                    continue;
+                yielded = true;
+                break;
+            }
+            break;
+        case Opcode::FBRANCH:
+            top -= 2;
+            if (compare(instruction->comparison, top[0].floatValue, top[1].floatValue) == instruction->jumpIf) {
+                executed += instruction + 1 - stretch;
+                instruction = stretch = first + instruction->target;
+                if (!Metered || executed < budget)
+                    continue;
+                yielded = true;
+                break;
+            }
+            break;
+        case Opcode::INT_TO_FLOAT: {
+            double converted = static_cast<double>(top[-1].intValue);
+            top[-1].isFloat = true;
+            top[-1].floatValue = converted;
+            break;
+        }
+        case Opcode::CALL:
+            // recursion past the preallocated frames fails the run
+            if (frame == lastFrame) {
+                ok = false;
+                break;
+            }
+            if (Metered
+                && (static_cast<std::size_t>(top - machine.stack) > machine.depthLimit
+                    || (top - machine.stack) * sizeof(Value) + (frame + 1 - machine.frames) * sizeof(Frame) > machine.byteLimit)) {
+                ok = false;
+                overBudget = true;
+                break;
+            }
+            *frame++ = { instruction + 1, locals };
+            locals = top - instruction->slot;
+            executed += instruction + 1 - stretch;
+            instruction = stretch = first + instruction->target;
+            if (!Metered || executed < budget)
+                continue;
+            yielded = true;
+            break;
+        case Opcode::RETURN:
+            --frame;
+            locals[0] = top[-1];
+            top = locals + 1;
+            locals = frame->locals;
+            executed += instruction + 1 - stretch;
+            instruction = stretch = frame->returnTo;
+            continue;
+        case Opcode::ARITH_IMM:
+            ok = apply(instruction->first, instruction->type, top[-1], instruction->rhs, top[-1]);
+            break;
+        case Opcode::PUSH_PUSH:
+            top[0] = instruction->lhs;
+            top[1] = instruction->rhs;
+            top += 2;
+            break;
+        case Opcode::PUSH_ARITH_IMM:
+            ok = apply(instruction->first, instruction->type, instruction->lhs, instruction->rhs, *top++);
+            break;
+        case Opcode::ARITH_ARITH:
+            top -= 2;
+            ok = apply(instruction->first, instruction->type, top[0], top[1], top[0])
+                && apply(instruction->second, instruction->type, top[-1], top[0], top[-1]);
+            break;
+        case Opcode::BRANCH_IMM:
+            --top;
+            if (holds(instruction->comparison, instruction->type, top[0], instruction->rhs) == instruction->jumpIf) {
+                executed += instruction + 1 - stretch;
+                instruction = stretch = first + instruction->target;
+                if (!Metered || executed < budget)
+                    continue;
+                yielded = true;
+                break;
+            }
+            break;
+        case Opcode::STORE_POP:
+            variables[instruction->slot] = *--top;
+            break;
+        default:
+            ok = false;
+            break;
+        }
+        if (!ok || (Metered && yielded))
+            break;
+        ++instruction;
+    }
+    executed += instruction - stretch;
+    *machine.executed += executed;
+    state = { static_cast<std::size_t>(instruction - first), top, locals, frame, previous, overBudget };
+    return ok;
+}
+
+#ifdef CCC_PROFILER
+template <bool Instrumented>
+bool ccc::StackBasedVM::executeProfiled()
+{
+    // the stretches between samples run the plain loop, so dispatches cost nothing extra
+    State state { 0, stack.data(), stack.data(), frames.data(), Opcode::COUNT, false };
+    Machine machine = this->machine();
+    unsigned int interval = profiler->sampleInterval();
+    unsigned long long overhead = profiler->clockOverhead();
+    profiler->enter();
+    while (true) {
+        unsigned long long budget = untilSample - 1;
+        bool ok = execute<Instrumented, true, false>(machine, state, budget);
+        untilSample = static_cast<unsigned int>(budget) + 1;
+        if (!ok) {
+            profiler->stop(state.pc);
+            lastError = failure(code[state.pc]);
+            return false;
+        }
+        if (state.pc == mainSize && state.frame == frames.data())
+            break;
+        std::size_t sample = state.pc;
+        unsigned long long one = 1;
+        unsigned long long start = Profiler::now();
+        ok = execute<Instrumented, true, false>(machine, state, one);
+        unsigned long long elapsed = Profiler::now() - start;
+        counters[sample].cycles += (elapsed > overhead ? elapsed - overhead : 0) * interval;
+        // with jumps an instruction runs any number of times per run, so the samples estimate that too
+        if (hasJumps)
+            counters[sample].executions += interval;
+        untilSample = interval;
+        if (!ok) {
+            profiler->stop(sample);
+            lastError = failure(code[sample]);
+            return false;
+        }
+    }
+    return true;
+}
+#endif
+
+bool ccc::StackBasedVM::result(Token& out) const
+{
+    if (!hasResult || !producesValue)
+        return false;
+    const Value& res = stack[mainLocals];
+    out = res.isFloat ? makeOperand(res.floatValue) : makeOperand(res.intValue);
+    return true;
+}
+
+void ccc::StackBasedVM::instrument(bool enabled)
+{
+    instrumented = enabled;
+}
+
+ccc::StackBasedVM::PairCounts ccc::StackBasedVM::pairCounts() const
+{
+    PairCounts res;
+    for (int first = 0; first < static_cast<int>(Opcode::COUNT); ++first)
+        for (int second = 0; second < static_cast<int>(Opcode::COUNT); ++second)
+            if (pairs[first][second] != 0)
+                res[{ static_cast<Opcode>(first), static_cast<Opcode>(second) }] = pairs[first][second];
+    return res;
+}
+
+std::size_t ccc::StackBasedVM::codeSize() const
+{
+    return code.size();
+}
+
+std::size_t ccc::StackBasedVM::dynamicInstructions() const
+{
+    std::size_t res = 0;
+    for (const Instruction& instruction : code)
+        if (instruction.type == Type::DYNAMIC
+            && (instruction.op == Opcode::ARITH || instruction.op == Opcode::BRANCH || instruction.op == Opcode::ARITH_IMM
+                || instruction.op == Opcode::PUSH_ARITH_IMM || instruction.op == Opcode::ARITH_ARITH || instruction.op == Opcode::BRANCH_IMM))
+            ++res;
+    return res;
+}
+
+#ifdef CCC_PROFILER
+void ccc::StackBasedVM::profile(Profiler* target)
+{
+    profiler = target;
+    counters = nullptr;
+    if (profiler == nullptr)
+        return;
+    std::vector<const SyntaxTree::SyntaxTreeNode*> nodes;
+    for (const Instruction& instruction : code)
+        nodes.push_back(instruction.node);
+    counters = profiler->attach(nodes, hasJumps);
+    untilSample = profiler->sampleInterval();
+}
+#endif
+
+bool ccc::StackBasedVM::isJump(Opcode op)
+{
+    return op == Opcode::JUMP || op == Opcode::BRANCH || op == Opcode::IBRANCH || op == Opcode::FBRANCH || op == Opcode::BRANCH_IMM
+        || op == Opcode::CALL;
+}
+
+bool ccc::StackBasedVM::isArithmetic(Opcode op)
+{
+    return op == Opcode::ARITH || (op >= Opcode::IADD && op <= Opcode::FDIV);
+}
+
+bool ccc::StackBasedVM::fusePair(const Instruction& lhs, const Instruction& rhs, Instruction& out)
+{
+    out = lhs;
+    out.node = rhs.node;
+    if (lhs.op == Opcode::PUSH && rhs.op == Opcode::PUSH) {
+        out.op = Opcode::PUSH_PUSH;
+        out.rhs = rhs.lhs;
+    } else if (lhs.op == Opcode::PUSH && isArithmetic(rhs.op)) {
+        // the pushed value is the right operand
+        out.op = Opcode::ARITH_IMM;
+        out.first = rhs.first;
+        out.rhs = lhs.lhs;
+        out.type = rhs.type;
+    } else if (lhs.op == Opcode::PUSH && rhs.op == Opcode::ARITH_IMM) {
+        out.op = Opcode::PUSH_ARITH_IMM;
+        out.first = rhs.first;
+        out.rhs = rhs.rhs;
+        out.type = rhs.type;
+    } else if (lhs.op == Opcode::PUSH_PUSH && isArithmetic(rhs.op)) {
+        out.op = Opcode::PUSH_ARITH_IMM;
+        out.first = rhs.first;
+        out.type = rhs.type;
+    } else if (isArithmetic(lhs.op) && isArithmetic(rhs.op) && lhs.type == rhs.type) {
+        // the fused pair keeps one type for both
+        out.op = Opcode::ARITH_ARITH;
+        out.second = rhs.first;
+    } else if (lhs.op == Opcode::PUSH && (rhs.op == Opcode::BRANCH || rhs.op == Opcode::IBRANCH || rhs.op == Opcode::FBRANCH)) {
+        // compare against the pushed value and branch in one dispatch
+        out = rhs;
+        out.op = Opcode::BRANCH_IMM;
+        out.rhs = lhs.lhs;
+    } else if (lhs.op == Opcode::STORE && rhs.op == Opcode::POP) {
+        out.op = Opcode::STORE_POP;
+        out.node = lhs.node;
+    } else
+        return false;
+    return true;
+}
+
+std::size_t ccc::StackBasedVM::fuse(const PairCounts& profile)
+{
+    suspended = false;
+    std::vector<std::pair<unsigned long long, std::pair<Opcode, Opcode>>> byCount;
+    for (const auto& pair : profile)
+        byCount.push_back({ pair.second, pair.first });
+    std::sort(byCount.begin(), byCount.end(), [](const auto& lhs, const auto& rhs) { return lhs.first > rhs.first; });
+
+    std::size_t before = code.size();
+    std::vector<Instruction> fused;
+    std::vector<bool> isTarget;
+    std::vector<std::size_t> moved;
+    for (const auto& pair : byCount) {
+        // a jump into the middle of a pair would skip half of it
+        isTarget.assign(code.size() + 1, false);
+        for (const Instruction& instruction : code)
+            if (isJump(instruction.op))
+                isTarget[instruction.target] = true;
+        fused.clear();
+        moved.assign(code.size() + 1, 0);
+        for (std::size_t i = 0; i < code.size(); ++i) {
+            moved[i] = fused.size();
+            Instruction instruction;
+            if (i + 1 < code.size() && code[i].op == pair.second.first && code[i + 1].op == pair.second.second
+                && !isTarget[i + 1] && fusePair(code[i], code[i + 1], instruction)) {
+                fused.push_back(instruction);
+                ++i;
+            } else
+                fused.push_back(code[i]);
+        }
+        moved[code.size()] = fused.size();
+        for (Instruction& instruction : fused)
+            if (isJump(instruction.op))
+                instruction.target = moved[instruction.target];
+        mainSize = moved[mainSize];
+        code.swap(fused);
+    }
+    return before - code.size();
+}
+
+std::shared_ptr<const ccc::CompiledProgram> ccc::StackBasedVM::program()
+{
+    revalidate();
+    if (!lowered)
+        return nullptr;
+    std::shared_ptr<CompiledProgram> res { new CompiledProgram };
+    res->code = code;
+    // the nodes only attribute profiles, so the program does not keep the AST alive
+    for (Instruction& instruction : res->code)
+        instruction.node = nullptr;
+    res->mainSize = mainSize;
+    res->mainLocals = mainLocals;
+    res->stackSize = stack.size();
+    res->frameCount = frames.size();
+    res->producesValue = producesValue;
+    res->variables.assign(globals->values(), globals->values() + globals->size());
+    return res;
+}
+
+ccc::StackContext::StackContext(std::shared_ptr<const CompiledProgram> program)
+    : program { std::move(program) }
+    , stack(this->program->stackSize)
+    , frames(this->program->frameCount)
+    , variables(this->program->variables)
+    , allocated { false }
+    , hasResult { false }
+    , paused {}
+    , suspended { false }
+{
+    // like a VM, a context over the memory budget fails every run instead of growing
+    allocated = MemoryStats::allocate(MemoryStats::Subsystem::VM_STACK,
+        (stack.size() + variables.size()) * sizeof(Value) + frames.size() * sizeof(StackBasedVM::Frame));
+}
+
+ccc::StackContext::~StackContext()
+{
+    if (allocated)
+        MemoryStats::release(MemoryStats::Subsystem::VM_STACK,
+            (stack.size() + variables.size()) * sizeof(Value) + frames.size() * sizeof(StackBasedVM::Frame));
+}
+
+bool ccc::StackContext::run()
+{
+    hasResult = false;
+    suspended = false;
+    if (!allocated)
+        return false;
+    lastError = Diagnostic {};
+    // the stores of the run before are undone, which also keeps every global the type the code was lowered for
+    std::copy(program->variables.begin(), program->variables.end(), variables.begin());
+    StackBasedVM::Machine machine { program->code.data(), program->mainSize, variables.data(), frames.data(), frames.size(), &executed, nullptr,
+        stack.data(), 0, 0 };
+    StackBasedVM::State state { 0, stack.data(), stack.data(), frames.data(), StackBasedVM::Opcode::COUNT, false };
+    unsigned long long unlimited = 0;
+    hasResult = StackBasedVM::execute<false, false, false>(machine, state, unlimited);
+    if (!hasResult)
+        lastError = StackBasedVM::failure(program->code[state.pc]);
+    return hasResult;
+}
+
+ccc::VM::Status ccc::StackContext::resume(const Budget& budget)
+{
+    if (!suspended) {
+        hasResult = false;
+        if (!allocated)
+            return Status::FAILED;
+        lastError = Diagnostic {};
+        std::copy(program->variables.begin(), program->variables.end(), variables.begin());
+        paused = StackBasedVM::State { 0, stack.data(), stack.data(), frames.data(), StackBasedVM::Opcode::COUNT, false };
+    }
+    StackBasedVM::Machine machine { program->code.data(), program->mainSize, variables.data(), frames.data(), frames.size(), &executed, nullptr,
+        stack.data(), 0, 0 };
+    Status res = StackBasedVM::slice(machine, paused, budget, false, lastError);
+    suspended = res == Status::YIELDED;
+    hasResult = res == Status::FINISHED;
+    return res;
+}
+
+bool ccc::StackContext::result(Token& out) const
+{
+    if (!hasResult || !program->producesValue)
+        return false;
+    const Value& res = stack[program->mainLocals];
+    out = res.isFloat ? makeOperand(res.floatValue) : makeOperand(res.intValue);
+    return true;
+}
+
+ccc::RegisterVM::RegisterVM(SyntaxTree& ast)
+    : compiled { false }
+    , hasResult { false }
+{
+    Operand root;
+    if (ast.root == nullptr || ast.root->next != nullptr || !compile(ast.root, 0, root)) {
+        registers.clear();
+        return;
+    }
+    if (root.isImmediate)
+        program.push_back({ Opcode::MOVI, 0, 0, 0, root.immediate });
+    if (!MemoryStats::allocate(MemoryStats::Subsystem::VM_STACK, registers.size() * sizeof(Value))) {
+        registers.clear();
+        return;
+    }
+    divisionError = Diagnostic { "division by zero", ast.root->offset, ast.root->length };
+    compiled = true;
+}
+
+ccc::RegisterVM::~RegisterVM()
+{
+    MemoryStats::release(MemoryStats::Subsystem::VM_STACK, registers.size() * sizeof(Value));
+}
+
+bool ccc::RegisterVM::compile(SyntaxTree::SyntaxTreeNode* node, unsigned int reg, Operand& out)
+{
+    if (registers.size() <= reg)
+        registers.resize(reg + 1);
+
+    switch (node->val.term) {
+    case Terminal::INT_LITERAL:
+        out.isImmediate = true;
+        out.immediate.isFloat = false;
+        out.immediate.intValue = node->val.intValue;
+        return true;
+    case Terminal::FLOAT_LITERAL:
+        out.isImmediate = true;
+        out.immediate.isFloat = true;
+        out.immediate.floatValue = node->val.floatValue;
+        return true;
+    case Terminal::ARITHMETIC_OP_PLUS:
+    case Terminal::ARITHMETIC_OP_MINUS:
     case Terminal::ARITHMETIC_OP_MULT:
-        res = firstOperand * secondOperand;
+    case Terminal::ARITHMETIC_OP_DIV:
         break;
+    default:
+        return false;
+    }
+
+    SyntaxTree::SyntaxTreeNode* left = node->children;
+    if (left == nullptr || left->next == nullptr || left->next->next != nullptr)
+        return false;
+    // the left operand's register is reused for the result
+    Operand lhs;
+    Operand rhs;
+    if (!compile(left, reg, lhs) || !compile(left->next, reg + 1, rhs))
+        return false;
+
+    // ir forms take the literal as the left operand, + and * just swap it to the right
+    Opcode rr;
+    Opcode ri;
+    Opcode ir;
+    switch (node->val.term) {
     case Terminal::ARITHMETIC_OP_PLUS:
-        res = firstOperand + secondOperand;
+        rr = Opcode::ADD;
+        ri = ir = Opcode::ADDI;
         break;
     case Terminal::ARITHMETIC_OP_MINUS:
-        res = secondOperand - firstOperand;
+        rr = Opcode::SUB;
+        ri = Opcode::SUBI;
+        ir = Opcode::RSUBI;
+        break;
+    case Terminal::ARITHMETIC_OP_MULT:
+        rr = Opcode::MUL;
+        ri = ir = Opcode::MULI;
+        break;
+    default:
+        rr = Opcode::DIV;
+        ri = Opcode::DIVI;
+        ir = Opcode::RDIVI;
         break;
     }
-    return res;
+
+    if (lhs.isImmediate && rhs.isImmediate) {
+        program.push_back({ Opcode::MOVI, reg, 0, 0, lhs.immediate });
+        program.push_back({ ri, reg, reg, 0, rhs.immediate });
+    } else if (rhs.isImmediate)
+        program.push_back({ ri, reg, lhs.reg, 0, rhs.immediate });
+    else if (lhs.isImmediate)
+        program.push_back({ ir, reg, rhs.reg, 0, lhs.immediate });
+    else
+        program.push_back({ rr, reg, lhs.reg, rhs.reg, {} });
+
+    out.isImmediate = false;
+    out.reg = reg;
+    return true;
 }
 
-bool ccc::StackBasedVM::binaryOp(Token token)
+bool ccc::RegisterVM::run()
 {
-    if (operands.size() < 2)
+    hasResult = false;
+    if (!compiled)
         return false;
+    lastError = Diagnostic {};
 
-    Token firstOperand = operands.top();
-    operands.pop();
-    Token secondOperand = operands.top();
-    operands.pop();
+    Value* regs = registers.data();
+    for (const Instruction& instruction : program) {
+        bool ok = true;
+        switch (instruction.op) {
+        case Opcode::MOVI:
+            regs[instruction.dst] = instruction.immediate;
+            break;
+        case Opcode::ADD:
+            ok = calc(Terminal::ARITHMETIC_OP_PLUS, regs[instruction.lhs], regs[instruction.rhs], regs[instruction.dst]);
+            break;
+        case Opcode::ADDI:
+            ok = calc(Terminal::ARITHMETIC_OP_PLUS, regs[instruction.lhs], instruction.immediate, regs[instruction.dst]);
+            break;
+        case Opcode::SUB:
+            ok = calc(Terminal::ARITHMETIC_OP_MINUS, regs[instruction.lhs], regs[instruction.rhs], regs[instruction.dst]);
+            break;
+        case Opcode::SUBI:
+            ok = calc(Terminal::ARITHMETIC_OP_MINUS, regs[instruction.lhs], instruction.immediate, regs[instruction.dst]);
+            break;
+        case Opcode::RSUBI:
+            ok = calc(Terminal::ARITHMETIC_OP_MINUS, instruction.immediate, regs[instruction.lhs], regs[instruction.dst]);
+            break;
+        case Opcode::MUL:
+            ok = calc(Terminal::ARITHMETIC_OP_MULT, regs[instruction.lhs], regs[instruction.rhs], regs[instruction.dst]);
+            break;
+        case Opcode::MULI:
+            ok = calc(Terminal::ARITHMETIC_OP_MULT, regs[instruction.lhs], instruction.immediate, regs[instruction.dst]);
+            break;
+        case Opcode::DIV:
+            ok = calc(Terminal::ARITHMETIC_OP_DIV, regs[instruction.lhs], regs[instruction.rhs], regs[instruction.dst]);
+            break;
+        case Opcode::DIVI:
+            ok = calc(Terminal::ARITHMETIC_OP_DIV, regs[instruction.lhs], instruction.immediate, regs[instruction.dst]);
+            break;
+        case Opcode::RDIVI:
+            ok = calc(Terminal::ARITHMETIC_OP_DIV, instruction.immediate, regs[instruction.lhs], regs[instruction.dst]);
+            break;
+        }
+        if (!ok) {
+            lastError = divisionError;
+            return false;
+        }
+    }
+    executed += program.size();
+    hasResult = true;
+    return true;
+}
 
-    if (firstOperand.term == Terminal::FLOAT_LITERAL || secondOperand.term == Terminal::FLOAT_LITERAL) {
-        auto res = calc(std::stod(firstOperand.lexeme), std::stod(secondOperand.lexeme), token.term);
-        operands.push({ std::to_string(res), Terminal::FLOAT_LITERAL });
-    } else {
-        auto res = calc(std::stoll(firstOperand.lexeme), std::stoll(secondOperand.lexeme), token.term);
-        operands.push({ std::to_string(res), Terminal::INT_LITERAL });
+bool ccc::RegisterVM::result(Token& out) const
+{
+    if (!hasResult)
+        return false;
+    const Value& res = registers[0];
+    out = res.isFloat ? makeOperand(res.floatValue) : makeOperand(res.intValue);
+    return true;
+}
+
+ccc::StreamingVM::StreamingVM(TokenSource& buffer)
+    : parser { buffer }
+    , charged { 0 }
+    , peak { 0 }
+    , hasResult { false }
+{
+    last.isFloat = false;
+    last.intValue = 0;
+}
+
+ccc::StreamingVM::~StreamingVM()
+{
+    MemoryStats::release(MemoryStats::Subsystem::VM_STACK, charged);
+}
+
+bool ccc::StreamingVM::run()
+{
+    hasResult = false;
+    bool more = true;
+    while (more) {
+        operands.clear();
+        if (!parser.stream(*this, more)) {
+            lastError = parser.error();
+            return false;
+        }
+        last = operands.back();
     }
+    hasResult = true;
+    return true;
+}
+
+bool ccc::StreamingVM::result(Token& out) const
+{
+    if (!hasResult)
+        return false;
+    out = last.isFloat ? makeOperand(last.floatValue) : makeOperand(last.intValue);
+    return true;
+}
 
+std::size_t ccc::StreamingVM::peakDepth() const
+{
+    return peak;
+}
+
+bool ccc::StreamingVM::operand(const Token& literal, std::string& error)
+{
+    Value value;
+    value.isFloat = literal.term == Terminal::FLOAT_LITERAL;
+    if (value.isFloat)
+        value.floatValue = literal.floatValue;
+    else
+        value.intValue = literal.intValue;
+    // the stack only grows with the nesting, so it is charged as it grows instead of per operand
+    if (operands.size() == operands.capacity()) {
+        std::size_t bytes = std::max<std::size_t>(2 * operands.capacity(), 16) * sizeof(Value);
+        if (!MemoryStats::allocate(MemoryStats::Subsystem::VM_STACK, bytes - charged)) {
+            error = "memory budget of " + std::to_string(MemoryStats::budget()) + " bytes exceeded";
+            return false;
+        }
+        operands.reserve(bytes / sizeof(Value));
+        charged = bytes;
+    }
+    operands.push_back(value);
+    peak = std::max(peak, operands.size());
+    ++executed;
+    return true;
+}
+
+bool ccc::StreamingVM::apply(const Token& op, std::string& error)
+{
+    Value rhs = operands.back();
+    operands.pop_back();
+    ++executed;
+    if (!calc(op.term, operands.back(), rhs, operands.back())) {
+        error = "division by zero";
+        return false;
+    }
     return true;
 }
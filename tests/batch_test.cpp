@@ -0,0 +1,212 @@
+#include "batch.h"
+#include "lexer.h"
+#include "parser.h"
+#include "support.h"
+#include "vm.h"
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+/* Longer than two vectors and not a multiple of one */
+#define ROWS 2500
+
+/* Variables a0 to a9 are the columns, divisors are whole subexpressions so integer division by zero comes up as well */
+static const ccc::test::Shape shape { false, false, ".25", "a", ccc::test::Shape::Divisor::ANY, false };
+
+/* Int columns a0 to a3 are never zero and a4 is in every 500th row, float columns a5 to a9 are never zero.
+ * z is zero in its last row only,
+ * m is INT64_MIN every third row and n is -1 throughout,
+ * o alternates between INT64_MAX and INT64_MIN so + - * wrap around */
+struct Columns {
+    std::vector<std::pair<std::string, std::vector<long long>>> ints;
+    std::vector<std::pair<std::string, std::vector<double>>> floats;
+};
+
+static bool identical(const ccc::Token& lhs, double rhs)
+{
+    return lhs.term == ccc::Terminal::FLOAT_LITERAL
+        && (std::memcmp(&lhs.floatValue, &rhs, sizeof(double)) == 0 || (std::isnan(lhs.floatValue) && std::isnan(rhs)));
+}
+
+/* The stack VM with every column bound through globals, one run per row. False when a row fails */
+static bool interpret(ccc::SyntaxTree& ast, const Columns& columns, std::size_t rows, std::vector<ccc::Token>& out)
+{
+    ccc::Globals globals;
+    std::vector<std::size_t> intSlots;
+    std::vector<std::size_t> floatSlots;
+    for (const auto& column : columns.ints)
+        intSlots.push_back(globals.slot(column.first));
+    for (const auto& column : columns.floats)
+        floatSlots.push_back(globals.slot(column.first));
+
+    std::unique_ptr<ccc::StackBasedVM> vm;
+    for (std::size_t row = 0; row < rows; ++row) {
+        ccc::VM::Value* values = globals.values();
+        for (std::size_t i = 0; i < intSlots.size(); ++i) {
+            values[intSlots[i]].isFloat = false;
+            values[intSlots[i]].intValue = columns.ints[i].second[row];
+        }
+        for (std::size_t i = 0; i < floatSlots.size(); ++i) {
+            values[floatSlots[i]].isFloat = true;
+            values[floatSlots[i]].floatValue = columns.floats[i].second[row];
+        }
+        // lowered once the globals have their types
+        if (vm == nullptr)
+            vm.reset(new ccc::StackBasedVM { ast, &globals });
+        out.emplace_back("", ccc::Terminal::ERROR);
+        if (!vm->run() || !vm->result(out.back()))
+            return false;
+    }
+    return true;
+}
+
+/* The batch fails where the stack VM fails on any row and gives its value on every other, failed tells which */
+static bool agree(const std::string& expression, const Columns& columns, std::size_t rows, bool& failed)
+{
+    ccc::SyntaxTree ast;
+    if (!ccc::test::parse(expression, ast)) {
+        std::cout << "Failed to parse " << expression << '\n';
+        return false;
+    }
+    std::vector<ccc::Token> expected;
+    failed = !interpret(ast, columns, rows, expected);
+
+    ccc::BatchEvaluator batch { ast };
+    for (const auto& column : columns.ints)
+        batch.bind(column.first, column.second.data());
+    for (const auto& column : columns.floats)
+        batch.bind(column.first, column.second.data());
+    // constant division by zero already fails to fold
+    bool compiled = batch.compile();
+    std::vector<long long> ints(rows);
+    std::vector<double> floats(rows);
+    bool ran = compiled
+        && (batch.resultType() == ccc::Type::FLOAT ? batch.run(rows, floats.data()) : batch.run(rows, ints.data()));
+    if (ran == failed) {
+        std::cout << expression << " over " << rows << " rows " << (ran ? "ran in the batch" : "failed in the batch") << " but "
+                  << (failed ? "failed" : "ran") << " on the stack VM\n";
+        return false;
+    }
+    if (failed)
+        return true;
+
+    for (std::size_t row = 0; row < rows; ++row) {
+        const ccc::Token& value = expected[row];
+        bool same = batch.resultType() == ccc::Type::FLOAT
+            ? identical(value, floats[row])
+            : value.term == ccc::Terminal::INT_LITERAL && value.intValue == ints[row];
+        if (!same) {
+            std::cout << "Mismatch for " << expression << " in row " << row << " of " << rows << ": " << value.lexeme << " != ";
+            if (batch.resultType() == ccc::Type::FLOAT)
+                std::cout << floats[row] << '\n';
+            else
+                std::cout << ints[row] << '\n';
+            return false;
+        }
+    }
+    return true;
+}
+
+int main()
+{
+    std::mt19937 rng { 2026 };
+    unsigned int failures = 0;
+
+    Columns columns;
+    std::uniform_int_distribution<long long> small { -20, 20 };
+    std::uniform_int_distribution<int> quarters { -80, 80 };
+    for (int i = 0; i < 5; ++i) {
+        std::vector<long long> ints(ROWS);
+        std::vector<double> floats(ROWS);
+        for (std::size_t row = 0; row < ROWS; ++row) {
+            do
+                ints[row] = small(rng);
+            while (ints[row] == 0);
+            if (i == 4 && row % 500 == 499)
+                ints[row] = 0;
+            floats[row] = quarters(rng) * 0.25 + 0.125;
+        }
+        columns.ints.emplace_back("a" + std::to_string(i), ints);
+        columns.floats.emplace_back("a" + std::to_string(i + 5), floats);
+    }
+    std::vector<long long> z(ROWS, 3);
+    z.back() = 0;
+    std::vector<long long> m(ROWS, 9);
+    for (std::size_t row = 0; row < ROWS; row += 3)
+        m[row] = LLONG_MIN;
+    columns.ints.emplace_back("z", z);
+    columns.ints.emplace_back("m", m);
+    columns.ints.emplace_back("n", std::vector<long long>(ROWS, -1));
+    std::vector<long long> o(ROWS);
+    for (std::size_t row = 0; row < ROWS; ++row)
+        o[row] = row % 2 == 0 ? LLONG_MAX : LLONG_MIN;
+    columns.ints.emplace_back("o", o);
+
+    // row counts around the vector size and the ends of the columns
+    const std::size_t rowCounts[] = { 1, 2, 3, 17, 1023, 1024, 1025, 2047, ROWS };
+    bool dividedByZero = false;
+    for (unsigned int i = 0; i < 2000; ++i) {
+        bool failed;
+        if (!agree(ccc::test::generate(rng, 1 + i % 3, shape), columns, rowCounts[i % std::size(rowCounts)], failed))
+            ++failures;
+        dividedByZero = dividedByZero || failed;
+    }
+    if (!dividedByZero) {
+        std::cout << "No generated expression divided by zero\n";
+        ++failures;
+    }
+
+    const struct {
+        const char* expression;
+        std::size_t rows;
+        bool fails;
+    } edges[] = {
+        { "a0 / z", ROWS - 1, false },
+        { "a0 / z", ROWS, true },
+        { "a5 / z", ROWS, false },
+        { "z / (a0 - a0)", 1, true },
+        { "a0 / 0", 1025, true },
+        { "5 / 0", 3, true },
+        { "5.5 / 0", 3, false },
+        { "m / n", 1, true },
+        { "m / n", 1025, true },
+        { "m / (n - 1)", ROWS, false },
+        { "m / 2", ROWS, false },
+        { "((0 - 9223372036854775807) - 1) / n", 2, true },
+        { "((0 - 9223372036854775807) - 1) / (0 - 1)", 2, true },
+        { "m * 0.5 + a0", ROWS, false },
+        // integer overflow wraps around in both
+        { "o + 1", ROWS, false },
+        { "o - 1", ROWS, false },
+        { "o * n", ROWS, false },
+        { "o + a0", 1025, false },
+        { "o - a1", 1023, false },
+        { "o * a2", ROWS, false },
+        { "o + o", 1, false },
+        { "(a0 / a1) * 1.5 + a5 / 2", 1023, false },
+        { "a0 * a1 - a2 + a4 / a3", 1024, false },
+        { "a3 / a4", 499, false },
+        { "a3 / a4", 500, true },
+        { "a5 * a6 - a7 / a8 + a9", ROWS, false },
+        { "7", 1025, false },
+        { "a9", 17, false },
+    };
+    for (const auto& edge : edges) {
+        bool failed;
+        if (!agree(edge.expression, columns, edge.rows, failed)) {
+            ++failures;
+        } else if (failed != edge.fails) {
+            std::cout << edge.expression << " over " << edge.rows << " rows " << (failed ? "failed" : "ran") << '\n';
+            ++failures;
+        }
+    }
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,232 @@
+#include "jit.h"
+#include "lexer.h"
+#include "parallel.h"
+#include "parser.h"
+#include "support.h"
+#include "vm.h"
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+/* Resumes until the run no longer yields, counting the slices */
+static ccc::VM::Status finish(ccc::VM& vm, const ccc::VM::Budget& budget, unsigned long long& slices)
+{
+    ccc::VM::Status status = ccc::VM::Status::YIELDED;
+    for (slices = 0; status == ccc::VM::Status::YIELDED; ++slices)
+        status = vm.resume(budget);
+    return status;
+}
+
+/* Same result or the same failure and the same dispatches however finely the run is sliced, and the same result
+ * or failure from the VMs that hand control flow to the interpreter */
+static bool sliced(ccc::Lexer& lexer, ccc::ForkJoinPool& pool, const std::string& source)
+{
+    ccc::SyntaxTree ast;
+    if (!ccc::test::parse(lexer, source, ast)) {
+        std::cout << "Failed to parse " << source << '\n';
+        return false;
+    }
+    ccc::StackBasedVM whole { ast };
+    ccc::Token expected { "", ccc::Terminal::ERROR };
+    bool ran = whole.run() && whole.result(expected);
+    unsigned long long dispatches = whole.executedInstructions();
+    for (unsigned long long instructions : { 1ULL, 7ULL, 100ULL, 0ULL }) {
+        ccc::StackBasedVM vm { ast };
+        unsigned long long slices;
+        ccc::VM::Status status = finish(vm, ccc::VM::Budget { instructions, 0, 0 }, slices);
+        ccc::Token actual { "", ccc::Terminal::ERROR };
+        bool finished = status == ccc::VM::Status::FINISHED && vm.result(actual);
+        if (finished != ran || (ran && !(actual == expected)) || vm.executedInstructions() != dispatches) {
+            std::cout << source << " in slices of " << instructions << " evaluated to " << (finished ? actual.lexeme : "a failure") << " after "
+                      << vm.executedInstructions() << " dispatches instead of " << (ran ? expected.lexeme : "a failure") << " after " << dispatches
+                      << '\n';
+            return false;
+        }
+        if (instructions == 1 && dispatches > 20 && slices < 3) {
+            std::cout << source << " did not yield in slices of one\n";
+            return false;
+        }
+    }
+    for (const char* name : { "jit", "parallel" }) {
+        std::unique_ptr<ccc::VM> vm;
+        bool interpreted;
+        if (name[0] == 'j') {
+            ccc::JitVM* jit = new ccc::JitVM { ast };
+            interpreted = !jit->isCompiled();
+            vm.reset(jit);
+        } else {
+            ccc::ParallelVM* parallel = new ccc::ParallelVM { ast, pool, nullptr, 1 };
+            interpreted = parallel->tasks() == 0;
+            vm.reset(parallel);
+        }
+        unsigned long long slices;
+        ccc::VM::Status status = finish(*vm, ccc::VM::Budget { 1, 0, 0 }, slices);
+        ccc::Token actual { "", ccc::Terminal::ERROR };
+        bool finished = status == ccc::VM::Status::FINISHED && vm->result(actual);
+        if (finished != ran || (ran && !(actual == expected)) || vm->error().message != whole.error().message
+            || (interpreted && dispatches > 20 && slices < 3)) {
+            std::cout << source << " on the " << name << " VM in slices of one evaluated to " << (finished ? actual.lexeme : "a failure")
+                      << " in " << slices << " slices with \"" << vm->error().message << "\"\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+int main()
+{
+    unsigned int failures = 0;
+    ccc::Lexer lexer;
+    ccc::ForkJoinPool pool { 2 };
+
+    const char* programs[] = {
+        "int fib(int n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); } fib(15)",
+        "s = 0; i = 0; while (i < 1000) { s = s + i * 0.5; i = i + 1; } s",
+        "f = 0; i = 0; while (i < 3) { f = f + 0.5; i = i + 1; } f",
+        "int depth(int n) { if (n == 0) { return 0; } return 1 + depth(n - 1); } depth(4000)",
+        "7 / (3 - 3)",
+        "int forever(int n) { return forever(n + 1); } forever(0)",
+        "int x = 4; x * 3",
+        "(2 + 3) * (4 - 1.5)",
+    };
+    for (const char* source : programs)
+        if (!sliced(lexer, pool, source))
+            ++failures;
+
+    // a program that never ends keeps yielding while the others sharing the thread run to the end
+    {
+        const char* sources[] = { "while (1 < 2) { }", "int sum(int n) { int s = 0; while (n > 0) { s = s + n; n = n - 1; } return s; } sum(100)",
+            "f = 0.5; while (f <= 10) { f = f * 2; } f" };
+        std::vector<ccc::SyntaxTree> asts(3);
+        std::vector<std::unique_ptr<ccc::VM>> vms;
+        for (int i = 0; i < 3; ++i) {
+            if (!ccc::test::parse(lexer, sources[i], asts[i])) {
+                std::cout << "Failed to parse " << sources[i] << '\n';
+                return 1;
+            }
+            vms.emplace_back(new ccc::StackBasedVM { asts[i] });
+        }
+        ccc::VM::Status statuses[3] = { ccc::VM::Status::YIELDED, ccc::VM::Status::YIELDED, ccc::VM::Status::YIELDED };
+        for (int round = 0; round < 1000; ++round)
+            for (int i = 0; i < 3; ++i)
+                if (statuses[i] == ccc::VM::Status::YIELDED)
+                    statuses[i] = vms[i]->resume(ccc::VM::Budget { 10, 0, 0 });
+        ccc::Token sum { "", ccc::Terminal::ERROR };
+        ccc::Token doubled { "", ccc::Terminal::ERROR };
+        if (statuses[0] != ccc::VM::Status::YIELDED || statuses[1] != ccc::VM::Status::FINISHED || statuses[2] != ccc::VM::Status::FINISHED
+            || !vms[1]->result(sum) || !(sum == ccc::Token { 5050LL }) || !vms[2]->result(doubled) || !(doubled == ccc::Token { 16.0 })) {
+            std::cout << "Programs time-sliced with an endless loop did not run to the end\n";
+            ++failures;
+        }
+        // the endless one stops at the first taken jump past its budget
+        ccc::StackBasedVM& endless = static_cast<ccc::StackBasedVM&>(*vms[0]);
+        unsigned long long before = endless.executedInstructions();
+        if (endless.resume(ccc::VM::Budget { 10, 0, 0 }) != ccc::VM::Status::YIELDED || endless.executedInstructions() - before > 20) {
+            std::cout << "An endless loop overran its slice\n";
+            ++failures;
+        }
+    }
+
+    // a run after a yield starts over
+    {
+        ccc::SyntaxTree ast;
+        ccc::Token value { "", ccc::Terminal::ERROR };
+        if (!ccc::test::parse(lexer, "total = 0; i = 0; while (i < 50) { total = total + i; i = i + 1; } total", ast)) {
+            std::cout << "Failed to parse the loop\n";
+            return 1;
+        }
+        ccc::StackBasedVM vm { ast };
+        if (vm.resume(ccc::VM::Budget { 20, 0, 0 }) != ccc::VM::Status::YIELDED || vm.result(value) || !vm.run() || !vm.result(value)
+            || !(value == ccc::Token { 1225LL }) || vm.resume(ccc::VM::Budget { 0, 0, 0 }) != ccc::VM::Status::FINISHED) {
+            std::cout << "A run after a yield evaluated to " << value.lexeme << '\n';
+            ++failures;
+        }
+    }
+
+    // recursion past the stack or memory budget fails with a diagnostic at the call instead of running out of frames
+    {
+        ccc::SyntaxTree ast;
+        const std::string source = "int depth(int n) { if (n == 0) { return 0; } return 1 + depth(n - 1); } depth(1000)";
+        if (!ccc::test::parse(lexer, source, ast)) {
+            std::cout << "Failed to parse the recursion\n";
+            return 1;
+        }
+        ccc::StackBasedVM vm { ast };
+        const ccc::VM::Budget budgets[] = { { 0, 100, 0 }, { 0, 0, 4096 }, { 3, 100, 0 } };
+        for (const ccc::VM::Budget& budget : budgets) {
+            unsigned long long slices;
+            if (finish(vm, budget, slices) != ccc::VM::Status::FAILED || vm.error().message.find("budget") == std::string::npos
+                || source.compare(vm.error().offset, 5, "depth") != 0) {
+                std::cout << "Recursion over budget gave " << vm.error().message << '\n';
+                ++failures;
+            }
+        }
+        ccc::Token value { "", ccc::Terminal::ERROR };
+        if (vm.resume(ccc::VM::Budget { 0, 5000, 0 }) != ccc::VM::Status::FINISHED || !vm.result(value) || !(value == ccc::Token { 1000LL })
+            || !vm.error().message.empty()) {
+            std::cout << "Recursion within budget evaluated to " << value.lexeme << '\n';
+            ++failures;
+        }
+    }
+
+    // contexts of one program pause and resume on their own
+    {
+        ccc::SyntaxTree ast;
+        if (!ccc::test::parse(lexer, "total = 1; i = 0; while (i < 100) { i = i + 1; } total + i", ast)) {
+            std::cout << "Failed to parse the context program\n";
+            return 1;
+        }
+        ccc::StackBasedVM vm { ast };
+        ccc::StackContext first { vm.program() };
+        ccc::StackContext second { vm.program() };
+        unsigned long long firstSlices;
+        unsigned long long secondSlices;
+        ccc::Token firstValue { "", ccc::Terminal::ERROR };
+        ccc::Token secondValue { "", ccc::Terminal::ERROR };
+        if (first.resume(ccc::VM::Budget { 5, 0, 0 }) != ccc::VM::Status::YIELDED
+            || finish(second, ccc::VM::Budget { 5, 0, 0 }, secondSlices) != ccc::VM::Status::FINISHED
+            || finish(first, ccc::VM::Budget { 5, 0, 0 }, firstSlices) != ccc::VM::Status::FINISHED || !first.result(firstValue)
+            || !second.result(secondValue) || !(firstValue == ccc::Token { 101LL }) || !(secondValue == firstValue)) {
+            std::cout << "Sliced contexts evaluated to " << firstValue.lexeme << " and " << secondValue.lexeme << '\n';
+            ++failures;
+        }
+    }
+
+    // a paused run typed for a shared global fails once another VM gives the global the other type
+    {
+        ccc::Globals globals;
+        ccc::SyntaxTree loop;
+        ccc::SyntaxTree assign;
+        if (!ccc::test::parse(lexer, "x = 1; i = 0; while (i < 100) { i = i + x; } i", loop) || !ccc::test::parse(lexer, "x = 0.5", assign)) {
+            std::cout << "Failed to parse the shared statements\n";
+            return 1;
+        }
+        ccc::StackBasedVM paused { loop, &globals };
+        ccc::StackBasedVM other { assign, &globals };
+        if (paused.resume(ccc::VM::Budget { 10, 0, 0 }) != ccc::VM::Status::YIELDED || !other.run()
+            || paused.resume(ccc::VM::Budget { 0, 0, 0 }) != ccc::VM::Status::FAILED || paused.error().message.empty()) {
+            std::cout << "A paused run went on after a shared global changed its type\n";
+            ++failures;
+        }
+    }
+
+    // a VM without loops or calls has nothing to yield at
+    {
+        ccc::SyntaxTree ast;
+        ccc::Token value { "", ccc::Terminal::ERROR };
+        if (!ccc::test::parse(lexer, "(1 + 2) * 3", ast)) {
+            std::cout << "Failed to parse the expression\n";
+            return 1;
+        }
+        ccc::RegisterVM vm { ast };
+        if (vm.resume(ccc::VM::Budget { 1, 1, 1 }) != ccc::VM::Status::FINISHED || !vm.result(value) || !(value == ccc::Token { 9LL })) {
+            std::cout << "The register VM evaluated to " << value.lexeme << '\n';
+            ++failures;
+        }
+    }
+
+    if (failures == 0)
+        std::cout << "All budget tests passed\n";
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,103 @@
+#include "bundle.h"
+#include "pipeline.h"
+#include "support.h"
+#include "vm.h"
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <string>
+
+static const std::string file = "bundle_input.bundle";
+
+int main()
+{
+    unsigned int failures = 0;
+    const struct {
+        const char* name;
+        const char* source;
+        bool runs;
+        /* A statement fails as it runs, the statements after it still run */
+        bool fails;
+        ccc::Token expected;
+    } entries[] = {
+        { "a.c", "x = 6; x * 7", true, false, ccc::Token { 42LL } },
+        // every entry gets fresh variables
+        { "b.c", "int x = 1; x + 0.5;\n", true, false, ccc::Token { 1.5 } },
+        { "empty.c", "", false, false, ccc::Token { "", ccc::Terminal::ERROR } },
+        { "broken.c", "y = 2;\ny +;\n", false, false, ccc::Token { "", ccc::Terminal::ERROR } },
+        { "dir/loop.c", "i = 0; while (i < 10) { i = i + 1; } i", true, false, ccc::Token { 10LL } },
+        { "dz.c", "x = 5;\nx / (x - 5);\nx", false, true, ccc::Token { 5LL } },
+    };
+    ccc::BundleWriter writer;
+    for (const auto& entry : entries)
+        writer.add(entry.name, entry.source);
+    if (!writer.write(file)) {
+        std::cout << "Failed to write " << file << '\n';
+        return 1;
+    }
+
+    ccc::Bundle bundle;
+    if (!bundle.open(file) || bundle.size() != sizeof(entries) / sizeof(entries[0])) {
+        std::cout << "Failed to open " << file << '\n';
+        return 1;
+    }
+    ccc::Pipeline pipeline { ccc::test::stackBased, 4, std::numeric_limits<std::size_t>::max() };
+    for (std::size_t i = 0; i < bundle.size(); ++i) {
+        const ccc::Bundle::Entry& entry = bundle[i];
+        if (entry.name != entries[i].name || std::string { entry.source, entry.length } != entries[i].source) {
+            std::cout << "Entry " << i << " came back as " << entry.name << '\n';
+            ++failures;
+            continue;
+        }
+        ccc::Token last { "", ccc::Terminal::ERROR };
+        bool failed = false;
+        bool ran = pipeline.run(entry.source, entry.length, [&last, &failed](std::size_t, bool ok, const ccc::Token& value) {
+            last = value;
+            failed = failed || !ok;
+        });
+        bool valued = entries[i].expected.term != ccc::Terminal::ERROR;
+        if (ran != entries[i].runs || failed != entries[i].fails || (valued && !(last == entries[i].expected))) {
+            std::cout << entry.name << (ran ? " evaluated to the wrong value" : " failed: " + pipeline.error().message) << '\n';
+            ++failures;
+        }
+    }
+    // offsets of a syntax error are relative to the entry
+    if (pipeline.run(bundle[3].source, bundle[3].length, nullptr) || pipeline.error().offset != 10) {
+        std::cout << "The error in broken.c was reported at " << pipeline.error().offset << '\n';
+        ++failures;
+    }
+    // and so are those of a statement that failed as it ran
+    if (pipeline.run(bundle[5].source, bundle[5].length, nullptr) || pipeline.error().offset != 7 || pipeline.error().message != "division by zero") {
+        std::cout << "The error in dz.c was reported at " << pipeline.error().offset << ": " << pipeline.error().message << '\n';
+        ++failures;
+    }
+
+    // a truncated or foreign file is not a bundle
+    std::string contents;
+    {
+        std::ifstream in { file, std::ios::binary };
+        contents.assign(std::istreambuf_iterator<char> { in }, std::istreambuf_iterator<char> {});
+    }
+    const std::string broken[] = {
+        contents.substr(0, contents.size() - 1),
+        contents.substr(0, 20),
+        "CCCB",
+        "int x = 1;\n",
+        std::string { "CCCB\x02\0\0\0", 8 } + contents.substr(8),
+    };
+    for (const std::string& bytes : broken) {
+        std::ofstream { file, std::ios::binary | std::ios::trunc } << bytes;
+        if (bundle.open(file)) {
+            std::cout << "Opened a broken bundle of " << bytes.size() << " bytes\n";
+            ++failures;
+        }
+    }
+    if (bundle.open("missing.bundle")) {
+        std::cout << "Opened a missing bundle\n";
+        ++failures;
+    }
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
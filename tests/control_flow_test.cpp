@@ -0,0 +1,103 @@
+#include "lexer.h"
+#include "parser.h"
+#include "pipeline.h"
+#include "support.h"
+#include "vm.h"
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+
+static const std::string file = "control_flow_input.txt";
+
+int main()
+{
+    unsigned int failures = 0;
+    const struct {
+        const char* program;
+        ccc::Token expected;
+    } programs[] = {
+        { "s = 0; i = 0; while (i < 100) { s = s + i; i = i + 1; } s;", ccc::Token { 4950LL } },
+        { "x = 5; if (x > 3) { x = x * 2; } if (x == 3) { x = 0; } x", ccc::Token { 10LL } },
+        { "n = 0; i = 0; while (i < 10) { j = 0; while (j < i) { n = n + 1; j = j + 1; } i = i + 1; } n", ccc::Token { 45LL } },
+        { "f = 0.5; while (f <= 10) { f = f * 2; } f", ccc::Token { 16.0 } },
+        { "k = 7; while (k != 7) { k = 1; } if (k >= 8) { k = 0; } k", ccc::Token { 7LL } },
+        { "a = b = 3; a + b", ccc::Token { 6LL } },
+        { "i = 0; while ((i + 1) * 2 < 50 - 2) { if ((i / 2) * 2 == i) { i = i + 3; } i = i + 1; } i", ccc::Token { 24LL } },
+        // keywords are whole words only
+        { "iffy = 2; whilex = 3; iffy * whilex", ccc::Token { 6LL } },
+    };
+
+    for (const auto& test : programs) {
+        ccc::SyntaxTree ast;
+        if (!ccc::test::parse(test.program, ast)) {
+            std::cout << "Failed to parse " << test.program << '\n';
+            ++failures;
+            continue;
+        }
+        ccc::StackBasedVM plain { ast };
+        ccc::StackBasedVM fused { ast };
+        ccc::test::optimize(fused);
+        ccc::Token expected { "", ccc::Terminal::ERROR };
+        ccc::Token actual { "", ccc::Terminal::ERROR };
+        unsigned long long before = fused.executedInstructions();
+        if (!plain.run() || !plain.result(expected) || !(expected == test.expected)) {
+            std::cout << test.program << " evaluated to " << expected.lexeme << '\n';
+            ++failures;
+        } else if (!fused.run() || !fused.result(actual) || !(actual == expected)) {
+            std::cout << "Fused code of " << test.program << " evaluated to " << actual.lexeme << '\n';
+            ++failures;
+        } else if (fused.executedInstructions() - before >= plain.executedInstructions()) {
+            std::cout << "Fusing did not save dispatches in " << test.program << '\n';
+            ++failures;
+        }
+
+        // statements evaluated one at a time see the variables of the ones before
+        std::ofstream { file } << test.program << '\n';
+        ccc::Pipeline pipeline { ccc::test::stackBased, 4, std::numeric_limits<std::size_t>::max() };
+        ccc::Token last { "", ccc::Terminal::ERROR };
+        bool evaluated = pipeline.run(file, [&](std::size_t, bool ok, const ccc::Token& value) {
+            if (!ok)
+                ++failures;
+            last = value;
+        });
+        if (!evaluated || !(last == test.expected)) {
+            std::cout << "The pipeline evaluated " << test.program << " to " << last.lexeme << '\n';
+            ++failures;
+        }
+    }
+
+    // control flow leaves no result, a division by zero in a loop still fails the run
+    const struct {
+        const char* program;
+        bool runs;
+    } valueless[] = {
+        { "x = 1; while (x < 1000) { x = x * 3; }", true },
+        { "i = 3; while (i > 0) { i = i - 1; x = 6 / i; }", false },
+        { "1 = 2", false },
+    };
+    for (const auto& test : valueless) {
+        ccc::SyntaxTree ast;
+        ccc::Token value { "", ccc::Terminal::ERROR };
+        if (!ccc::test::parse(test.program, ast)) {
+            std::cout << "Failed to parse " << test.program << '\n';
+            ++failures;
+            continue;
+        }
+        ccc::StackBasedVM vm { ast };
+        if (vm.run() != test.runs || vm.result(value)) {
+            std::cout << test.program << (test.runs ? " did not run" : " ran") << " or had a result\n";
+            ++failures;
+        }
+    }
+
+    ccc::SyntaxTree ast;
+    ccc::Diagnostic error;
+    if (ccc::test::parse("if (1 < 2) { 3 }", ast, &error) || error.message != "unexpected '}'" || error.offset != 15) {
+        std::cout << "Missing ; in a block reported at " << error.offset << ": " << error.message << '\n';
+        ++failures;
+    }
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
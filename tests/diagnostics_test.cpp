@@ -0,0 +1,78 @@
+#include "diagnostics.h"
+#include "lexer.h"
+#include "parser.h"
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+
+static bool parseFile(const std::string& source, ccc::Diagnostic& error)
+{
+    const std::string file = "diagnostics_input.txt";
+    std::ofstream { file, std::ios::binary } << source;
+    ccc::SharedBuffer buffer;
+    ccc::Lexer lexer;
+    lexer.run(file, buffer);
+    ccc::LL1Parser parser { buffer };
+    ccc::SyntaxTree ast;
+    bool res = parser.parse(ast);
+    error = parser.error();
+    return res;
+}
+
+int main()
+{
+    unsigned int failures = 0;
+
+    // the vector scan has to agree with a plain walk across chunk boundaries
+    std::mt19937 rng { 30 };
+    std::string text;
+    for (unsigned int i = 0; i < 10000; ++i)
+        text += std::uniform_int_distribution<int> { 0, 7 }(rng) == 0 ? '\n' : 'x';
+    ccc::LineIndex lines { text.data(), text.size() };
+    unsigned int line = 1;
+    unsigned int column = 1;
+    for (unsigned int offset = 0; offset < text.size(); ++offset) {
+        unsigned int foundLine;
+        unsigned int foundColumn;
+        lines.locate(offset, foundLine, foundColumn);
+        if (foundLine != line || foundColumn != column) {
+            std::cout << "Offset " << offset << " is " << foundLine << ":" << foundColumn << " instead of " << line << ":" << column << '\n';
+            ++failures;
+            break;
+        }
+        if (text[offset] == '\n') {
+            ++line;
+            column = 1;
+        } else
+            ++column;
+    }
+
+    // the error points at the token, not at the start of the file
+    std::string source;
+    for (unsigned int i = 0; i < 300; ++i)
+        source += "(1 + 2) *\n";
+    source += "  3 + * 4\n";
+    ccc::Diagnostic error;
+    std::string expected = "input:301:7: error: unexpected '*'\n  3 + * 4\n      ^\n";
+    if (parseFile(source, error)) {
+        std::cout << "Invalid input was accepted\n";
+        ++failures;
+    } else {
+        ccc::LineIndex sourceLines { source.data(), source.size() };
+        std::string message = sourceLines.format("input", error);
+        if (message != expected) {
+            std::cout << "Unexpected diagnostic:\n" << message;
+            ++failures;
+        }
+    }
+
+    // lexer errors carry their position through the parser
+    if (parseFile("1 +\n 2 $ 3\n", error) || error.offset != 7) {
+        std::cout << "Lex error reported at " << error.offset << '\n';
+        ++failures;
+    }
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
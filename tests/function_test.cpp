@@ -0,0 +1,98 @@
+#include "lexer.h"
+#include "parser.h"
+#include "pipeline.h"
+#include "support.h"
+#include "vm.h"
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+
+static const std::string file = "function_input.txt";
+
+int main()
+{
+    unsigned int failures = 0;
+    const std::string fib = "int fib(int n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }\n";
+    const struct {
+        std::string program;
+        ccc::Token expected;
+    } programs[] = {
+        { fib + "fib(20);", ccc::Token { 6765LL } },
+        { "int madd(int a, int b, int c) { return a * b + c; } madd(2, 3, 4) + madd(1, 1, 1);", ccc::Token { 12LL } },
+        // the callee sees the globals, falling off its end returns 0
+        { "int bump() { count = count + 1; } count = 40; bump() + bump(); count", ccc::Token { 42LL } },
+        { "int twice(float x) { x = x * 2; return x; } twice(1.25) + 1", ccc::Token { 3.5 } },
+        // calls may come before the definition in one AST, and nest in arguments
+        { "int even(int n) { if (n == 0) { return 1; } return odd(n - 1); }\n"
+          "int odd(int n) { if (n == 0) { return 0; } return even(n - 1); }\n"
+          "even(10) * 10 + odd(7)",
+            ccc::Token { 11LL } },
+        { "int sq(int n) { return n * n; } sq(sq(3)) - sq(2 + 1)", ccc::Token { 72LL } },
+        { "int sum(int n) { int s = 0; while (n > 0) { s = s + n; n = n - 1; } return s; } sum(100)", ccc::Token { 5050LL } },
+        { "int depth(int n) { if (n == 0) { return 0; } return 1 + depth(n - 1); } depth(4000)", ccc::Token { 4000LL } },
+    };
+
+    for (const auto& test : programs) {
+        ccc::SyntaxTree ast;
+        if (!ccc::test::parse(test.program, ast)) {
+            std::cout << "Failed to parse " << test.program << '\n';
+            ++failures;
+            continue;
+        }
+        ccc::StackBasedVM plain { ast };
+        ccc::StackBasedVM fused { ast };
+        ccc::test::optimize(fused);
+        ccc::Token expected { "", ccc::Terminal::ERROR };
+        ccc::Token actual { "", ccc::Terminal::ERROR };
+        if (!plain.run() || !plain.result(expected) || !(expected == test.expected)) {
+            std::cout << test.program << " evaluated to " << expected.lexeme << '\n';
+            ++failures;
+        } else if (!fused.run() || !fused.result(actual) || !(actual == expected)) {
+            std::cout << "Fused code of " << test.program << " evaluated to " << actual.lexeme << '\n';
+            ++failures;
+        }
+    }
+
+    // definitions evaluated as statements of their own stay callable by the ones after
+    std::ofstream { file } << fib << "a = fib(10);\nint inc(int x) { return x + 1; }\ninc(a);\n";
+    ccc::Pipeline pipeline { ccc::test::stackBased, 4, std::numeric_limits<std::size_t>::max() };
+    ccc::Token last { "", ccc::Terminal::ERROR };
+    bool evaluated = pipeline.run(file, [&](std::size_t, bool ok, const ccc::Token& value) {
+        if (!ok)
+            ++failures;
+        last = value;
+    });
+    if (!evaluated || pipeline.evaluatedStatements() != 4 || !(last == ccc::Token { 56LL })) {
+        std::cout << "The pipeline evaluated the functions to " << last.lexeme << '\n';
+        ++failures;
+    }
+
+    const char* failing[] = {
+        "int f(int a, int b) { return a + b; } f(1)",
+        "g(1)",
+        "while (1 < 2) { return 1; }",
+        "int f(int a, int a) { return a; } f(1, 2)",
+        "int f() { return 1; } int f() { return 2; } f()",
+        "int f(int n) { return 6 / n; } f(0)",
+        // recursion past the preallocated frames fails instead of growing
+        "int forever(int n) { return forever(n + 1); } forever(0)",
+    };
+    for (const char* program : failing) {
+        ccc::SyntaxTree ast;
+        ccc::Token value { "", ccc::Terminal::ERROR };
+        if (!ccc::test::parse(program, ast)) {
+            std::cout << "Failed to parse " << program << '\n';
+            ++failures;
+            continue;
+        }
+        ccc::StackBasedVM vm { ast };
+        if (vm.run() || vm.result(value)) {
+            std::cout << program << " ran\n";
+            ++failures;
+        }
+    }
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,89 @@
+#include "lexer.h"
+#include "parser.h"
+#include "pipeline.h"
+#include "support.h"
+#include "utility.h"
+#include "vm.h"
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+
+static const std::string file = "hashcons_input.txt";
+
+static std::size_t countNodes(const ccc::SyntaxTree::SyntaxTreeNode* node)
+{
+    std::size_t res = 0;
+    for (; node != nullptr; node = node->next)
+        res += 1 + countNodes(node->children);
+    return res;
+}
+
+int main()
+{
+    unsigned int failures = 0;
+    const struct {
+        const char* program;
+        std::size_t saved;
+    } programs[] = {
+        { "a = 3; b = 4; (a + b) * (a + b)", 2 },
+        // nested repeats share the outermost copy only
+        { "x = 2; ((x * 3 + 1) - (x * 3 + 1)) + (x * 3) / 2", 6 },
+        // the first copy is stored again on every iteration before the later ones load it
+        { "s = 0; i = 0; while (i < 10) { s = s + (i * i + 1) * (i * i + 1); i = i + 1; } s", 4 },
+        { "int f(int n) { int m = n * 2; return (m + n) * (m + n) - (m + n); } f(3) + f(4)", 4 },
+        { "y = 1.5; (y * y) / (y * y + 1.0)", 2 },
+        // assignments and calls are not pure, nothing is shared across statements
+        { "c = 1; c = c + 1; c = c + 1; c", 0 },
+    };
+    for (const auto& test : programs) {
+        ccc::SyntaxTree plain;
+        ccc::SyntaxTree shared;
+        if (!ccc::test::parse(test.program, plain) || !ccc::test::parse(test.program, shared)) {
+            std::cout << "Failed to parse " << test.program << '\n';
+            ++failures;
+            continue;
+        }
+        std::size_t before = countNodes(shared.root);
+        std::size_t saved = shared.hashCons();
+        if (saved != test.saved || countNodes(shared.root) != before - saved) {
+            std::cout << "Hash-consing " << test.program << " saved " << saved << " nodes\n";
+            ++failures;
+        }
+        ccc::StackBasedVM expected { plain };
+        ccc::StackBasedVM actual { shared };
+        ccc::Token expectedValue { "", ccc::Terminal::ERROR };
+        ccc::Token actualValue { "", ccc::Terminal::ERROR };
+        if (!expected.run() || !expected.result(expectedValue) || !actual.run() || !actual.result(actualValue) || !(actualValue == expectedValue)) {
+            std::cout << "The shared tree of " << test.program << " evaluated to " << actualValue.lexeme << " instead of " << expectedValue.lexeme << '\n';
+            ++failures;
+        } else if (actual.executedInstructions() > expected.executedInstructions()) {
+            // a store and a load cost what a repeated leaf operation does, larger repeats save dispatches
+            std::cout << "Sharing cost dispatches in " << test.program << '\n';
+            ++failures;
+        }
+    }
+
+    // the pipeline shares within each statement and the stats report what that saved
+    ccc::MemoryStats::reset();
+    std::ofstream { file } << "p = 5;\nq = (p - 1) * (p - 1) + (p - 1);\nq * 2;\n";
+    ccc::Pipeline pipeline { ccc::test::stackBased, 4, std::numeric_limits<std::size_t>::max(), true };
+    ccc::Token last { "", ccc::Terminal::ERROR };
+    bool evaluated = pipeline.run(file, [&](std::size_t, bool ok, const ccc::Token& value) {
+        if (!ok)
+            ++failures;
+        last = value;
+    });
+    std::ostringstream stats;
+    ccc::MemoryStats::print(stats);
+    if (!evaluated || !(last == ccc::Token { 40LL }) || stats.str().find("hash-consing") == std::string::npos
+        || stats.str().find(" bytes saved") == std::string::npos) {
+        std::cout << "The hash-consing pipeline evaluated to " << last.lexeme << " and printed\n"
+                  << stats.str();
+        ++failures;
+    }
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,146 @@
+#include "incremental.h"
+#include "support.h"
+#include <iostream>
+#include <random>
+#include <string>
+
+/* Unbracketed groups and spaces give the edits more to merge and split */
+static const ccc::test::Shape shape { false, false, ".25", "a", ccc::test::Shape::Divisor::ANY, true };
+
+static bool sameTree(const ccc::SyntaxTree::SyntaxTreeNode* lhs, const ccc::SyntaxTree::SyntaxTreeNode* rhs)
+{
+    for (; lhs != nullptr && rhs != nullptr; lhs = lhs->next, rhs = rhs->next) {
+        if (!(lhs->val == rhs->val) || lhs->val.offset != rhs->val.offset || lhs->val.length != rhs->val.length
+            || lhs->offset != rhs->offset || lhs->length != rhs->length || !sameTree(lhs->children, rhs->children))
+            return false;
+    }
+    return lhs == rhs;
+}
+
+/* The incrementally maintained state has to match compiling the edited text from scratch */
+static bool check(ccc::IncrementalCompiler& compiler, bool accepted)
+{
+    ccc::IncrementalCompiler fresh;
+    bool expected = fresh.load(compiler.source());
+    if (accepted != expected)
+        return false;
+    if (compiler.tokens().size() != fresh.tokens().size())
+        return false;
+    for (std::size_t i = 0; i < fresh.tokens().size(); ++i) {
+        const ccc::Token& lhs = compiler.tokens()[i];
+        const ccc::Token& rhs = fresh.tokens()[i];
+        if (!(lhs == rhs) || lhs.offset != rhs.offset || lhs.length != rhs.length)
+            return false;
+    }
+    return !expected || sameTree(compiler.ast().root, fresh.ast().root);
+}
+
+/* Definitions, declarations and control flow around generated expressions */
+static std::string program(std::mt19937& rng)
+{
+    std::uniform_int_distribution<int> kind { 0, 4 };
+    std::string res = "int f(int x, float y) { if (x < " + ccc::test::generate(rng, 2, shape) + ") { return x * y; } return "
+        + ccc::test::generate(rng, 2, shape) + "; }\n";
+    for (int i = kind(rng); i >= 0; --i) {
+        switch (kind(rng)) {
+        case 0:
+            res += "int v = " + ccc::test::generate(rng, 3, shape) + ";\n";
+            break;
+        case 1:
+            res += "while (v < " + ccc::test::generate(rng, 2, shape) + ") { v = v + (1); }\n";
+            break;
+        case 2:
+            res += "a = f(" + ccc::test::generate(rng, 2, shape) + ", (" + ccc::test::generate(rng, 2, shape) + "));\n";
+            break;
+        default:
+            res += ccc::test::generate(rng, 4, shape) + ";\n";
+        }
+    }
+    return res;
+}
+
+/* Replaces removed characters at offset with inserted, false when that did not give the same as loading the result */
+static bool apply(ccc::IncrementalCompiler& compiler, std::size_t offset, std::size_t removed, const std::string& inserted)
+{
+    std::string before = compiler.source();
+    bool accepted = compiler.edit(offset, removed, inserted);
+    if (check(compiler, accepted))
+        return true;
+    std::cout << "Mismatch after replacing " << removed << " chars at " << offset << " with \"" << inserted << "\" in " << before << '\n';
+    return false;
+}
+
+int main()
+{
+    std::mt19937 rng { 2029 };
+    unsigned int failures = 0;
+    const std::string pieces[] = { "7", "42", ".5", "+", "-", "*", "/", "(", ")", " ", "b", "3.25" };
+
+    for (unsigned int round = 0; round < 200; ++round) {
+        ccc::IncrementalCompiler compiler;
+        compiler.load(ccc::test::generate(rng, 6, shape));
+        for (unsigned int step = 0; step < 50; ++step) {
+            const std::string& text = compiler.source();
+            std::size_t offset = std::uniform_int_distribution<std::size_t> { 0, text.size() }(rng);
+            std::size_t removed = std::uniform_int_distribution<std::size_t> { 0, std::min<std::size_t>(2, text.size() - offset) }(rng);
+            std::string inserted = std::uniform_int_distribution<int> { 0, 3 }(rng) == 0
+                ? ""
+                : pieces[std::uniform_int_distribution<std::size_t> { 0, std::size(pieces) - 1 }(rng)];
+            if (!apply(compiler, offset, removed, inserted)) {
+                ++failures;
+                break;
+            }
+        }
+    }
+
+    // whole tokens of definitions, declarations and conditions swapped for others, ids and literals most of all
+    const std::string swaps[] = { "x", "5", "2.5", "v", "f", "+", "*", "(", ")", "{", "}", ";", ",", "int", "if", "<", "=", "return" };
+    for (unsigned int round = 0; round < 300; ++round) {
+        ccc::IncrementalCompiler compiler;
+        compiler.load(program(rng));
+        for (unsigned int step = 0; step < 30 && !compiler.tokens().empty(); ++step) {
+            const ccc::Token& token = compiler.tokens()[std::uniform_int_distribution<std::size_t> { 0, compiler.tokens().size() - 1 }(rng)];
+            std::uniform_int_distribution<std::size_t> pick { 0, std::uniform_int_distribution<int> { 0, 1 }(rng) == 0 ? 2 : std::size(swaps) - 1 };
+            if (!apply(compiler, token.offset, token.length, swaps[pick(rng)])) {
+                ++failures;
+                break;
+            }
+        }
+    }
+
+    // a parameter is no operand, so a literal in its place is a syntax error
+    ccc::IncrementalCompiler definition;
+    const std::string source = "int f(int x) { return x; }\nf(2);";
+    if (!definition.load(source) || definition.edit(source.find("x)"), 1, "5") || !check(definition, false)) {
+        std::cout << "A literal parameter compiled\n";
+        ++failures;
+    }
+
+    // a one digit edit deep inside a long input only touches its own bracket group
+    std::string large;
+    for (unsigned int i = 0; i < 5000; ++i)
+        large += "(1+2*3)+";
+    large += "4";
+    ccc::IncrementalCompiler compiler;
+    if (!compiler.load(large) || !compiler.edit(large.size() / 2 + 1, 1, "9") || !check(compiler, true)
+        || compiler.relexedTokens() > 2 || compiler.reparsedTokens() > 5) {
+        std::cout << "Local edit relexed " << compiler.relexedTokens() << " and reparsed " << compiler.reparsedTokens() << " tokens\n";
+        ++failures;
+    }
+
+    // edits that change the length only move the spans around them and the tokens between them, not the rest of the file
+    std::string statements;
+    for (unsigned int i = 0; i < 5000; ++i)
+        statements += "x = (1+2*3);\n";
+    ccc::IncrementalCompiler lines;
+    std::size_t middle = statements.size() / 2 + 5;
+    bool local = lines.load(statements) && lines.edit(middle, 1, "42") && lines.shiftedSpans() < 100;
+    local = local && lines.edit(middle + 41, 0, " * 7") && lines.shiftedSpans() < 100;
+    if (!local || !check(lines, true)) {
+        std::cout << "Growing edits shifted " << lines.shiftedSpans() << " spans\n";
+        ++failures;
+    }
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
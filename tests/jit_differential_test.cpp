@@ -0,0 +1,138 @@
+#include "jit.h"
+#include "lexer.h"
+#include "parser.h"
+#include "support.h"
+#include "vm.h"
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+
+/* Every binary subexpression is bracketed so the tree is exactly the generated one, divisors are non zero literals
+ * so neither side traps */
+static const ccc::test::Shape shape { false, false, ".25", nullptr, ccc::test::Shape::Divisor::DIGIT, false };
+/* Divisors are whole subexpressions, so integer division by zero comes up as well */
+static const ccc::test::Shape anyDivisor { false, false, ".25", nullptr, ccc::test::Shape::Divisor::ANY, false };
+
+static bool identical(const ccc::Token& lhs, const ccc::Token& rhs)
+{
+    if (lhs.term != rhs.term)
+        return false;
+    if (lhs.term == ccc::Terminal::ERROR)
+        return true;
+    if (lhs.term == ccc::Terminal::INT_LITERAL)
+        return lhs.intValue == rhs.intValue;
+    return std::memcmp(&lhs.floatValue, &rhs.floatValue, sizeof(double)) == 0;
+}
+
+static void print(const ccc::Token& token)
+{
+    if (token.term == ccc::Terminal::ERROR)
+        std::cout << "a failure";
+    else if (token.term == ccc::Terminal::INT_LITERAL)
+        std::cout << token.intValue;
+    else
+        std::cout << token.floatValue;
+}
+
+/* Runs both tiers, an ERROR token stands for a failed run */
+static bool evaluate(const std::string& expression, bool& jitted, ccc::Token& interpreted, ccc::Token& compiled)
+{
+    ccc::SyntaxTree ast;
+    if (!ccc::test::parse(expression, ast))
+        return false;
+    ccc::StackBasedVM vm { ast };
+    ccc::JitVM jit { ast };
+    jitted = jit.isCompiled();
+    if (!vm.run() || !vm.result(interpreted))
+        interpreted = { "", ccc::Terminal::ERROR };
+    if (!jit.run() || !jit.result(compiled))
+        compiled = { "", ccc::Terminal::ERROR };
+    return true;
+}
+
+/* Both tiers evaluate expression to the same value or both fail, failed tells which */
+static bool agree(const std::string& expression, bool& failed)
+{
+    bool jitted;
+    ccc::Token interpreted { "", ccc::Terminal::ERROR };
+    ccc::Token compiled { "", ccc::Terminal::ERROR };
+    bool same = evaluate(expression, jitted, interpreted, compiled) && jitted && identical(interpreted, compiled);
+    failed = interpreted.term == ccc::Terminal::ERROR;
+    if (same)
+        return true;
+    std::cout << "Mismatch for " << expression << ": ";
+    print(interpreted);
+    std::cout << " != ";
+    print(compiled);
+    std::cout << '\n';
+    return false;
+}
+
+int main()
+{
+    std::mt19937 rng { 2024 };
+    unsigned int failures = 0;
+
+    for (unsigned int i = 0; i < 2000; ++i) {
+        bool failed;
+        if (!agree(ccc::test::generate(rng, 1 + i % 10, shape), failed) || failed)
+            ++failures;
+    }
+
+    // a zero divisor fails both tiers instead of trapping the native code
+    unsigned int zeroDivisors = 0;
+    for (unsigned int i = 0; i < 2000; ++i) {
+        bool failed;
+        if (!agree(ccc::test::generate(rng, 1 + i % 6, anyDivisor), failed))
+            ++failures;
+        zeroDivisors += failed;
+    }
+    if (zeroDivisors == 0) {
+        std::cout << "No generated expression divided by zero\n";
+        ++failures;
+    }
+
+    // the one integer quotient that does not fit traps like a zero divisor, the ones next to it do not
+    const struct {
+        const char* source;
+        bool fails;
+    } edges[] = {
+        { "5 / 0", true },
+        { "7 / (3 - 3)", true },
+        { "(1 + 2) * (4 / (2 - 2)) + 1.5", true },
+        { "((0 - 9223372036854775807) - 1) / (0 - 1)", true },
+        { "(((0 - 9223372036854775807) - 1) / (2 - 3)) * 2", true },
+        { "((0 - 9223372036854775807) - 1) / 1", false },
+        { "(0 - 9223372036854775807) / (0 - 1)", false },
+        { "((0 - 9223372036854775807) - 1) / (0 - 2)", false },
+        { "((0 - 9223372036854775807) - 1) / (0 - 1.0)", false },
+        // integer overflow wraps around in both tiers
+        { "9223372036854775807 + 1", false },
+        { "((0 - 9223372036854775807) - 1) - 1", false },
+        { "((0 - 9223372036854775807) - 1) * (0 - 1)", false },
+        { "(9223372036854775807 + 1) / (0 - 1)", true },
+    };
+    for (const auto& edge : edges) {
+        bool failed;
+        if (!agree(edge.source, failed))
+            ++failures;
+        else if (failed != edge.fails) {
+            std::cout << edge.source << (failed ? " failed\n" : " did not fail\n");
+            ++failures;
+        }
+    }
+
+    // identifiers have no native lowering and must go through the interpreter
+    bool jitted = true;
+    ccc::Token interpreted { "", ccc::Terminal::ERROR };
+    ccc::Token compiled { "", ccc::Terminal::ERROR };
+    evaluate("a*2", jitted, interpreted, compiled);
+    if (jitted) {
+        std::cout << "Identifier was compiled\n";
+        ++failures;
+    }
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
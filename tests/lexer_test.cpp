@@ -0,0 +1,48 @@
+#include "lexer.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+
+static bool scan(const std::string& text, ccc::Token& out)
+{
+    ccc::Lexer lexer;
+    std::size_t pos = 0;
+    std::size_t examined;
+    return lexer.next(text.data(), text.size(), true, pos, out, examined) == ccc::Lexer::ScanResult::TOKEN && pos == text.size();
+}
+
+int main()
+{
+    unsigned int failures = 0;
+    ccc::Token token { "", ccc::Terminal::ERROR };
+
+    if (!scan("9223372036854775807", token) || token.term != ccc::Terminal::INT_LITERAL || token.intValue != 9223372036854775807LL) {
+        std::cout << "Largest int literal was not decoded\n";
+        ++failures;
+    }
+    if (scan("9223372036854775808", token) || token.term != ccc::Terminal::ERROR || token.length != 19) {
+        std::cout << "Overflowing int literal was accepted\n";
+        ++failures;
+    }
+
+    // doubles have to round exactly like strtod, including the tricky long mantissas
+    std::mt19937_64 rng { 31 };
+    for (unsigned int i = 0; i < 10000; ++i) {
+        std::string text = std::to_string(rng() % 1000000) + "." + std::to_string(rng());
+        double expected = std::strtod(text.c_str(), nullptr);
+        if (!scan(text, token) || token.term != ccc::Terminal::FLOAT_LITERAL || std::memcmp(&token.floatValue, &expected, sizeof(double)) != 0) {
+            std::cout << "Float literal " << text << " decoded to " << token.floatValue << '\n';
+            ++failures;
+            break;
+        }
+    }
+    if (!scan(".5", token) || token.floatValue != 0.5) {
+        std::cout << "Float literal without integer part was not decoded\n";
+        ++failures;
+    }
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,85 @@
+#include "lines.h"
+#include "pipeline.h"
+#include "support.h"
+#include "vm.h"
+#include <charconv>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+
+static const ccc::test::Shape shape { true, false, ".25", nullptr, ccc::test::Shape::Divisor::FLOAT, false };
+
+int main()
+{
+    std::mt19937 rng { 45 };
+    unsigned int failures = 0;
+
+    // each line on its own through the pipeline gives the expected output line
+    std::string input;
+    std::string expected;
+    std::size_t expectedFailures = 0;
+    ccc::Pipeline pipeline { ccc::test::stackBased, 4, std::numeric_limits<std::size_t>::max() };
+    for (unsigned int i = 0; i < 5000; ++i) {
+        std::string line;
+        if (i % 97 == 0)
+            line = "  \t";
+        else if (i % 89 == 0)
+            line = "1 + * 2";
+        else if (i % 83 == 0)
+            line = "x = " + std::to_string(i) + "; x * 2";
+        else if (i % 79 == 0)
+            line = "int f(int n) { return n * 3; } f(" + std::to_string(i) + ")";
+        else if (i % 73 == 0)
+            line = "i = 0; while (i < 3) { i = i + 1; }";
+        else
+            line = ccc::test::generate(rng, 1 + i % 4, shape);
+        input += line + (i % 2 == 0 ? "\n" : "\r\n");
+        if (line == "  \t") {
+            expected += '\n';
+            continue;
+        }
+        ccc::Token last { "", ccc::Terminal::ERROR };
+        if (!pipeline.run(line.data(), line.size(), [&last](std::size_t, bool, const ccc::Token& value) { last = value; })) {
+            expected += "error: " + pipeline.error().message + '\n';
+            ++expectedFailures;
+            continue;
+        }
+        char digits[32];
+        if (last.term == ccc::Terminal::FLOAT_LITERAL)
+            expected.append(digits, std::to_chars(digits, digits + sizeof(digits), last.floatValue).ptr);
+        else if (last.term == ccc::Terminal::INT_LITERAL)
+            expected.append(digits, std::to_chars(digits, digits + sizeof(digits), last.intValue).ptr);
+        else
+            expected += "ok";
+        expected += '\n';
+    }
+    // the last line may end without a newline
+    input += "6 * 7";
+    expected += "42\n";
+
+    for (std::size_t threads : { 1, 3, 8 }) {
+        for (std::size_t chunkLines : { std::size_t { 1 }, std::size_t { 7 }, ccc::LineRunner::defaultChunkLines }) {
+            ccc::LineRunner runner { threads, chunkLines };
+            std::ostringstream out;
+            bool ok = runner.run(input.data(), input.size(), out);
+            if (ok || runner.failedLines() != expectedFailures || out.str() != expected) {
+                std::cout << threads << " threads with " << chunkLines << " line chunks failed " << runner.failedLines() << " lines instead of "
+                          << expectedFailures << (out.str() == expected ? "" : " and wrote different output") << '\n';
+                ++failures;
+            }
+        }
+    }
+
+    ccc::LineRunner runner { 2 };
+    std::ostringstream out;
+    if (!runner.run("", 0, out) || !out.str().empty() || !runner.run("1\n\n2\n", 5, out) || out.str() != "1\n\n2\n") {
+        std::cout << "Empty and blank lines wrote " << out.str() << '\n';
+        ++failures;
+    }
+
+    if (failures == 0)
+        std::cout << "All line tests passed\n";
+    return failures == 0 ? 0 : 1;
+}
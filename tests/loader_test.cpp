@@ -0,0 +1,72 @@
+#include "loader.h"
+#include "pipeline.h"
+#include "support.h"
+#include "vm.h"
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+int main()
+{
+    unsigned int failures = 0;
+    std::vector<std::string> paths;
+    std::vector<std::string> sources;
+    for (int i = 0; i < 40; ++i) {
+        paths.push_back("loader_input_" + std::to_string(i) + ".txt");
+        // one large file takes several reads, one is empty
+        if (i == 7)
+            sources.push_back(std::string(3 << 20, ' ') + "1 + 1");
+        else if (i == 11)
+            sources.push_back("");
+        else
+            sources.push_back("x = " + std::to_string(i) + "; x * 2");
+        std::ofstream { paths.back(), std::ios::binary } << sources.back();
+    }
+    // a missing file is handed out in its place in the list and fails alone
+    paths.insert(paths.begin() + 5, "loader_missing.txt");
+    sources.insert(sources.begin() + 5, "");
+
+    for (ccc::FileLoader::Backend backend : { ccc::FileLoader::Backend::AUTO, ccc::FileLoader::Backend::THREADS }) {
+        for (std::size_t inFlight : { 1, 4, 64 }) {
+            ccc::FileLoader loader { paths, inFlight, backend };
+            if (backend == ccc::FileLoader::Backend::THREADS && loader.backend() != ccc::FileLoader::Backend::THREADS) {
+                std::cout << "The thread backend was not used\n";
+                ++failures;
+            }
+            ccc::Pipeline pipeline { ccc::test::stackBased, 4, std::numeric_limits<std::size_t>::max() };
+            ccc::FileLoader::File file;
+            std::size_t count = 0;
+            while (loader.next(file)) {
+                std::size_t i = count++;
+                bool missing = i == 5;
+                if (file.path != paths[i] || file.ok == missing || std::string { file.contents.begin(), file.contents.end() } != sources[i]) {
+                    std::cout << "File " << i << " came back as " << file.path << " with " << file.contents.size() << " bytes\n";
+                    ++failures;
+                    continue;
+                }
+                if (missing || sources[i].empty())
+                    continue;
+                ccc::Token last { "", ccc::Terminal::ERROR };
+                long long expected = i == 8 ? 2 : 2 * (static_cast<long long>(i) - (i > 5 ? 1 : 0));
+                if (!pipeline.run(file.contents.data(), file.contents.size(), [&last](std::size_t, bool, const ccc::Token& value) { last = value; })
+                    || !(last == ccc::Token { expected })) {
+                    std::cout << file.path << " evaluated to " << last.intValue << " instead of " << expected << '\n';
+                    ++failures;
+                }
+            }
+            if (count != paths.size()) {
+                std::cout << "The loader handed out " << count << " of " << paths.size() << " files\n";
+                ++failures;
+            }
+        }
+        // a loader dropped with reads in flight waits for them
+        ccc::FileLoader dropped { paths, 8, backend };
+        ccc::FileLoader::File file;
+        dropped.next(file);
+    }
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,128 @@
+#include "lexer.h"
+#include "parser.h"
+#include "utility.h"
+#include "vm.h"
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+
+using Subsystem = ccc::MemoryStats::Subsystem;
+
+/* Lexes and parses on two threads like the driver, so backpressure is what keeps the lexer in check */
+static bool compile(const std::string& file, ccc::Diagnostic& error, bool run)
+{
+    ccc::MemoryStats::reset();
+    ccc::SharedBuffer buffer;
+    ccc::Lexer lexer;
+    std::thread lexerThread { &ccc::Lexer::run, &lexer, file, std::ref(buffer) };
+    ccc::LL1Parser parser { buffer };
+    ccc::SyntaxTree ast;
+    bool parsed = parser.parse(ast);
+    lexerThread.join();
+    error = parser.error();
+    if (!parsed)
+        return false;
+    parser.convertToAst(ast);
+    if (run) {
+        ccc::StackBasedVM vm { ast };
+        return vm.run();
+    }
+    return true;
+}
+
+static bool released()
+{
+    for (int i = 0; i < static_cast<int>(Subsystem::COUNT); ++i)
+        if (ccc::MemoryStats::current(static_cast<Subsystem>(i)) != 0)
+            return false;
+    return true;
+}
+
+int main()
+{
+    unsigned int failures = 0;
+    const std::string file = "memory_input.txt";
+    std::mt19937 rng { 34 };
+    std::string source = "1";
+    for (unsigned int i = 0; i < 3000; ++i)
+        source += (i % 7 == 0 ? " + (" : " + ") + std::to_string(std::uniform_int_distribution<int> { 1, 999 }(rng)) + (i % 7 == 0 ? " * 2)" : "");
+    std::ofstream { file } << source << '\n';
+
+    ccc::Diagnostic error;
+    if (!compile(file, error, true)) {
+        std::cout << "Unbounded compile failed: " << error.message << '\n';
+        return 1;
+    }
+    const char* names[] = { "lexer buffer", "token queue", "parse tree", "symbol table", "vm stack" };
+    for (Subsystem subsystem : { Subsystem::LEXER_BUFFER, Subsystem::TOKEN_QUEUE, Subsystem::PARSE_TREE, Subsystem::VM_STACK })
+        if (ccc::MemoryStats::peak(subsystem) == 0) {
+            std::cout << "No " << names[static_cast<int>(subsystem)] << " bytes were counted\n";
+            ++failures;
+        }
+    if (!released()) {
+        std::cout << "Bytes still counted after the compile\n";
+        ccc::MemoryStats::print(std::cout);
+        ++failures;
+    }
+
+    {
+        ccc::SymbolTable symbols;
+        symbols.addScope();
+        symbols.insert("x", ccc::Symbol { ccc::Type::INT, ccc::StorageSpecifier::AUTO });
+        symbols.addScope();
+        symbols.insert("y", ccc::Symbol { ccc::Type::FLOAT, ccc::StorageSpecifier::AUTO });
+        if (ccc::MemoryStats::current(Subsystem::SYMBOL_TABLE) == 0) {
+            std::cout << "No symbol table bytes were counted\n";
+            ++failures;
+        }
+        symbols.removeScope();
+    }
+    if (ccc::MemoryStats::current(Subsystem::SYMBOL_TABLE) != 0) {
+        std::cout << "Symbol table bytes still counted after its destruction\n";
+        ++failures;
+    }
+
+    // room for everything but the queue, the lexer has to wait for the parser instead of running ahead
+    std::size_t tree = ccc::MemoryStats::peak(Subsystem::PARSE_TREE);
+    std::size_t budget = tree + ccc::MemoryStats::peak(Subsystem::LEXER_BUFFER) + ccc::MemoryStats::peak(Subsystem::VM_STACK) + 1024;
+    ccc::MemoryStats::setBudget(budget);
+    if (!compile(file, error, true)) {
+        std::cout << "Compile within a budget of " << budget << " failed: " << error.message << '\n';
+        ++failures;
+    } else if (ccc::MemoryStats::exceeded() || ccc::MemoryStats::peak() > budget) {
+        std::cout << "Peak of " << ccc::MemoryStats::peak() << " bytes is over the budget of " << budget << '\n';
+        ++failures;
+    }
+
+    // a tree that does not fit fails the compile with a diagnostic instead of growing
+    budget = tree / 2;
+    ccc::MemoryStats::setBudget(budget);
+    if (compile(file, error, false)) {
+        std::cout << "Compile over a budget of " << budget << " succeeded\n";
+        ++failures;
+    } else if (error.message != "memory budget of " + std::to_string(budget) + " bytes exceeded") {
+        std::cout << "Unexpected error over budget: " << error.message << '\n';
+        ++failures;
+    }
+
+    // a single token longer than the budget stops the lexer
+    std::ofstream { file } << std::string(20000, '1') << '\n';
+    budget = 8192;
+    ccc::MemoryStats::setBudget(budget);
+    if (compile(file, error, false) || error.message != "memory budget of " + std::to_string(budget) + " bytes exceeded") {
+        std::cout << "Long token over budget gave: " << error.message << '\n';
+        ++failures;
+    }
+    ccc::MemoryStats::setBudget(0);
+    if (!released()) {
+        std::cout << "Bytes still counted after failed compiles\n";
+        ccc::MemoryStats::print(std::cout);
+        ++failures;
+    }
+
+    if (failures == 0)
+        std::cout << "All memory tests passed\n";
+    return failures == 0 ? 0 : 1;
+}
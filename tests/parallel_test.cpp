@@ -0,0 +1,170 @@
+#include "lexer.h"
+#include "parallel.h"
+#include "parser.h"
+#include "pipeline.h"
+#include "support.h"
+#include "vm.h"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+
+static const std::string file = "parallel_input.txt";
+
+/* Balanced tree of 2^depth leaves, leaf and op pick the text of the next leaf and operator */
+static std::string balanced(unsigned int depth, const char* const* leaves, std::size_t leafCount, const char* ops, unsigned int& leaf)
+{
+    if (depth == 0)
+        return leaves[leaf++ % leafCount];
+    std::string lhs = balanced(depth - 1, leaves, leafCount, ops, leaf);
+    std::string rhs = balanced(depth - 1, leaves, leafCount, ops, leaf);
+    return "(" + lhs + " " + ops[(depth + leaf) % std::strlen(ops)] + " " + rhs + ")";
+}
+
+/* Serial and parallel results have to match bit for bit, not just compare equal */
+static bool identical(const ccc::Token& lhs, const ccc::Token& rhs)
+{
+    if (lhs.term != rhs.term)
+        return false;
+    return lhs.term == ccc::Terminal::FLOAT_LITERAL ? std::memcmp(&lhs.floatValue, &rhs.floatValue, sizeof(double)) == 0 : lhs.intValue == rhs.intValue;
+}
+
+int main()
+{
+    unsigned int failures = 0;
+    const char* floatLeaves[] = { "x", "1.5", "2", "0.75", "y" };
+    const char* intLeaves[] = { "3", "n", "7", "1" };
+    unsigned int leaf = 0;
+    const std::string floats = balanced(12, floatLeaves, 5, "+-*/+*", leaf);
+    leaf = 0;
+    const std::string ints = balanced(12, intLeaves, 4, "+--+", leaf);
+    leaf = 0;
+    const std::string divides = balanced(8, intLeaves, 4, "+-", leaf) + " + (" + balanced(8, intLeaves, 4, "*+", leaf) + " / (n - 5))";
+
+    ccc::Globals globals;
+    std::size_t x = globals.slot("x");
+    std::size_t y = globals.slot("y");
+    std::size_t n = globals.slot("n");
+    ccc::VM::Value* values = globals.values();
+    values[x].isFloat = true;
+    values[x].floatValue = 0.1;
+    values[y].isFloat = true;
+    values[y].floatValue = -3.3;
+    values[n].isFloat = false;
+    values[n].intValue = 5;
+
+    const struct {
+        const std::string& program;
+        std::size_t grain;
+        bool runs;
+    } programs[] = {
+        { floats, 64, true },
+        { floats, 1, true },
+        { ints, 16, true },
+        // a division by zero in one task fails the run whichever thread gets to it
+        { divides, 8, false },
+    };
+    for (std::size_t threads : { 1, 2, 4 }) {
+        ccc::ForkJoinPool pool { threads };
+        for (const auto& test : programs) {
+            ccc::SyntaxTree ast;
+            if (!ccc::test::parse(test.program, ast)) {
+                std::cout << "Failed to parse a tree of " << test.program.size() << " characters\n";
+                ++failures;
+                continue;
+            }
+            ccc::StackBasedVM serial { ast, &globals };
+            ccc::ParallelVM parallel { ast, pool, &globals, test.grain };
+            ccc::Token expected { "", ccc::Terminal::ERROR };
+            ccc::Token actual { "", ccc::Terminal::ERROR };
+            if (parallel.tasks() < 3) {
+                std::cout << "A tree of " << test.program.size() << " characters was not split at grain " << test.grain << '\n';
+                ++failures;
+            }
+            if (serial.run() != test.runs || parallel.run() != test.runs) {
+                std::cout << "A tree of " << test.program.size() << " characters did " << (test.runs ? "not run" : "run") << " on " << threads << " threads\n";
+                ++failures;
+                continue;
+            }
+            if (!test.runs)
+                continue;
+            // the pool is reused by every run
+            for (int round = 0; round < 3; ++round) {
+                if (!serial.result(expected) || !parallel.run() || !parallel.result(actual) || !identical(actual, expected)) {
+                    std::cout << "A tree of " << test.program.size() << " characters evaluated to " << actual.lexeme << " instead of "
+                              << expected.lexeme << " on " << threads << " threads\n";
+                    ++failures;
+                    break;
+                }
+            }
+            if (parallel.executedInstructions() == 0) {
+                std::cout << "Parallel runs counted no instructions\n";
+                ++failures;
+            }
+        }
+    }
+
+    // anything but one arithmetic expression runs on the interpreter
+    ccc::ForkJoinPool pool { 2 };
+    const struct {
+        const char* program;
+        ccc::Token expected;
+    } fallbacks[] = {
+        { "a = 1; a + 2", ccc::Token { 3LL } },
+        { "int f(int n) { return n * n; } f(4) + 1", ccc::Token { 17LL } },
+        { "1 + 2 * 3", ccc::Token { 7LL } },
+    };
+    for (const auto& test : fallbacks) {
+        ccc::SyntaxTree ast;
+        ccc::Token value { "", ccc::Terminal::ERROR };
+        if (!ccc::test::parse(test.program, ast)) {
+            std::cout << "Failed to parse " << test.program << '\n';
+            ++failures;
+            continue;
+        }
+        ccc::ParallelVM vm { ast, pool };
+        if (!vm.run() || !vm.result(value) || !(value == test.expected)) {
+            std::cout << test.program << " evaluated to " << value.lexeme << '\n';
+            ++failures;
+        }
+    }
+    ccc::SyntaxTree undeclared;
+    if (!ccc::test::parse("q * 2", undeclared)) {
+        ++failures;
+    } else {
+        ccc::ParallelVM vm { undeclared, pool };
+        if (vm.run() || vm.error().message != "undeclared identifier 'q'") {
+            std::cout << "An undeclared identifier reported " << vm.error().message << '\n';
+            ++failures;
+        }
+    }
+
+    // the pipeline hands every statement to its own parallel VM, the variables are shared
+    std::ofstream { file } << "x = 0.1;\ny = 0.0 - 3.3;\n" << floats << ";\n";
+    ccc::Pipeline pipeline { [&pool](ccc::SyntaxTree& ast, ccc::Globals& globals) {
+                                return std::unique_ptr<ccc::VM> { new ccc::ParallelVM { ast, pool, &globals, 64 } };
+                            },
+        4, std::numeric_limits<std::size_t>::max() };
+    ccc::Token last { "", ccc::Terminal::ERROR };
+    bool evaluated = pipeline.run(file, [&](std::size_t, bool ok, const ccc::Token& value) {
+        if (!ok)
+            ++failures;
+        last = value;
+    });
+    ccc::SyntaxTree ast;
+    ccc::Token expected { "", ccc::Terminal::ERROR };
+    if (!ccc::test::parse(floats, ast)) {
+        ++failures;
+    } else {
+        ccc::StackBasedVM serial { ast, &globals };
+        if (!evaluated || !serial.run() || !serial.result(expected) || !identical(last, expected)) {
+            std::cout << "The pipeline evaluated to " << last.lexeme << " instead of " << expected.lexeme << '\n';
+            ++failures;
+        }
+    }
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
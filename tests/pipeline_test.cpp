@@ -0,0 +1,162 @@
+#include "jit.h"
+#include "lexer.h"
+#include "parallel.h"
+#include "parser.h"
+#include "pipeline.h"
+#include "support.h"
+#include "utility.h"
+#include "vm.h"
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+static const ccc::test::Shape shape { true, false, ".5", nullptr, ccc::test::Shape::Divisor::FLOAT, false };
+
+static bool evaluate(const std::string& file, ccc::Token& value, std::size_t& treePeak)
+{
+    ccc::MemoryStats::reset();
+    ccc::SharedBuffer buffer;
+    ccc::Lexer lexer;
+    if (!lexer.run(file, buffer))
+        return false;
+    ccc::LL1Parser parser { buffer };
+    ccc::SyntaxTree ast;
+    if (!parser.parse(ast))
+        return false;
+    parser.convertToAst(ast);
+    treePeak = ccc::MemoryStats::peak(ccc::MemoryStats::Subsystem::PARSE_TREE);
+    ccc::StackBasedVM vm { ast };
+    return vm.run() && vm.result(value);
+}
+
+int main()
+{
+    std::mt19937 rng { 35 };
+    unsigned int failures = 0;
+    const std::string file = "pipeline_input.txt";
+
+    std::vector<std::string> statements;
+    std::vector<ccc::Token> expected;
+    std::size_t treePeak = 0;
+    for (unsigned int i = 0; i < 300; ++i) {
+        statements.push_back(ccc::test::generate(rng, 1 + i % 5, shape));
+        std::ofstream { file } << statements.back() << '\n';
+        ccc::Token value { "", ccc::Terminal::ERROR };
+        if (!evaluate(file, value, treePeak)) {
+            std::cout << "Statement " << statements.back() << " does not evaluate on its own\n";
+            return 1;
+        }
+        expected.push_back(value);
+    }
+    {
+        std::ofstream out { file };
+        for (const std::string& statement : statements)
+            out << statement << ";\n";
+    }
+
+    // the whole file as one AST results in the last statement
+    ccc::Token last { "", ccc::Terminal::ERROR };
+    if (!evaluate(file, last, treePeak) || !(last == expected.back())) {
+        std::cout << "Statement list evaluates to " << last.lexeme << " instead of the last statement\n";
+        ++failures;
+    }
+
+    std::string broken;
+    for (std::size_t i = 0; i < 10; ++i)
+        broken += statements[i] + ";\n";
+    std::size_t errorOffset = broken.size() + 4;
+    broken += "1 + * 2;\n" + statements[10] + ";\n";
+    const std::string brokenFile = "pipeline_broken_input.txt";
+    std::ofstream { brokenFile } << broken;
+
+    // statements that parse but fail as they run, with the VMs ccc picks for --jit and --threads
+    // the parallel tasks keep no nodes and report at the start of the statement
+    const struct {
+        const char* source;
+        std::size_t statements;
+        std::size_t offset;
+        std::size_t statementOffset;
+        const char* message;
+    } failing[] = {
+        { "x = 4;\n5 / (x - 4);\nx * 2;\n", 3, 7, 7, "division by zero" },
+        { "(1 + 2) * (7 / (3 - 3));\n4;\n", 2, 10, 0, "division by zero" },
+        { "int forever(int n) { return forever(n + 1); }\nforever(0);\n1;\n", 3, 28, 28, "call stack overflow" },
+    };
+    const std::string failingFile = "pipeline_failing_input.txt";
+    ccc::ForkJoinPool pool { 2 };
+    const ccc::Pipeline::VMFactory factories[] = {
+        ccc::test::stackBased,
+        [](ccc::SyntaxTree& ast, ccc::Globals& globals) { return std::unique_ptr<ccc::VM> { new ccc::JitVM { ast, &globals } }; },
+        [&pool](ccc::SyntaxTree& ast, ccc::Globals& globals) { return std::unique_ptr<ccc::VM> { new ccc::ParallelVM { ast, pool, &globals, 1 } }; },
+    };
+
+    // threads from 0 bytes on, and never
+    for (std::size_t threadedFrom : { std::size_t { 0 }, std::numeric_limits<std::size_t>::max() }) {
+        const char* mode = threadedFrom == 0 ? "threaded" : "single-threaded";
+        ccc::MemoryStats::reset();
+        ccc::Pipeline pipeline { ccc::test::stackBased, 4, threadedFrom };
+        std::size_t seen = 0;
+        bool pipelined = pipeline.run(file, [&](std::size_t statement, bool ok, const ccc::Token& value) {
+            if (statement != seen || !ok || !(value == expected[statement])) {
+                std::cout << "Statement " << statement << " of the " << mode << " pipeline does not match its own evaluation\n";
+                ++failures;
+            }
+            ++seen;
+        });
+        if (!pipelined || seen != statements.size() || pipeline.evaluatedStatements() != statements.size()
+            || pipeline.threaded() != (threadedFrom == 0)) {
+            std::cout << "The " << mode << " pipeline evaluated " << seen << " of " << statements.size() << " statements\n";
+            ++failures;
+        }
+        // only the statements in flight are alive at once
+        std::size_t pipelinePeak = ccc::MemoryStats::peak(ccc::MemoryStats::Subsystem::PARSE_TREE);
+        if (pipelinePeak * 4 > treePeak) {
+            std::cout << "The " << mode << " pipeline's tree peak " << pipelinePeak << " is close to the whole file's " << treePeak << '\n';
+            ++failures;
+        }
+
+        // statements before a syntax error still run
+        seen = 0;
+        if (pipeline.run(brokenFile, [&](std::size_t, bool, const ccc::Token&) { ++seen; })) {
+            std::cout << "The " << mode << " pipeline accepted a syntax error\n";
+            ++failures;
+        } else if (seen != 10 || pipeline.error().offset != errorOffset || pipeline.error().message != "unexpected '*'") {
+            std::cout << "Syntax error after " << seen << " statements reported at " << pipeline.error().offset << ": " << pipeline.error().message << '\n';
+            ++failures;
+        }
+
+        // a statement that fails at run time fails the run with a diagnostic at it, the ones after it still run
+        for (const auto& failure : failing) {
+            std::ofstream { failingFile } << failure.source;
+            for (const ccc::Pipeline::VMFactory& factory : factories) {
+                std::size_t offset = &factory == &factories[2] ? failure.statementOffset : failure.offset;
+                ccc::Pipeline run { factory, 4, threadedFrom };
+                std::size_t failed = 0;
+                seen = 0;
+                bool accepted = run.run(failingFile, [&](std::size_t, bool ok, const ccc::Token&) {
+                    ++seen;
+                    failed += ok ? 0 : 1;
+                });
+                if (accepted || seen != failure.statements || failed != 1 || run.error().offset != offset
+                    || run.error().message != failure.message) {
+                    std::cout << "The " << mode << " pipeline ran " << failure.source << (accepted ? " without failing" : " and failed") << " at "
+                              << run.error().offset << ": " << run.error().message << '\n';
+                    ++failures;
+                }
+            }
+        }
+
+        if (pipeline.run("missing_input.txt", nullptr) || pipeline.error().message != "invalid character 'missing_input.txt'") {
+            std::cout << "The " << mode << " pipeline reported a missing file as: " << pipeline.error().message << '\n';
+            ++failures;
+        }
+    }
+
+    if (failures == 0)
+        std::cout << "All pipeline tests passed\n";
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,200 @@
+#include "lexer.h"
+#include "parser.h"
+#include "support.h"
+#include "utility.h"
+#include <iostream>
+#include <random>
+#include <string>
+
+static std::string expression(std::mt19937& rng, unsigned int depth);
+
+static std::string operand(std::mt19937& rng, unsigned int depth)
+{
+    std::uniform_int_distribution<int> kind { 0, 5 };
+    std::uniform_int_distribution<int> literal { 0, 99 };
+    const char* names[] = { "a", "b", "n", "total" };
+    switch (depth == 0 ? kind(rng) % 3 : kind(rng)) {
+    case 0:
+        return std::to_string(literal(rng));
+    case 1:
+        return std::to_string(literal(rng)) + ".5";
+    case 2:
+        return names[literal(rng) % 4];
+    case 3: {
+        // calls take assignments as arguments
+        std::string res = "f(";
+        for (int i = literal(rng) % 3; i > 0; --i)
+            res += expression(rng, depth - 1) + (i > 1 ? ", " : "");
+        return res + ")";
+    }
+    default:
+        return "(" + expression(rng, depth - 1) + ")";
+    }
+}
+
+static std::string expression(std::mt19937& rng, unsigned int depth)
+{
+    std::uniform_int_distribution<int> coin { 0, 3 };
+    const char* ops[] = { " + ", " - ", " * ", " / " };
+    std::string res = operand(rng, depth);
+    for (int i = coin(rng); i > 0; --i)
+        res += ops[coin(rng)] + operand(rng, depth);
+    return res;
+}
+
+static std::string assignment(std::mt19937& rng, unsigned int depth)
+{
+    std::uniform_int_distribution<int> coin { 0, 3 };
+    return coin(rng) == 0 ? "a = " + (coin(rng) == 0 ? "b = " + expression(rng, depth) : expression(rng, depth)) : expression(rng, depth);
+}
+
+static std::string declaration(std::mt19937& rng, unsigned int depth)
+{
+    std::uniform_int_distribution<int> coin { 0, 3 };
+    const char* specifiers[] = { "", "static ", "extern ", "" };
+    const char* types[] = { "int", "float", "char", "int" };
+    std::string res = std::string { specifiers[coin(rng)] } + types[coin(rng)] + " v";
+    return res + (coin(rng) == 0 ? ";" : " = " + assignment(rng, depth) + ";");
+}
+
+static std::string block(std::mt19937& rng, unsigned int depth);
+
+static std::string statement(std::mt19937& rng, unsigned int depth)
+{
+    std::uniform_int_distribution<int> kind { 0, 5 };
+    const char* comparisons[] = { " < ", " > ", " == ", " != ", " <= ", " >= " };
+    switch (depth == 0 ? kind(rng) % 3 : kind(rng)) {
+    case 0:
+        return assignment(rng, depth) + ";";
+    case 1:
+        return declaration(rng, depth);
+    case 2:
+        return "return " + assignment(rng, depth) + ";";
+    default:
+        return std::string { kind(rng) % 2 == 0 ? "if (" : "while (" } + assignment(rng, depth) + comparisons[kind(rng)] + assignment(rng, depth)
+            + ") " + block(rng, depth - 1);
+    }
+}
+
+static std::string block(std::mt19937& rng, unsigned int depth)
+{
+    std::uniform_int_distribution<int> count { 0, 3 };
+    std::string res = "{";
+    for (int i = count(rng); i > 0; --i)
+        res += " " + statement(rng, depth);
+    return res + " }";
+}
+
+/* A program of every kind of top-level statement, the last one may omit its ; */
+static std::string program(std::mt19937& rng, unsigned int depth)
+{
+    std::uniform_int_distribution<int> kind { 0, 4 };
+    std::string res;
+    for (int i = kind(rng); i >= 0; --i) {
+        switch (kind(rng)) {
+        case 0:
+            res += declaration(rng, depth);
+            break;
+        case 1: {
+            res += "float f(";
+            for (int parameters = kind(rng) % 3; parameters > 0; --parameters)
+                res += std::string { "int p" } + std::to_string(parameters) + (parameters > 1 ? ", " : "");
+            res += ") " + block(rng, depth);
+            break;
+        }
+        case 2:
+            res += statement(rng, depth);
+            break;
+        default:
+            res += assignment(rng, depth) + (i == 0 && kind(rng) == 0 ? "" : ";");
+        }
+        res += '\n';
+    }
+    return res;
+}
+
+/* Same terminals, lexemes, spans and shape */
+static bool same(const ccc::SyntaxTree::SyntaxTreeNode* lhs, const ccc::SyntaxTree::SyntaxTreeNode* rhs)
+{
+    for (; lhs != nullptr && rhs != nullptr; lhs = lhs->next, rhs = rhs->next)
+        if (lhs->val.term != rhs->val.term || lhs->val.lexeme != rhs->val.lexeme || lhs->offset != rhs->offset || lhs->length != rhs->length
+            || !same(lhs->children, rhs->children))
+            return false;
+    return lhs == rhs;
+}
+
+/* Both accept source with the same AST or reject it with the same diagnostic */
+static bool agree(ccc::Lexer& lexer, const std::string& source)
+{
+    ccc::SyntaxTree ll1;
+    ccc::SyntaxTree pratt;
+    ccc::Diagnostic ll1Error;
+    ccc::Diagnostic prattError;
+    bool ll1Parsed = ccc::test::parse(lexer, source, ll1, &ll1Error, ccc::Parser::Backend::LL1);
+    bool prattParsed = ccc::test::parse(lexer, source, pratt, &prattError, ccc::Parser::Backend::PRATT);
+    if (ll1Parsed != prattParsed) {
+        std::cout << (ll1Parsed ? "Only LL1Parser" : "Only PrattParser") << " parsed " << source << '\n';
+        return false;
+    }
+    if (ll1Parsed && !same(ll1.root, pratt.root)) {
+        std::cout << "The ASTs of " << source << " differ\n";
+        return false;
+    }
+    if (!ll1Parsed && (ll1Error.message != prattError.message || ll1Error.offset != prattError.offset)) {
+        std::cout << "The diagnostics of " << source << " differ: " << ll1Error.message << " and " << prattError.message << '\n';
+        return false;
+    }
+    return true;
+}
+
+int main()
+{
+    std::mt19937 rng { 47 };
+    unsigned int failures = 0;
+    ccc::Lexer lexer;
+
+    // generated programs of every statement and operator
+    for (unsigned int i = 0; i < 2000; ++i)
+        if (!agree(lexer, program(rng, 1 + i % 4)))
+            ++failures;
+
+    // the same programs with a token dropped, doubled or swapped for another, mostly syntax errors
+    const char* replacements[] = { ";", ")", "(", "{", "}", "=", "+", "<", ",", "int", "return", "x", "7", "@" };
+    std::uniform_int_distribution<int> pick { 0, static_cast<int>(sizeof(replacements) / sizeof(replacements[0])) - 1 };
+    for (unsigned int i = 0; i < 3000; ++i) {
+        std::string source = program(rng, 1 + i % 3);
+        std::uniform_int_distribution<std::size_t> at { 0, source.size() - 1 };
+        std::size_t position = at(rng);
+        switch (i % 3) {
+        case 0:
+            source.erase(position, 1);
+            break;
+        case 1:
+            source.insert(position, source.substr(position, 1));
+            break;
+        default:
+            source.replace(position, 1, std::string { " " } + replacements[pick(rng)] + " ");
+        }
+        if (!agree(lexer, source))
+            ++failures;
+    }
+
+    const char* edges[] = { "", ";", "1 2", "(1 + 2", "f(1, )", "f(1; 2)", "a = (b = 1)", "2)", "return 1;", "int f(int n) { return n; } f(2)",
+        "if (1 < 2) { int g(int x) { } }", "static x = 1;", "int 3;", "while (1) { }", "{ 1; }", "int x = 1", "1 + @", "99999999999999999999" };
+    for (const char* source : edges)
+        if (!agree(lexer, source))
+            ++failures;
+
+    // equal operators nest to the right as the chains of the grammar do
+    ccc::SyntaxTree ast;
+    ccc::Diagnostic error;
+    if (!ccc::test::parse(lexer, "a - b - c", ast, &error, ccc::Parser::Backend::PRATT) || ast.root->val.term != ccc::Terminal::ARITHMETIC_OP_MINUS
+        || ast.root->children->next->val.term != ccc::Terminal::ARITHMETIC_OP_MINUS) {
+        std::cout << "a - b - c does not nest to the right\n";
+        ++failures;
+    }
+
+    if (failures == 0)
+        std::cout << "All Pratt parser tests passed\n";
+    return failures == 0 ? 0 : 1;
+}
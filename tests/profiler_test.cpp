@@ -0,0 +1,85 @@
+#include "lexer.h"
+#include "parser.h"
+#include "profiler.h"
+#include "vm.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+int main()
+{
+    unsigned int failures = 0;
+    const std::string source = "(1.5 * 2 + 3)\n  * (4 - 5 / 2.5)\n";
+    const std::string file = "profiler_input.txt";
+    std::ofstream { file } << source;
+
+    ccc::SharedBuffer buffer;
+    ccc::Lexer lexer;
+    lexer.run(file, buffer);
+    ccc::LL1Parser parser { buffer };
+    ccc::SyntaxTree ast;
+    if (!parser.parse(ast)) {
+        std::cout << "Failed to parse\n";
+        return 1;
+    }
+    parser.convertToAst(ast);
+
+    const unsigned int runs = 1000;
+    ccc::StackBasedVM vm { ast };
+    ccc::Profiler profiler { source, ast, 4 };
+    vm.profile(&profiler);
+    for (unsigned int i = 0; i < runs; ++i)
+        vm.run();
+    vm.profile(nullptr);
+
+    // every stack starts at the whole expression
+    std::ostringstream folded;
+    profiler.writeFolded(folded);
+    std::istringstream lines { folded.str() };
+    std::string line;
+    unsigned int stacks = 0;
+    unsigned long long cycles = 0;
+    while (std::getline(lines, line)) {
+        ++stacks;
+        if (line.compare(0, 4, "1:1 ") != 0) {
+            std::cout << "Unexpected stack " << line << '\n';
+            ++failures;
+        }
+        cycles += std::stoull(line.substr(line.rfind(' ') + 1));
+    }
+    if (stacks == 0 || cycles == 0) {
+        std::cout << "No cycles were sampled\n";
+        ++failures;
+    }
+    if (folded.str().find("2:5 (4 - 5 / 2.5);2:10 5 / 2.5") == std::string::npos) {
+        std::cout << "Second line subexpression is missing from\n" << folded.str();
+        ++failures;
+    }
+
+    // each instruction of straight line code runs once per run
+    std::ostringstream report;
+    profiler.writeReport(report, 3);
+    std::istringstream rows { report.str() };
+    std::getline(rows, line);
+    unsigned int reported = 0;
+    while (std::getline(rows, line)) {
+        std::istringstream fields { line };
+        unsigned long long nodeCycles;
+        double percent;
+        unsigned long long executions;
+        fields >> nodeCycles >> percent >> executions;
+        if (executions % runs != 0 || executions == 0) {
+            std::cout << "Unexpected report row " << line << '\n';
+            ++failures;
+        }
+        ++reported;
+    }
+    if (reported != 3) {
+        std::cout << "Report has " << reported << " rows\n";
+        ++failures;
+    }
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
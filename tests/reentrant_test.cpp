@@ -0,0 +1,109 @@
+#include "lexer.h"
+#include "parser.h"
+#include "support.h"
+#include "vm.h"
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define THREADS 8
+#define RUNS 200
+
+/* Runs program RUNS times on each of THREADS threads at once, every run has to give expected or fail if it did */
+static bool concurrent(const std::shared_ptr<const ccc::CompiledProgram>& program, bool ran, const ccc::Token& expected,
+    unsigned long long dispatches)
+{
+    std::atomic<unsigned int> wrong { 0 };
+    std::vector<std::thread> threads;
+    for (int i = 0; i < THREADS; ++i) {
+        threads.emplace_back([&] {
+            ccc::StackContext context { program };
+            for (int run = 0; run < RUNS; ++run) {
+                ccc::Token actual { "", ccc::Terminal::ERROR };
+                bool ok = context.run() && context.result(actual);
+                if (ok != ran || (ran && !(actual == expected)))
+                    ++wrong;
+            }
+            if (context.executedInstructions() != dispatches * RUNS)
+                ++wrong;
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+    return wrong == 0;
+}
+
+int main()
+{
+    unsigned int failures = 0;
+    ccc::Lexer lexer;
+    const char* programs[] = {
+        "int fib(int n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); } fib(15)",
+        "s = 0; i = 0; while (i < 1000) { s = s + i * 0.5; i = i + 1; } s",
+        "float half(float x) { return x / 2; } int pick(int n) { if (n < 1) { return 1; } return 0.5; } half(3) + half(3.0) + pick(1)",
+        // every run starts from the globals the program was made with and stores to its own copy of them
+        "total = total + 1; total",
+        "int bump() { count = count + 1; } bump() + bump(); count",
+        "int depth(int n) { if (n == 0) { return 0; } return 1 + depth(n - 1); } depth(4000)",
+        "7 / (3 - 3)",
+        "int forever(int n) { return forever(n + 1); } forever(0)",
+        "int x = 4;",
+    };
+    for (const char* source : programs) {
+        for (int fused = 0; fused < 2; ++fused) {
+            std::shared_ptr<const ccc::CompiledProgram> program;
+            bool ran;
+            ccc::Token expected { "", ccc::Terminal::ERROR };
+            unsigned long long dispatches;
+            {
+                // the program outlives the AST, the globals and the VM it was made from
+                ccc::SyntaxTree ast;
+                if (!ccc::test::parse(lexer, source, ast)) {
+                    std::cout << "Failed to parse " << source << '\n';
+                    ++failures;
+                    break;
+                }
+                ccc::Globals globals;
+                std::size_t count = globals.slot("count");
+                std::size_t total = globals.slot("total");
+                globals.values()[total].intValue = 41;
+                ccc::StackBasedVM vm { ast, &globals };
+                for (int round = 0; fused && round < 2; ++round) {
+                    vm.instrument(true);
+                    vm.run();
+                    vm.instrument(false);
+                    vm.fuse(vm.pairCounts());
+                    // the instrumented runs stored to the globals
+                    globals.values()[total].intValue = 41;
+                    globals.values()[count].intValue = 0;
+                }
+                program = vm.program();
+                unsigned long long before = vm.executedInstructions();
+                ran = vm.run() && vm.result(expected);
+                dispatches = vm.executedInstructions() - before;
+            }
+            if (program == nullptr) {
+                std::cout << source << " made no program\n";
+                ++failures;
+            } else if (!concurrent(program, ran, expected, dispatches)) {
+                std::cout << (fused ? "Fused " : "") << source << " evaluated to something other than " << (ran ? expected.lexeme : "a failure")
+                          << " concurrently\n";
+                ++failures;
+            }
+        }
+    }
+
+    // nothing to run for an AST that did not compile
+    ccc::SyntaxTree ast;
+    if (!ccc::test::parse(lexer, "undeclared + 1", ast) || ccc::StackBasedVM { ast }.program() != nullptr) {
+        std::cout << "A program that did not compile made a program\n";
+        ++failures;
+    }
+
+    if (failures == 0)
+        std::cout << "All reentrant tests passed\n";
+    return failures == 0 ? 0 : 1;
+}
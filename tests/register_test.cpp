@@ -0,0 +1,120 @@
+#include "lexer.h"
+#include "parser.h"
+#include "support.h"
+#include "vm.h"
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+
+/* Divisors are whole subexpressions, so integer division by zero comes up as well */
+static const ccc::test::Shape shape { false, false, ".25", nullptr, ccc::test::Shape::Divisor::ANY, false };
+
+static bool identical(const ccc::Token& lhs, const ccc::Token& rhs)
+{
+    if (lhs.term != rhs.term)
+        return false;
+    if (lhs.term == ccc::Terminal::ERROR)
+        return true;
+    if (lhs.term == ccc::Terminal::INT_LITERAL)
+        return lhs.intValue == rhs.intValue;
+    return std::memcmp(&lhs.floatValue, &rhs.floatValue, sizeof(double)) == 0;
+}
+
+static void print(const ccc::Token& token, const ccc::VM& vm)
+{
+    if (token.term == ccc::Terminal::ERROR)
+        std::cout << '"' << vm.error().message << '"';
+    else if (token.term == ccc::Terminal::INT_LITERAL)
+        std::cout << token.intValue;
+    else
+        std::cout << token.floatValue;
+}
+
+/* Both VMs evaluate expression to the same value or both fail with the same message, failed tells which */
+static bool agree(const std::string& expression, bool& failed)
+{
+    ccc::SyntaxTree ast;
+    if (!ccc::test::parse(expression, ast)) {
+        std::cout << "Failed to parse " << expression << '\n';
+        return false;
+    }
+    ccc::StackBasedVM stack { ast };
+    ccc::RegisterVM registers { ast };
+    ccc::Token expected { "", ccc::Terminal::ERROR };
+    ccc::Token actual { "", ccc::Terminal::ERROR };
+    if (!stack.run() || !stack.result(expected))
+        expected = { "", ccc::Terminal::ERROR };
+    if (!registers.run() || !registers.result(actual))
+        actual = { "", ccc::Terminal::ERROR };
+    failed = expected.term == ccc::Terminal::ERROR;
+    if (identical(expected, actual) && registers.error().message == stack.error().message)
+        return true;
+    std::cout << "Mismatch for " << expression << ": ";
+    print(expected, stack);
+    std::cout << " != ";
+    print(actual, registers);
+    std::cout << '\n';
+    return false;
+}
+
+int main()
+{
+    std::mt19937 rng { 2028 };
+    unsigned int failures = 0;
+
+    bool dividedByZero = false;
+    for (unsigned int i = 0; i < 3000; ++i) {
+        bool failed;
+        if (!agree(ccc::test::generate(rng, 1 + i % 8, shape), failed))
+            ++failures;
+        dividedByZero = dividedByZero || failed;
+    }
+    if (!dividedByZero) {
+        std::cout << "No generated expression divided by zero\n";
+        ++failures;
+    }
+
+    // a literal on the left of a register takes the RSUBI and RDIVI forms, on both sides of the int to float promotion
+    const struct {
+        const char* expression;
+        bool fails;
+    } edges[] = {
+        { "10 - (2 * 3)", false },
+        { "10 / (2 + 1)", false },
+        { "(2 + 1) - 10", false },
+        { "(2 + 1) / 10", false },
+        { "1.5 - (2 * 3)", false },
+        { "7 / (2 * 0.5)", false },
+        { "7.5 / (2 + 1)", false },
+        { "7 - (0.25 * 3)", false },
+        { "(1 + 2) * 0.5", false },
+        { "2.5 + (3 * 4)", false },
+        { "10 / (2 - 2)", true },
+        { "10.5 / (2 - 2)", false },
+        { "(4 * 2) / 0", true },
+        { "5 / 0", true },
+        { "5 / 0.25", false },
+        { "((0 - 9223372036854775807) - 1) / (0 - 1)", true },
+        { "((0 - 9223372036854775807) - 1) / (0 - 2)", false },
+        // integer overflow wraps around on both VMs
+        { "9223372036854775807 + 1", false },
+        { "((0 - 9223372036854775807) - 1) - 1", false },
+        { "((0 - 9223372036854775807) - 1) * (0 - 1)", false },
+        { "(9223372036854775807 + 1) / (0 - 1)", true },
+        { "42", false },
+        { "0.25", false },
+    };
+    for (const auto& edge : edges) {
+        bool failed;
+        if (!agree(edge.expression, failed)) {
+            ++failures;
+        } else if (failed != edge.fails) {
+            std::cout << edge.expression << (failed ? " failed" : " ran") << '\n';
+            ++failures;
+        }
+    }
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
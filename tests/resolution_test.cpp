@@ -0,0 +1,88 @@
+#include "lexer.h"
+#include "parser.h"
+#include "pipeline.h"
+#include "support.h"
+#include "vm.h"
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+
+static const std::string file = "resolution_input.txt";
+
+int main()
+{
+    unsigned int failures = 0;
+    const struct {
+        const char* program;
+        ccc::Token expected;
+    } programs[] = {
+        { "int x = 4; float y; y = x * 1.5; y", ccc::Token { 6.0 } },
+        // a block's declaration shadows the outer one until the block ends
+        { "int f(int n) { int r = n; if (n > 0) { int r = 100; n = r; } return r + n; } f(2)", ccc::Token { 102LL } },
+        // every call gets fresh locals, a static keeps its value between calls
+        { "int next() { static int count = 10; int fresh; fresh = fresh + 1; count = count + fresh; return count; } next(); next(); next()",
+            ccc::Token { 13LL } },
+        { "int total = 5; int add(int n) { extern int total; total = total + n; return total; } add(1); add(2)", ccc::Token { 8LL } },
+        // locals of top-level blocks live in the frame of the top-level code
+        { "s = 0; i = 0; while (i < 5) { int sq = i * i; s = s + sq; i = i + 1; } s", ccc::Token { 30LL } },
+        { "int pick(int a, int b) { if (a > b) { int t = a; a = b; b = t; } return b - a; } pick(9, 4) * 10 + pick(1, 3)", ccc::Token { 52LL } },
+        { "int g = 3; static int h = 4; extern int g; g * h", ccc::Token { 12LL } },
+    };
+    for (const auto& test : programs) {
+        ccc::SyntaxTree ast;
+        ccc::Token value { "", ccc::Terminal::ERROR };
+        if (!ccc::test::parse(test.program, ast)) {
+            std::cout << "Failed to parse " << test.program << '\n';
+            ++failures;
+            continue;
+        }
+        ccc::StackBasedVM vm { ast };
+        if (!vm.run() || !vm.result(value) || !(value == test.expected)) {
+            std::cout << test.program << " evaluated to " << value.lexeme << ": " << vm.error().message << '\n';
+            ++failures;
+        }
+    }
+
+    // names are resolved before the run, so an error points at the name instead of reading 0
+    const struct {
+        const char* program;
+        const char* message;
+        unsigned int offset;
+    } errors[] = {
+        { "x = 1; x + y", "undeclared identifier 'y'", 11 },
+        { "int f() { t = 2; return t; } f()", "undeclared identifier 't'", 10 },
+        { "int f() { int a; int a; return a; } f()", "redeclaration of 'a'", 17 },
+        { "int f(int n) { static int s = n; return s; } f(1)", "initializer of static 's' is not a constant", 30 },
+        { "int f() { extern int e = 1; return e; } f()", "extern variable 'e' has an initializer", 10 },
+        { "if (1 < 2) { int v = 1; } v", "undeclared identifier 'v'", 26 },
+        { "g(1)", "undefined function 'g'", 0 },
+        { "int f(int a) { return a; } f(1, 2)", "'f' takes 1 arguments", 27 },
+    };
+    for (const auto& test : errors) {
+        ccc::SyntaxTree ast;
+        if (!ccc::test::parse(test.program, ast)) {
+            std::cout << "Failed to parse " << test.program << '\n';
+            ++failures;
+            continue;
+        }
+        ccc::StackBasedVM vm { ast };
+        if (vm.run() || vm.error().message != test.message || vm.error().offset != test.offset) {
+            std::cout << test.program << " reported at " << vm.error().offset << ": " << vm.error().message << '\n';
+            ++failures;
+        }
+    }
+
+    // the pipeline fails the run on a statement that does not compile and goes on with the others
+    std::ofstream { file } << "int a = 2;\nb = a + c;\na * 3;\n";
+    ccc::Pipeline pipeline { ccc::test::stackBased, 4, std::numeric_limits<std::size_t>::max() };
+    ccc::Token last { "", ccc::Terminal::ERROR };
+    if (pipeline.run(file, [&](std::size_t, bool, const ccc::Token& value) { last = value; })
+        || pipeline.error().message != "undeclared identifier 'c'" || pipeline.error().offset != 19 || !(last == ccc::Token { 6LL })) {
+        std::cout << "The pipeline reported " << pipeline.error().message << " at " << pipeline.error().offset << '\n';
+        ++failures;
+    }
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,97 @@
+#include "lexer.h"
+#include "parser.h"
+#include "support.h"
+#include "utility.h"
+#include "vm.h"
+#include <iostream>
+#include <random>
+#include <string>
+
+/* Through the tree and the stack-based VM */
+static const ccc::test::Shape shape { true, false, ".5", nullptr, ccc::test::Shape::Divisor::FLOAT, false };
+
+static bool evaluate(ccc::Lexer& lexer, const std::string& source, ccc::Token& value)
+{
+    ccc::SyntaxTree ast;
+    if (!ccc::test::parse(lexer, source, ast))
+        return false;
+    ccc::StackBasedVM vm { ast };
+    return vm.run() && vm.result(value);
+}
+
+static bool stream(ccc::Lexer& lexer, const std::string& source, ccc::Token& value, ccc::Diagnostic& error, std::size_t& depth)
+{
+    ccc::PullLexer tokens { lexer, source.data(), source.size() };
+    ccc::StreamingVM vm { tokens };
+    bool res = vm.run() && vm.result(value);
+    error = vm.error();
+    depth = vm.peakDepth();
+    return res;
+}
+
+int main()
+{
+    std::mt19937 rng { 44 };
+    unsigned int failures = 0;
+    ccc::Lexer lexer;
+    ccc::Diagnostic error;
+    std::size_t depth = 0;
+
+    // bit-identical to the tree, chains nest to the right in both
+    std::string statements;
+    for (unsigned int i = 0; i < 300; ++i) {
+        std::string source = ccc::test::generate(rng, 1 + i % 5, shape);
+        source += i % 2 == 0 ? "" : " - 7 / 3 - 2.5 * 4 + 1";
+        statements += source + ";\n";
+        ccc::Token expected { "", ccc::Terminal::ERROR };
+        ccc::Token streamed { "", ccc::Terminal::ERROR };
+        if (!evaluate(lexer, source, expected) || !stream(lexer, source, streamed, error, depth) || !(streamed == expected)) {
+            std::cout << source << " streamed to " << streamed.lexeme << " instead of " << expected.lexeme << ": " << error.message << '\n';
+            ++failures;
+        }
+    }
+    ccc::Token expected { "", ccc::Terminal::ERROR };
+    ccc::Token streamed { "", ccc::Terminal::ERROR };
+    if (!evaluate(lexer, statements, expected) || !stream(lexer, statements, streamed, error, depth) || !(streamed == expected)) {
+        std::cout << "The statement list streamed to " << streamed.lexeme << " instead of " << expected.lexeme << '\n';
+        ++failures;
+    }
+
+    // a bracketed chain nesting to the left holds two operands however long it is, and nothing of a tree
+    std::string left = "1";
+    for (int i = 2; i <= 2000; ++i)
+        left = "(" + left + (i % 3 == 0 ? " - " : " + ") + std::to_string(i % 7) + ")";
+    ccc::MemoryStats::reset();
+    if (!stream(lexer, left, streamed, error, depth) || !evaluate(lexer, left, expected) || !(streamed == expected) || depth != 2) {
+        std::cout << "A left-nested chain held " << depth << " operands\n";
+        ++failures;
+    }
+    ccc::MemoryStats::reset();
+    stream(lexer, left, streamed, error, depth);
+    if (ccc::MemoryStats::peak(ccc::MemoryStats::Subsystem::PARSE_TREE) != 0 || ccc::MemoryStats::current(ccc::MemoryStats::Subsystem::VM_STACK) != 0) {
+        std::cout << "Streaming built " << ccc::MemoryStats::peak(ccc::MemoryStats::Subsystem::PARSE_TREE) << " bytes of tree\n";
+        ++failures;
+    }
+
+    const struct {
+        const char* source;
+        unsigned int offset;
+        const char* message;
+    } errors[] = {
+        { "1 + 2;\n3 * x", 11, "only literals and arithmetic can be streamed, not 'x'" },
+        { "8 / (2 - 2)", 2, "division by zero" },
+        { "(1 + 2", 6, "expected ')' before end of input" },
+        { "1 + 2) * 3", 5, "unexpected ')' after the expression" },
+        { "1 + * 2", 4, "unexpected '*'" },
+    };
+    for (const auto& test : errors) {
+        if (stream(lexer, test.source, streamed, error, depth) || error.offset != test.offset || error.message != test.message) {
+            std::cout << test.source << " failed at " << error.offset << ": " << error.message << '\n';
+            ++failures;
+        }
+    }
+
+    if (failures == 0)
+        std::cout << "All streaming tests passed\n";
+    return failures == 0 ? 0 : 1;
+}
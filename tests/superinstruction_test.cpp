@@ -0,0 +1,57 @@
+#include "lexer.h"
+#include "parser.h"
+#include "support.h"
+#include "vm.h"
+#include <iostream>
+#include <random>
+#include <string>
+
+/* Chains nest to the right so a/b/c divides by b/c, float divisors keep that from trapping */
+static const ccc::test::Shape shape { true, false, ".5", nullptr, ccc::test::Shape::Divisor::FLOAT, false };
+
+int main()
+{
+    std::mt19937 rng { 32 };
+    unsigned int failures = 0;
+
+    for (unsigned int i = 0; i < 1000; ++i) {
+        std::string expression = ccc::test::generate(rng, 1 + i % 6, shape);
+        ccc::SyntaxTree ast;
+        if (!ccc::test::parse(expression, ast)) {
+            std::cout << "Failed to parse " << expression << '\n';
+            ++failures;
+            continue;
+        }
+        ccc::StackBasedVM plain { ast };
+        ccc::StackBasedVM fused { ast };
+        ccc::test::optimize(fused);
+        ccc::Token expected { "", ccc::Terminal::ERROR };
+        ccc::Token actual { "", ccc::Terminal::ERROR };
+        unsigned long long before = fused.executedInstructions();
+        if (!plain.run() || !plain.result(expected) || !fused.run() || !fused.result(actual) || !(expected == actual)) {
+            std::cout << "Mismatch for " << expression << '\n';
+            ++failures;
+        } else if (fused.executedInstructions() - before > plain.executedInstructions()
+            || (plain.codeSize() > 1 && fused.codeSize() >= plain.codeSize())) {
+            std::cout << "Nothing was fused in " << expression << '\n';
+            ++failures;
+        }
+    }
+
+    // a fused division still reports the division by zero
+    ccc::SyntaxTree ast;
+    if (!ccc::test::parse("7/0", ast)) {
+        std::cout << "Failed to parse 7/0\n";
+        ++failures;
+    } else {
+        ccc::StackBasedVM vm { ast };
+        ccc::test::optimize(vm);
+        if (vm.codeSize() != 1 || vm.run()) {
+            std::cout << "Fused division by zero succeeded\n";
+            ++failures;
+        }
+    }
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,70 @@
+#include "support.h"
+
+bool ccc::test::parse(Lexer& lexer, const std::string& source, SyntaxTree& ast, Diagnostic* error, Parser::Backend backend)
+{
+    PullLexer tokens { lexer, source.data(), source.size() };
+    std::unique_ptr<Parser> parser = Parser::create(backend, tokens);
+    if (!parser->parse(ast)) {
+        if (error != nullptr)
+            *error = parser->error();
+        return false;
+    }
+    parser->convertToAst(ast);
+    return true;
+}
+
+bool ccc::test::parse(const std::string& source, SyntaxTree& ast, Diagnostic* error)
+{
+    Lexer lexer;
+    return parse(lexer, source, ast, error);
+}
+
+static std::string operand(std::mt19937& rng, const ccc::test::Shape& shape)
+{
+    std::uniform_int_distribution<int> coin { 0, 3 };
+    std::uniform_int_distribution<int> literal { 0, 99 };
+    if (shape.fraction != nullptr && coin(rng) == 0)
+        return std::to_string(literal(rng)) + shape.fraction;
+    if (shape.names != nullptr && coin(rng) == 0)
+        return shape.names + std::to_string(literal(rng) % 10);
+    return std::to_string(literal(rng));
+}
+
+std::string ccc::test::generate(std::mt19937& rng, unsigned int depth, const Shape& shape)
+{
+    std::uniform_int_distribution<int> coin { 0, 3 };
+    if (depth == 0 || (!shape.full && coin(rng) == 0))
+        return operand(rng, shape);
+    const char ops[] = { '+', '-', '*', '/' };
+    std::string res = generate(rng, depth - 1, shape);
+    for (int i = shape.chains ? coin(rng) : 0; i >= 0; --i) {
+        char op = ops[coin(rng)];
+        res += op;
+        if (shape.loose && coin(rng) == 0)
+            res += ' ';
+        if (op != '/' || shape.divisor == Shape::Divisor::ANY)
+            res += generate(rng, depth - 1, shape);
+        else if (shape.divisor == Shape::Divisor::DIGIT)
+            res += std::to_string(std::uniform_int_distribution<int> { 1, 9 }(rng));
+        else
+            res += std::to_string(std::uniform_int_distribution<int> { 1, 99 }(rng)) + ".5";
+    }
+    if (shape.loose && coin(rng) == 0)
+        return res;
+    return "(" + res + ")";
+}
+
+void ccc::test::optimize(StackBasedVM& vm)
+{
+    for (int round = 0; round < 2; ++round) {
+        vm.instrument(true);
+        vm.run();
+        vm.instrument(false);
+        vm.fuse(vm.pairCounts());
+    }
+}
+
+std::unique_ptr<ccc::VM> ccc::test::stackBased(SyntaxTree& ast, Globals& globals)
+{
+    return std::unique_ptr<VM> { new StackBasedVM { ast, &globals } };
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "diagnostics.h"
+#include "lexer.h"
+#include "parser.h"
+#include "vm.h"
+#include <memory>
+#include <random>
+#include <string>
+
+namespace ccc {
+namespace test {
+
+/* Parses source in place with a pull lexer and converts it to an AST, error gets the diagnostic of a rejected source */
+bool parse(Lexer& lexer, const std::string& source, SyntaxTree& ast, Diagnostic* error = nullptr,
+    Parser::Backend backend = Parser::Backend::LL1);
+bool parse(const std::string& source, SyntaxTree& ast, Diagnostic* error = nullptr);
+
+/* What generate puts into an arithmetic expression */
+struct Shape {
+    enum class Divisor {
+        /* Any operand, so zero as well */
+        ANY,
+        /* An int literal from 1 to 9 */
+        DIGIT,
+        /* A literal with a .5 fraction, never zero */
+        FLOAT
+    };
+
+    /* Groups chain up to four operands instead of two */
+    bool chains;
+    /* Every operand goes down to the full depth instead of stopping at random */
+    bool full;
+    /* Appended to a quarter of the literals to make them floats, nullptr for int literals only */
+    const char* fraction;
+    /* Prefix of the variables a quarter of the other operands are, nullptr for none */
+    const char* names;
+    Divisor divisor;
+    /* Groups may go without brackets and operators without spaces, so the tree is not exactly the generated one */
+    bool loose;
+};
+
+/* An arithmetic expression of groups nested depth deep */
+std::string generate(std::mt19937& rng, unsigned int depth, const Shape& shape);
+
+/* Profiles twice so pairs of already fused instructions get fused as well */
+void optimize(StackBasedVM& vm);
+
+/* A pipeline VM factory for the stack-based VM over the pipeline's globals */
+std::unique_ptr<VM> stackBased(SyntaxTree& ast, Globals& globals);
+
+}
+}
@@ -0,0 +1,98 @@
+#include "pipeline.h"
+#include "support.h"
+#include "utility.h"
+#include "vm.h"
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+
+static std::size_t count(const std::string& text, const std::string& part)
+{
+    std::size_t res = 0;
+    for (std::size_t pos = text.find(part); pos != std::string::npos; pos = text.find(part, pos + 1))
+        ++res;
+    return res;
+}
+
+int main()
+{
+    unsigned int failures = 0;
+    const std::string file = "trace_input.txt";
+    {
+        std::ofstream out { file };
+        for (int i = 0; i < 2000; ++i)
+            out << "x" << i % 10 << " = " << i << " * 3 + (" << i << " - 1) / 2;\n";
+    }
+
+    // nothing is recorded while the tracer is off
+    ccc::Pipeline pipeline { ccc::test::stackBased, 4, 0 };
+    pipeline.run(file, nullptr);
+    ccc::Tracer::start();
+    ccc::Tracer::stop();
+    std::ostringstream empty;
+    ccc::Tracer::write(empty);
+    if (count(empty.str(), "\"ph\"") != 0) {
+        std::cout << "The tracer recorded while off\n";
+        ++failures;
+    }
+
+    // the threaded pipeline shows every stage on a thread of its own
+    ccc::Tracer::start();
+    if (!pipeline.run(file, nullptr) || !pipeline.threaded()) {
+        std::cout << "The traced pipeline did not run threaded\n";
+        ++failures;
+    }
+    {
+        ccc::Tracer::Scope quoted { "detail", ccc::Tracer::intern("a \"quoted\"\\path") };
+    }
+    ccc::Tracer::stop();
+    std::ostringstream out;
+    ccc::Tracer::write(out);
+    std::string trace = out.str();
+    if (trace.rfind("{\"traceEvents\":[", 0) != 0 || trace.find("],\"displayTimeUnit\":\"ns\"}") == std::string::npos) {
+        std::cout << "The trace is not a trace event object\n";
+        ++failures;
+    }
+    const struct {
+        const char* name;
+        std::size_t least;
+    } phases[] = { { "file", 1 }, { "lex", 1 }, { "refill window", 1 }, { "parse", 2000 }, { "convertToAst", 2000 }, { "compile", 2000 },
+        { "run", 2000 } };
+    for (const auto& phase : phases) {
+        std::size_t seen = count(trace, "{\"name\":\"" + std::string { phase.name } + "\",");
+        if (seen < phase.least) {
+            std::cout << "The trace has " << seen << " " << phase.name << " events\n";
+            ++failures;
+        }
+    }
+    if (trace.find("\"args\":{\"detail\":\"" + file + "\"}") == std::string::npos
+        || trace.find("\"args\":{\"detail\":\"a \\\"quoted\\\"\\\\path\"}") == std::string::npos) {
+        std::cout << "The trace lost or did not escape a detail\n";
+        ++failures;
+    }
+    std::set<std::string> lanes;
+    for (std::size_t pos = trace.find("\"tid\":"); pos != std::string::npos; pos = trace.find("\"tid\":", pos + 1))
+        lanes.insert(trace.substr(pos, trace.find_first_of(",}", pos) - pos));
+    if (lanes.size() < 3) {
+        std::cout << "The trace shows " << lanes.size() << " threads instead of the lexer, parser and evaluator\n";
+        ++failures;
+    }
+
+    // a ring keeps the newest events once it is full
+    ccc::Tracer::start();
+    for (int i = 0; i < 100000; ++i)
+        ccc::Tracer::Scope step { i < 50000 ? "old" : "new" };
+    ccc::Tracer::stop();
+    std::ostringstream wrapped;
+    ccc::Tracer::write(wrapped);
+    if (count(wrapped.str(), "\"old\"") != 0 || count(wrapped.str(), "\"new\"") == 0) {
+        std::cout << "A full ring kept " << count(wrapped.str(), "\"old\"") << " old events\n";
+        ++failures;
+    }
+
+    if (failures == 0)
+        std::cout << "All trace tests passed\n";
+    return failures == 0 ? 0 : 1;
+}
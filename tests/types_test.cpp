@@ -0,0 +1,177 @@
+#include "lexer.h"
+#include "parser.h"
+#include "support.h"
+#include "vm.h"
+#include <iostream>
+#include <random>
+#include <string>
+
+static std::string constant(std::mt19937& rng)
+{
+    std::uniform_int_distribution<int> literal { 0, 19 };
+    int value = literal(rng);
+    return std::to_string(value / 2) + (value % 2 == 0 ? "" : ".5");
+}
+
+static std::string expression(std::mt19937& rng, unsigned int depth)
+{
+    std::uniform_int_distribution<int> kind { 0, 7 };
+    std::uniform_int_distribution<int> literal { 0, 9 };
+    const char* names[] = { "a", "b", "c" };
+    const char* ops[] = { " + ", " - ", " * ", " / " };
+    switch (depth == 0 ? kind(rng) % 4 : kind(rng)) {
+    case 0:
+    case 1:
+        return constant(rng);
+    case 2:
+    case 3:
+        return names[literal(rng) % 3];
+    case 4:
+        return "scale(" + expression(rng, depth - 1) + ", " + expression(rng, depth - 1) + ")";
+    case 5:
+        return "mixed(" + std::to_string(literal(rng)) + ")";
+    default:
+        return "(" + expression(rng, depth - 1) + ops[literal(rng) % 4] + expression(rng, depth - 1) + ")";
+    }
+}
+
+static std::string statements(std::mt19937& rng, unsigned int depth);
+
+static std::string statement(std::mt19937& rng, unsigned int depth)
+{
+    std::uniform_int_distribution<int> kind { 0, 4 };
+    const char* names[] = { "a", "b", "c" };
+    const char* comparisons[] = { " < ", " > ", " == ", " != ", " <= ", " >= " };
+    switch (depth == 0 ? 0 : kind(rng)) {
+    case 0:
+    case 1:
+        return std::string { names[kind(rng) % 3] } + " = " + expression(rng, 2) + ";";
+    case 2:
+        return "if (" + expression(rng, 1) + comparisons[kind(rng)] + expression(rng, 1) + ") {" + statements(rng, depth - 1) + " }";
+    default: {
+        // every loop counts its own variable up to a small bound
+        std::string counter = "i" + std::to_string(depth);
+        return counter + " = 0; while (" + counter + " < " + std::to_string(kind(rng)) + ") { " + counter + " = " + counter + " + 1; "
+            + statements(rng, depth - 1) + " }";
+    }
+    }
+}
+
+static std::string statements(std::mt19937& rng, unsigned int depth)
+{
+    std::uniform_int_distribution<int> count { 1, 3 };
+    std::string res;
+    for (int i = count(rng); i > 0; --i)
+        res += " " + statement(rng, depth);
+    return res;
+}
+
+/* Variables of either type, loops that may change their types, and functions whose return type depends on
+ * their argument types or on their argument values */
+static std::string program(std::mt19937& rng)
+{
+    std::string res = "float scale(float x, int k) { return x * k / 2; }\n"
+                      "int mixed(int n) { if (n < 3) { return n; } return mixed(n - 1) + 0.5; }\n"
+                      "a = "
+        + constant(rng) + "; b = " + constant(rng) + "; c = " + constant(rng) + ";\n";
+    std::uniform_int_distribution<int> count { 1, 4 };
+    for (int i = count(rng); i > 0; --i)
+        res += statement(rng, 3) + "\n";
+    return res + expression(rng, 2);
+}
+
+/* Same result or the same failure typed and untyped, plain and fused */
+static bool agree(ccc::Lexer& lexer, const std::string& source)
+{
+    ccc::SyntaxTree ast;
+    if (!ccc::test::parse(lexer, source, ast)) {
+        std::cout << "Failed to parse " << source << '\n';
+        return false;
+    }
+    ccc::StackBasedVM untyped { ast, nullptr, false };
+    ccc::Token expected { "", ccc::Terminal::ERROR };
+    bool ran = untyped.run() && untyped.result(expected);
+    for (int fused = 0; fused < 2; ++fused) {
+        ccc::StackBasedVM typed { ast };
+        if (fused)
+            ccc::test::optimize(typed);
+        ccc::Token actual { "", ccc::Terminal::ERROR };
+        bool typedRan = typed.run() && typed.result(actual);
+        if (typedRan != ran || (ran && !(actual == expected))) {
+            std::cout << (fused ? "Fused typed" : "Typed") << " code of " << source << " evaluated to " << (typedRan ? actual.lexeme : "a failure")
+                      << " instead of " << (ran ? expected.lexeme : "a failure") << '\n';
+            return false;
+        }
+    }
+    return true;
+}
+
+int main()
+{
+    std::mt19937 rng { 48 };
+    unsigned int failures = 0;
+    ccc::Lexer lexer;
+
+    for (unsigned int i = 0; i < 1500; ++i)
+        if (!agree(lexer, program(rng)))
+            ++failures;
+
+    // programs whose every value has one type run without a single type check
+    const struct {
+        const char* program;
+        ccc::Token expected;
+        bool monomorphic;
+    } programs[] = {
+        { "int fib(int n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); } fib(15)", ccc::Token { 610LL }, true },
+        { "int sum(int n) { int s = 0; while (n > 0) { s = s + n; n = n - 1; } return s; } sum(100)", ccc::Token { 5050LL }, true },
+        { "f = 0.5; while (f <= 10) { f = f * 2; } f", ccc::Token { 16.0 }, true },
+        { "int x = 4; float y; y = x * 1.5; y", ccc::Token { 6.0 }, true },
+        // one function lowered for each list of argument types it is called with
+        { "float half(float x) { return x / 2; } half(3) + half(3.0)", ccc::Token { 2.5 }, true },
+        { "int twice(float x) { x = x * 2; return x; } twice(1.25) + 1", ccc::Token { 3.5 }, true },
+        // a variable an int on the first iteration and a float on the next is checked at run time
+        { "f = 0; i = 0; while (i < 3) { f = f + 0.5; i = i + 1; } f", ccc::Token { 1.5 }, false },
+        { "int pick(int n) { if (n < 1) { return 1; } return 0.5; } pick(0) + pick(1)", ccc::Token { 1.5 }, false },
+    };
+    for (const auto& test : programs) {
+        ccc::SyntaxTree ast;
+        ccc::Token actual { "", ccc::Terminal::ERROR };
+        if (!ccc::test::parse(lexer, test.program, ast)) {
+            std::cout << "Failed to parse " << test.program << '\n';
+            ++failures;
+            continue;
+        }
+        ccc::StackBasedVM vm { ast };
+        if (!vm.run() || !vm.result(actual) || !(actual == test.expected)) {
+            std::cout << test.program << " evaluated to " << actual.lexeme << '\n';
+            ++failures;
+        } else if ((vm.dynamicInstructions() == 0) != test.monomorphic) {
+            std::cout << test.program << " left " << vm.dynamicInstructions() << " instructions checking types\n";
+            ++failures;
+        }
+    }
+
+    // a statement typed by a global another statement then gives the other type is lowered again
+    ccc::Globals globals;
+    ccc::SyntaxTree first;
+    ccc::SyntaxTree second;
+    ccc::SyntaxTree third;
+    ccc::Token value { "", ccc::Terminal::ERROR };
+    if (!ccc::test::parse(lexer, "x = 1", first) || !ccc::test::parse(lexer, "x = x * 0.5", second) || !ccc::test::parse(lexer, "x + 1", third)) {
+        std::cout << "Failed to parse the statements\n";
+        return 1;
+    }
+    ccc::StackBasedVM assign { first, &globals };
+    assign.run();
+    ccc::StackBasedVM read { third, &globals };
+    ccc::StackBasedVM half { second, &globals };
+    if (!read.run() || !read.result(value) || !(value == ccc::Token { 2LL }) || !half.run() || !read.run() || !read.result(value)
+        || !(value == ccc::Token { 1.5 })) {
+        std::cout << "A global of a new type evaluated to " << value.lexeme << '\n';
+        ++failures;
+    }
+
+    if (failures == 0)
+        std::cout << "All type tests passed\n";
+    return failures == 0 ? 0 : 1;
+}